@@ -40,53 +40,28 @@
 #include <stdbool.h>
 
 #include "sagan.h"
+#include "util-time.h"
 #include "aetas.h"
 #include "rules.h"
 
-struct _Rule_Struct *rulestruct;
-
 int Check_Time(int rule_number)
 {
 
-    char ct[64] = { 0 };
-    char buf[80] = { 0 };
-
     int day_current;
 
-    time_t     now;
     struct     tm  ts;
 
-    /* For current utime */
-    time_t t;
-    struct tm *now_utime;
-
-
     sbool   next_day = 0;
     sbool   off_day = 0;
 
-    char current_time_tmp[5];
-    char hour_tmp[3];
-    char minute_tmp[3];
-
     int	 current_time;
 
-    /* Get current utime / and day of the week */
-
-    t = time(NULL);
-    now_utime=localtime(&t);
-    strftime(ct, sizeof(ct), "%s",  now_utime);
-    day_current = localtime(&t)->tm_wday;
-
-    time(&now);
-    ts = *localtime(&now);
-
-    strftime(hour_tmp, sizeof(buf), "%H", &ts);
-    strftime(minute_tmp, sizeof(buf), "%M", &ts);
+    /* Get the day of the week and the time of day as HHMM */
 
-    snprintf(current_time_tmp, sizeof(current_time_tmp), "%s%s",  hour_tmp, minute_tmp);
-    current_time = atoi(current_time_tmp);
+    Sagan_Clock_LocalTime(&ts);
 
-    strftime(buf, sizeof(buf), "%d", &ts);
+    day_current = ts.tm_wday;
+    current_time = ts.tm_hour * 100 + ts.tm_min;
 
     /* We check if rule extends to a new day */
 
@@ -36,6 +36,7 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "rules.h"
 #include "after.h"
 #include "ipc.h"
@@ -53,7 +54,6 @@ struct after_by_dstport_ipc *afterbydstport_ipc;
 struct after_by_username_ipc *afterbyusername_ipc;
 
 struct _SaganCounters *counters;
-struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
 
@@ -68,17 +68,13 @@ sbool After_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bits
 
     sbool after_log_flag = true;
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     int i;
 
     uint64_t after_oldtime;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     for (i = 0; i < counters_ipc->after_count_by_src; i++ )
         {
@@ -94,7 +90,7 @@ sbool After_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bits
                     afterbysrc_ipc[i].count++;
                     afterbysrc_ipc[i].total_count++;
 
-                    after_oldtime = atol(timet) - afterbysrc_ipc[i].utime;
+                    after_oldtime = epoch_time - afterbysrc_ipc[i].utime;
 
                     strlcpy(afterbysrc_ipc[i].syslog_message, syslog_message, sizeof(afterbysrc_ipc[i].syslog_message));
                     strlcpy(afterbysrc_ipc[i].signature_msg, rulestruct[rule_position].s_msg, sizeof(afterbysrc_ipc[i].signature_msg));
@@ -107,7 +103,7 @@ sbool After_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bits
                         {
 
                             afterbysrc_ipc[i].count=1;
-                            afterbysrc_ipc[i].utime = atol(timet);
+                            afterbysrc_ipc[i].utime = epoch_time;
 
                             after_log_flag = true;
                         }
@@ -146,7 +142,7 @@ sbool After_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bits
             strlcpy(afterbysrc_ipc[counters_ipc->after_count_by_src].sid, rulestruct[rule_position].s_sid, sizeof(afterbysrc_ipc[counters_ipc->after_count_by_src].sid));
             selector == NULL ? afterbysrc_ipc[counters_ipc->after_count_by_src].selector[0] = '\0' : strlcpy(afterbysrc_ipc[counters_ipc->after_count_by_src].selector, selector, MAXSELECTOR);
             afterbysrc_ipc[counters_ipc->after_count_by_src].count = 1;
-            afterbysrc_ipc[counters_ipc->after_count_by_src].utime = atol(timet);
+            afterbysrc_ipc[counters_ipc->after_count_by_src].utime = epoch_time;
             afterbysrc_ipc[counters_ipc->after_count_by_src].expire = rulestruct[rule_position].after_seconds;
 
             strlcpy(afterbysrc_ipc[counters_ipc->after_count_by_src].syslog_message, syslog_message, sizeof(afterbysrc_ipc[counters_ipc->after_count_by_src].syslog_message));
@@ -171,17 +167,13 @@ sbool After_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bits
 
     sbool after_log_flag = true;
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     int i;
 
     uint64_t after_oldtime;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     for (i = 0; i < counters_ipc->after_count_by_dst; i++ )
         {
@@ -197,7 +189,7 @@ sbool After_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bits
                     afterbydst_ipc[i].count++;
                     afterbydst_ipc[i].total_count++;
 
-                    after_oldtime = atol(timet) - afterbydst_ipc[i].utime;
+                    after_oldtime = epoch_time - afterbydst_ipc[i].utime;
 
                     strlcpy(afterbydst_ipc[i].syslog_message, syslog_message, sizeof(afterbydst_ipc[i].syslog_message));
                     strlcpy(afterbydst_ipc[i].signature_msg, rulestruct[rule_position].s_msg, sizeof(afterbydst_ipc[i].signature_msg));
@@ -207,7 +199,7 @@ sbool After_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bits
                         {
 
                             afterbydst_ipc[i].count=1;
-                            afterbydst_ipc[i].utime = atol(timet);
+                            afterbydst_ipc[i].utime = epoch_time;
                             after_log_flag = true;
                         }
 
@@ -245,7 +237,7 @@ sbool After_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bits
             strlcpy(afterbydst_ipc[counters_ipc->after_count_by_dst].sid, rulestruct[rule_position].s_sid, sizeof(afterbydst_ipc[counters_ipc->after_count_by_dst].sid));
             selector == NULL ? afterbydst_ipc[counters_ipc->after_count_by_dst].selector[0] = '\0' : strlcpy(afterbydst_ipc[counters_ipc->after_count_by_dst].selector, selector, MAXSELECTOR);
             afterbydst_ipc[counters_ipc->after_count_by_dst].count = 1;
-            afterbydst_ipc[counters_ipc->after_count_by_dst].utime = atol(timet);
+            afterbydst_ipc[counters_ipc->after_count_by_dst].utime = epoch_time;
             afterbydst_ipc[counters_ipc->after_count_by_dst].expire = rulestruct[rule_position].after_seconds;
 
             strlcpy(afterbydst_ipc[counters_ipc->after_count_by_dst].syslog_message, syslog_message, sizeof(afterbydst_ipc[counters_ipc->after_count_by_dst].syslog_message));
@@ -272,17 +264,13 @@ sbool After_By_Username( int rule_position, char *normalize_username, char *sele
 
     sbool after_log_flag = true;
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     int i;
 
     uint64_t after_oldtime;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     /* Check array for matching username / sid */
 
@@ -310,7 +298,7 @@ sbool After_By_Username( int rule_position, char *normalize_username, char *sele
                     afterbyusername_ipc[i].count++;
                     afterbyusername_ipc[i].total_count++;
 
-                    after_oldtime = atol(timet) - afterbyusername_ipc[i].utime;
+                    after_oldtime = epoch_time - afterbyusername_ipc[i].utime;
 
                     strlcpy(afterbyusername_ipc[i].syslog_message, syslog_message, sizeof(afterbyusername_ipc[i].syslog_message));
                     strlcpy(afterbyusername_ipc[i].signature_msg, rulestruct[rule_position].s_msg, sizeof(afterbyusername_ipc[i].signature_msg));
@@ -320,7 +308,7 @@ sbool After_By_Username( int rule_position, char *normalize_username, char *sele
                         {
 
                             afterbyusername_ipc[i].count=1;
-                            afterbyusername_ipc[i].utime = atol(timet);
+                            afterbyusername_ipc[i].utime = epoch_time;
 
                             after_log_flag = true;
                         }
@@ -358,7 +346,7 @@ sbool After_By_Username( int rule_position, char *normalize_username, char *sele
             strlcpy(afterbyusername_ipc[counters_ipc->after_count_by_username].sid, rulestruct[rule_position].s_sid, sizeof(afterbyusername_ipc[counters_ipc->after_count_by_username].sid));
             selector == NULL ? afterbyusername_ipc[counters_ipc->after_count_by_username].selector[0] = '\0' : strlcpy(afterbyusername_ipc[counters_ipc->after_count_by_username].selector, selector, MAXSELECTOR);
             afterbyusername_ipc[counters_ipc->after_count_by_username].count = 1;
-            afterbyusername_ipc[counters_ipc->after_count_by_username].utime = atol(timet);
+            afterbyusername_ipc[counters_ipc->after_count_by_username].utime = epoch_time;
             afterbyusername_ipc[counters_ipc->after_count_by_username].expire = rulestruct[rule_position].after_seconds;
 
             strlcpy(afterbyusername_ipc[counters_ipc->after_count_by_username].syslog_message, syslog_message, sizeof(afterbyusername_ipc[counters_ipc->after_count_by_username].syslog_message));
@@ -383,17 +371,13 @@ sbool After_By_SrcPort( int rule_position, uint32_t ip_srcport_u32, char *select
 
     sbool after_log_flag = true;
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     int i;
 
     uint64_t after_oldtime;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
 
     for (i = 0; i < counters_ipc->after_count_by_srcport; i++ )
@@ -419,14 +403,14 @@ sbool After_By_SrcPort( int rule_position, uint32_t ip_srcport_u32, char *select
                     afterbysrcport_ipc[i].count++;
                     afterbysrcport_ipc[i].total_count++;
 
-                    after_oldtime = atol(timet) - afterbysrcport_ipc[i].utime;
+                    after_oldtime = epoch_time - afterbysrcport_ipc[i].utime;
 
                     if ( after_oldtime > rulestruct[rule_position].after_seconds ||
                             afterbysrc_ipc[i].count == 0 )
                         {
 
                             afterbysrcport_ipc[i].count=1;
-                            afterbysrcport_ipc[i].utime = atol(timet);
+                            afterbysrcport_ipc[i].utime = epoch_time;
                             after_log_flag = true;
                         }
 
@@ -462,7 +446,7 @@ sbool After_By_SrcPort( int rule_position, uint32_t ip_srcport_u32, char *select
             strlcpy(afterbysrcport_ipc[counters_ipc->after_count_by_srcport].sid, rulestruct[rule_position].s_sid, sizeof(afterbysrcport_ipc[counters_ipc->after_count_by_srcport].sid));
             selector == NULL ? afterbysrcport_ipc[counters_ipc->after_count_by_srcport].selector[0] = '\0' : strlcpy(afterbysrcport_ipc[counters_ipc->after_count_by_srcport].selector, selector, MAXSELECTOR);
             afterbysrcport_ipc[counters_ipc->after_count_by_srcport].count = 1;
-            afterbysrcport_ipc[counters_ipc->after_count_by_srcport].utime = atol(timet);
+            afterbysrcport_ipc[counters_ipc->after_count_by_srcport].utime = epoch_time;
             afterbysrcport_ipc[counters_ipc->after_count_by_srcport].expire = rulestruct[rule_position].after_seconds;
 
             counters_ipc->after_count_by_srcport++;
@@ -485,17 +469,13 @@ sbool After_By_DstPort( int rule_position, uint32_t ip_dstport_u32, char *select
 
     sbool after_log_flag = true;
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     int i;
 
     uint64_t after_oldtime;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
 
     for (i = 0; i < counters_ipc->after_count_by_dstport; i++ )
@@ -521,14 +501,14 @@ sbool After_By_DstPort( int rule_position, uint32_t ip_dstport_u32, char *select
                     afterbydstport_ipc[i].count++;
                     afterbydstport_ipc[i].total_count++;
 
-                    after_oldtime = atol(timet) - afterbydstport_ipc[i].utime;
+                    after_oldtime = epoch_time - afterbydstport_ipc[i].utime;
 
                     if ( after_oldtime > rulestruct[rule_position].after_seconds ||
                             afterbysrc_ipc[i].count == 0 )
                         {
 
                             afterbydstport_ipc[i].count=1;
-                            afterbydstport_ipc[i].utime = atol(timet);
+                            afterbydstport_ipc[i].utime = epoch_time;
                             after_log_flag = true;
 
                         }
@@ -565,7 +545,7 @@ sbool After_By_DstPort( int rule_position, uint32_t ip_dstport_u32, char *select
             strlcpy(afterbydstport_ipc[counters_ipc->after_count_by_dstport].sid, rulestruct[rule_position].s_sid, sizeof(afterbydstport_ipc[counters_ipc->after_count_by_dstport].sid));
             selector == NULL ? afterbydstport_ipc[counters_ipc->after_count_by_dstport].selector[0] = '\0' : strlcpy(afterbydstport_ipc[counters_ipc->after_count_by_dstport].selector, selector, MAXSELECTOR);
             afterbydstport_ipc[counters_ipc->after_count_by_dstport].count = 1;
-            afterbydstport_ipc[counters_ipc->after_count_by_dstport].utime = atol(timet);
+            afterbydstport_ipc[counters_ipc->after_count_by_dstport].utime = epoch_time;
             afterbydstport_ipc[counters_ipc->after_count_by_dstport].expire = rulestruct[rule_position].after_seconds;
 
             counters_ipc->after_count_by_dstport++;
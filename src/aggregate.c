@@ -0,0 +1,434 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+
+/* aggregate.c
+ *
+ * Optional stage between Send_Alert() and the output plugins.  Alerts are
+ * grouped by signature plus the "aggregate-by" fields.  The first alert of
+ * a group goes out right away;  the rest are only counted.  When the
+ * group's "aggregate-window" is up,  one summary alert with the count goes
+ * out (if anything was counted) and the group is dropped.
+ *
+ * Groups hold a copy of their first alert.  Their memory is charged to
+ * "aggregate-memory";  when that's used up,  new groups aren't made and
+ * their alerts go out as normal.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "util-time.h"
+#include "output.h"
+#include "rules.h"
+#include "aggregate.h"
+#include "util-hash.h"
+
+struct _SaganConfig *config;
+
+static _Sagan_Aggregate_Stripe *stripes = NULL;
+
+static uint64_t aggregate_groups = 0;
+static uint64_t aggregate_memory = 0;
+static uint64_t aggregate_suppressed = 0;
+static uint64_t aggregate_summaries = 0;
+static uint64_t aggregate_overflow = 0;
+
+static sbool aggregate_init = false;
+
+/****************************************************************************
+ * Aggregate_Key - Builds the group key for an alert.  Returns its length.
+ ****************************************************************************/
+
+static size_t Aggregate_Key( _Sagan_Event *Event, char *key )
+{
+
+    size_t len = 0;
+
+    len = snprintf(key, AGGREGATE_KEY_SIZE, "%lu:%s", Event->generatorid, Event->sid);
+
+    if ( len < AGGREGATE_KEY_SIZE && ( config->aggregate_by & AGGREGATE_BY_SRC ) )
+        {
+            len += snprintf(key + len, AGGREGATE_KEY_SIZE - len, "|%s", Event->ip_src);
+        }
+
+    if ( len < AGGREGATE_KEY_SIZE && ( config->aggregate_by & AGGREGATE_BY_DST ) )
+        {
+            len += snprintf(key + len, AGGREGATE_KEY_SIZE - len, ">%s", Event->ip_dst);
+        }
+
+    if ( len < AGGREGATE_KEY_SIZE && ( config->aggregate_by & AGGREGATE_BY_SRCPORT ) )
+        {
+            len += snprintf(key + len, AGGREGATE_KEY_SIZE - len, ":%d", Event->src_port);
+        }
+
+    if ( len < AGGREGATE_KEY_SIZE && ( config->aggregate_by & AGGREGATE_BY_DSTPORT ) )
+        {
+            len += snprintf(key + len, AGGREGATE_KEY_SIZE - len, "/%d", Event->dst_port);
+        }
+
+    if ( len >= AGGREGATE_KEY_SIZE )
+        {
+            len = AGGREGATE_KEY_SIZE - 1;
+        }
+
+    return(len);
+}
+
+/****************************************************************************
+ * Aggregate_Event - Called by Output() for every alert.  Returns true if
+ * the alert should go to the output plugins,  false if it was counted in
+ * a group instead.
+ ****************************************************************************/
+
+sbool Aggregate_Event( _Sagan_Event *Event )
+{
+
+    _Sagan_Aggregate_Stripe *stripe = NULL;
+    _Sagan_Aggregate_Entry *entry = NULL;
+
+    char key[AGGREGATE_KEY_SIZE];
+    size_t len = 0;
+    uint32_t hash = 0;
+    uint32_t bucket = 0;
+
+    if ( stripes == NULL )
+        {
+            return(true);
+        }
+
+    len = Aggregate_Key(Event, key);
+    hash = Hash_FNV1a(key, len);
+
+    stripe = &stripes[hash & ( AGGREGATE_STRIPES - 1 )];
+    bucket = ( hash / AGGREGATE_STRIPES ) & ( AGGREGATE_BUCKETS - 1 );
+
+    pthread_mutex_lock(&stripe->lock);
+
+    for ( entry = stripe->buckets[bucket]; entry != NULL; entry = entry->next )
+        {
+
+            if ( entry->hash == hash && !strcmp(entry->key, key) )
+                {
+                    entry->count++;
+                    pthread_mutex_unlock(&stripe->lock);
+
+                    __atomic_add_fetch(&aggregate_suppressed, 1, __ATOMIC_RELAXED);
+                    return(false);
+                }
+        }
+
+    /* A new group.  Out of memory means the alert just goes out */
+
+    if ( __atomic_load_n(&aggregate_memory, __ATOMIC_RELAXED) >= config->aggregate_memory )
+        {
+            pthread_mutex_unlock(&stripe->lock);
+
+            __atomic_add_fetch(&aggregate_overflow, 1, __ATOMIC_RELAXED);
+            return(true);
+        }
+
+    entry = malloc(sizeof(_Sagan_Aggregate_Entry));
+
+    if ( entry == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for alert aggregation. Abort!", __FILE__, __LINE__);
+        }
+
+    memcpy(entry->key, key, len);
+    entry->key[len] = '\0';
+
+    entry->hash = hash;
+    entry->count = 1;
+    entry->first = Sagan_Clock_Epoch();
+    entry->record = Output_Record_New(Event);
+    entry->size = sizeof(_Sagan_Aggregate_Entry) + entry->record->size;
+
+    entry->next = stripe->buckets[bucket];
+    stripe->buckets[bucket] = entry;
+
+    /* Every group has the same window,  so creation order is expiry order */
+
+    entry->newer = NULL;
+
+    if ( stripe->newest == NULL )
+        {
+            stripe->oldest = entry;
+        }
+    else
+        {
+            stripe->newest->newer = entry;
+        }
+
+    stripe->newest = entry;
+
+    pthread_mutex_unlock(&stripe->lock);
+
+    __atomic_add_fetch(&aggregate_memory, entry->size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&aggregate_groups, 1, __ATOMIC_RELAXED);
+
+    return(true);
+}
+
+/****************************************************************************
+ * Aggregate_Summary - Sends the summary for a group,  if alerts were
+ * counted in it,  and frees the group
+ ****************************************************************************/
+
+static void Aggregate_Summary( _Sagan_Aggregate_Entry *entry )
+{
+
+    _Sagan_Event summary;
+    char msg[MAX_SAGAN_MSG + 64];
+
+    _Rules_Version *caller = rules_active;
+
+    if ( entry->count > 1 )
+        {
+
+            memcpy(&summary, &entry->record->event, sizeof(_Sagan_Event));
+
+            snprintf(msg, sizeof(msg), "%s (%" PRIu64 " more in %ld seconds)", entry->record->event.f_msg, entry->count - 1, (long)( Sagan_Clock_Epoch() - entry->first ));
+
+            summary.f_msg = msg;
+            summary.aggregate_count = entry->count;
+
+            Sagan_Clock_Timeval(&summary.event_time);
+
+            summary.json_normalize = NULL;
+
+            /* The summary is rendered with the rules of the alert.  The
+             * record (and its reference to them) is freed below,  so the
+             * caller gets its own version back afterwards */
+
+            Rules_Use(entry->record->rules);
+
+#if defined HAVE_LIBLOGNORM || defined WITH_BLUEDOT
+
+            if ( entry->record->normalize != NULL )
+                {
+                    summary.json_normalize = json_tokener_parse(entry->record->normalize);
+                }
+
+#endif
+
+            Output_Summary(&summary);
+
+#if defined HAVE_LIBLOGNORM || defined WITH_BLUEDOT
+
+            if ( summary.json_normalize != NULL )
+                {
+                    json_object_put(summary.json_normalize);
+                }
+
+#endif
+
+            rules_active = caller;
+
+            __atomic_add_fetch(&aggregate_summaries, 1, __ATOMIC_RELAXED);
+        }
+
+    __atomic_sub_fetch(&aggregate_memory, entry->size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&aggregate_groups, 1, __ATOMIC_RELAXED);
+
+    Output_Record_Free(entry->record);
+    free(entry);
+
+}
+
+/****************************************************************************
+ * Aggregate_Expire - Ends every group whose window is up,  or all of them
+ * if "all" is set
+ ****************************************************************************/
+
+static void Aggregate_Expire( sbool all )
+{
+
+    _Sagan_Aggregate_Stripe *stripe = NULL;
+    _Sagan_Aggregate_Entry *expired = NULL;
+    _Sagan_Aggregate_Entry *entry = NULL;
+    _Sagan_Aggregate_Entry **p = NULL;
+
+    time_t now = (time_t)Sagan_Clock_Epoch();
+    int i = 0;
+
+    for ( i = 0; i < AGGREGATE_STRIPES; i++ )
+        {
+
+            stripe = &stripes[i];
+            expired = NULL;
+
+            pthread_mutex_lock(&stripe->lock);
+
+            while ( stripe->oldest != NULL && ( all == true || now - stripe->oldest->first >= config->aggregate_window ) )
+                {
+
+                    entry = stripe->oldest;
+
+                    stripe->oldest = entry->newer;
+
+                    if ( stripe->oldest == NULL )
+                        {
+                            stripe->newest = NULL;
+                        }
+
+                    for ( p = &stripe->buckets[( entry->hash / AGGREGATE_STRIPES ) & ( AGGREGATE_BUCKETS - 1 )]; *p != entry; p = &(*p)->next );
+
+                    *p = entry->next;
+
+                    /* Reuse "newer" to keep the expired groups in order */
+
+                    entry->newer = expired;
+                    expired = entry;
+                }
+
+            pthread_mutex_unlock(&stripe->lock);
+
+            /* Summaries go out without the stripe locked;  Output() may
+             * have to wait on a full queue */
+
+            while ( expired != NULL )
+                {
+                    entry = expired;
+                    expired = entry->newer;
+                    Aggregate_Summary(entry);
+                }
+        }
+
+}
+
+/****************************************************************************
+ * Aggregate_Thread - Sends summaries as windows end
+ ****************************************************************************/
+
+static void Aggregate_Thread( void )
+{
+
+    (void)SetThreadName("SaganAggregate");
+
+    for (;;)
+        {
+            sleep(1);
+            Aggregate_Expire(false);
+        }
+
+}
+
+/****************************************************************************
+ * Aggregate_Flush - Ends every group now.  Called before a reload,  so
+ * groups start over with the new "aggregate" settings.
+ ****************************************************************************/
+
+void Aggregate_Flush( void )
+{
+
+    if ( stripes != NULL )
+        {
+            Aggregate_Expire(true);
+        }
+
+}
+
+/****************************************************************************
+ * Aggregate_Init - Allocates the group table and starts the summary
+ * thread.  Only the first call does anything.
+ ****************************************************************************/
+
+void Aggregate_Init( void )
+{
+
+    pthread_t aggregate_thread;
+    pthread_attr_t aggregate_thread_attr;
+
+    _Sagan_Aggregate_Stripe *tmp = NULL;
+
+    int rc = 0;
+    int i = 0;
+
+    if ( aggregate_init == true )
+        {
+            return;
+        }
+
+    aggregate_init = true;
+
+    tmp = calloc(AGGREGATE_STRIPES, sizeof(_Sagan_Aggregate_Stripe));
+
+    if ( tmp == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for alert aggregation. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < AGGREGATE_STRIPES; i++ )
+        {
+            pthread_mutex_init(&tmp[i].lock, NULL);
+        }
+
+    __atomic_store_n(&stripes, tmp, __ATOMIC_RELEASE);
+
+    pthread_attr_init(&aggregate_thread_attr);
+    pthread_attr_setdetachstate(&aggregate_thread_attr,  PTHREAD_CREATE_DETACHED);
+
+    rc = pthread_create( &aggregate_thread, &aggregate_thread_attr, (void *)Aggregate_Thread, NULL );
+
+    if ( rc != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Could not pthread_create() for the aggregation thread [error: %d]", __FILE__, __LINE__, rc);
+        }
+
+    pthread_attr_destroy(&aggregate_thread_attr);
+
+}
+
+/****************************************************************************
+ * Aggregate_Stats - For perfmon/stats
+ ****************************************************************************/
+
+void Aggregate_Stats( _Sagan_Aggregate_Stats *stats )
+{
+
+    stats->groups = __atomic_load_n(&aggregate_groups, __ATOMIC_RELAXED);
+    stats->memory = __atomic_load_n(&aggregate_memory, __ATOMIC_RELAXED);
+    stats->suppressed = __atomic_load_n(&aggregate_suppressed, __ATOMIC_RELAXED);
+    stats->summaries = __atomic_load_n(&aggregate_summaries, __ATOMIC_RELAXED);
+    stats->overflow = __atomic_load_n(&aggregate_overflow, __ATOMIC_RELAXED);
+
+}
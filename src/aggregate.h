@@ -0,0 +1,84 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+
+/* aggregate.h
+ *
+ * Coalesces duplicate alerts before they reach the output plugins.  See
+ * aggregate.c
+ *
+ */
+
+#define AGGREGATE_BY_SRC	0x01
+#define AGGREGATE_BY_DST	0x02
+#define AGGREGATE_BY_SRCPORT	0x04
+#define AGGREGATE_BY_DSTPORT	0x08
+#define AGGREGATE_BY_SID	0x10		/* Always set when aggregating */
+
+#define AGGREGATE_KEY_SIZE	192
+
+/* One group of alerts.  "record" is a copy of the first alert,  used to
+ * build the summary */
+
+typedef struct _Sagan_Aggregate_Entry _Sagan_Aggregate_Entry;
+struct _Sagan_Aggregate_Entry
+{
+    uint32_t hash;
+    char key[AGGREGATE_KEY_SIZE];
+
+    uint64_t count;			/* Alerts in the group,  including the first */
+    time_t first;
+
+    struct _Sagan_Output_Record *record;
+    size_t size;			/* Bytes charged to "aggregate-memory" */
+
+    struct _Sagan_Aggregate_Entry *next;	/* Bucket chain */
+    struct _Sagan_Aggregate_Entry *newer;	/* Creation order */
+};
+
+/* Groups are spread over AGGREGATE_STRIPES locks.  "oldest"/"newest" is
+ * the stripe's groups in the order they were made */
+
+#define AGGREGATE_STRIPES	16		/* Power of 2 */
+#define AGGREGATE_BUCKETS	4096		/* Per stripe,  power of 2 */
+
+typedef struct _Sagan_Aggregate_Stripe _Sagan_Aggregate_Stripe;
+struct _Sagan_Aggregate_Stripe
+{
+    pthread_mutex_t lock;
+    _Sagan_Aggregate_Entry *buckets[AGGREGATE_BUCKETS];
+    _Sagan_Aggregate_Entry *oldest;
+    _Sagan_Aggregate_Entry *newest;
+};
+
+typedef struct _Sagan_Aggregate_Stats _Sagan_Aggregate_Stats;
+struct _Sagan_Aggregate_Stats
+{
+    uint64_t groups;
+    uint64_t memory;
+    uint64_t suppressed;
+    uint64_t summaries;
+    uint64_t overflow;
+};
+
+void  Aggregate_Init( void );
+void  Aggregate_Flush( void );
+sbool Aggregate_Event( _Sagan_Event * );
+void  Aggregate_Stats( _Sagan_Aggregate_Stats * );
@@ -35,6 +35,7 @@
 #include <pthread.h>
 #include <errno.h>
 #include <string.h>
+#include <pcre.h>
 
 #include "version.h"
 
@@ -42,6 +43,7 @@
 #include "sagan-defs.h"
 #include "gen-msg.h"
 #include "classifications.h"
+#include "rules.h"
 
 struct _SaganCounters *counters;
 struct _Class_Struct *classstruct;
@@ -150,27 +152,41 @@ void Load_Classifications( const char *ruleset )
 }
 
 /****************************************************************************
- * Classtype_Lookup - Simple routine that looks up the classtype
- * (s_shortname) and returns the classtype's description
+ * Classtype_Find - Returns the index of a classtype (s_shortname) in the
+ * calling thread's rule version,  or -1 if there is no such classtype.
+ * Rules resolve their classtype with this once,  when loaded.
  ****************************************************************************/
 
-int Classtype_Lookup( const char *classtype, char *str, size_t size )
+int Classtype_Find( const char *classtype )
 {
 
     int i;
 
-    for (i = 0; i < counters->classcount; i++)
+    for (i = 0; i < rules_active->class_count; i++)
         {
 
-            if (!strcmp(classtype, classstruct[i].s_shortname))
+            if (!strcmp(classtype, rules_active->classes[i].s_shortname))
                 {
-                    snprintf(str, size, "%s", classstruct[i].s_desc);
-                    return 0;
+                    return(i);
                 }
         }
 
+    return(-1);
+}
+
+/****************************************************************************
+ * Classtype_Lookup - Returns the description of a classtype found with
+ * Classtype_Find(),  in the same rule version
+ ****************************************************************************/
+
+const char *Classtype_Lookup( int class_id )
+{
+
+    if ( class_id < 0 || class_id >= rules_active->class_count )
+        {
+            return("UNKNOWN");
+        }
 
-    snprintf(str, sizeof("UNKNOWN"), "UNKNOWN");
-    return -1;
+    return(rules_active->classes[class_id].s_desc);
 }
 
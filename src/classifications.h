@@ -34,6 +34,7 @@ struct _Class_Struct
 
 
 void Load_Classifications( const char * );
-int  Classtype_Lookup( const char *classtype, char *str, size_t size );
+int  Classtype_Find( const char *classtype );
+const char *Classtype_Lookup( int class_id );
 
 
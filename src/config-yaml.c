@@ -37,13 +37,14 @@
 #include "version.h"
 #include "sagan.h"
 #include "sagan-defs.h"
+#include "sagan-config.h"
 #include "config-yaml.h"
 #include "rules.h"
-#include "sagan-config.h"
 #include "classifications.h"
 #include "gen-msg.h"
 #include "protocol-map.h"
 #include "references.h"
+#include "aggregate.h"
 #include "parsers/parsers.h"
 
 /* Processors */
@@ -84,7 +85,6 @@ struct _SaganDebug *debug;
 struct _SaganVar *var;
 struct _SaganCounters *counters;
 struct _Rules_Loaded *rules_loaded;
-struct _Rule_Struct *rulestruct;
 
 #ifndef HAVE_LIBYAML
 ** You must of LIBYAML installed! **
@@ -98,7 +98,15 @@ pthread_mutex_t CounterLoadConfigGenericMutex=PTHREAD_MUTEX_INITIALIZER;
 
 #ifdef HAVE_LIBYAML
 
-void Load_YAML_Config( char *yaml_file )
+/****************************************************************************
+ * Load_YAML_Config - Loads "yaml_file" into "config".  At start up that
+ * is the live configuration.  A reload (SIGHUP) passes a copy,  which the
+ * signal handler publishes once it is complete (see Config_Publish()).
+ * The parameter hides the global "config" on purpose,  so everything set
+ * here goes to the copy while the workers keep reading the live one.
+ ****************************************************************************/
+
+void Load_YAML_Config( struct _SaganConfig *config, char *yaml_file )
 {
 
     struct stat filecheck;
@@ -108,13 +116,12 @@ void Load_YAML_Config( char *yaml_file )
 
     sbool done = 0;
 
-    int check = 0;
-
     unsigned char type = 0;
     unsigned char sub_type = 0;
     unsigned char toggle = 0;
 
     char *tok = NULL;
+    char *ptr = NULL;
 
     char tmp[CONFBUF] = { 0 };
 
@@ -160,8 +167,38 @@ void Load_YAML_Config( char *yaml_file )
             config->max_track_clients = DEFAULT_IPC_CLIENT_TRACK_IPC;
             config->pp_sagan_track_clients = TRACK_TIME;
 
+            config->brointel_domain_boundary = false;
+
             config->sagan_proto = 17;           /* Default to UDP */
             config->max_processor_threads = MAX_PROCESSOR_THREADS;
+            config->rule_compile_threads = 0;
+            config->rule_cache_dir[0] = '\0';
+
+            config->dns_cache_size = DNS_CACHE_SIZE_DEFAULT;
+            config->dns_ttl = DNS_TTL_DEFAULT;
+            config->dns_negative_ttl = DNS_NEGATIVE_TTL_DEFAULT;
+            config->dns_resolvers = DNS_RESOLVERS_DEFAULT;
+            config->dns_pending_policy = DNS_PENDING_PASS;
+            config->dns_hold_time = DNS_HOLD_TIME_DEFAULT;
+            config->dns_queue_size = DNS_QUEUE_SIZE_DEFAULT;
+
+            config->output_queue_size = OUTPUT_QUEUE_SIZE_DEFAULT;
+            config->output_overflow = OUTPUT_OVERFLOW_BLOCK;
+            config->aggregate_by = 0;
+            config->aggregate_window = AGGREGATE_WINDOW_DEFAULT;
+            config->aggregate_memory = AGGREGATE_MEMORY_DEFAULT * 1024 * 1024;
+
+            config->external_mode = EXTERNAL_MODE_EXEC;
+            config->external_format = EXTERNAL_FORMAT_TEXT;
+            config->external_processes = EXTERNAL_PROCESSES_DEFAULT;
+            config->external_timeout = EXTERNAL_TIMEOUT_DEFAULT;
+
+            config->fwsam_queue_size = FWSAM_QUEUE_SIZE_DEFAULT;
+
+#ifdef HAVE_LIBESMTP
+            config->esmtp_spool_size = ESMTP_SPOOL_SIZE_DEFAULT;
+            config->esmtp_digest_max = ESMTP_DIGEST_MAX_DEFAULT;
+#endif
 
             config->eve_fd              = -1;
             config->sagan_alert_fd      = -1;
@@ -205,6 +242,12 @@ void Load_YAML_Config( char *yaml_file )
             config->bluedot_url_queue = BLUEDOT_URL_QUEUE_DEFAULT;
             config->bluedot_filename_queue = BLUEDOT_FILENAME_QUEUE_DEFAULT;
 
+            config->bluedot_request_timeout = BLUEDOT_REQUEST_TIMEOUT_DEFAULT;
+            config->bluedot_negative_ttl = BLUEDOT_NEGATIVE_TTL_DEFAULT;
+            config->bluedot_max_connections = BLUEDOT_MAX_CONNECTIONS_DEFAULT;
+            config->bluedot_max_deferred = BLUEDOT_MAX_DEFERRED_DEFAULT;
+            config->bluedot_pending_policy = BLUEDOT_PENDING_EVALUATE;
+
 #endif
 
 #ifdef WITH_SYSLOG
@@ -488,7 +531,7 @@ void Load_YAML_Config( char *yaml_file )
 
                                     Var_To_Value(value, tmp, sizeof(tmp));
                                     Sagan_Log(NORMAL, "Loading included file '%s'.", tmp);
-                                    Load_YAML_Config(tmp);
+                                    Load_YAML_Config(config, tmp);
 
                                     toggle = 1;
 
@@ -620,6 +663,178 @@ void Load_YAML_Config( char *yaml_file )
                                                 }
                                         }
 
+                                    else if (!strcmp(last_pass, "dns-cache-size"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->dns_cache_size = strtoull(tmp, NULL, 10);
+
+                                            if ( config->dns_cache_size == 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan-core 'dns-cache-size' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "dns-ttl"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->dns_ttl = atoi(tmp);
+                                        }
+
+                                    else if (!strcmp(last_pass, "dns-negative-ttl"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->dns_negative_ttl = atoi(tmp);
+                                        }
+
+                                    else if (!strcmp(last_pass, "dns-resolvers"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->dns_resolvers = atoi(tmp);
+
+                                            if ( config->dns_resolvers <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan-core 'dns-resolvers' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "dns-pending-policy"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if (!strcasecmp(tmp, "pass"))
+                                                {
+                                                    config->dns_pending_policy = DNS_PENDING_PASS;
+                                                }
+
+                                            else if (!strcasecmp(tmp, "hold"))
+                                                {
+                                                    config->dns_pending_policy = DNS_PENDING_HOLD;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan-core 'dns-pending-policy' must be 'pass' or 'hold'. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "dns-hold-time"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->dns_hold_time = atoi(tmp);
+                                        }
+
+                                    else if (!strcmp(last_pass, "dns-queue-size"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->dns_queue_size = atoi(tmp);
+
+                                            if ( config->dns_queue_size <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan-core 'dns-queue-size' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "output-queue-size"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->output_queue_size = strtoull(tmp, NULL, 10);
+
+                                            if ( config->output_queue_size == 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan-core 'output-queue-size' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "output-overflow"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if (!strcasecmp(tmp, "block"))
+                                                {
+                                                    config->output_overflow = OUTPUT_OVERFLOW_BLOCK;
+                                                }
+
+                                            else if (!strcasecmp(tmp, "drop"))
+                                                {
+                                                    config->output_overflow = OUTPUT_OVERFLOW_DROP;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan-core 'output-overflow' must be 'block' or 'drop'. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "aggregate-by"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            config->aggregate_by = 0;
+
+                                            if ( strcasecmp(tmp, "none") )
+                                                {
+
+                                                    config->aggregate_by = AGGREGATE_BY_SID;
+
+                                                    ptr = strtok_r(tmp, ",", &tok);
+
+                                                    while ( ptr != NULL )
+                                                        {
+
+                                                            Remove_Spaces(ptr);
+
+                                                            if (!strcasecmp(ptr, "src"))
+                                                                {
+                                                                    config->aggregate_by |= AGGREGATE_BY_SRC;
+                                                                }
+
+                                                            else if (!strcasecmp(ptr, "dst"))
+                                                                {
+                                                                    config->aggregate_by |= AGGREGATE_BY_DST;
+                                                                }
+
+                                                            else if (!strcasecmp(ptr, "src-port"))
+                                                                {
+                                                                    config->aggregate_by |= AGGREGATE_BY_SRCPORT;
+                                                                }
+
+                                                            else if (!strcasecmp(ptr, "dst-port"))
+                                                                {
+                                                                    config->aggregate_by |= AGGREGATE_BY_DSTPORT;
+                                                                }
+
+                                                            else if (strcasecmp(ptr, "sid"))
+                                                                {
+                                                                    Sagan_Log(ERROR, "[%s, line %d] sagan-core 'aggregate-by' has an unknown field '%s'. Use 'none' or a list of 'sid', 'src', 'dst', 'src-port' and 'dst-port'. Abort!", __FILE__, __LINE__, ptr);
+                                                                }
+
+                                                            ptr = strtok_r(NULL, ",", &tok);
+                                                        }
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "aggregate-window"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->aggregate_window = atoi(tmp);
+
+                                            if ( config->aggregate_window <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan-core 'aggregate-window' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "aggregate-memory"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->aggregate_memory = strtoull(tmp, NULL, 10) * 1024 * 1024;
+
+                                            if ( config->aggregate_memory == 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan-core 'aggregate-memory' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
 #if defined(HAVE_GETPIPE_SZ) && defined(HAVE_SETPIPE_SZ)
 
                                     else if (!strcmp(last_pass, "fifo-size"))
@@ -658,6 +873,25 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    else if (!strcmp(last_pass, "rule-cache"))
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            strlcpy(config->rule_cache_dir, tmp, sizeof(config->rule_cache_dir));
+                                        }
+
+                                    else if (!strcmp(last_pass, "rule-compile-threads"))
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->rule_compile_threads = atoi(tmp);
+
+                                            if ( config->rule_compile_threads < 0 || config->rule_compile_threads > RULES_COMPILE_THREADS_MAX )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] sagan:core 'rule-compile-threads' must be between 0 and %d. Abort!", __FILE__, __LINE__, RULES_COMPILE_THREADS_MAX);
+                                                }
+
+                                        }
+
                                     else if (!strcmp(last_pass, "classification"))
                                         {
 
@@ -1285,6 +1519,13 @@ void Load_YAML_Config( char *yaml_file )
                                             strlcpy(config->blacklist_files, tmp, sizeof(config->blacklist_files));
                                         }
 
+                                    else if (!strcmp(last_pass, "intel-db") && config->blacklist_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            strlcpy(config->blacklist_db, tmp, sizeof(config->blacklist_db));
+                                        }
+
                                 } /* if sub_type == YAML_PROCESSORS_BLACKLIST */
 
 #ifndef WITH_BLUEDOT
@@ -1447,6 +1688,70 @@ void Load_YAML_Config( char *yaml_file )
                                                 }
                                         }
 
+                                    else if (!strcmp(last_pass, "request-timeout") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_request_timeout = atoi(tmp);
+
+                                            if ( config->bluedot_request_timeout <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'request-timeout' has to be a non-zero number. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "negative-cache-timeout") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_negative_ttl = atoi(tmp);
+
+                                            if ( config->bluedot_negative_ttl < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'negative-cache-timeout' cannot be negative. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "max-connections") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_max_connections = atoi(tmp);
+
+                                            if ( config->bluedot_max_connections <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'max-connections' has to be a non-zero number. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "max-deferred") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->bluedot_max_deferred = atoi(tmp);
+
+                                            if ( config->bluedot_max_deferred < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'max-deferred' cannot be negative. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "pending-policy") && config->bluedot_flag == true )
+                                        {
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+
+                                            if (!strcasecmp(tmp, "evaluate"))
+                                                {
+                                                    config->bluedot_pending_policy = BLUEDOT_PENDING_EVALUATE;
+                                                }
+
+                                            else if (!strcasecmp(tmp, "defer"))
+                                                {
+                                                    config->bluedot_pending_policy = BLUEDOT_PENDING_DEFER;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'processor' : 'bluedot' - 'pending-policy' must be 'evaluate' or 'defer'. Abort!!", __FILE__, __LINE__);
+                                                }
+                                        }
+
                                     else if (!strcmp(last_pass, "categories") && config->bluedot_flag == true )
                                         {
                                             Var_To_Value(value, tmp, sizeof(tmp));
@@ -1492,6 +1797,23 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    else if (!strcmp(last_pass, "intel-db") && config->brointel_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            strlcpy(config->brointel_db, tmp, sizeof(config->brointel_db));
+
+                                        }
+
+                                    else if (!strcmp(last_pass, "domain-boundary") && config->brointel_flag == true )
+                                        {
+
+                                            if ( !strcasecmp(value, "yes") || !strcasecmp(value, "true") )
+                                                {
+                                                    config->brointel_domain_boundary = true;
+                                                }
+                                        }
+
                                 } /* if sub_type == YAML_PROCESSORS_BROINTEL */
 
                             else if ( sub_type == YAML_PROCESSORS_DYNAMIC_LOAD )
@@ -1600,6 +1922,8 @@ void Load_YAML_Config( char *yaml_file )
                                                     strlcpy(config->eve_interface, "logs", sizeof(config->eve_interface)); 	/* Set a "default" value */
 
                                                     config->eve_type = 0;  /* Only one type at this time! */
+                                                    config->eve_buffer_size = EVE_BUFFER_SIZE_DEFAULT;
+                                                    config->eve_flush_interval = EVE_FLUSH_INTERVAL_DEFAULT;
 
                                                 }
                                         }
@@ -1650,6 +1974,72 @@ void Load_YAML_Config( char *yaml_file )
                                                 }
 
                                         }
+
+                                    else if ( !strcmp(last_pass, "buffer-size") && config->eve_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->eve_buffer_size = strtoull(tmp, NULL, 10);
+                                        }
+
+                                    else if ( !strcmp(last_pass, "flush-interval") && config->eve_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->eve_flush_interval = atoi(tmp);
+
+                                            if ( config->eve_flush_interval <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'eve-log' 'flush-interval' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if ( !strcmp(last_pass, "sync") && config->eve_flag == true )
+                                        {
+
+                                            if ( !strcasecmp(value, "yes") || !strcasecmp(value, "true") )
+                                                {
+                                                    config->eve_sync = true;
+                                                }
+
+                                        }
+
+                                    else if ( !strcmp(last_pass, "compress") && config->eve_flag == true )
+                                        {
+
+                                            if ( !strcasecmp(value, "gzip") )
+                                                {
+#ifdef HAVE_LIBZ
+                                                    config->eve_compress = STREAM_COMPRESS_GZIP;
+#else
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'eve-log' 'compress' is set to 'gzip', but Sagan is not compiled with zlib support. Abort!", __FILE__, __LINE__);
+#endif
+                                                }
+
+                                            else if ( strcasecmp(value, "none") && strcasecmp(value, "no") )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'eve-log' 'compress' must be 'gzip' or 'none'. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if ( !strcmp(last_pass, "rotate-size") && config->eve_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->eve_rotate_size = strtoull(tmp, NULL, 10) * 1024 * 1024;
+                                        }
+
+                                    else if ( !strcmp(last_pass, "rotate-interval") && config->eve_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->eve_rotate_interval = atoi(tmp);
+
+                                            if ( config->eve_rotate_interval < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'eve-log' 'rotate-interval' can't be negative. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
                                 }
 
                             else if ( sub_type == YAML_OUTPUT_ALERT )
@@ -1672,6 +2062,43 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    else if ( !strcmp(last_pass, "compress") && config->alert_flag == true )
+                                        {
+
+                                            if ( !strcasecmp(value, "gzip") )
+                                                {
+#ifdef HAVE_LIBZ
+                                                    config->alert_compress = STREAM_COMPRESS_GZIP;
+#else
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'alert' 'compress' is set to 'gzip', but Sagan is not compiled with zlib support. Abort!", __FILE__, __LINE__);
+#endif
+                                                }
+
+                                            else if ( strcasecmp(value, "none") && strcasecmp(value, "no") )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'alert' 'compress' must be 'gzip' or 'none'. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if ( !strcmp(last_pass, "rotate-size") && config->alert_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->alert_rotate_size = strtoull(tmp, NULL, 10) * 1024 * 1024;
+                                        }
+
+                                    else if ( !strcmp(last_pass, "rotate-interval") && config->alert_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->alert_rotate_interval = atoi(tmp);
+
+                                            if ( config->alert_rotate_interval < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'alert' 'rotate-interval' can't be negative. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
                                 } /* sub_type == YAML_OUTPUT_ALERT */
 
                             else if ( sub_type == YAML_OUTPUT_FAST )
@@ -1694,6 +2121,43 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    else if ( !strcmp(last_pass, "compress") && config->fast_flag == true )
+                                        {
+
+                                            if ( !strcasecmp(value, "gzip") )
+                                                {
+#ifdef HAVE_LIBZ
+                                                    config->fast_compress = STREAM_COMPRESS_GZIP;
+#else
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'fast' 'compress' is set to 'gzip', but Sagan is not compiled with zlib support. Abort!", __FILE__, __LINE__);
+#endif
+                                                }
+
+                                            else if ( strcasecmp(value, "none") && strcasecmp(value, "no") )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'fast' 'compress' must be 'gzip' or 'none'. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if ( !strcmp(last_pass, "rotate-size") && config->fast_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->fast_rotate_size = strtoull(tmp, NULL, 10) * 1024 * 1024;
+                                        }
+
+                                    else if ( !strcmp(last_pass, "rotate-interval") && config->fast_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->fast_rotate_interval = atoi(tmp);
+
+                                            if ( config->fast_rotate_interval < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'fast' 'rotate-interval' can't be negative. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
                                 } /* sub_type == YAML_OUTPUT_FAST */
 
 #if !defined(HAVE_DNET_H) && !defined(HAVE_DUMBNET_H)
@@ -1783,6 +2247,68 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    else if (!strcmp(last_pass, "mode") && config->sagan_external_output_flag == true)
+                                        {
+
+                                            if (!strcmp(value, "exec"))
+                                                {
+                                                    config->external_mode = EXTERNAL_MODE_EXEC;
+                                                }
+
+                                            else if (!strcmp(value, "persistent"))
+                                                {
+                                                    config->external_mode = EXTERNAL_MODE_PERSISTENT;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'external' 'mode' must be 'exec' or 'persistent'. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "format") && config->sagan_external_output_flag == true)
+                                        {
+
+                                            if (!strcmp(value, "text"))
+                                                {
+                                                    config->external_format = EXTERNAL_FORMAT_TEXT;
+                                                }
+
+                                            else if (!strcmp(value, "json"))
+                                                {
+                                                    config->external_format = EXTERNAL_FORMAT_JSON;
+                                                }
+
+                                            else
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'external' 'format' must be 'text' or 'json'. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "processes") && config->sagan_external_output_flag == true)
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->external_processes = atoi(tmp);
+
+                                            if ( config->external_processes <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'external' 'processes' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if (!strcmp(last_pass, "timeout") && config->sagan_external_output_flag == true)
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->external_timeout = atoi(tmp);
+
+                                            if ( config->external_timeout <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'external' 'timeout' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
                                 } /* else if sub_type == YAML_OUTPUT_EXTERNAL ) */
 
 
@@ -1842,6 +2368,42 @@ void Load_YAML_Config( char *yaml_file )
 
                                         }
 
+                                    else if ( !strcmp(last_pass, "spool-size") && config->sagan_esmtp_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->esmtp_spool_size = atoi(tmp);
+
+                                            if ( config->esmtp_spool_size <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'smtp' 'spool-size' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if ( !strcmp(last_pass, "digest-interval") && config->sagan_esmtp_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->esmtp_digest_interval = atoi(tmp);
+
+                                            if ( config->esmtp_digest_interval < 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'smtp' 'digest-interval' can't be negative. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
+                                    else if ( !strcmp(last_pass, "digest-max") && config->sagan_esmtp_flag == true )
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->esmtp_digest_max = atoi(tmp);
+
+                                            if ( config->esmtp_digest_max <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'smtp' 'digest-max' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
+
                                 } /* else if sub_type == YAML_OUTPUT_SMTP ) */
 
 #endif
@@ -1886,6 +2448,18 @@ void Load_YAML_Config( char *yaml_file )
                                             strlcpy(config->sagan_fwsam_info, tmp, sizeof(config->sagan_fwsam_info));
 
                                         }
+
+                                    else if (!strcmp(last_pass, "queue-size") && config->sagan_fwsam_flag == true)
+                                        {
+
+                                            Var_To_Value(value, tmp, sizeof(tmp));
+                                            config->fwsam_queue_size = atoi(tmp);
+
+                                            if ( config->fwsam_queue_size <= 0 )
+                                                {
+                                                    Sagan_Log(ERROR, "[%s, line %d] 'snortsam' 'queue-size' must be greater than zero. Abort!", __FILE__, __LINE__);
+                                                }
+                                        }
                                 }
 #endif
 
@@ -2208,7 +2782,11 @@ void Load_YAML_Config( char *yaml_file )
 
 #ifdef WITH_BLUEDOT
 
-                            if ( config->bluedot_flag == true && bluedot_load == false )
+                            /* These read the global configuration.  On reload
+                             * the signal handler calls them once the new one is
+                             * published */
+
+                            if ( config->bluedot_flag == true && bluedot_load == false && config->sagan_reload == false )
                                 {
 
                                     Sagan_Bluedot_Init();
@@ -2220,8 +2798,8 @@ void Load_YAML_Config( char *yaml_file )
 
 #endif
 
-                            Var_To_Value(value, tmp, sizeof(tmp));
-                            (void)Load_Rules( (char*)tmp );
+                            /* The rules are loaded by Rules_Load_All() once the
+                             * configuration is done */
 
                             rules_loaded = (_Rules_Loaded *) realloc(rules_loaded, (counters->rules_loaded_count+1) * sizeof(_Rules_Loaded));
 
@@ -2384,22 +2962,6 @@ void Load_YAML_Config( char *yaml_file )
     /* Sanity checks here */
     /**********************/
 
-    /* Check rules for duplicate sid.  We can't have that! */
-
-    for (a = 0; a < counters->rulecount; a++)
-        {
-
-            for ( check = a+1; check < counters->rulecount; check++)
-                {
-
-                    if (!strcmp (rulestruct[check].s_sid, rulestruct[a].s_sid ))
-                        {
-                            Sagan_Log(ERROR, "[%s, line %d] Detected duplicate signature id [sid] number %s.  Please correct this.", __FILE__, __LINE__, rulestruct[check].s_sid, rulestruct[a].s_sid);
-                        }
-                }
-        }
-
-
     if ( config->sagan_is_file == false && config->sagan_fifo[0] == '\0' )
         {
             Sagan_Log(ERROR, "[%s, line %d] No FIFO option found which is required! Aborting!", __FILE__, __LINE__);
@@ -2441,8 +3003,14 @@ void Load_YAML_Config( char *yaml_file )
                     Sagan_Log(ERROR, "[%s, line %d] GeoIP2 is enabled, but the $HOME_COUNTRY variable is not set. . Abort!", __FILE__, __LINE__);
                 }
 
-            Sagan_Log(NORMAL, "Loading GeoIP2 database. [%s]", config->geoip2_country_file);
-            Open_GeoIP2_Database();
+            /* On reload (SIGHUP) the intel loader thread swaps the new
+             * database in once workers are running again */
+
+            if ( config->sagan_reload == false )
+                {
+                    Sagan_Log(NORMAL, "Loading GeoIP2 database. [%s]", config->geoip2_country_file);
+                    Open_GeoIP2_Database();
+                }
 
         }
 
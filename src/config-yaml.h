@@ -79,6 +79,6 @@
 #define		YAML_OUTPUT_ALERT		19
 #define		YAML_OUTPUT_EVE			20
 
-void Load_YAML_Config( char * );
+void Load_YAML_Config( struct _SaganConfig *, char * );
 
 #endif
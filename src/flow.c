@@ -35,8 +35,6 @@
 #include "rules.h"
 #include "sagan-config.h"
 
-struct _Rule_Struct *rulestruct;
-
 /********************/ /************************/ /*****************/
 /***** flow_type ****/ /******* flow_var *******/ /*** direction ***/
 /* 0 = not in group */ /**      0 = any       **/ /**   0 = any   **/
@@ -84,7 +82,6 @@ sbool Check_Flow( int b, int ip_proto, unsigned char *ip_src_bits, int normalize
 
     /*flow 1*/
 
-    int w=0;
     int a1=0;
     int eq1=0;
     int ne1=0;
@@ -95,7 +92,6 @@ sbool Check_Flow( int b, int ip_proto, unsigned char *ip_src_bits, int normalize
     /*port 1*/
 
     int b1=0;
-    int u=0;
     int eq3=0;
     int ne3=0;
     int eq3_val=0;
@@ -105,7 +101,6 @@ sbool Check_Flow( int b, int ip_proto, unsigned char *ip_src_bits, int normalize
 
     /*flow 2*/
 
-    int z=0;
     int a2=0;
     int eq2=0;
     int ne2=0;
@@ -116,7 +111,6 @@ sbool Check_Flow( int b, int ip_proto, unsigned char *ip_src_bits, int normalize
     /*port 2*/
 
     int b2=0;
-    int v=0;
     int eq4=0;
     int ne4=0;
     int eq4_val=0;
@@ -151,8 +145,7 @@ sbool Check_Flow( int b, int ip_proto, unsigned char *ip_src_bits, int normalize
         {
             for(i=0; i < rulestruct[b].flow_1_counter; i++)
                 {
-                    w++;
-                    f1 = rulestruct[b].flow_1_type[w];
+                    f1 = rulestruct[b].flow_1[i].type;
 
                     if(f1 == 0)
                         {
@@ -247,8 +240,7 @@ sbool Check_Flow( int b, int ip_proto, unsigned char *ip_src_bits, int normalize
         {
             for(i=0; i < rulestruct[b].port_1_counter; i++)
                 {
-                    u++;
-                    g1 = rulestruct[b].port_1_type[u];
+                    g1 = rulestruct[b].port_1[i].type;
 
                     if(g1 == 0)
                         {
@@ -330,8 +322,7 @@ sbool Check_Flow( int b, int ip_proto, unsigned char *ip_src_bits, int normalize
         {
             for(i=0; i < rulestruct[b].flow_2_counter; i++)
                 {
-                    z++;
-                    f2 = rulestruct[b].flow_2_type[z];
+                    f2 = rulestruct[b].flow_2[i].type;
 
                     if(f2 == 0)
                         {
@@ -417,8 +408,7 @@ sbool Check_Flow( int b, int ip_proto, unsigned char *ip_src_bits, int normalize
         {
             for(i=0; i < rulestruct[b].port_2_counter; i++)
                 {
-                    v++;
-                    g2 = rulestruct[b].port_2_type[v];
+                    g2 = rulestruct[b].port_2[i].type;
 
                     if(g2 == 0)
                         {
@@ -32,10 +32,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <pcre.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "gen-msg.h"
+#include "rules.h"
 
 struct _SaganCounters *counters;
 struct _Sagan_Processor_Generator *generator;
@@ -44,6 +46,29 @@ struct _SaganDebug *debug;
 
 pthread_mutex_t CounterGenMapMutex=PTHREAD_MUTEX_INITIALIZER;
 
+/****************************************************************************
+ * Generator_Compare - qsort()/bsearch() order for the gen-msg map
+ ****************************************************************************/
+
+static int Generator_Compare( const void *a, const void *b )
+{
+
+    const _Sagan_Processor_Generator *x = a;
+    const _Sagan_Processor_Generator *y = b;
+
+    if ( x->generatorid != y->generatorid )
+        {
+            return( x->generatorid < y->generatorid ? -1 : 1 );
+        }
+
+    if ( x->alertid != y->alertid )
+        {
+            return( x->alertid < y->alertid ? -1 : 1 );
+        }
+
+    return(0);
+}
+
 
 void Load_Gen_Map( const char *genmap )
 {
@@ -125,30 +150,35 @@ void Load_Gen_Map( const char *genmap )
         }
 
     fclose(genmapfile);
+
+    /* Sorted,  so Generator_Lookup() doesn't walk the whole map */
+
+    qsort(generator, counters->genmapcount, sizeof(_Sagan_Processor_Generator), Generator_Compare);
+
     Sagan_Log(NORMAL, "%d generators loaded.", counters->genmapcount);
 }
 
 
-/****************************************************************************/
-/* Sagan_Generator_Lookup - Looks up the "generator" ID (see the            */
-/* "gen-msg.map") of a processor                                            */
-/****************************************************************************/
+/****************************************************************************
+ * Generator_Lookup - Returns the message for a processor's "generator" and
+ * alert ID (see the "gen-msg.map"),  or NULL if there isn't one
+ ****************************************************************************/
 
-void Generator_Lookup(int processor_id, int alert_id, char *str, size_t size)
+const char *Generator_Lookup( int processor_id, int alert_id )
 {
 
-    int z=0;
-    char *msg=NULL;
+    _Sagan_Processor_Generator key;
+    _Sagan_Processor_Generator *gen = NULL;
 
-    for (z=0; z<counters->genmapcount; z++)
+    if ( rules_active->generator_count == 0 )
         {
-            if ( generator[z].generatorid == processor_id && generator[z].alertid == alert_id)
-                {
-                    msg=generator[z].generator_msg;
-                    break;
-                }
+            return(NULL);
         }
 
-    snprintf(str, size, "%s", msg);
-}
+    key.generatorid = processor_id;
+    key.alertid = alert_id;
 
+    gen = bsearch(&key, rules_active->generators, rules_active->generator_count, sizeof(_Sagan_Processor_Generator), Generator_Compare);
+
+    return( gen != NULL ? gen->generator_msg : NULL );
+}
@@ -34,4 +34,4 @@ struct _Sagan_Processor_Generator
 
 
 void Load_Gen_Map( const char * );
-void Generator_Lookup( int, int, char *str, size_t size );
+const char *Generator_Lookup( int, int );
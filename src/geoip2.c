@@ -37,7 +37,11 @@
 #ifdef HAVE_LIBMAXMINDDB
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <maxminddb.h>
 #include <pthread.h>
 #include <errno.h>
@@ -48,19 +52,35 @@
 #include "rules.h"
 #include "geoip2.h"
 #include "sagan-config.h"
+#include "util-hash.h"
+#include "util-rcu.h"
 
 struct _SaganConfig *config;
-struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganCounters *counters;
 
 pthread_mutex_t CountGeoIP2MissMutex=PTHREAD_MUTEX_INITIALIZER;
 
+uint32_t geoip2_generation = 0;		/* Bumped each time the database is opened */
+
+static void GeoIP2_Database_Free( void *ptr )
+{
+
+    MMDB_s *mmdb = (MMDB_s *)ptr;
+
+    MMDB_close(mmdb);
+    free(mmdb);
+
+}
+
 void Open_GeoIP2_Database( void )
 {
 
     int status;
 
+    MMDB_s *mmdb = NULL;
+    MMDB_s *old = NULL;
+
     /*
      * The GeoIP library gives a really vague error when it cannot load
      * the GeoIP database.  We give the user more information here so
@@ -77,47 +97,220 @@ void Open_GeoIP2_Database( void )
             Sagan_Log(ERROR, "Sagan is NOT loading the GeoIP database data! Abort!");
         }
 
-    status = MMDB_open(config->geoip2_country_file, MMDB_MODE_MMAP, &config->geoip2);
+    mmdb = malloc(sizeof(MMDB_s));
+
+    if ( mmdb == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for GeoIP2 database. Abort!", __FILE__, __LINE__);
+        }
+
+    status = MMDB_open(config->geoip2_country_file, MMDB_MODE_MMAP, mmdb);
 
     if ( status != 0 )
         {
             Sagan_Log(ERROR, "Error loading Maxmind GeoIP2 data (%s).  Are you trying to load an older, non-GeoIP2 database?", config->geoip2_country_file);
         }
 
+    /* Workers keep using the old handle until the swap.  It is closed once
+     * none of them can still be in MMDB_lookup_sockaddr() with it */
+
+    old = config->geoip2;
+
+    Sagan_RCU_Assign(config->geoip2, mmdb);
+    Sagan_RCU_Retire(old, GeoIP2_Database_Free);
+
+    /* Per thread caches hold results from the old database */
+
+    __atomic_add_fetch(&geoip2_generation, 1, __ATOMIC_RELEASE);
+
 }
 
 /*****************************************************************************
- * GeoIP2_Lookup_Country - Looks up the country and determines if
- * it is in/out of HOME_COUNTRY
+ * GeoIP2_Country_Index - Maps a two letter ISO country code to its bit in
+ * a country set.  Returns -1 if it isn't two upper case letters.
  ****************************************************************************/
 
-int GeoIP2_Lookup_Country( char *ipaddr, unsigned char *ip_bits, int rule_position )
+int GeoIP2_Country_Index( const char *code )
 {
 
+    if ( code[0] < 'A' || code[0] > 'Z' || code[1] < 'A' || code[1] > 'Z' || code[2] != '\0' )
+        {
+            return(-1);
+        }
 
-    int gai_error;
-    int mmdb_error;
-    int res;
+    return( ( code[0] - 'A' ) * 26 + ( code[1] - 'A' ) );
+}
 
+/*****************************************************************************
+ * GeoIP2_Country_Set - Compiles a rule's comma separated country codes
+ * into "set".  Returns false if any code could not be used.
+ ****************************************************************************/
+
+sbool GeoIP2_Country_Set( uint64_t *set, const char *codes )
+{
+
+    char tmp[256] = { 0 };
     char *ptmp = NULL;
     char *tok = NULL;
 
-    char country[2];
-    char tmp[1024];
+    int index = 0;
+    sbool ret = true;
 
-    if ( is_notroutable(ip_bits) )
+    memset(set, 0, GEOIP2_COUNTRY_WORDS * sizeof(uint64_t));
+    strlcpy(tmp, codes, sizeof(tmp));
+
+    ptmp = strtok_r(tmp, ",", &tok);
+
+    while ( ptmp != NULL )
         {
-            if (debug->debuggeoip2)
+
+            index = GeoIP2_Country_Index(ptmp);
+
+            if ( index == -1 )
                 {
-                    Sagan_Log(DEBUG, "[%s, line %d] IP address %s is not routable. Skipping GeoIP2 lookup.", __FILE__, __LINE__, ipaddr);
+                    ret = false;
+                }
+            else
+                {
+                    set[index / 64] |= (uint64_t)1 << ( index % 64 );
                 }
 
-            return(false);
+            ptmp = strtok_r(NULL, ",", &tok);
         }
 
-    MMDB_lookup_result_s result = MMDB_lookup_string(&config->geoip2, ipaddr, &gai_error, &mmdb_error);
+    return(ret);
+}
+
+/*****************************************************************************
+ * GeoIP2_Cache_Hash - Bucket for an address in the per thread cache
+ ****************************************************************************/
+
+static inline uint32_t GeoIP2_Cache_Hash( const unsigned char *ip_bits, unsigned char family )
+{
+    return( Hash_FNV1a_Step( Hash_FNV1a(ip_bits, MAXIPBIT), family ) & ( GEOIP2_CACHE_BUCKETS - 1 ) );
+}
+
+/*****************************************************************************
+ * GeoIP2_Cache_Unlink - Removes an entry from the LRU list
+ ****************************************************************************/
+
+static void GeoIP2_Cache_Unlink( _GeoIP2_Cache *cache, uint16_t index )
+{
+
+    _GeoIP2_Cache_Entry *entry = &cache->entries[index];
+
+    if ( entry->prev != 0 )
+        {
+            cache->entries[entry->prev - 1].next = entry->next;
+        }
+    else
+        {
+            cache->head = entry->next;
+        }
+
+    if ( entry->next != 0 )
+        {
+            cache->entries[entry->next - 1].prev = entry->prev;
+        }
+    else
+        {
+            cache->tail = entry->prev;
+        }
+
+    entry->prev = 0;
+    entry->next = 0;
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Cache_Push - Makes an entry the most recently used
+ ****************************************************************************/
+
+static void GeoIP2_Cache_Push( _GeoIP2_Cache *cache, uint16_t index )
+{
+
+    _GeoIP2_Cache_Entry *entry = &cache->entries[index];
+
+    entry->prev = 0;
+    entry->next = cache->head;
+
+    if ( cache->head != 0 )
+        {
+            cache->entries[cache->head - 1].prev = index + 1;
+        }
+
+    cache->head = index + 1;
+
+    if ( cache->tail == 0 )
+        {
+            cache->tail = index + 1;
+        }
+
+}
+
+/*****************************************************************************
+ * GeoIP2_Database_Country - Looks an address up in the Maxmind database.
+ * The caller already has the address bits,  so we hand Maxmind a sockaddr
+ * rather than have it parse the string again.
+ ****************************************************************************/
+
+static int16_t GeoIP2_Database_Country( char *ipaddr, unsigned char *ip_bits, unsigned char family )
+{
+
+    struct sockaddr_in sin;
+    struct sockaddr_in6 sin6;
+    struct sockaddr *sa = NULL;
+
+    MMDB_s *mmdb = Sagan_RCU_Dereference(config->geoip2);
+    MMDB_lookup_result_s result;
     MMDB_entry_data_s entry_data;
 
+    char country[3] = { 0 };
+
+    int mmdb_error = 0;
+    int res = 0;
+
+    if ( mmdb == NULL )
+        {
+            return(-1);
+        }
+
+    if ( family == AF_INET6 )
+        {
+            memset(&sin6, 0, sizeof(sin6));
+            sin6.sin6_family = AF_INET6;
+            memcpy(&sin6.sin6_addr, ip_bits, sizeof(sin6.sin6_addr));
+            sa = (struct sockaddr *)&sin6;
+        }
+    else
+        {
+            memset(&sin, 0, sizeof(sin));
+            sin.sin_family = AF_INET;
+            memcpy(&sin.sin_addr, ip_bits, sizeof(sin.sin_addr));
+            sa = (struct sockaddr *)&sin;
+        }
+
+    pthread_mutex_lock(&CountGeoIP2MissMutex);
+    counters->geoip2_lookup++;
+    pthread_mutex_unlock(&CountGeoIP2MissMutex);
+
+    result = MMDB_lookup_sockaddr(mmdb, sa, &mmdb_error);
+
+    if ( mmdb_error != MMDB_SUCCESS || !result.found_entry )
+        {
+
+            pthread_mutex_lock(&CountGeoIP2MissMutex);
+            counters->geoip2_miss++;
+            pthread_mutex_unlock(&CountGeoIP2MissMutex);
+
+            if ( debug->debuggeoip2 )
+                {
+                    Sagan_Log(DEBUG, "%s not found in GeoIP2 DB (%s)", ipaddr, MMDB_strerror(mmdb_error));
+                }
+
+            return(-1);
+        }
+
     res = MMDB_get_value(&result.entry, &entry_data, "country", "iso_code", NULL);
 
     if (res != MMDB_SUCCESS)
@@ -127,11 +320,11 @@ int GeoIP2_Lookup_Country( char *ipaddr, unsigned char *ip_bits, int rule_positi
             pthread_mutex_unlock(&CountGeoIP2MissMutex);
 
             Sagan_Log(WARN, "Country code MMDB_get_value failure (%s) for %s.", MMDB_strerror(res), ipaddr);
-            return(false);
+            return(-1);
 
         }
 
-    if (!entry_data.has_data || entry_data.type != MMDB_DATA_TYPE_UTF8_STRING)
+    if (!entry_data.has_data || entry_data.type != MMDB_DATA_TYPE_UTF8_STRING || entry_data.data_size != 2 )
         {
 
             pthread_mutex_lock(&CountGeoIP2MissMutex);
@@ -142,40 +335,148 @@ int GeoIP2_Lookup_Country( char *ipaddr, unsigned char *ip_bits, int rule_positi
                 {
                     Sagan_Log(DEBUG, "Country code for %s not found in GeoIP2 DB", ipaddr);
                 }
-            return(false);
+            return(-1);
         }
 
-    strlcpy(country, entry_data.utf8_string, 3);
-    strlcpy(tmp, rulestruct[rule_position].geoip2_country_codes, sizeof(tmp));
+    /* utf8_string is not NUL terminated */
+
+    memcpy(country, entry_data.utf8_string, 2);
 
-    if (debug->debuggeoip2)
+    if ( debug->debuggeoip2 )
         {
             Sagan_Log(DEBUG, "GeoIP Lookup IP  : %s", ipaddr);
-            Sagan_Log(DEBUG, "Country Codes    : |%s|", rulestruct[rule_position].geoip2_country_codes);
             Sagan_Log(DEBUG, "Found in GeoIP DB: %s", country);
         }
 
+    return( GeoIP2_Country_Index(country) );
+}
 
-    ptmp = strtok_r(tmp, ",", &tok);
+/*****************************************************************************
+ * GeoIP2_Country - Returns the country index for an address,  from this
+ * thread's LRU when we can.  Every GeoIP2 rule an event hits shares the
+ * one database lookup.
+ ****************************************************************************/
+
+static int16_t GeoIP2_Country( char *ipaddr, unsigned char *ip_bits )
+{
+
+    static __thread _GeoIP2_Cache *cache = NULL;
 
-    while (ptmp != NULL )
+    _GeoIP2_Cache_Entry *entry = NULL;
+    uint16_t *link = NULL;
+
+    unsigned char family = strchr(ipaddr, ':') != NULL ? AF_INET6 : AF_INET;
+    uint32_t bucket = GeoIP2_Cache_Hash(ip_bits, family);
+    uint16_t index = 0;
+
+    if ( cache == NULL )
         {
-            if (debug->debuggeoip2)
+
+            cache = malloc(sizeof(_GeoIP2_Cache));
+
+            if ( cache == NULL )
                 {
-                    Sagan_Log(DEBUG, "GeoIP2 rule string parsing %s|%s", ptmp, country);
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for GeoIP2 cache. Abort!", __FILE__, __LINE__);
                 }
 
-            if (!strcmp(ptmp, country))
+            memset(cache, 0, sizeof(_GeoIP2_Cache));
+            cache->generation = geoip2_generation;
+        }
+
+    /* The database was reloaded,  forget everything */
+
+    if ( cache->generation != geoip2_generation )
+        {
+            memset(cache, 0, sizeof(_GeoIP2_Cache));
+            cache->generation = geoip2_generation;
+        }
+
+    for ( index = cache->buckets[bucket]; index != 0; index = cache->entries[index - 1].chain )
+        {
+
+            entry = &cache->entries[index - 1];
+
+            if ( entry->family == family && !memcmp(entry->ip, ip_bits, MAXIPBIT) )
                 {
-                    if (debug->debuggeoip2)
+
+                    if ( cache->head != index )
                         {
-                            Sagan_Log(DEBUG, "GeoIP Status: Found in user defined values [%s].", country);
+                            GeoIP2_Cache_Unlink(cache, index - 1);
+                            GeoIP2_Cache_Push(cache, index - 1);
                         }
 
-                    return(true);  /* GeoIP was found / there was a hit */
+                    return(entry->country);
                 }
+        }
 
-            ptmp = strtok_r(NULL, ",", &tok);
+    /* Not cached.  Take a free entry or recycle the least recently used */
+
+    if ( cache->count < GEOIP2_CACHE_SIZE )
+        {
+            index = cache->count++;
+        }
+    else
+        {
+
+            index = cache->tail - 1;
+            entry = &cache->entries[index];
+
+            GeoIP2_Cache_Unlink(cache, index);
+
+            for ( link = &cache->buckets[GeoIP2_Cache_Hash(entry->ip, entry->family)]; *link != index + 1; link = &cache->entries[*link - 1].chain );
+
+            *link = entry->chain;
+        }
+
+    entry = &cache->entries[index];
+
+    memcpy(entry->ip, ip_bits, MAXIPBIT);
+    entry->family = family;
+    entry->country = GeoIP2_Database_Country(ipaddr, ip_bits, family);
+
+    entry->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = index + 1;
+
+    GeoIP2_Cache_Push(cache, index);
+
+    return(entry->country);
+}
+
+/*****************************************************************************
+ * GeoIP2_Lookup_Country - Looks up the country and determines if
+ * it is in/out of HOME_COUNTRY
+ ****************************************************************************/
+
+int GeoIP2_Lookup_Country( char *ipaddr, unsigned char *ip_bits, int rule_position )
+{
+
+    int16_t country = 0;
+
+    if ( is_notroutable(ip_bits) )
+        {
+            if (debug->debuggeoip2)
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] IP address %s is not routable. Skipping GeoIP2 lookup.", __FILE__, __LINE__, ipaddr);
+                }
+
+            return(false);
+        }
+
+    country = GeoIP2_Country(ipaddr, ip_bits);
+
+    if ( country == -1 )
+        {
+            return(false);
+        }
+
+    if ( rulestruct[rule_position].geoip2_country_set[country / 64] & ( (uint64_t)1 << ( country % 64 ) ) )
+        {
+            if (debug->debuggeoip2)
+                {
+                    Sagan_Log(DEBUG, "GeoIP Status: %s found in user defined values [%s].", ipaddr, rulestruct[rule_position].geoip2_country_codes);
+                }
+
+            return(true);  /* GeoIP was found / there was a hit */
         }
 
     if (debug->debuggeoip2) Sagan_Log(DEBUG, "GeoIP Status: Not found in user defined values.");
@@ -184,4 +485,3 @@ int GeoIP2_Lookup_Country( char *ipaddr, unsigned char *ip_bits, int rule_positi
 }
 
 #endif
-
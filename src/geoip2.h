@@ -28,8 +28,38 @@
 #endif
 
 #ifdef HAVE_LIBMAXMINDDB
+
+#include <stdint.h>
+
 void Open_GeoIP2_Database( void );
 int GeoIP2_Lookup_Country( char *, unsigned char *ip_bits, int );
+int GeoIP2_Country_Index( const char * );
+sbool GeoIP2_Country_Set( uint64_t *, const char * );
+
+/* Per thread cache of ip -> country.  Indexes are "index + 1",  0 == none */
+
+typedef struct _GeoIP2_Cache_Entry _GeoIP2_Cache_Entry;
+struct _GeoIP2_Cache_Entry
+{
+    unsigned char ip[MAXIPBIT];
+    unsigned char family;
+    int16_t country;		/* GeoIP2_Country_Index() or -1 if unknown */
+    uint16_t prev;		/* LRU list,  "head" is most recent */
+    uint16_t next;
+    uint16_t chain;		/* Next entry in the same bucket */
+};
+
+typedef struct _GeoIP2_Cache _GeoIP2_Cache;
+struct _GeoIP2_Cache
+{
+    _GeoIP2_Cache_Entry entries[GEOIP2_CACHE_SIZE];
+    uint16_t buckets[GEOIP2_CACHE_BUCKETS];
+    uint16_t head;
+    uint16_t tail;
+    uint16_t count;
+    uint32_t generation;	/* Flushed when the database is reloaded */
+};
+
 #endif
 
 
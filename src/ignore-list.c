@@ -54,6 +54,9 @@ void Load_Ignore_List ( void )
 
     char droplistbuf[1024] = { 0 };
 
+    pthread_mutex_lock(&CountDropListMutex);
+    counters->droplist_count = 0;
+    pthread_mutex_unlock(&CountDropListMutex);
 
     if ( config->sagan_droplist_flag )
         {
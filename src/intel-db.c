@@ -0,0 +1,296 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+
+/* intel-db.c
+ *
+ * Reads and writes precompiled intel images.  Parsing large blacklist and
+ * Bro Intel feeds (and building their tries,  hash indexes and automatons)
+ * is slow,  so "saganintel" does it once,  offline.  The result is written
+ * as one file that Sagan mmap()'s read only.  Every structure in the image
+ * refers to other entries by index,  never by pointer,  so the processors
+ * use it in place.  Loading is a single validation pass (nothing is parsed
+ * or copied) and every Sagan process on a host shares the same page cache
+ * copy.
+ *
+ * Intel_DB_Open() only checks the header and that every section lies
+ * within the file.  The indexes inside a section (trie children,  hash
+ * slots,  automaton edges) mean nothing here,  so each processor checks
+ * its own sections once when it maps them.  Lookups trust them after that.
+ *
+ * Layout: a fixed size header holding a table of sections,  followed by
+ * the sections themselves,  each aligned to INTEL_DB_ALIGN bytes.  The
+ * image is written to a temporary file and rename()'ed into place,  so a
+ * running Sagan never maps a half written image.  Images are only valid
+ * for the build (structure sizes) and byte order that wrote them.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "util-time.h"
+#include "intel-db.h"
+
+/****************************************************************************
+ * Intel_DB_Open - Maps and validates an image.  Errors are fatal,  just
+ * like an unreadable blacklist or Bro Intel file.
+ ****************************************************************************/
+
+_Sagan_Intel_DB *Intel_DB_Open( const char *path )
+{
+
+    _Sagan_Intel_DB *db = NULL;
+    const _Sagan_Intel_DB_Header *header = NULL;
+
+    struct stat st;
+    void *base = NULL;
+    int fd = 0;
+    uint32_t i;
+
+    if (( fd = open(path, O_RDONLY)) == -1 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Could not open intel database %s (%s)", __FILE__, __LINE__, path, strerror(errno));
+        }
+
+    if ( fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(_Sagan_Intel_DB_Header) )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Intel database %s is truncated. Abort!", __FILE__, __LINE__, path);
+        }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);		/* The mapping keeps the file */
+
+    if ( base == MAP_FAILED )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Could not mmap() intel database %s (%s)", __FILE__, __LINE__, path, strerror(errno));
+        }
+
+    header = (const _Sagan_Intel_DB_Header *)base;
+
+    if ( memcmp(header->magic, INTEL_DB_MAGIC, sizeof(header->magic)) )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] %s is not a Sagan intel database. Abort!", __FILE__, __LINE__, path);
+        }
+
+    if ( header->version != INTEL_DB_VERSION || header->byte_order != INTEL_DB_BYTE_ORDER )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Intel database %s was built for a different version/architecture. Rebuild it with saganintel. Abort!", __FILE__, __LINE__, path);
+        }
+
+    if ( header->size != (uint64_t)st.st_size || header->section_count > INTEL_DB_MAX_SECTIONS )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Intel database %s is corrupt. Abort!", __FILE__, __LINE__, path);
+        }
+
+    for ( i = 0; i < header->section_count; i++ )
+        {
+
+            if ( header->sections[i].offset < sizeof(_Sagan_Intel_DB_Header) ||
+                    header->sections[i].offset % INTEL_DB_ALIGN != 0 ||
+                    header->sections[i].offset > header->size ||
+                    header->sections[i].count > ( header->size - header->sections[i].offset ) / ( header->sections[i].elem_size ? header->sections[i].elem_size : 1 ) )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt section (type %" PRIu32 "). Abort!", __FILE__, __LINE__, path, header->sections[i].type);
+                }
+        }
+
+    db = malloc(sizeof(_Sagan_Intel_DB));
+
+    if ( db == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for intel database. Abort!", __FILE__, __LINE__);
+        }
+
+    db->base = base;
+    db->size = st.st_size;
+    db->header = header;
+
+    return(db);
+}
+
+/****************************************************************************
+ * Intel_DB_Close - Unmaps an image
+ ****************************************************************************/
+
+void Intel_DB_Close( _Sagan_Intel_DB *db )
+{
+
+    munmap((void *)db->base, db->size);
+    free(db);
+
+}
+
+/****************************************************************************
+ * Intel_DB_Section - Returns a pointer to a section's first element.  A
+ * missing section is empty (NULL,  count 0).  "elem_size" catches images
+ * built with different structure layouts.
+ ****************************************************************************/
+
+const void *Intel_DB_Section( _Sagan_Intel_DB *db, uint32_t type, uint32_t elem_size, uint64_t *count, uint64_t *aux )
+{
+
+    const _Sagan_Intel_DB_Section *section = NULL;
+    uint32_t i;
+
+    *count = 0;
+
+    if ( aux != NULL )
+        {
+            *aux = 0;
+        }
+
+    for ( i = 0; i < db->header->section_count; i++ )
+        {
+
+            section = &db->header->sections[i];
+
+            if ( section->type != type )
+                {
+                    continue;
+                }
+
+            if ( section->elem_size != elem_size )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Intel database section %" PRIu32 " doesn't match this build of Sagan. Rebuild it with saganintel. Abort!", __FILE__, __LINE__, type);
+                }
+
+            *count = section->count;
+
+            if ( aux != NULL )
+                {
+                    *aux = section->aux;
+                }
+
+            return( section->count ? db->base + section->offset : NULL );
+        }
+
+    return(NULL);
+}
+
+/****************************************************************************
+ * Intel_DB_Create - Starts writing an image to "path".  Data goes to a
+ * temporary file until Intel_DB_Finish().
+ ****************************************************************************/
+
+void Intel_DB_Create( _Sagan_Intel_DB_Writer *writer, const char *path )
+{
+
+    memset(writer, 0, sizeof(_Sagan_Intel_DB_Writer));
+
+    strlcpy(writer->path, path, sizeof(writer->path));
+    snprintf(writer->tmp_path, sizeof(writer->tmp_path), "%s.tmp", path);
+
+    if (( writer->fd = fopen(writer->tmp_path, "w" )) == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Could not create %s (%s)", __FILE__, __LINE__, writer->tmp_path, strerror(errno));
+        }
+
+    memcpy(writer->header.magic, INTEL_DB_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = INTEL_DB_VERSION;
+    writer->header.byte_order = INTEL_DB_BYTE_ORDER;
+    writer->header.created = Sagan_Clock_Epoch();
+
+    /* The header is written last,  once the section table is known */
+
+    writer->offset = sizeof(_Sagan_Intel_DB_Header);
+
+}
+
+/****************************************************************************
+ * Intel_DB_Add - Appends a section of "count" elements
+ ****************************************************************************/
+
+void Intel_DB_Add( _Sagan_Intel_DB_Writer *writer, uint32_t type, const void *data, uint32_t elem_size, uint64_t count, uint64_t aux )
+{
+
+    static const unsigned char pad[INTEL_DB_ALIGN] = { 0 };
+
+    _Sagan_Intel_DB_Section *section = NULL;
+    uint64_t aligned = 0;
+
+    if ( writer->header.section_count == INTEL_DB_MAX_SECTIONS )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Too many intel database sections. Abort!", __FILE__, __LINE__);
+        }
+
+    aligned = ( writer->offset + INTEL_DB_ALIGN - 1 ) & ~(uint64_t)( INTEL_DB_ALIGN - 1 );
+
+    if ( fseek(writer->fd, writer->offset, SEEK_SET) != 0 ||
+            fwrite(pad, 1, aligned - writer->offset, writer->fd) != aligned - writer->offset ||
+            ( count != 0 && fwrite(data, elem_size, count, writer->fd) != count ) )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Error writing %s (%s)", __FILE__, __LINE__, writer->tmp_path, strerror(errno));
+        }
+
+    section = &writer->header.sections[writer->header.section_count++];
+
+    section->type = type;
+    section->elem_size = elem_size;
+    section->offset = aligned;
+    section->count = count;
+    section->aux = aux;
+
+    writer->offset = aligned + ( elem_size * count );
+
+}
+
+/****************************************************************************
+ * Intel_DB_Finish - Writes the header and moves the image into place
+ ****************************************************************************/
+
+void Intel_DB_Finish( _Sagan_Intel_DB_Writer *writer )
+{
+
+    writer->header.size = writer->offset;
+
+    if ( fseek(writer->fd, 0, SEEK_SET) != 0 ||
+            fwrite(&writer->header, sizeof(_Sagan_Intel_DB_Header), 1, writer->fd) != 1 ||
+            fflush(writer->fd) != 0 ||
+            fsync(fileno(writer->fd)) != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Error writing %s (%s)", __FILE__, __LINE__, writer->tmp_path, strerror(errno));
+        }
+
+    fclose(writer->fd);
+    writer->fd = NULL;
+
+    if ( rename(writer->tmp_path, writer->path) != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Could not rename %s to %s (%s)", __FILE__, __LINE__, writer->tmp_path, writer->path, strerror(errno));
+        }
+
+}
@@ -0,0 +1,99 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+
+/* Precompiled,  memory mapped intel database.  See intel-db.c */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sagan-defs.h"
+
+#define INTEL_DB_MAGIC			"SAGANIDB"
+#define INTEL_DB_VERSION		1
+#define INTEL_DB_BYTE_ORDER		0x01020304
+#define INTEL_DB_MAX_SECTIONS		64
+#define INTEL_DB_ALIGN			64
+
+/* Section types.  Bro Intel sections are "base + indicator type" */
+
+#define INTEL_DB_BLACKLIST_NODES	1
+
+#define INTEL_DB_BROINTEL_ARRAY		100
+#define INTEL_DB_BROINTEL_INDEX		200
+#define INTEL_DB_BROINTEL_FALLBACK	300
+#define INTEL_DB_BROINTEL_AC_NODES	400
+#define INTEL_DB_BROINTEL_AC_EDGES	410
+#define INTEL_DB_BROINTEL_AC_ROOT	420
+
+typedef struct _Sagan_Intel_DB_Section _Sagan_Intel_DB_Section;
+struct _Sagan_Intel_DB_Section
+{
+    uint32_t type;
+    uint32_t elem_size;		/* Must match the reader's sizeof() */
+    uint64_t offset;		/* From the start of the file */
+    uint64_t count;		/* Elements */
+    uint64_t aux;		/* Section specific (ie - entries in a hash index) */
+};
+
+typedef struct _Sagan_Intel_DB_Header _Sagan_Intel_DB_Header;
+struct _Sagan_Intel_DB_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t size;		/* Total file size */
+    uint64_t created;		/* Epoch time the image was compiled */
+    uint32_t section_count;
+    uint32_t pad;
+    _Sagan_Intel_DB_Section sections[INTEL_DB_MAX_SECTIONS];
+};
+
+/* An open (mapped) image */
+
+typedef struct _Sagan_Intel_DB _Sagan_Intel_DB;
+struct _Sagan_Intel_DB
+{
+    const unsigned char *base;
+    size_t size;
+    const _Sagan_Intel_DB_Header *header;
+};
+
+/* An image being written */
+
+typedef struct _Sagan_Intel_DB_Writer _Sagan_Intel_DB_Writer;
+struct _Sagan_Intel_DB_Writer
+{
+    FILE *fd;
+    char path[MAXPATH];
+    char tmp_path[MAXPATH+8];
+    _Sagan_Intel_DB_Header header;
+    uint64_t offset;
+};
+
+_Sagan_Intel_DB *Intel_DB_Open( const char * );
+void Intel_DB_Close( _Sagan_Intel_DB * );
+const void *Intel_DB_Section( _Sagan_Intel_DB *, uint32_t, uint32_t, uint64_t *, uint64_t * );
+
+void Intel_DB_Create( _Sagan_Intel_DB_Writer *, const char * );
+void Intel_DB_Add( _Sagan_Intel_DB_Writer *, uint32_t, const void *, uint32_t, uint64_t, uint64_t );
+void Intel_DB_Finish( _Sagan_Intel_DB_Writer * );
+
@@ -103,20 +103,12 @@ sbool Clean_IPC_Object( int type )
     if ( type == AFTER_BY_SRC && config->max_after_by_src < counters_ipc->after_count_by_src )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
 
             if ( debug->debugipc )
@@ -196,20 +188,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == AFTER_BY_DST && config->max_after_by_dst < counters_ipc->after_count_by_dst )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -287,21 +271,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == AFTER_BY_SRCPORT && config->max_after_by_srcport < counters_ipc->after_count_by_srcport )
         {
 
-
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -374,21 +349,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == AFTER_BY_DSTPORT && config->max_after_by_dstport < counters_ipc->after_count_by_dstport )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -461,20 +427,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == AFTER_BY_USERNAME && config->max_after_by_username < counters_ipc->after_count_by_username )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -547,20 +505,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == THRESH_BY_SRC && config->max_threshold_by_src < counters_ipc->thresh_count_by_src )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -637,20 +587,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == THRESH_BY_SRC && config->max_threshold_by_dst < counters_ipc->thresh_count_by_dst )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -727,20 +669,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == THRESH_BY_SRCPORT && config->max_threshold_by_srcport < counters_ipc->thresh_count_by_srcport )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -813,20 +747,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == THRESH_BY_DSTPORT && config->max_threshold_by_dstport < counters_ipc->thresh_count_by_dstport )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -899,20 +825,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == THRESH_BY_USERNAME && config->max_threshold_by_username < counters_ipc->thresh_count_by_username )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -985,20 +903,12 @@ sbool Clean_IPC_Object( int type )
     else if ( type == XBIT && config->max_xbits < counters_ipc->xbit_count && config->xbit_storage == XBIT_STORAGE_MMAP )
         {
 
-            time_t t;
-            struct tm *now;
-
             int i;
             int utime = 0;
             int new_count = 0;
             int old_count = 0;
 
-            char timet[20];
-
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(timet, sizeof(timet), "%s",  now);
-            utime = atol(timet);
+            utime = Sagan_Clock_Epoch();
 
             new_count = 0;
             old_count = 0;
@@ -33,10 +33,12 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 
 #include "sagan.h"
+#include "classifications.h"
 #include "references.h"
 #include "util-base64.h"
 #include "util-time.h"
@@ -47,17 +49,198 @@ struct _SaganConfig *config;
 struct _SaganDebug *debug;
 
 /*****************************************************************************
- * Format_JSON_Alert_EVE - Sends only alerts out to eve file in JSON
+ * JSON_Buffer_Reserve - Makes room for "need" more bytes
  *****************************************************************************/
 
-void Format_JSON_Alert_EVE( _Sagan_Event *Event, char *str, size_t size )
+void JSON_Buffer_Reserve( _Sagan_JSON_Buffer *buf, size_t need )
+{
+
+    size_t size = buf->size == 0 ? 4096 : buf->size;
+
+    if ( buf->len + need + 1 <= buf->size )
+        {
+            return;
+        }
+
+    while ( size < buf->len + need + 1 )
+        {
+            size *= 2;
+        }
+
+    buf->data = realloc(buf->data, size);
+
+    if ( buf->data == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for JSON buffer. Abort!", __FILE__, __LINE__);
+        }
+
+    buf->size = size;
+}
+
+/*****************************************************************************
+ * JSON_Buffer_Raw - Appends "len" bytes as is
+ *****************************************************************************/
+
+void JSON_Buffer_Raw( _Sagan_JSON_Buffer *buf, const char *str, size_t len )
+{
+
+    JSON_Buffer_Reserve(buf, len);
+
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+
+}
+
+/*****************************************************************************
+ * JSON_Buffer_Str - Appends a C string as is
+ *****************************************************************************/
+
+void JSON_Buffer_Str( _Sagan_JSON_Buffer *buf, const char *str )
+{
+
+    if ( str != NULL )
+        {
+            JSON_Buffer_Raw(buf, str, strlen(str));
+        }
+
+}
+
+/*****************************************************************************
+ * JSON_Buffer_Escape - Appends "str" escaped for use inside a JSON string
+ * (the quotes are not added).  Escapes the same characters json-c does;
+ * "slash" also escapes '/' like json-c's default output.
+ *****************************************************************************/
+
+void JSON_Buffer_Escape( _Sagan_JSON_Buffer *buf, const char *str, sbool slash )
+{
+
+    static const char hex[] = "0123456789abcdef";
+
+    const unsigned char *p = (const unsigned char *)str;
+    const unsigned char *start = p;
+
+    char *out = NULL;
+
+    if ( str == NULL )
+        {
+            return;
+        }
+
+    /* Worst case every byte becomes \u00XX */
+
+    JSON_Buffer_Reserve(buf, strlen(str) * 6);
+
+    out = buf->data + buf->len;
+
+    for ( ; *p != '\0'; p++ )
+        {
+
+            if ( *p >= ' ' && *p != '"' && *p != '\\' && ( *p != '/' || slash == false ) )
+                {
+                    continue;
+                }
+
+            memcpy(out, start, p - start);
+            out += p - start;
+            start = p + 1;
+
+            *out++ = '\\';
+
+            switch ( *p )
+                {
+
+                case '\b':
+                    *out++ = 'b';
+                    break;
+
+                case '\n':
+                    *out++ = 'n';
+                    break;
+
+                case '\r':
+                    *out++ = 'r';
+                    break;
+
+                case '\t':
+                    *out++ = 't';
+                    break;
+
+                case '\f':
+                    *out++ = 'f';
+                    break;
+
+                case '"':
+                case '\\':
+                case '/':
+                    *out++ = *p;
+                    break;
+
+                default:
+                    *out++ = 'u';
+                    *out++ = '0';
+                    *out++ = '0';
+                    *out++ = hex[*p >> 4];
+                    *out++ = hex[*p & 0xf];
+                    break;
+                }
+        }
+
+    memcpy(out, start, p - start);
+    out += p - start;
+
+    buf->len = out - buf->data;
+    buf->data[buf->len] = '\0';
+
+}
+
+/*****************************************************************************
+ * JSON_Buffer_Free - Releases the buffer memory
+ *****************************************************************************/
+
+void JSON_Buffer_Free( _Sagan_JSON_Buffer *buf )
+{
+
+    free(buf->data);
+
+    buf->data = NULL;
+    buf->len = 0;
+    buf->size = 0;
+
+}
+
+/*****************************************************************************
+ * JSON_Buffer_Field - Appends a string member.  "sep" is everything before
+ * the value's opening quote.
+ *****************************************************************************/
+
+static void JSON_Buffer_Field( _Sagan_JSON_Buffer *buf, const char *sep, const char *value, sbool slash )
+{
+
+    JSON_Buffer_Str(buf, sep);
+    JSON_Buffer_Escape(buf, value, slash);
+    JSON_Buffer_Raw(buf, "\"", 1);
+
+}
+
+/*****************************************************************************
+ * Format_JSON_Alert_EVE - Serializes an alert for the eve file.  The
+ * field order is the Suricata EVE alert layout.
+ *****************************************************************************/
+
+void Format_JSON_Alert_EVE( _Sagan_Event *Event, _Sagan_JSON_Buffer *buf )
 {
 
     char *proto = NULL;
     char *drop = NULL;
 
     char timebuf[64];
-    char classbuf[64];
+    const char *classbuf = NULL;
+    char tmp[128];
+
+    size_t start = buf->len;
+    size_t msg_len = strlen(Event->message);
+    unsigned long b64_len = 0;
 
     if ( Event->ip_proto == 17 )
         {
@@ -74,7 +257,7 @@ void Format_JSON_Alert_EVE( _Sagan_Event *Event, char *str, size_t size )
             proto = "ICMP";
         }
 
-    else if ( Event->ip_proto != 1 || Event->ip_proto != 6 || Event->ip_proto != 17 )
+    else
         {
             proto = "UNKNOWN";
         }
@@ -91,85 +274,111 @@ void Format_JSON_Alert_EVE( _Sagan_Event *Event, char *str, size_t size )
         }
 
     CreateIsoTimeString(&Event->event_time, timebuf, sizeof(timebuf));
+    classbuf = Classtype_Lookup( Event->class_id );
+
+    JSON_Buffer_Field(buf, "{\"timestamp\":\"", timebuf, false);
+
+    snprintf(tmp, sizeof(tmp), ",\"flow_id\":%" PRIu64 "", (uint64_t)FlowGetId(Event->event_time));
+    JSON_Buffer_Str(buf, tmp);
+
+    JSON_Buffer_Field(buf, ",\"in_iface\":\"", config->eve_interface, false);
+    JSON_Buffer_Field(buf, ",\"event_type\":\"alert\",\"src_ip\":\"", Event->ip_src, false);
 
-    unsigned long b64_len = strlen(Event->message) * 2;
-    uint8_t b64_target[b64_len];
+    snprintf(tmp, sizeof(tmp), ",\"src_port\":%d", Event->src_port);
+    JSON_Buffer_Str(buf, tmp);
 
-    Base64Encode( (const unsigned char*)Event->message, strlen(Event->message), b64_target, &b64_len);
-    Classtype_Lookup( Event->class, classbuf, sizeof(classbuf) );
+    JSON_Buffer_Field(buf, ",\"dest_ip\":\"", Event->ip_dst, false);
 
-    snprintf(str, size, EVE_ALERT, timebuf, FlowGetId(Event->event_time), config->eve_interface, Event->ip_src, Event->src_port, Event->ip_dst, Event->dst_port, proto, drop, Event->generatorid, Event->sid, Event->rev,Event->f_msg, classbuf, Event->pri, b64_target, "", Event->host, !Event->json_normalize ? "{}" : json_object_to_json_string_ext(Event->json_normalize, FJSON_TO_STRING_PLAIN));
+    snprintf(tmp, sizeof(tmp), ",\"dest_port\":%d,\"proto\":\"%s\",\"alert\":{\"action\":\"%s\",\"gid\":%lu,\"signature_id\":", Event->dst_port, proto, drop, Event->generatorid);
+    JSON_Buffer_Str(buf, tmp);
+
+    /* sid and rev are numbers in the EVE layout */
+
+    JSON_Buffer_Str(buf, Event->sid);
+    JSON_Buffer_Str(buf, ",\"rev\":");
+    JSON_Buffer_Str(buf, Event->rev);
+
+    JSON_Buffer_Field(buf, ",\"signature\":\"", Event->f_msg, false);
+    JSON_Buffer_Field(buf, ",\"category\":\"", classbuf, false);
+
+    snprintf(tmp, sizeof(tmp), ",\"severity\":%d", Event->pri);
+    JSON_Buffer_Str(buf, tmp);
+
+    /* Aggregation summaries carry the number of alerts they stand for */
+
+    if ( Event->aggregate_count != 0 )
+        {
+            snprintf(tmp, sizeof(tmp), ",\"aggregate_count\":%" PRIu64 "", Event->aggregate_count);
+            JSON_Buffer_Str(buf, tmp);
+        }
+
+    JSON_Buffer_Str(buf, "},\"payload\":\"");
+
+    /* Base64 the message straight into the buffer */
+
+    b64_len = 4 * ( ( msg_len + 2 ) / 3 ) + 1;
+    JSON_Buffer_Reserve(buf, b64_len);
+
+    if ( Base64Encode( (const unsigned char*)Event->message, msg_len, (unsigned char *)buf->data + buf->len, &b64_len) == 0 )
+        {
+            buf->len += strlen(buf->data + buf->len);
+        }
+
+    JSON_Buffer_Field(buf, "\",\"stream\":0,\"packet\":\"\",\"packet_info\":{\"linktype\":1},\"xff\":\"", Event->host, false);
+
+    JSON_Buffer_Str(buf, ",\"normalize\":");
+    JSON_Buffer_Str(buf, !Event->json_normalize ? "{}" : json_object_to_json_string_ext(Event->json_normalize, FJSON_TO_STRING_PLAIN));
+    JSON_Buffer_Raw(buf, "}", 1);
 
     if ( debug->debugjson )
         {
-            Sagan_Log(DEBUG, "[%s, line %d] Format_JSON_Alert_EVE Output: %s", __FILE__, __LINE__, str);
+            Sagan_Log(DEBUG, "[%s, line %d] Format_JSON_Alert_EVE Output: %s", __FILE__, __LINE__, buf->data + start);
         }
 
 }
 
 /*****************************************************************************
- * Format_JSON_Log_EVE - Outputs all logs to the JSON/Eve file.
+ * Format_JSON_Log_EVE - Serializes a log line for the JSON/Eve file.  The
+ * layout matches what json-c's json_object_to_json_string() gave us,
+ * including its spacing and '/' escaping.
  *****************************************************************************/
 
-void Format_JSON_Log_EVE( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, struct timeval tp, char *str, size_t size, json_object *json_normalize )
+void Format_JSON_Log_EVE( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, struct timeval tp, _Sagan_JSON_Buffer *buf, json_object *json_normalize )
 {
 
-    struct json_object *jobj;
     char timebuf[64];
     char tmp[32];
-    char *proto = NULL;
 
-    char tmp_data[MAX_SYSLOGMSG+1024] = { 0 };
+    size_t start = buf->len;
 
     CreateIsoTimeString(&tp, timebuf, sizeof(timebuf));
 
-    jobj = json_object_new_object();
-
-    json_object *jdate = json_object_new_string(timebuf);
-    json_object_object_add(jobj,"timestamp", jdate);
-
-    json_object *jevent_type = json_object_new_string("log");
-    json_object_object_add(jobj,"event_type", jevent_type);
-
-    json_object *jflow_id = json_object_new_int64( FlowGetId(tp) );
-    json_object_object_add(jobj,"flow_id", jflow_id);
+    JSON_Buffer_Field(buf, "{ \"timestamp\": \"", timebuf, true);
+    JSON_Buffer_Str(buf, ", \"event_type\": \"log\"");
 
-    json_object *jsyslog_host = json_object_new_string(SaganProcSyslog_LOCAL->syslog_host);
-    json_object_object_add(jobj,"syslog_source", jsyslog_host);
+    snprintf(tmp, sizeof(tmp), ", \"flow_id\": %" PRId64 "", FlowGetId(tp));
+    JSON_Buffer_Str(buf, tmp);
 
-    json_object *jsyslog_proto = json_object_new_string(config->sagan_proto_string);
-    json_object_object_add(jobj,"syslog_proto", jsyslog_proto);
-
-    json_object *jsyslog_facility = json_object_new_string(SaganProcSyslog_LOCAL->syslog_facility);
-    json_object_object_add(jobj,"facility", jsyslog_facility);
-
-    json_object *jsyslog_priority = json_object_new_string(SaganProcSyslog_LOCAL->syslog_priority);
-    json_object_object_add(jobj,"priority", jsyslog_priority);
-
-    json_object *jsyslog_level = json_object_new_string(SaganProcSyslog_LOCAL->syslog_level);
-    json_object_object_add(jobj,"level", jsyslog_level);
-
-    json_object *jsyslog_tag = json_object_new_string(SaganProcSyslog_LOCAL->syslog_tag);
-    json_object_object_add(jobj,"tag", jsyslog_tag);
+    JSON_Buffer_Field(buf, ", \"syslog_source\": \"", SaganProcSyslog_LOCAL->syslog_host, true);
+    JSON_Buffer_Field(buf, ", \"syslog_proto\": \"", config->sagan_proto_string, true);
+    JSON_Buffer_Field(buf, ", \"facility\": \"", SaganProcSyslog_LOCAL->syslog_facility, true);
+    JSON_Buffer_Field(buf, ", \"priority\": \"", SaganProcSyslog_LOCAL->syslog_priority, true);
+    JSON_Buffer_Field(buf, ", \"level\": \"", SaganProcSyslog_LOCAL->syslog_level, true);
+    JSON_Buffer_Field(buf, ", \"tag\": \"", SaganProcSyslog_LOCAL->syslog_tag, true);
 
     snprintf(tmp, sizeof(tmp), "%s %s", SaganProcSyslog_LOCAL->syslog_date, SaganProcSyslog_LOCAL->syslog_time);
-    json_object *jsyslog_timestamp = json_object_new_string(tmp);
-    json_object_object_add(jobj,"source_timestamp", jsyslog_timestamp);
-
-    json_object *jsyslog_program = json_object_new_string(SaganProcSyslog_LOCAL->syslog_program);
-    json_object_object_add(jobj,"program", jsyslog_program);
-
-    json_object *jsyslog_message = json_object_new_string(SaganProcSyslog_LOCAL->syslog_message);
-    json_object_object_add(jobj,"message", jsyslog_message);
+    JSON_Buffer_Field(buf, ", \"source_timestamp\": \"", tmp, true);
 
-    snprintf(tmp_data, sizeof(tmp_data), "%s", json_object_to_json_string(jobj));
-    tmp_data[strlen(tmp_data) - 2] = '\0';
+    JSON_Buffer_Field(buf, ", \"program\": \"", SaganProcSyslog_LOCAL->syslog_program, true);
+    JSON_Buffer_Field(buf, ", \"message\": \"", SaganProcSyslog_LOCAL->syslog_message, true);
 
-    snprintf(str, size, "%s, \"normalize\": %s }", tmp_data,  json_object_to_json_string_ext(json_normalize, FJSON_TO_STRING_PLAIN));
+    JSON_Buffer_Str(buf, ", \"normalize\": ");
+    JSON_Buffer_Str(buf, json_normalize == NULL ? "null" : json_object_to_json_string_ext(json_normalize, FJSON_TO_STRING_PLAIN));
+    JSON_Buffer_Raw(buf, " }", 2);
 
     if ( debug->debugjson )
         {
-            Sagan_Log(DEBUG, "[%s, line %d] Format_JSON_Log_EVE Output: %s", __FILE__, __LINE__, str);
+            Sagan_Log(DEBUG, "[%s, line %d] Format_JSON_Log_EVE Output: %s", __FILE__, __LINE__, buf->data + start);
         }
 
 }
@@ -26,13 +26,22 @@
 
 #include <inttypes.h>
 
-void Format_JSON_Alert_EVE( _Sagan_Event *, char *, size_t);
-void Format_JSON_Log_EVE( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, struct timeval tp, char *, size_t, json_object *json_normalize );
-
-
-/* Suricata EVE Alert output */
-
-#define EVE_ALERT "{\"timestamp\":\"\%s\",\"flow_id\":%" PRIu64 ",\"in_iface\":\"%s\",\"event_type\":\"alert\",\"src_ip\":\"%s\",\"src_port\":%d,\"dest_ip\":\"%s\",\"dest_port\":%d,\"proto\":\"%s\",\"alert\":{\"action\":\"%s\",\"gid\":%lu,\"signature_id\":%s,\"rev\":%s,\"signature\":\"%s\",\"category\":\"%s\",\"severity\":%d},\"payload\":\"%s\",\"stream\":0,\"packet\":\"%s\",\"packet_info\":{\"linktype\":1},\"xff\":\"%s\",\"normalize\":%s}"
-
-
+/* Growable output buffer.  EVE records are serialized straight into it */
+
+typedef struct _Sagan_JSON_Buffer _Sagan_JSON_Buffer;
+struct _Sagan_JSON_Buffer
+{
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+void JSON_Buffer_Reserve( _Sagan_JSON_Buffer *, size_t );
+void JSON_Buffer_Raw( _Sagan_JSON_Buffer *, const char *, size_t );
+void JSON_Buffer_Str( _Sagan_JSON_Buffer *, const char * );
+void JSON_Buffer_Escape( _Sagan_JSON_Buffer *, const char *, sbool );
+void JSON_Buffer_Free( _Sagan_JSON_Buffer * );
+
+void Format_JSON_Alert_EVE( _Sagan_Event *, _Sagan_JSON_Buffer * );
+void Format_JSON_Log_EVE( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, struct timeval tp, _Sagan_JSON_Buffer *, json_object *json_normalize );
 
@@ -44,8 +44,6 @@
 #include "rules.h"
 #include "parsers/parsers.h"
 
-struct _Rule_Struct *rulestruct;
-
 int Meta_Content_Search(char *syslog_msg, int rule_position , int meta_content_count)
 {
 
@@ -41,7 +41,6 @@
 #include "references.h"
 #include "sagan-config.h"
 
-struct _Rule_Struct *rulestruct;
 struct _SaganConfig *config;
 struct _SaganCounters *counters;
 
@@ -50,7 +49,7 @@ pthread_mutex_t CounterAlertTotalMutex=PTHREAD_MUTEX_INITIALIZER;
 void Alert_File( _Sagan_Event *Event )
 {
 
-    char tmpref[256];
+    const char *tmpref = NULL;
     char timebuf[64];
 
     CreateTimeString(&Event->event_time, timebuf, sizeof(timebuf), 1);
@@ -68,14 +67,12 @@ void Alert_File( _Sagan_Event *Event )
     if ( Event->found != 0 )
         {
 
-            Reference_Lookup( Event->found, 0, tmpref, sizeof(tmpref) );
+            tmpref = Reference_Lookup( Event->found, 0 );
 
-            if (strcmp(tmpref, "" ))
+            if ( tmpref[0] != '\0' )
                 {
                     fprintf(config->sagan_alert_stream, "%s\n", tmpref);
                 }
         }
 
-    fflush(config->sagan_alert_stream);
-
 }
@@ -23,6 +23,13 @@
  * Threaded output for e-mail support via the libesmtp.  For more information
  * about libesmtp,  please see: http://www.stafford.uklinux.net/libesmtp.
  *
+ * ESMTP_Thread() only formats the alert and puts it in a bounded spool;
+ * a mail thread does the SMTP work,  so a slow or dead relay never backs
+ * up the output queues.  Mails are sent ESMTP_BATCH_MAX at a time over a
+ * single SMTP session/connection.  With "digest-interval" set,  alerts
+ * for the same recipient are collected into one mail that goes out when
+ * the interval is up or it holds "digest-max" alerts.
+ *
  */
 
 #ifdef HAVE_CONFIG_H
@@ -38,6 +45,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -48,7 +62,6 @@
 #include "util-time.h"
 #include "version.h"
 
-struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
 struct _SaganCounters *counters;
@@ -56,67 +69,168 @@ struct _SaganCounters *counters;
 pthread_mutex_t CounterESMTPCountFailed=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t CounterESMTPCountSuccess=PTHREAD_MUTEX_INITIALIZER;
 
-int ESMTP_Thread ( _Sagan_Event *Event )
+/* The spool.  "outgoing" is ready to send,  "digests" are still collecting
+ * alerts.  "spooled" counts alerts in both */
+
+static pthread_mutex_t SaganESMTPSpoolMutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t SaganESMTPSpoolCond=PTHREAD_COND_INITIALIZER;
+
+static _Sagan_ESMTP_Mail *outgoing_head = NULL;
+static _Sagan_ESMTP_Mail *outgoing_tail = NULL;
+static _Sagan_ESMTP_Mail *digests = NULL;
+static int spooled = 0;
+
+static sbool esmtp_init = false;
+
+/****************************************************************************
+ * ESMTP_Append - Adds "str" to the mail's text,  turning bare LFs into
+ * CRLFs as SMTP wants.
+ ****************************************************************************/
+
+static void ESMTP_Append( _Sagan_ESMTP_Mail *mail, const char *str )
 {
 
-    char tmpref[256];
-    char timebuf[64];
+    size_t need = strlen(str) * 2 + 1;
+    char *tmp = NULL;
 
-    char tmpa[MAX_EMAILSIZE];
-    char tmpb[MAX_EMAILSIZE];
-    int r = 0;
+    if ( mail->len + need > mail->size )
+        {
 
-    Reference_Lookup( Event->found, 0, tmpref, sizeof(tmpref));
-    CreateTimeString(&Event->event_time, timebuf, sizeof(timebuf), 1);
+            mail->size = ( mail->len + need ) * 2;
+            tmp = realloc(mail->text, mail->size);
+
+            if ( tmp == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for e-mail. Abort!", __FILE__, __LINE__);
+                }
+
+            mail->text = tmp;
+        }
 
-    if ((r = snprintf(tmpa, sizeof(tmpa),
-                      "MIME-Version: 1.0\r\n"
-                      "Content-Type: text/plain;\r\n"
-                      "Content-Transfer-Encoding: 8bit\r\n"
-                      "From: %s\r\n"
-                      "To: %s\r\n"
-                      "Subject: %s%s\r\n"
-                      "\r\n\n"
-                      "[**] [%lu:%s] %s [**]\n"
-                      "[Classification: %s] [Priority: %d] [%s]\n"
-                      "[Alert Time: %s]\n"
-                      "%s %s %s:%d -> %s:%d %s %s\n"
-                      "Syslog message: %s\r\n%s\n\r",
-                      config->sagan_esmtp_from,
-                      rulestruct[Event->found].email,
-                      config->sagan_email_subject,
-                      Event->f_msg,
-                      Event->generatorid,
-                      Event->sid,
-                      Event->f_msg,
-                      Event->class,
-                      Event->pri,
-                      Event->host,
-                      timebuf,
-                      Event->date,
-                      Event->time,
-                      Event->ip_src,
-                      Event->src_port,
-                      Event->ip_dst,
-                      Event->dst_port,
-                      Event->facility,
-                      Event->priority,
-                      Event->message,
-                      tmpref)) < 0)
+    for ( ; *str != '\0'; str++ )
         {
-            Sagan_Log(NORMAL, "[%s, line %d] Cannot build mail.",  __FILE__, __LINE__);
-            goto failure;
+
+            if ( *str == '\n' && ( mail->len == 0 || mail->text[mail->len-1] != '\r' ) )
+                {
+                    mail->text[mail->len++] = '\r';
+                }
+
+            mail->text[mail->len++] = *str;
         }
 
-    /* Start building libesmtp connection information */
+    mail->text[mail->len] = '\0';
+
+}
+
+/****************************************************************************
+ * ESMTP_Free - Releases a mail and its alerts' room in the spool
+ ****************************************************************************/
+
+static void ESMTP_Free( _Sagan_ESMTP_Mail *mail )
+{
+
+    pthread_mutex_lock(&SaganESMTPSpoolMutex);
+    spooled -= mail->alerts;
+    pthread_mutex_unlock(&SaganESMTPSpoolMutex);
+
+    free(mail->text);
+    free(mail->message);
+    free(mail);
+
+}
+
+/****************************************************************************
+ * ESMTP_Queue - Moves a mail to the end of the outgoing list.  The caller
+ * holds SaganESMTPSpoolMutex.
+ ****************************************************************************/
+
+static void ESMTP_Queue( _Sagan_ESMTP_Mail *mail )
+{
+
+    mail->next = NULL;
+
+    if ( outgoing_tail == NULL )
+        {
+            outgoing_head = mail;
+        }
+    else
+        {
+            outgoing_tail->next = mail;
+        }
+
+    outgoing_tail = mail;
+
+    pthread_cond_signal(&SaganESMTPSpoolCond);
+
+}
+
+/****************************************************************************
+ * ESMTP_Queue_Digest - Unlinks the digest at "*p" and queues it.  The
+ * caller holds SaganESMTPSpoolMutex.
+ ****************************************************************************/
+
+static void ESMTP_Queue_Digest( _Sagan_ESMTP_Mail **p )
+{
+
+    _Sagan_ESMTP_Mail *mail = *p;
+
+    *p = mail->next;
+
+    snprintf(mail->subject, sizeof(mail->subject), "%s%d alert%s", config->sagan_email_subject, mail->alerts, mail->alerts == 1 ? "" : "s");
+
+    ESMTP_Queue(mail);
+
+}
+
+/****************************************************************************
+ * ESMTP_Queue_Digests - Queues digests that are "force"d or whose
+ * interval is up.  The caller holds SaganESMTPSpoolMutex.
+ ****************************************************************************/
+
+static void ESMTP_Queue_Digests( sbool force )
+{
+
+    _Sagan_ESMTP_Mail **p = &digests;
 
-    smtp_session_t session;
-    smtp_message_t message;
-    smtp_recipient_t recipient;
+    time_t now = (time_t)Sagan_Clock_Epoch();
+
+    while ( *p != NULL )
+        {
+
+            if ( force == true || now - (*p)->first >= config->esmtp_digest_interval )
+                {
+                    ESMTP_Queue_Digest(p);
+                    continue;
+                }
+
+            p = &(*p)->next;
+        }
+
+}
+
+/****************************************************************************
+ * ESMTP_Send - Sends a list of mails over one SMTP session and frees them
+ ****************************************************************************/
+
+static void ESMTP_Send( _Sagan_ESMTP_Mail *batch )
+{
+
+    _Sagan_ESMTP_Mail *mail = NULL;
+    _Sagan_ESMTP_Mail *next = NULL;
+
+    smtp_session_t session = NULL;
+    smtp_message_t message[ESMTP_BATCH_MAX];
 
     const smtp_status_t *status;
     struct sigaction sa;
 
+    char errtmp[128];
+    size_t size = 0;
+
+    int count = 0;
+    int sent = 0;
+    int i = 0;
+
     sa.sa_handler = SIG_IGN;
     sigemptyset (&sa.sa_mask);
     sa.sa_flags = 0;
@@ -125,142 +239,365 @@ int ESMTP_Thread ( _Sagan_Event *Event )
     if((session = smtp_create_session ()) == NULL)
         {
             Sagan_Log(WARN, "[%s, line %d] Cannot create smtp session.",  __FILE__, __LINE__);
-            pthread_mutex_lock(&CounterESMTPCountFailed);
-            counters->esmtp_count_failed++;
-            pthread_mutex_unlock(&CounterESMTPCountFailed);
-            goto failure;
-        }
-    if((message = smtp_add_message (session)) == NULL)
-        {
-            Sagan_Log(WARN, "[%s, line %d] Cannot add message to smtp session.",  __FILE__, __LINE__);
-            pthread_mutex_lock(&CounterESMTPCountFailed);
-            counters->esmtp_count_failed++;
-            pthread_mutex_unlock(&CounterESMTPCountFailed);
-            goto failure;
+            goto done;
         }
+
     if(!smtp_set_server (session, config->sagan_esmtp_server))
         {
             Sagan_Log(WARN, "[%s, line %d] Cannot set smtp server.",  __FILE__, __LINE__);
-            pthread_mutex_lock(&CounterESMTPCountFailed);
-            counters->esmtp_count_failed++;
-            pthread_mutex_unlock(&CounterESMTPCountFailed);
-            goto failure;
-        }
-    if((r = FixLF(config, tmpb, tmpa)) <= 0)
-        {
-            Sagan_Log(WARN, "[%s, line %d] Cannot FixLF.",  __FILE__, __LINE__);
-            pthread_mutex_lock(&CounterESMTPCountFailed);
-            counters->esmtp_count_failed++;
-            pthread_mutex_unlock(&CounterESMTPCountFailed);
-            goto failure;
+            goto done;
         }
-    if(!smtp_set_message_str (message, tmpb))
-        {
-            Sagan_Log(WARN, "[%s, line %d] Cannot set message string.",  __FILE__, __LINE__);
-            pthread_mutex_lock(&CounterESMTPCountFailed);
-            counters->esmtp_count_failed++;
-            pthread_mutex_unlock(&CounterESMTPCountFailed);
-            goto failure;
-        }
-    if(!smtp_set_reverse_path (message, config->sagan_esmtp_from))
-        {
-            Sagan_Log(WARN, "[%s, line %d] Cannot reverse path.",  __FILE__, __LINE__);
-            pthread_mutex_lock(&CounterESMTPCountFailed);
-            counters->esmtp_count_failed++;
-            pthread_mutex_unlock(&CounterESMTPCountFailed);
-            goto failure;
-        }
-    if((recipient = smtp_add_recipient (message, rulestruct[Event->found].email)) == NULL)
+
+    for ( mail = batch; mail != NULL && count < ESMTP_BATCH_MAX; mail = mail->next )
         {
-            Sagan_Log(WARN, "[%s, line %d] Cannot add recipient.",  __FILE__, __LINE__);
-            pthread_mutex_lock(&CounterESMTPCountFailed);
-            counters->esmtp_count_failed++;
-            pthread_mutex_unlock(&CounterESMTPCountFailed);
-            goto failure;
+
+            size = mail->len + 512 + strlen(config->sagan_esmtp_from) + strlen(mail->to) + strlen(mail->subject);
+            mail->message = malloc(size);
+
+            if ( mail->message == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for e-mail. Abort!", __FILE__, __LINE__);
+                }
+
+            snprintf(mail->message, size,
+                     "MIME-Version: 1.0\r\n"
+                     "Content-Type: text/plain;\r\n"
+                     "Content-Transfer-Encoding: 8bit\r\n"
+                     "From: %s\r\n"
+                     "To: %s\r\n"
+                     "Subject: %s\r\n"
+                     "\r\n%s",
+                     config->sagan_esmtp_from,
+                     mail->to,
+                     mail->subject,
+                     mail->text);
+
+            if((message[count] = smtp_add_message (session)) == NULL)
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Cannot add message to smtp session.",  __FILE__, __LINE__);
+                    goto done;
+                }
+
+            if(!smtp_set_message_str (message[count], mail->message))
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Cannot set message string.",  __FILE__, __LINE__);
+                    goto done;
+                }
+
+            if(!smtp_set_reverse_path (message[count], config->sagan_esmtp_from))
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Cannot reverse path.",  __FILE__, __LINE__);
+                    goto done;
+                }
+
+            if(smtp_add_recipient (message[count], mail->to) == NULL)
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Cannot add recipient.",  __FILE__, __LINE__);
+                    goto done;
+                }
+
+            count++;
         }
 
     if (!smtp_start_session (session))
         {
-            char errtmp[128];
-            smtp_strerror (smtp_errno (), errtmp, sizeof(errtmp));
 
             /* We log the error,  but keep going.  While SMTP failed,
              * we might be storing alerts another way
              */
 
             Sagan_Log(WARN, "[%s, line %d] SMTP Error: %s", __FILE__, __LINE__, smtp_strerror (smtp_errno (), errtmp, sizeof(errtmp)));
-            pthread_mutex_lock(&CounterESMTPCountFailed);
-            counters->esmtp_count_failed++;
-            pthread_mutex_unlock(&CounterESMTPCountFailed);
+            goto done;
+        }
+
+    for ( i = 0; i < count; i++ )
+        {
+
+            status = smtp_message_transfer_status (message[i]);
+
+            if ( status != NULL && status->code / 100 == 2 )
+                {
+                    sent++;
+                }
 
+            if ( debug->debugesmtp ) Sagan_Log(DEBUG, "SMTP %d %s", status != NULL ? status->code : 0, ( status != NULL && status->text != NULL ) ? status->text : "\n");
         }
-    else
+
+done:
+
+    if (session != NULL)
         {
+            smtp_destroy_session (session);
+        }
 
-            /* SMTP sent successful */
+    pthread_mutex_lock(&CounterESMTPCountSuccess);
+    counters->esmtp_count_success += sent;
+    pthread_mutex_unlock(&CounterESMTPCountSuccess);
 
-            status = smtp_message_transfer_status (message);
+    /* Everything in the batch that didn't make it,  including anything
+     * past a setup failure */
 
-            pthread_mutex_lock(&CounterESMTPCountSuccess);
-            counters->esmtp_count_success++;
-            pthread_mutex_unlock(&CounterESMTPCountSuccess);
+    for ( i = 0, mail = batch; mail != NULL; mail = mail->next )
+        {
+            i++;
+        }
 
-            if ( debug->debugesmtp ) Sagan_Log(DEBUG, "SMTP %d %s", status->code, (status->text != NULL) ? status->text : "\n");
+    pthread_mutex_lock(&CounterESMTPCountFailed);
+    counters->esmtp_count_failed += i - sent;
+    pthread_mutex_unlock(&CounterESMTPCountFailed);
 
+    for ( mail = batch; mail != NULL; mail = next )
+        {
+            next = mail->next;
+            ESMTP_Free(mail);
         }
 
-failure:
-    if (session != NULL)
-        smtp_destroy_session (session);
-    return(0);
 }
 
-int
-FixLF( _SaganConfig *config, char *d, char *s)
+/****************************************************************************
+ * ESMTP_Take - Takes up to ESMTP_BATCH_MAX mails off the outgoing list.
+ * The caller holds SaganESMTPSpoolMutex.
+ ****************************************************************************/
+
+static _Sagan_ESMTP_Mail *ESMTP_Take( void )
+{
+
+    _Sagan_ESMTP_Mail *batch = outgoing_head;
+    _Sagan_ESMTP_Mail *last = NULL;
+
+    int i = 0;
+
+    for ( i = 0; outgoing_head != NULL && i < ESMTP_BATCH_MAX; i++ )
+        {
+            last = outgoing_head;
+            outgoing_head = outgoing_head->next;
+        }
+
+    if ( last != NULL )
+        {
+            last->next = NULL;
+        }
+
+    if ( outgoing_head == NULL )
+        {
+            outgoing_tail = NULL;
+        }
+
+    return(batch);
+}
+
+/****************************************************************************
+ * ESMTP_Mail_Thread - Sends whatever is in the spool
+ ****************************************************************************/
+
+static void ESMTP_Mail_Thread( void )
 {
-    int sl=0;
-    int i=0;
-    int j=0;
 
-    if(d == NULL)
+    _Sagan_ESMTP_Mail *batch = NULL;
+    struct timespec wait;
+
+    (void)SetThreadName("SaganESMTP");
+
+    for (;;)
         {
-            return 0;
+
+            pthread_mutex_lock(&SaganESMTPSpoolMutex);
+
+            if ( outgoing_head == NULL )
+                {
+                    clock_gettime(CLOCK_REALTIME, &wait);
+                    wait.tv_sec++;
+                    pthread_cond_timedwait(&SaganESMTPSpoolCond, &SaganESMTPSpoolMutex, &wait);
+                }
+
+            ESMTP_Queue_Digests(false);
+
+            batch = ESMTP_Take();
+
+            pthread_mutex_unlock(&SaganESMTPSpoolMutex);
+
+            if ( batch != NULL )
+                {
+                    ESMTP_Send(batch);
+                }
         }
 
-    if(s == NULL)
+}
+
+/****************************************************************************
+ * ESMTP_Init - Starts the mail thread.  Only the first call does anything.
+ ****************************************************************************/
+
+void ESMTP_Init( void )
+{
+
+    pthread_t esmtp_thread;
+    pthread_attr_t esmtp_thread_attr;
+
+    int rc = 0;
+
+    if ( esmtp_init == true )
         {
-            d[0] = '\0';
-            return 0;
+            return;
         }
 
-    if((sl=strlen(s)) >= MAX_EMAILSIZE)
+    esmtp_init = true;
+
+    pthread_attr_init(&esmtp_thread_attr);
+    pthread_attr_setdetachstate(&esmtp_thread_attr,  PTHREAD_CREATE_DETACHED);
+
+    rc = pthread_create( &esmtp_thread, &esmtp_thread_attr, (void *)ESMTP_Mail_Thread, NULL );
+
+    if ( rc != 0 )
         {
-            s[MAX_EMAILSIZE]='\0';
-            sl=MAX_EMAILSIZE;
-            Sagan_Log(WARN, "[%s, line %d] Mail too large.", __FILE__, __LINE__);
+            Sagan_Log(ERROR, "[%s, line %d] Could not pthread_create() for the SMTP mail thread [error: %d]", __FILE__, __LINE__, rc);
         }
 
-    for(i=0; i<sl; i++)
+    pthread_attr_destroy(&esmtp_thread_attr);
+
+}
+
+/****************************************************************************
+ * ESMTP_Close - Sends pending digests and anything else in the spool.
+ * Called at shutdown.
+ ****************************************************************************/
+
+void ESMTP_Close( void )
+{
+
+    _Sagan_ESMTP_Mail *batch = NULL;
+
+    for (;;)
         {
-            if(j>=MAX_EMAILSIZE)
+
+            pthread_mutex_lock(&SaganESMTPSpoolMutex);
+
+            ESMTP_Queue_Digests(true);
+            batch = ESMTP_Take();
+
+            pthread_mutex_unlock(&SaganESMTPSpoolMutex);
+
+            if ( batch == NULL )
                 {
-                    d[MAX_EMAILSIZE]='\0';
-                    Sagan_Log(WARN, "[%s, line %d] Mail too large.", __FILE__, __LINE__);
                     break;
                 }
-            if(i>0 && s[i] == '\n' && s[i-1] != '\r')
+
+            ESMTP_Send(batch);
+        }
+
+}
+
+/****************************************************************************
+ * ESMTP_Thread - Formats an alert and puts it in the spool.  The alert is
+ * dropped if the spool is full.
+ ****************************************************************************/
+
+int ESMTP_Thread ( _Sagan_Event *Event )
+{
+
+    _Sagan_ESMTP_Mail *mail = NULL;
+    _Sagan_ESMTP_Mail **p = NULL;
+
+    const char *tmpref = NULL;
+    char timebuf[64];
+
+    char tmpa[MAX_EMAILSIZE];
+
+    tmpref = Reference_Lookup( Event->found, 0 );
+    CreateTimeString(&Event->event_time, timebuf, sizeof(timebuf), 1);
+
+    if (snprintf(tmpa, sizeof(tmpa),
+                 "\n"
+                 "[**] [%lu:%s] %s [**]\n"
+                 "[Classification: %s] [Priority: %d] [%s]\n"
+                 "[Alert Time: %s]\n"
+                 "%s %s %s:%d -> %s:%d %s %s\n"
+                 "Syslog message: %s\r\n%s\n\r",
+                 Event->generatorid,
+                 Event->sid,
+                 Event->f_msg,
+                 Event->class,
+                 Event->pri,
+                 Event->host,
+                 timebuf,
+                 Event->date,
+                 Event->time,
+                 Event->ip_src,
+                 Event->src_port,
+                 Event->ip_dst,
+                 Event->dst_port,
+                 Event->facility,
+                 Event->priority,
+                 Event->message,
+                 tmpref) < 0)
+        {
+            Sagan_Log(NORMAL, "[%s, line %d] Cannot build mail.",  __FILE__, __LINE__);
+            return(0);
+        }
+
+    pthread_mutex_lock(&SaganESMTPSpoolMutex);
+
+    if ( spooled >= config->esmtp_spool_size )
+        {
+            pthread_mutex_unlock(&SaganESMTPSpoolMutex);
+
+            pthread_mutex_lock(&CounterESMTPCountFailed);
+            counters->esmtp_count_dropped++;
+            pthread_mutex_unlock(&CounterESMTPCountFailed);
+
+            return(0);
+        }
+
+    /* Digest mode;  add to this recipient's mail if there is one */
+
+    if ( config->esmtp_digest_interval != 0 )
+        {
+            for ( mail = digests; mail != NULL && strcmp(mail->to, rulestruct[Event->found].email); mail = mail->next );
+        }
+
+    if ( mail == NULL )
+        {
+
+            mail = calloc(1, sizeof(_Sagan_ESMTP_Mail));
+
+            if ( mail == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for e-mail. Abort!", __FILE__, __LINE__);
+                }
+
+            strlcpy(mail->to, rulestruct[Event->found].email, sizeof(mail->to));
+            snprintf(mail->subject, sizeof(mail->subject), "%s%s", config->sagan_email_subject, Event->f_msg);
+            mail->first = (time_t)Sagan_Clock_Epoch();
+
+            if ( config->esmtp_digest_interval != 0 )
                 {
-                    d[j++] = '\r';
+                    mail->next = digests;
+                    digests = mail;
                 }
-            d[j++] = s[i];
         }
 
-    if(j<MAX_EMAILSIZE)
+    ESMTP_Append(mail, tmpa);
+    mail->alerts++;
+    spooled++;
+
+    if ( config->esmtp_digest_interval == 0 )
+        {
+            ESMTP_Queue(mail);
+        }
+
+    /* A full digest doesn't wait for its interval */
+
+    else if ( mail->alerts >= config->esmtp_digest_max )
         {
-            d[j++] = '\0';
+
+            for ( p = &digests; *p != mail; p = &(*p)->next );
+
+            ESMTP_Queue_Digest(p);
         }
 
-    return j;
+    pthread_mutex_unlock(&SaganESMTPSpoolMutex);
+
+    return(0);
 }
 
 #endif
@@ -32,9 +32,27 @@
 #define ESMTPSERVER     32            /* SMTP server size max */
 #define MAX_EMAILSIZE   15360          /* Largest e-mail that can be sent */
 
+/* A mail waiting in the spool.  "text" holds one alert,  or in digest
+ * mode every alert for "to" in the current interval */
+
+typedef struct _Sagan_ESMTP_Mail _Sagan_ESMTP_Mail;
+struct _Sagan_ESMTP_Mail
+{
+    char to[255];
+    char subject[256];
+    char *text;
+    size_t len;
+    size_t size;
+    char *message;			/* Headers + text,  while it's being sent */
+    int alerts;
+    time_t first;			/* When the first alert was added */
+    struct _Sagan_ESMTP_Mail *next;
+};
+
 const char *esmtp_cb ( void **, int *, void * );
 int ESMTP_Thread( _Sagan_Event * );
-int FixLF(_SaganConfig *, char *, char *);
+void ESMTP_Init( void );
+void ESMTP_Close( void );
 
 #endif
 
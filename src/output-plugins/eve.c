@@ -22,6 +22,17 @@
  *
  * Write alerts in a JSON/Suricata like format
  *
+ * Records are serialized straight into a per-thread buffer.  A buffer is
+ * written with one writev() when it reaches "buffer-size" bytes or its
+ * oldest record is "flush-interval" milliseconds old.  A flusher thread
+ * covers threads that go quiet.  "sync" adds an fdatasync() after every
+ * write.
+ *
+ * When the file is compressed the worker threads don't write at all;  a
+ * due buffer is handed to the flusher thread,  which does the compressing.
+ * A thread only writes (and compresses) its own buffer if the flusher
+ * falls EVE_BACKLOG_FACTOR "buffer-size"s behind.
+ *
  */
 
 
@@ -30,7 +41,20 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -38,35 +62,430 @@
 #include "output-plugins/eve.h"
 
 #include "sagan-config.h"
+#include "util-time.h"
+#include "util-stream.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 struct _SaganConfig *config;
 
+static __thread _Sagan_Eve_Buffer *eve_buffer = NULL;
+
+/* Every thread's buffer,  for Eve_Flush_All() */
+
+static pthread_mutex_t SaganEveBufferListMutex=PTHREAD_MUTEX_INITIALIZER;
+static _Sagan_Eve_Buffer *SaganEveBufferList = NULL;
+
+/* Serializes writes so records from different threads never interleave,
+ * even on a stream socket that takes a partial write */
+
+static pthread_mutex_t SaganEveWriteMutex=PTHREAD_MUTEX_INITIALIZER;
+
+/* Wakes the flusher early when a compressed file has a buffer due */
+
+static pthread_mutex_t SaganEveFlushMutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t SaganEveFlushCond=PTHREAD_COND_INITIALIZER;
+
+static sbool eve_init = false;
+
+/****************************************************************************
+ * Eve_Write_Locked - Writes "iovcnt" buffers to the eve file.  The caller
+ * holds SaganEveWriteMutex.
+ ****************************************************************************/
+
+static void Eve_Write_Locked( struct iovec *iov, int iovcnt )
+{
+
+    ssize_t written = 0;
+
+    int fd = -1;
+    int first = 0;
+
+    if ( config->eve_stream == NULL )
+        {
+            return;
+        }
+
+    fd = fileno(config->eve_stream);
+
+    /* Compressed and/or rotated file (util-stream.c).  There's no
+     * descriptor to writev() to */
+
+    if ( fd == -1 )
+        {
+
+            for ( first = 0; first < iovcnt; first++ )
+                {
+                    fwrite(iov[first].iov_base, 1, iov[first].iov_len, config->eve_stream);
+                }
+
+            if ( fflush(config->eve_stream) != 0 )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Error writing to %s: %s", __FILE__, __LINE__, config->eve_filename, strerror(errno));
+                    clearerr(config->eve_stream);
+                }
+
+            Sagan_Stream_Maintain(config->eve_stream);
+            return;
+        }
+
+    while ( first < iovcnt )
+        {
+
+            written = writev(fd, &iov[first], iovcnt - first);
+
+            if ( written < 0 )
+                {
+
+                    if ( errno == EINTR )
+                        {
+                            continue;
+                        }
+
+                    Sagan_Log(WARN, "[%s, line %d] Error writing to %s: %s", __FILE__, __LINE__, config->eve_filename, strerror(errno));
+                    break;
+                }
+
+            /* Step past whatever made it out */
+
+            while ( first < iovcnt && (size_t)written >= iov[first].iov_len )
+                {
+                    written -= iov[first].iov_len;
+                    first++;
+                }
+
+            if ( first < iovcnt )
+                {
+                    iov[first].iov_base = (char *)iov[first].iov_base + written;
+                    iov[first].iov_len -= written;
+                }
+        }
+
+    if ( config->eve_sync == true )
+        {
+            fdatasync(fd);
+        }
+
+}
+
+/****************************************************************************
+ * Eve_Write - writev()s "count" buffers to the eve file and empties them.
+ * The caller holds each buffer's lock.
+ ****************************************************************************/
+
+static void Eve_Write( _Sagan_Eve_Buffer **buffers, int count )
+{
+
+    struct iovec iov[IOV_MAX];
+
+    int iovcnt = 0;
+    int i = 0;
+
+    for ( i = 0; i < count && iovcnt < IOV_MAX; i++ )
+        {
+
+            if ( buffers[i]->json.len == 0 )
+                {
+                    continue;
+                }
+
+            iov[iovcnt].iov_base = buffers[i]->json.data;
+            iov[iovcnt].iov_len = buffers[i]->json.len;
+            iovcnt++;
+        }
+
+    if ( iovcnt == 0 )
+        {
+            return;
+        }
+
+    pthread_mutex_lock(&SaganEveWriteMutex);
+    Eve_Write_Locked(iov, iovcnt);
+    pthread_mutex_unlock(&SaganEveWriteMutex);
+
+    for ( i = 0; i < count; i++ )
+        {
+            buffers[i]->json.len = 0;
+        }
+
+}
+
+/****************************************************************************
+ * Eve_Flush_All - Writes out every thread's buffer.  Called by the flusher
+ * thread,  and before the eve file is reopened or closed.
+ ****************************************************************************/
+
+void Eve_Flush_All( void )
+{
+
+    _Sagan_Eve_Buffer *buffers[IOV_MAX];
+    _Sagan_Eve_Buffer *buffer = NULL;
+
+    int count = 0;
+    int i = 0;
+
+    pthread_mutex_lock(&SaganEveBufferListMutex);
+
+    buffer = SaganEveBufferList;
+
+    while ( buffer != NULL )
+        {
+
+            for ( count = 0; buffer != NULL && count < IOV_MAX; buffer = buffer->next )
+                {
+                    pthread_mutex_lock(&buffer->lock);
+                    buffers[count++] = buffer;
+                }
+
+            Eve_Write(buffers, count);
+
+            for ( i = 0; i < count; i++ )
+                {
+                    pthread_mutex_unlock(&buffers[i]->lock);
+                }
+        }
+
+    pthread_mutex_unlock(&SaganEveBufferListMutex);
+
+}
+
+/****************************************************************************
+ * Eve_Close - Writes out every buffer and closes the eve file.  The close
+ * happens under SaganEveWriteMutex so the flusher never sees a stale
+ * stream.
+ ****************************************************************************/
+
+void Eve_Close( void )
+{
+
+    Eve_Flush_All();
+
+    pthread_mutex_lock(&SaganEveWriteMutex);
+
+    if ( config->eve_stream != NULL )
+        {
+            fclose(config->eve_stream);		/* Also closes a unix:// socket */
+        }
+
+    config->eve_stream = NULL;
+    config->eve_fd = -1;
+
+    pthread_mutex_unlock(&SaganEveWriteMutex);
+
+}
+
+/****************************************************************************
+ * Eve_Flush_Thread - Writes out buffers that are due,  either because
+ * they've gone quiet or because a compressed file left the writing to us.
+ * A due buffer is swapped for our empty one,  so its thread can carry on
+ * while we write.
+ ****************************************************************************/
+
+static void Eve_Flush_Thread( void )
+{
+
+    _Sagan_Eve_Buffer *buffer = NULL;
+    _Sagan_JSON_Buffer spare = { 0 };
+    _Sagan_JSON_Buffer tmp;
+
+    struct timespec wait;
+    struct iovec iov;
+
+    uint64_t now = 0;
+
+    (void)SetThreadName("SaganEveFlush");
+
+    for (;;)
+        {
+
+            clock_gettime(CLOCK_REALTIME, &wait);
+
+            wait.tv_sec += config->eve_flush_interval / 1000;
+            wait.tv_nsec += ( config->eve_flush_interval % 1000 ) * 1000000L;
+
+            if ( wait.tv_nsec >= 1000000000L )
+                {
+                    wait.tv_sec++;
+                    wait.tv_nsec -= 1000000000L;
+                }
+
+            pthread_mutex_lock(&SaganEveFlushMutex);
+            pthread_cond_timedwait(&SaganEveFlushCond, &SaganEveFlushMutex, &wait);
+            pthread_mutex_unlock(&SaganEveFlushMutex);
+
+            now = Sagan_Clock_Mono_NS() / 1000000;
+
+            pthread_mutex_lock(&SaganEveBufferListMutex);
+
+            for ( buffer = SaganEveBufferList; buffer != NULL; buffer = buffer->next )
+                {
+
+                    pthread_mutex_lock(&buffer->lock);
+
+                    if ( buffer->json.len == 0 ||
+                            ( buffer->json.len < config->eve_buffer_size &&
+                              now - buffer->first_time < config->eve_flush_interval ) )
+                        {
+                            pthread_mutex_unlock(&buffer->lock);
+                            continue;
+                        }
+
+                    tmp = buffer->json;
+                    buffer->json = spare;
+                    spare = tmp;
+
+                    /* Take the write lock before letting go of the buffer,  so
+                     * its thread can't get a later record out ahead of these */
+
+                    pthread_mutex_lock(&SaganEveWriteMutex);
+                    pthread_mutex_unlock(&buffer->lock);
+
+                    iov.iov_base = spare.data;
+                    iov.iov_len = spare.len;
+
+                    Eve_Write_Locked(&iov, 1);
+
+                    pthread_mutex_unlock(&SaganEveWriteMutex);
+
+                    spare.len = 0;
+                }
+
+            pthread_mutex_unlock(&SaganEveBufferListMutex);
+
+            /* Age based rotation of a file nobody is writing to */
+
+            pthread_mutex_lock(&SaganEveWriteMutex);
+            Sagan_Stream_Maintain(config->eve_stream);
+            pthread_mutex_unlock(&SaganEveWriteMutex);
+
+        }
+
+}
+
+/****************************************************************************
+ * Eve_Init - Starts the flusher thread.  Only the first call does anything.
+ ****************************************************************************/
+
+void Eve_Init( void )
+{
+
+    pthread_t eve_flush_thread;
+    pthread_attr_t eve_flush_thread_attr;
+
+    int rc = 0;
+
+    if ( eve_init == true )
+        {
+            return;
+        }
+
+    eve_init = true;
+
+    pthread_attr_init(&eve_flush_thread_attr);
+    pthread_attr_setdetachstate(&eve_flush_thread_attr,  PTHREAD_CREATE_DETACHED);
+
+    rc = pthread_create( &eve_flush_thread, &eve_flush_thread_attr, (void *)Eve_Flush_Thread, NULL );
+
+    if ( rc != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Could not pthread_create() for EVE flush thread [error: %d]", __FILE__, __LINE__, rc);
+        }
+
+    pthread_attr_destroy(&eve_flush_thread_attr);
+
+}
+
+/****************************************************************************
+ * Eve_Buffer_Get - This thread's buffer,  locked.  Allocated on first use.
+ ****************************************************************************/
+
+static _Sagan_Eve_Buffer *Eve_Buffer_Get( void )
+{
+
+    if ( eve_buffer == NULL )
+        {
+
+            eve_buffer = calloc(1, sizeof(_Sagan_Eve_Buffer));
+
+            if ( eve_buffer == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for EVE buffer. Abort!", __FILE__, __LINE__);
+                }
+
+            pthread_mutex_init(&eve_buffer->lock, NULL);
+
+            pthread_mutex_lock(&SaganEveBufferListMutex);
+            eve_buffer->next = SaganEveBufferList;
+            SaganEveBufferList = eve_buffer;
+            pthread_mutex_unlock(&SaganEveBufferListMutex);
+        }
+
+    pthread_mutex_lock(&eve_buffer->lock);
+
+    if ( eve_buffer->json.len == 0 )
+        {
+            eve_buffer->first_time = Sagan_Clock_Mono_NS() / 1000000;
+        }
+
+    return(eve_buffer);
+}
+
+/****************************************************************************
+ * Eve_Buffer_Done - Ends a record,  writes the buffer out (or leaves it to
+ * the flusher) if it's due,  and unlocks it.
+ ****************************************************************************/
+
+static void Eve_Buffer_Done( _Sagan_Eve_Buffer *buffer )
+{
+
+    JSON_Buffer_Raw(&buffer->json, "\n", 1);
+
+    if ( buffer->json.len >= config->eve_buffer_size ||
+            Sagan_Clock_Mono_NS() / 1000000 - buffer->first_time >= config->eve_flush_interval )
+        {
+
+            if ( config->eve_compress == STREAM_COMPRESS_NONE ||
+                    buffer->json.len >= config->eve_buffer_size * EVE_BACKLOG_FACTOR )
+                {
+                    Eve_Write(&buffer, 1);
+                }
+            else
+                {
+                    pthread_cond_signal(&SaganEveFlushCond);
+                }
+        }
+
+    pthread_mutex_unlock(&buffer->lock);
+
+}
+
 void Alert_JSON( _Sagan_Event *Event )
 {
 
-    char alert_data[MAX_SYSLOGMSG+1024] = { 0 };
+    _Sagan_Eve_Buffer *buffer = NULL;
 
     if ( config->eve_alerts == true )
         {
 
-            Format_JSON_Alert_EVE( Event, alert_data, sizeof(alert_data) );
+            buffer = Eve_Buffer_Get();
 
-            fprintf(config->eve_stream, "%s\n", alert_data);
+            Format_JSON_Alert_EVE( Event, &buffer->json );
 
-        }
+            Eve_Buffer_Done(buffer);
 
-    fflush(config->eve_stream);
+        }
 
 }
 
 void Log_JSON ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, struct timeval tp, json_object *json_normalize )
 {
 
-    char log_data[MAX_SYSLOGMSG+1024] = { 0 };
+    _Sagan_Eve_Buffer *buffer = Eve_Buffer_Get();
 
-    Format_JSON_Log_EVE( SaganProcSyslog_LOCAL, tp, log_data, sizeof(log_data), json_normalize );
-    fprintf(config->eve_stream, "%s\n", log_data);
-    fflush(config->eve_stream);
+    Format_JSON_Log_EVE( SaganProcSyslog_LOCAL, tp, &buffer->json, json_normalize );
 
+    Eve_Buffer_Done(buffer);
 
 }
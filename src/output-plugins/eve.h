@@ -24,6 +24,20 @@
  *
  */
 
+/* Every thread that writes EVE records gets one of these.  Records are
+ * serialized into "json" and written out in bulk */
 
-void Alert_JSON( _Sagan_Event * );
+typedef struct _Sagan_Eve_Buffer _Sagan_Eve_Buffer;
+struct _Sagan_Eve_Buffer
+{
+    pthread_mutex_t lock;
+    _Sagan_JSON_Buffer json;
+    uint64_t first_time;		/* When the oldest unwritten record was added (ms) */
+    struct _Sagan_Eve_Buffer *next;
+};
 
+void Alert_JSON( _Sagan_Event * );
+void Log_JSON ( _Sagan_Proc_Syslog *, struct timeval, json_object * );
+void Eve_Init( void );
+void Eve_Flush_All( void );
+void Eve_Close( void );
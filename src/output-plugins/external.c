@@ -23,6 +23,17 @@
  * Threaded function for user defined external system (execl) calls.  This
  * allows sagan to pass information to a external program.
  *
+ * In "exec" mode (the default) the program is fork()ed/exec()ed for every
+ * alert.  In "persistent" mode "processes" copies of each program are kept
+ * running and alerts are streamed to them over stdin,  round robin.  With
+ * the "text" format each alert is sent as "<length>\n<key:value block>";
+ * with "json" each alert is one line of EVE alert JSON.  A child that
+ * can't take an alert within "timeout" milliseconds is skipped;  one that
+ * stalls part way through an alert is killed and restarted.  A child that
+ * keeps dying right after it starts is restarted with an exponential
+ * backoff,  and after EXTERNAL_MAX_QUICK_EXITS of those in a row the pool
+ * stops restarting it altogether.
+ *
  */
 
 #ifdef HAVE_CONFIG_H
@@ -36,6 +47,12 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
@@ -44,33 +61,47 @@
 #include "lockfile.h"
 #include "references.h"
 #include "sagan-config.h"
+#include "util-time.h"
+#include "json-handler.h"
 #include "output-plugins/external.h"
 
-struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
+struct _SaganCounters *counters;
 
 pthread_mutex_t ext_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* Both protected by ext_mutex */
 
-void External_Thread ( _Sagan_Event *Event, char *execute_script )
+static _Sagan_External_Pool *SaganExternalPools = NULL;
+static _Sagan_JSON_Buffer external_buffer;
+
+/****************************************************************************
+ * External_Format - Builds the record handed to the external program in
+ * external_buffer.  "framed" adds the length prefix used by "persistent"
+ * mode to the key:value format.
+ ****************************************************************************/
+
+static void External_Format( _Sagan_Event *Event, sbool framed )
 {
 
-    int in[2];
-    int out[2];
-    int n, pid;
-    char buf[MAX_SYSLOGMSG];
     char data[MAX_SYSLOGMSG];
-    char tmpref[256];
+    const char *tmpref = NULL;
     char tmp[6];
+    char prefix[32];
 
-    if ( debug->debugexternal )
+    int len = 0;
+
+    external_buffer.len = 0;
+
+    if ( config->external_format == EXTERNAL_FORMAT_JSON )
         {
-            Sagan_Log(WARN, "[%s, line %d] In External_Thread()", __FILE__, __LINE__);
+            Format_JSON_Alert_EVE( Event, &external_buffer );
+            JSON_Buffer_Raw( &external_buffer, "\n", 1 );
+            return;
         }
 
-
-    Reference_Lookup( Event->found, 1, tmpref, sizeof(tmpref));
+    tmpref = Reference_Lookup( Event->found, 1 );
 
     if ( Event->drop == 1 )
         {
@@ -85,7 +116,7 @@ void External_Thread ( _Sagan_Event *Event, char *execute_script )
         }
 
 
-    snprintf(data, sizeof(data), "\n\
+    len = snprintf(data, sizeof(data), "\n\
 ID:%lu:%s\n\
 Message:%s\n\
 Classification:%s\n\
@@ -101,27 +132,57 @@ Facility:%s\n\
 Syslog Priority:%s\n\
 Liblognorm JSON:%s\n\
 %sSyslog message:%s\n"\
-             \
-             ,Event->generatorid\
-             ,Event->sid,\
-             Event->f_msg,\
-             Event->class,\
-             tmp,\
-             Event->pri,\
-             Event->date,\
-             Event->time,\
-             Event->ip_src,\
-             Event->src_port,\
-             Event->ip_dst,\
-             Event->dst_port,\
-             Event->facility,\
-             Event->priority,\
-             !Event->json_normalize ? "{}" : json_object_to_json_string_ext(Event->json_normalize, FJSON_TO_STRING_PLAIN),
-             tmpref,\
-             Event->message);
+                   \
+                   ,Event->generatorid\
+                   ,Event->sid,\
+                   Event->f_msg,\
+                   Event->class,\
+                   tmp,\
+                   Event->pri,\
+                   Event->date,\
+                   Event->time,\
+                   Event->ip_src,\
+                   Event->src_port,\
+                   Event->ip_dst,\
+                   Event->dst_port,\
+                   Event->facility,\
+                   Event->priority,\
+                   !Event->json_normalize ? "{}" : json_object_to_json_string_ext(Event->json_normalize, FJSON_TO_STRING_PLAIN),
+                   tmpref,\
+                   Event->message);
+
+    if ( len < 0 )
+        {
+            return;
+        }
 
+    if ( len >= (int)sizeof(data) )
+        {
+            len = sizeof(data) - 1;
+        }
 
-    pthread_mutex_lock( &ext_mutex );
+    if ( framed == true )
+        {
+            snprintf(prefix, sizeof(prefix), "%d\n", len);
+            JSON_Buffer_Str( &external_buffer, prefix );
+        }
+
+    JSON_Buffer_Raw( &external_buffer, data, len );
+
+}
+
+/****************************************************************************
+ * External_Exec - The original "exec" mode.  Runs "execute_script" once
+ * and feeds it the record.
+ ****************************************************************************/
+
+static void External_Exec( char *execute_script )
+{
+
+    int in[2];
+    int out[2];
+    int n, pid;
+    char buf[MAX_SYSLOGMSG];
 
     if ( pipe(in) < 0 )
         {
@@ -167,21 +228,421 @@ Liblognorm JSON:%s\n\
 
     /* Write to child input */
 
-    n = write(in[1], data, strlen(data));
+    n = write(in[1], external_buffer.data, external_buffer.len);
     close(in[1]);
 
-    n = read(out[0], buf, sizeof(buf));
+    n = read(out[0], buf, sizeof(buf) - 1);
     close(out[0]);
-    buf[n] = 0;
+    buf[ n < 0 ? 0 : n ] = 0;
 
     waitpid(pid, NULL, 0);
 
+}
+
+/****************************************************************************
+ * External_Backoff - Called when a child stops (or couldn't be started).
+ * Decides when it may be restarted.  A child that didn't live for
+ * EXTERNAL_QUICK_EXIT milliseconds probably can't run at all,  so each
+ * quick exit in a row doubles the wait.  Too many and the pool is marked
+ * failed.
+ ****************************************************************************/
+
+static void External_Backoff( _Sagan_External_Pool *pool, _Sagan_External_Child *child )
+{
+
+    uint64_t now = Sagan_Clock_Mono_NS() / 1000000;
+    uint64_t wait = EXTERNAL_BACKOFF_MIN;
+    int i = 0;
+
+    if ( child->started != 0 && now - child->started >= EXTERNAL_QUICK_EXIT )
+        {
+            child->quick_exits = 0;
+            child->started = 0;
+            child->retry = now;
+            return;
+        }
+
+    child->started = 0;
+    child->quick_exits++;
+
+    for ( i = 1; i < child->quick_exits && wait < EXTERNAL_BACKOFF_MAX; i++ )
+        {
+            wait *= 2;
+        }
+
+    child->retry = now + ( wait < EXTERNAL_BACKOFF_MAX ? wait : EXTERNAL_BACKOFF_MAX );
+
+    if ( child->quick_exits >= EXTERNAL_MAX_QUICK_EXITS && pool->failed == false )
+        {
+            pool->failed = true;
+            Sagan_Log(WARN, "[%s, line %d] External program %s exited within %d ms of starting %d times in a row. No longer restarting it; alerts for it will fail until Sagan is restarted.", __FILE__, __LINE__, pool->program, EXTERNAL_QUICK_EXIT, child->quick_exits);
+        }
+
+}
+
+/****************************************************************************
+ * External_Spawn - Starts one long lived copy of the pool's program.  Its
+ * stdin is a pipe we write alerts to;  stdout/stderr go to /dev/null so a
+ * chatty program can't stall on a pipe nobody reads.
+ ****************************************************************************/
+
+static void External_Spawn( _Sagan_External_Pool *pool, _Sagan_External_Child *child )
+{
+
+    sigset_t signal_set;
+
+    int in[2];
+    int devnull = -1;
+    pid_t pid;
+
+    if ( pipe(in) < 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot create input pipe for %s: %s", __FILE__, __LINE__, pool->program, strerror(errno));
+            External_Backoff(pool, child);
+            return;
+        }
+
+    /* Keep the other children's pipes out of this one */
+
+    fcntl(in[0], F_SETFD, FD_CLOEXEC);
+    fcntl(in[1], F_SETFD, FD_CLOEXEC);
+
+    pid = fork();
+
+    if ( pid < 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot create external program process for %s: %s", __FILE__, __LINE__, pool->program, strerror(errno));
+            close(in[0]);
+            close(in[1]);
+            External_Backoff(pool, child);
+            return;
+        }
+
+    if ( pid == 0 )
+        {
+
+            /* Sagan blocks everything for the signal thread;  don't hand
+             * that to the child */
+
+            sigemptyset(&signal_set);
+            sigprocmask(SIG_SETMASK, &signal_set, NULL);
+
+            dup2(in[0], 0);
+
+            devnull = open("/dev/null", O_WRONLY);
+
+            if ( devnull >= 0 )
+                {
+                    dup2(devnull, 1);
+                    dup2(devnull, 2);
+                }
+
+            execl(pool->program, pool->program, (char *)NULL);
+            _exit(127);
+        }
+
+    close(in[0]);
+    fcntl(in[1], F_SETFL, fcntl(in[1], F_GETFL) | O_NONBLOCK);
+
+    child->pid = pid;
+    child->fd = in[1];
+    child->started = Sagan_Clock_Mono_NS() / 1000000;
+
+}
+
+/****************************************************************************
+ * External_Kill - Stops a child and forgets it
+ ****************************************************************************/
+
+static void External_Kill( _Sagan_External_Pool *pool, _Sagan_External_Child *child )
+{
+
+    if ( child->fd >= 0 )
+        {
+            close(child->fd);
+            child->fd = -1;
+        }
+
+    if ( child->pid > 0 )
+        {
+            kill(child->pid, SIGKILL);
+            waitpid(child->pid, NULL, 0);
+            child->pid = 0;
+        }
+
+    if ( child->started != 0 )
+        {
+            External_Backoff(pool, child);
+        }
+
+}
+
+/****************************************************************************
+ * External_Pool_Get - Finds,  or starts,  the pool for "program"
+ ****************************************************************************/
+
+static _Sagan_External_Pool *External_Pool_Get( char *program )
+{
+
+    _Sagan_External_Pool *pool = NULL;
+    int i = 0;
+
+    for ( pool = SaganExternalPools; pool != NULL; pool = pool->next_pool )
+        {
+            if ( !strcmp(pool->program, program) )
+                {
+                    return(pool);
+                }
+        }
+
+    if ( access(program, X_OK) != 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] External program %s is not executable: %s", __FILE__, __LINE__, program, strerror(errno));
+        }
+
+    pool = calloc(1, sizeof(_Sagan_External_Pool));
+
+    if ( pool == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for external pool. Abort!", __FILE__, __LINE__);
+        }
+
+    pool->children = calloc(config->external_processes, sizeof(_Sagan_External_Child));
+
+    if ( pool->children == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for external pool. Abort!", __FILE__, __LINE__);
+        }
+
+    strlcpy(pool->program, program, sizeof(pool->program));
+    pool->count = config->external_processes;
+
+    for ( i = 0; i < pool->count; i++ )
+        {
+            pool->children[i].fd = -1;
+            External_Spawn(pool, &pool->children[i]);
+        }
+
+    Sagan_Log(NORMAL, "Started %d persistent copies of external program %s", pool->count, program);
+
+    pool->next_pool = SaganExternalPools;
+    SaganExternalPools = pool;
+
+    return(pool);
+}
+
+/****************************************************************************
+ * External_Pool_Reap - Restarts children that have exited,  once their
+ * backoff (see External_Backoff()) has passed
+ ****************************************************************************/
+
+static void External_Pool_Reap( _Sagan_External_Pool *pool )
+{
+
+    _Sagan_External_Child *child = NULL;
+    uint64_t now = Sagan_Clock_Mono_NS() / 1000000;
+    int i = 0;
+
+    for ( i = 0; i < pool->count; i++ )
+        {
+
+            child = &pool->children[i];
+
+            if ( child->pid > 0 && waitpid(child->pid, NULL, WNOHANG) == child->pid )
+                {
+                    child->pid = 0;
+                    External_Kill(pool, child);
+                }
+
+            if ( child->pid == 0 && pool->failed == false && now >= child->retry )
+                {
+
+                    External_Spawn(pool, child);
+
+                    if ( child->pid > 0 )
+                        {
+                            __atomic_add_fetch(&counters->external_restart_count, 1, __ATOMIC_SEQ_CST);
+                        }
+                }
+        }
+
+}
+
+/****************************************************************************
+ * External_Pool_Send - Writes external_buffer to the next child that can
+ * take it.  Gives up after "timeout" milliseconds.
+ ****************************************************************************/
+
+static void External_Pool_Send( _Sagan_External_Pool *pool )
+{
+
+    struct pollfd pfd[pool->count];
+    int index[pool->count];
+
+    _Sagan_External_Child *child = NULL;
+
+    uint64_t deadline = Sagan_Clock_Mono_NS() / 1000000 + config->external_timeout;
+    uint64_t now = 0;
+
+    size_t offset = 0;
+    ssize_t written = 0;
+
+    int nfds = 0;
+    int rc = 0;
+    int i = 0;
+    int j = 0;
+
+    External_Pool_Reap(pool);
+
+    for (;;)
+        {
+
+            now = Sagan_Clock_Mono_NS() / 1000000;
+
+            if ( now >= deadline )
+                {
+                    break;
+                }
+
+            /* Wait for any child with room,  starting at the round robin
+             * position */
+
+            nfds = 0;
+
+            for ( i = 0; i < pool->count; i++ )
+                {
+
+                    j = ( pool->next + i ) % pool->count;
+
+                    if ( pool->children[j].fd >= 0 )
+                        {
+                            pfd[nfds].fd = pool->children[j].fd;
+                            pfd[nfds].events = POLLOUT;
+                            pfd[nfds].revents = 0;
+                            index[nfds++] = j;
+                        }
+                }
+
+            if ( nfds == 0 )
+                {
+                    break;
+                }
+
+            rc = poll(pfd, nfds, deadline - now);
+
+            if ( rc < 0 && errno == EINTR )
+                {
+                    continue;
+                }
+
+            if ( rc <= 0 )
+                {
+                    break;
+                }
+
+            for ( i = 0; i < nfds && pfd[i].revents == 0; i++ );
+
+            child = &pool->children[index[i]];
+
+            if ( pfd[i].revents & ( POLLERR | POLLHUP | POLLNVAL ) )
+                {
+                    External_Kill(pool, child);
+                    continue;
+                }
+
+            /* Now the whole record has to go to this child */
+
+            offset = 0;
+
+            while ( offset < external_buffer.len )
+                {
+
+                    written = write(child->fd, external_buffer.data + offset, external_buffer.len - offset);
+
+                    if ( written > 0 )
+                        {
+                            offset += written;
+                            continue;
+                        }
+
+                    if ( written < 0 && errno == EINTR )
+                        {
+                            continue;
+                        }
+
+                    now = Sagan_Clock_Mono_NS() / 1000000;
+
+                    if ( written < 0 && errno == EAGAIN && now < deadline )
+                        {
+                            pfd[0].fd = child->fd;
+                            pfd[0].events = POLLOUT;
+                            poll(pfd, 1, deadline - now);
+                            continue;
+                        }
+
+                    break;
+                }
+
+            if ( offset == external_buffer.len )
+                {
+                    pool->next = ( index[i] + 1 ) % pool->count;
+                    __atomic_add_fetch(&counters->external_count_success, 1, __ATOMIC_SEQ_CST);
+                    return;
+                }
+
+            /* Nothing went out;  the child is just busy */
+
+            if ( offset == 0 && errno == EAGAIN )
+                {
+                    break;
+                }
+
+            /* A half written record leaves the child out of step.  It's
+             * either dead (EPIPE) or stuck;  either way it's restarted */
+
+            if ( offset != 0 )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] External program %s (pid %d) stalled part way through an alert. Restarting.", __FILE__, __LINE__, pool->program, (int)child->pid);
+                }
+
+            External_Kill(pool, child);
+
+            if ( offset != 0 )
+                {
+                    break;
+                }
+        }
+
+    __atomic_add_fetch(&counters->external_count_failed, 1, __ATOMIC_SEQ_CST);
+
+}
+
+void External_Thread ( _Sagan_Event *Event, char *execute_script )
+{
+
+    if ( debug->debugexternal )
+        {
+            Sagan_Log(WARN, "[%s, line %d] In External_Thread()", __FILE__, __LINE__);
+        }
+
+    pthread_mutex_lock( &ext_mutex );
+
+    if ( config->external_mode == EXTERNAL_MODE_PERSISTENT )
+        {
+            External_Format( Event, true );
+            External_Pool_Send( External_Pool_Get(execute_script) );
+        }
+    else
+        {
+            External_Format( Event, false );
+            External_Exec( execute_script );
+        }
+
     pthread_mutex_unlock( &ext_mutex );
 
     if ( debug->debugexternal == 1 )
         {
-            Sagan_Log(DEBUG, "[%s, line %d] Executed %s", __FILE__, __LINE__, config->sagan_external_command);
+            Sagan_Log(DEBUG, "[%s, line %d] Executed %s", __FILE__, __LINE__, execute_script);
         }
 
 }
-
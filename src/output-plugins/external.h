@@ -22,4 +22,28 @@
 #include "config.h"             /* From autoconf */
 #endif
 
+/* "persistent" mode keeps "processes" copies of each external program
+ * running and feeds them alerts over stdin */
+
+typedef struct _Sagan_External_Child _Sagan_External_Child;
+struct _Sagan_External_Child
+{
+    pid_t pid;
+    int fd;				/* Write end of the child's stdin, -1 == not running */
+    uint64_t started;			/* Monotonic ms,  0 == not running */
+    uint64_t retry;			/* Monotonic ms,  don't restart before this */
+    int quick_exits;			/* In a row,  see EXTERNAL_QUICK_EXIT */
+};
+
+typedef struct _Sagan_External_Pool _Sagan_External_Pool;
+struct _Sagan_External_Pool
+{
+    char program[MAXPATH];
+    int count;
+    int next;				/* Round robin */
+    sbool failed;			/* Children exit right away,  no more restarts */
+    _Sagan_External_Child *children;
+    struct _Sagan_External_Pool *next_pool;
+};
+
 void External_Thread( _Sagan_Event *, char * );
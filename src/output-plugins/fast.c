@@ -40,7 +40,6 @@
 
 #include "output-plugins/alert.h"
 
-struct _Rule_Struct *rulestruct;
 struct _SaganConfig *config;
 
 void Fast_File( _Sagan_Event *Event )
@@ -75,6 +74,4 @@ void Fast_File( _Sagan_Event *Event )
 
     fprintf(config->sagan_fast_stream," %s:%d -> %s:%d\n", Event->ip_src, Event->src_port, Event->ip_dst, Event->dst_port);
 
-    fflush(config->sagan_fast_stream);
-
 }
@@ -28,6 +28,11 @@
  * The majority of the code was taken from the samtool.c which is distributed
  * with Snortsam.
  *
+ * FWSam() only queues the block.  A snortsam thread sends it to every
+ * station over a session that stays checked in (and,  for agents that
+ * support it,  connected) between blocks.  A block for an IP/duration that
+ * was already sent is not sent again until that block has run out.
+ *
  */
 
 /*
@@ -81,63 +86,328 @@
 
 #include <pthread.h>
 #include <stdbool.h>
+#include <sys/time.h>
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "rules.h"
 #include "sagan-config.h"
+#include "util-time.h"
 
 #include "output-plugins/snortsam.h"
 
-#define NUM_HOSTS 255
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL	0
+#endif
+
+#define FWSAM_STATIONS_MAX	32
 #define FWSAM_NETWAIT	1000
 #define FWSAM_NETHOLD 	6000
+#define FWSAM_SEEN_BUCKETS	4096
+#define FWSAM_SEEN_MAX		65536
+#define FWSAM_SEEN_TTL		3600	/* Longest a block (even a permanent one) suppresses duplicates */
 
-struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
+struct _SaganCounters *counters;
+
+unsigned short blockport=0,blockproto=0,blocklog=FWSAM_LOG_NONE,blockhow=FWSAM_HOW_INOUT,blockmode=FWSAM_STATUS_BLOCK;
 
-unsigned long blockip[NUM_HOSTS +1],blockpeer[NUM_HOSTS +1],blockduration=0,blocksid=0;
-unsigned short blockport=0,blockproto=0,blocklog=FWSAM_LOG_NONE,blockhow=FWSAM_HOW_INOUT,blockmode=FWSAM_STATUS_BLOCK,checkout=true;
+/* The stations and their sessions.  Only the snortsam thread (and
+ * FWSam_Init()/FWSam_Close()) touch them,  under fwsam_mutex */
 
 pthread_mutex_t fwsam_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static FWsamStation stations[FWSAM_STATIONS_MAX];
+static int station_count = 0;
+static char station_info[1024] = { 0 };
+
+/* Requests waiting for the snortsam thread,  and the (ip, duration) pairs
+ * sent in the last FWSAM_SEEN_TTL seconds whose block hasn't run out yet */
+
+static pthread_mutex_t SaganFWSamQueueMutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t SaganFWSamQueueCond=PTHREAD_COND_INITIALIZER;
+
+static _Sagan_FWSam_Request *queue_head = NULL;
+static _Sagan_FWSam_Request *queue_tail = NULL;
+
+static _Sagan_FWSam_Seen *seen[FWSAM_SEEN_BUCKETS];
+static int seen_count = 0;
+
+static sbool fwsam_init = false;
+
+pthread_mutex_t CounterFWSamMutex=PTHREAD_MUTEX_INITIALIZER;
+
+static int FWsamBlock(FWsamStation *, unsigned long, unsigned long, unsigned long);
+
+/****************************************************************************
+ * FWSam_Seen_Hash - Bucket for an (ip, duration) pair
+ ****************************************************************************/
+
+static unsigned int FWSam_Seen_Hash( unsigned long ip, unsigned long duration )
+{
+    return( ( ip * 2654435761UL ^ duration ) % FWSAM_SEEN_BUCKETS );
+}
+
+/****************************************************************************
+ * FWSam_Seen - Returns true if a block for ip/duration was already sent
+ * and hasn't expired.  Expired entries in the bucket are dropped on the
+ * way.  The caller holds SaganFWSamQueueMutex.
+ ****************************************************************************/
+
+static sbool FWSam_Seen( unsigned long ip, unsigned long duration, time_t now )
+{
+
+    _Sagan_FWSam_Seen **p = &seen[FWSam_Seen_Hash(ip, duration)];
+    _Sagan_FWSam_Seen *s = NULL;
+
+    while ( *p != NULL )
+        {
+
+            s = *p;
+
+            if ( s->expires <= now )
+                {
+                    *p = s->next;
+                    free(s);
+                    seen_count--;
+                    continue;
+                }
+
+            if ( s->ip == ip && s->duration == duration )
+                {
+                    return(true);
+                }
+
+            p = &s->next;
+        }
+
+    return(false);
+}
+
+/****************************************************************************
+ * FWSam_Remember - Records that ip/duration is queued so duplicates get
+ * suppressed for the length of the block,  but no longer than
+ * FWSAM_SEEN_TTL.  Permanent (zero duration) blocks are sent again after
+ * that,  so the table doesn't fill up with them.  The caller holds
+ * SaganFWSamQueueMutex.
+ ****************************************************************************/
+
+static void FWSam_Remember( unsigned long ip, unsigned long duration, time_t now )
+{
+
+    unsigned int hash = FWSam_Seen_Hash(ip, duration);
+    _Sagan_FWSam_Seen *s = NULL;
+
+    if ( seen_count >= FWSAM_SEEN_MAX )
+        {
+            return;
+        }
+
+    s = malloc(sizeof(_Sagan_FWSam_Seen));
+
+    if ( s == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for snortsam request. Abort!", __FILE__, __LINE__);
+        }
+
+    s->ip = ip;
+    s->duration = duration;
+    s->expires = now + ( duration == 0 || duration > FWSAM_SEEN_TTL ? FWSAM_SEEN_TTL : duration );
+    s->next = seen[hash];
+
+    seen[hash] = s;
+    seen_count++;
+
+}
+
+/****************************************************************************
+ * FWSam_Forget - Removes ip/duration from the seen table,  so the next
+ * alert tries again.  Used when a block could not be sent.
+ ****************************************************************************/
+
+static void FWSam_Forget( unsigned long ip, unsigned long duration )
+{
+
+    _Sagan_FWSam_Seen **p = NULL;
+    _Sagan_FWSam_Seen *s = NULL;
+
+    pthread_mutex_lock(&SaganFWSamQueueMutex);
+
+    for ( p = &seen[FWSam_Seen_Hash(ip, duration)]; *p != NULL; p = &(*p)->next )
+        {
+
+            if ( (*p)->ip == ip && (*p)->duration == duration )
+                {
+                    s = *p;
+                    *p = s->next;
+                    free(s);
+                    seen_count--;
+                    break;
+                }
+        }
+
+    pthread_mutex_unlock(&SaganFWSamQueueMutex);
+
+}
+
+/****************************************************************************
+ * FWSam - Queues a block for the snortsam thread.  Requests for an
+ * ip/duration that was already sent within its block time are dropped
+ ****************************************************************************/
+
 void FWSam( _Sagan_Event *Event )
 {
 
-    pthread_mutex_lock(&fwsam_mutex);
+    _Sagan_FWSam_Request *request = NULL;
 
-    int retval=0;
+    unsigned long ip = 0;
+    unsigned long duration = rulestruct[Event->found].fwsam_seconds;
 
-    blockduration=rulestruct[Event->found].fwsam_seconds;
-    blocksid=atol(Event->sid);
+    time_t now = (time_t)Sagan_Clock_Epoch();
 
     if ( rulestruct[Event->found].fwsam_src_or_dst == 1 )
         {
-            blockip[0]=inet_addr(Event->ip_src);
-            blockip[1]=0;
+            ip = inet_addr(Event->ip_src);
         }
     else
         {
-            blockip[0]=inet_addr(Event->ip_dst);
-            blockip[1]=0;
+            ip = inet_addr(Event->ip_dst);
+        }
+
+    if ( ip == INADDR_NONE )
+        {
+            if ( debug->debugfwsam )
+                {
+                    Sagan_Log(DEBUG, "[FWSam] No valid IP to block for sid %s", Event->sid);
+                }
+
+            return;
         }
 
-    retval|=FWsamBlock(config->sagan_fwsam_info);
+    pthread_mutex_lock(&SaganFWSamQueueMutex);
 
-    pthread_mutex_unlock(&fwsam_mutex);
+    if ( FWSam_Seen(ip, duration, now) )
+        {
+            pthread_mutex_unlock(&SaganFWSamQueueMutex);
+
+            pthread_mutex_lock(&CounterFWSamMutex);
+            counters->fwsam_count_suppressed++;
+            pthread_mutex_unlock(&CounterFWSamMutex);
+
+            return;
+        }
+
+    if ( counters->fwsam_queue_depth >= (uint64_t)config->fwsam_queue_size )
+        {
+            pthread_mutex_unlock(&SaganFWSamQueueMutex);
+
+            pthread_mutex_lock(&CounterFWSamMutex);
+            counters->fwsam_count_dropped++;
+            pthread_mutex_unlock(&CounterFWSamMutex);
+
+            return;
+        }
+
+    request = malloc(sizeof(_Sagan_FWSam_Request));
+
+    if ( request == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for snortsam request. Abort!", __FILE__, __LINE__);
+        }
+
+    request->ip = ip;
+    request->duration = duration;
+    request->sid = atol(Event->sid);
+    request->next = NULL;
+    request->queued = Sagan_Clock_Mono_NS();
+
+    if ( queue_tail == NULL )
+        {
+            queue_head = request;
+        }
+    else
+        {
+            queue_tail->next = request;
+        }
+
+    queue_tail = request;
+    counters->fwsam_queue_depth++;
+
+    FWSam_Remember(ip, duration, now);
+
+    pthread_cond_signal(&SaganFWSamQueueCond);
+    pthread_mutex_unlock(&SaganFWSamQueueMutex);
 
 }
 
-int FWsamBlock(char *arg)
+/****************************************************************************
+ * FWSam_Take - Takes the next request off the queue,  waiting for one if
+ * "wait" is set.  Returns NULL when there is nothing to do.
+ ****************************************************************************/
+
+static _Sagan_FWSam_Request *FWSam_Take( sbool wait )
 {
 
-    char str[512],*p,*encbuf,*decbuf,*samport,*sampass,*samhost;
-    int i,error=true,len,ipidx=0,peeridx=0;
-    FWsamPacket sampacket;
+    _Sagan_FWSam_Request *request = NULL;
+
+    pthread_mutex_lock(&SaganFWSamQueueMutex);
+
+    while ( wait == true && queue_head == NULL )
+        {
+            pthread_cond_wait(&SaganFWSamQueueCond, &SaganFWSamQueueMutex);
+        }
+
+    request = queue_head;
+
+    if ( request != NULL )
+        {
+
+            queue_head = request->next;
+
+            if ( queue_head == NULL )
+                {
+                    queue_tail = NULL;
+                }
+
+            counters->fwsam_queue_depth--;
+        }
+
+    pthread_mutex_unlock(&SaganFWSamQueueMutex);
+
+    return(request);
+}
+
+/****************************************************************************
+ * FWsamDisconnect - Closes a station's socket,  if it has one open
+ ****************************************************************************/
+
+static void FWsamDisconnect( FWsamStation *station )
+{
+
+    if ( station->stationsocket != INVALID_SOCKET )
+        {
+            closesocket(station->stationsocket);
+            station->stationsocket = INVALID_SOCKET;
+        }
+
+}
+
+/****************************************************************************
+ * FWsamStationSetup - Fills in a station from "host[:port][/password]".
+ * Returns false if the host can't be used.
+ ****************************************************************************/
+
+static int FWsamStationSetup( char *arg, FWsamStation *station )
+{
+
+    char str[512],*p,*samport,*sampass,*samhost;
     struct hostent *hoste;
     unsigned long samip;
-    FWsamStation station;
 
     strlcpy(str,arg, sizeof(str));
 
@@ -169,7 +439,7 @@ int FWsamBlock(char *arg)
             if(!hoste)
                 {
                     Sagan_Log(WARN, "[%s, line %d] Unable to resolve host '%s', ignoring entry!" , __FILE__, __LINE__, samhost);
-                    return(1);
+                    return false;
                 }
             else
                 samip=*(unsigned long *)hoste->h_addr;
@@ -180,336 +450,589 @@ int FWsamBlock(char *arg)
             if(!samip)
                 {
                     Sagan_Log(WARN, "[%s, line %d] Invalid host address '%s', ignoring entry!", __FILE__, __LINE__, samhost);
-                    return(1);
+                    return false;
                 }
         }
 
+    memset(station, 0, sizeof(FWsamStation));
 
-    station.stationip.s_addr=samip;
+    station->stationip.s_addr=samip;
     if(samport!=NULL && atoi(samport)>0)
-        station.stationport=atoi(samport);
+        station->stationport=atoi(samport);
     else
-        station.stationport=FWSAM_DEFAULTPORT;
+        station->stationport=FWSAM_DEFAULTPORT;
     if(sampass!=NULL)
         {
-            strncpy(station.stationkey,sampass,TwoFish_KEY_LENGTH);
-            station.stationkey[TwoFish_KEY_LENGTH]=0;
+            strncpy(station->initialkey,sampass,TwoFish_KEY_LENGTH);
+            station->initialkey[TwoFish_KEY_LENGTH]=0;
         }
     else
-        station.stationkey[0]=0;
+        station->initialkey[0]=0;
+
+    station->localsocketaddr.sin_port=htons(0);
+    station->localsocketaddr.sin_addr.s_addr=0;
+    station->localsocketaddr.sin_family=AF_INET;
+    station->stationsocketaddr.sin_port=htons(station->stationport);
+    station->stationsocketaddr.sin_addr=station->stationip;
+    station->stationsocketaddr.sin_family=AF_INET;
+
+    station->stationsocket=INVALID_SOCKET;
+    station->checkedin=false;
+
+    return true;
+}
+
+/****************************************************************************
+ * FWsamStationCheckIn - Starts a new session with a station:  fresh
+ * sequence numbers and key modifiers,  back to the initial key.
+ ****************************************************************************/
+
+static int FWsamStationCheckIn( FWsamStation *station )
+{
+
+    FWsamDisconnect(station);
 
-    strlcpy(station.initialkey,station.stationkey,sizeof(station.initialkey));
-    station.stationfish=TwoFishInit(station.stationkey);
+    if ( station->stationfish != NULL )
+        {
+            TwoFishDestroy(station->stationfish);
+        }
 
-    station.localsocketaddr.sin_port=htons(0);
-    station.localsocketaddr.sin_addr.s_addr=0;
-    station.localsocketaddr.sin_family=AF_INET;
-    station.stationsocketaddr.sin_port=htons(station.stationport);
-    station.stationsocketaddr.sin_addr=station.stationip;
-    station.stationsocketaddr.sin_family=AF_INET;
+    strlcpy(station->stationkey,station->initialkey,sizeof(station->stationkey));
+    station->stationfish=TwoFishInit(station->stationkey);
 
     do
-        station.myseqno=rand();
-    while(station.myseqno<20 || station.myseqno>65500);
-    station.mykeymod[0]=rand();
-    station.mykeymod[1]=rand();
-    station.mykeymod[2]=rand();
-    station.mykeymod[3]=rand();
-    station.stationseqno=0;
-    station.persistentsocket=true;
-    station.packetversion=FWSAM_PACKETVERSION_PERSISTENT_CONN;
+        station->myseqno=rand();
+    while(station->myseqno<20 || station->myseqno>65500);
+    station->mykeymod[0]=rand();
+    station->mykeymod[1]=rand();
+    station->mykeymod[2]=rand();
+    station->mykeymod[3]=rand();
+    station->stationseqno=0;
+    station->persistentsocket=true;
+    station->packetversion=FWSAM_PACKETVERSION_PERSISTENT_CONN;
+
+    station->checkedin = FWsamCheckIn(station);
+
+    return(station->checkedin);
+}
+
+/****************************************************************************
+ * FWsamStationBlock - Sends a block to one station,  checking in first if
+ * there is no session.  An established session that fails (the agent may
+ * have dropped an idle connection) gets one fresh check in and retry.
+ * Returns true on error.
+ ****************************************************************************/
+
+static int FWsamStationBlock( FWsamStation *station, _Sagan_FWSam_Request *request )
+{
 
-    if(FWsamCheckIn(&station))
+    sbool fresh = false;
+
+    if ( station->checkedin == false )
         {
-            error=false;
 
-            do
+            if ( !FWsamStationCheckIn(station) )
                 {
-                    ipidx=0;
-                    do
+                    return true;
+                }
+
+            fresh = true;
+        }
+
+    if ( !FWsamBlock(station, request->ip, request->duration, request->sid) )
+        {
+            return false;
+        }
+
+    FWsamDisconnect(station);
+    station->checkedin = false;
+
+    if ( fresh == true || !FWsamStationCheckIn(station) )
+        {
+            return true;
+        }
+
+    if ( !FWsamBlock(station, request->ip, request->duration, request->sid) )
+        {
+            return false;
+        }
+
+    FWsamDisconnect(station);
+    station->checkedin = false;
+
+    return true;
+}
+
+/****************************************************************************
+ * FWSam_Send - Sends a request to every station and frees it.  A request
+ * that didn't make it to every station is forgotten,  so a later alert
+ * can try again.
+ ****************************************************************************/
+
+static void FWSam_Send( _Sagan_FWSam_Request *request )
+{
+
+    uint64_t latency = 0;
+
+    int error = false;
+    int i = 0;
+
+    pthread_mutex_lock(&fwsam_mutex);
+
+    for ( i = 0; i < station_count; i++ )
+        {
+            error |= FWsamStationBlock(&stations[i], request);
+        }
+
+    pthread_mutex_unlock(&fwsam_mutex);
+
+    if ( error || station_count == 0 )
+        {
+            FWSam_Forget(request->ip, request->duration);
+        }
+
+    latency = ( Sagan_Clock_Mono_NS() - request->queued ) / 1000;
+
+    pthread_mutex_lock(&CounterFWSamMutex);
+
+    if ( error || station_count == 0 )
+        {
+            counters->fwsam_count_failed++;
+        }
+    else
+        {
+            counters->fwsam_count++;
+        }
+
+    counters->fwsam_latency_total += latency;
+
+    if ( latency > counters->fwsam_latency_max )
+        {
+            counters->fwsam_latency_max = latency;
+        }
+
+    pthread_mutex_unlock(&CounterFWSamMutex);
+
+    free(request);
+
+}
+
+/****************************************************************************
+ * FWSam_Thread - Works the request queue
+ ****************************************************************************/
+
+static void FWSam_Thread( void )
+{
+
+    (void)SetThreadName("SaganFWSam");
+
+    for (;;)
+        {
+            FWSam_Send( FWSam_Take(true) );
+        }
+
+}
+
+/****************************************************************************
+ * FWSam_Checkout_All - Ends every session and forgets the stations.  The
+ * caller holds fwsam_mutex.
+ ****************************************************************************/
+
+static void FWSam_Checkout_All( void )
+{
+
+    int i = 0;
+
+    for ( i = 0; i < station_count; i++ )
+        {
+
+            if ( stations[i].checkedin == true )
+                {
+                    FWsamCheckOut(&stations[i]);
+                }
+
+            FWsamDisconnect(&stations[i]);
+
+            if ( stations[i].stationfish != NULL )
+                {
+                    TwoFishDestroy(stations[i].stationfish);
+                }
+        }
+
+    station_count = 0;
+    station_info[0] = '\0';
+
+}
+
+/****************************************************************************
+ * FWSam_Init - Loads the station list from the "server" option and starts
+ * the snortsam thread.  On a reload,  the stations are only replaced if
+ * "server" changed.  Stations check in on their first block.
+ ****************************************************************************/
+
+void FWSam_Init( void )
+{
+
+    pthread_t fwsam_thread;
+    pthread_attr_t fwsam_thread_attr;
+
+    char tmp[1024];
+    char *tok = NULL;
+    char *ptr = NULL;
+
+    int rc = 0;
+
+    pthread_mutex_lock(&fwsam_mutex);
+
+    if ( strcmp(station_info, config->sagan_fwsam_info) )
+        {
+
+            FWSam_Checkout_All();
+
+            strlcpy(station_info, config->sagan_fwsam_info, sizeof(station_info));
+            strlcpy(tmp, config->sagan_fwsam_info, sizeof(tmp));
+
+            for ( tok = strtok_r(tmp, " \t", &ptr); tok != NULL; tok = strtok_r(NULL, " \t", &ptr) )
+                {
+
+                    if ( station_count >= FWSAM_STATIONS_MAX )
                         {
-                            if(!station.persistentsocket)
-                                {
-                                    /* create a socket for the station */
-                                    station.stationsocket=socket(PF_INET,SOCK_STREAM,IPPROTO_TCP);
-                                    if(station.stationsocket==INVALID_SOCKET)
-                                        {
-                                            Sagan_Log(WARN, "[%s, line %d]  Invalid Socket error!", __FILE__, __LINE__ );
-                                            error=true;
-                                        }
-                                    if(bind(station.stationsocket,(struct sockaddr *)&(station.localsocketaddr),sizeof(struct sockaddr)))
-                                        {
-                                            Sagan_Log(WARN, "[%s, line %d] Can not bind socket!", __FILE__, __LINE__);
-                                            error=true;
-                                        }
-                                }
-                            else
-                                error=false;
-                            if(!error)
-                                {
-                                    if(!station.persistentsocket)
-                                        {
-                                            /* let's connect to the agent */
-                                            if(connect(station.stationsocket,(struct sockaddr *)&station.stationsocketaddr,sizeof(struct sockaddr)))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Could not send block to host %s.", __FILE__, __LINE__, inet_ntoa(station.stationip));
-                                                    closesocket(station.stationsocket);
-                                                    error=true;
-                                                }
-                                        }
+                            Sagan_Log(WARN, "[%s, line %d] Too many snortsam stations, only the first %d are used.", __FILE__, __LINE__, FWSAM_STATIONS_MAX);
+                            break;
+                        }
 
-                                    if(!error)
-                                        {
-                                            if( debug->debugfwsam )
-                                                {
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Connected to host %s. %s IP %s", inet_ntoa(station.stationip),blockmode==FWSAM_STATUS_BLOCK?"Blocking":"Unblocking",inettoa(blockip[ipidx]));
-                                                }
+                    if ( FWsamStationSetup(tok, &stations[station_count]) )
+                        {
+                            station_count++;
+                        }
+                }
 
-                                            /* now build the packet */
-                                            station.myseqno+=station.stationseqno; /* increase my seqno by adding agent seq no */
-                                            sampacket.endiancheck=1;                                                /* This is an endian indicator for Snortsam */
-                                            sampacket.snortseqno[0]=(char)station.myseqno;
-                                            sampacket.snortseqno[1]=(char)(station.myseqno>>8);
-                                            sampacket.fwseqno[0]=(char)station.stationseqno;/* fill station seqno */
-                                            sampacket.fwseqno[1]=(char)(station.stationseqno>>8);
-                                            sampacket.status=blockmode;                     /* set block action */
-                                            sampacket.version=station.packetversion;                        /* set packet version */
-                                            sampacket.duration[0]=(char)blockduration;              /* set duration */
-                                            sampacket.duration[1]=(char)(blockduration>>8);
-                                            sampacket.duration[2]=(char)(blockduration>>16);
-                                            sampacket.duration[3]=(char)(blockduration>>24);
-                                            sampacket.fwmode=blocklog|blockhow|FWSAM_WHO_SRC; /* set the mode */
-                                            sampacket.dstip[0]=(char)blockpeer[peeridx]; /* destination IP */
-                                            sampacket.dstip[1]=(char)(blockpeer[peeridx]>>8);
-                                            sampacket.dstip[2]=(char)(blockpeer[peeridx]>>16);
-                                            sampacket.dstip[3]=(char)(blockpeer[peeridx]>>24);
-                                            sampacket.srcip[0]=(char)blockip[ipidx];        /* source IP */
-                                            sampacket.srcip[1]=(char)(blockip[ipidx]>>8);
-                                            sampacket.srcip[2]=(char)(blockip[ipidx]>>16);
-                                            sampacket.srcip[3]=(char)(blockip[ipidx]>>24);
-                                            sampacket.protocol[0]=(char)blockproto; /* protocol */
-                                            sampacket.protocol[1]=(char)(blockproto>>8);/* protocol */
-
-                                            if(blockproto==6 || blockproto==17)
-                                                {
-                                                    sampacket.dstport[0]=(char)blockport;
-                                                    sampacket.dstport[1]=(char)(blockport>>8);
-                                                }
-                                            else
-                                                sampacket.dstport[0]=sampacket.dstport[1]=0;
-                                            sampacket.srcport[0]=sampacket.srcport[1]=0;
+            if ( station_count == 0 )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] No usable snortsam stations in '%s'!", __FILE__, __LINE__, config->sagan_fwsam_info);
+                }
+        }
 
-                                            sampacket.sig_id[0]=(char)blocksid;             /* set signature ID */
-                                            sampacket.sig_id[1]=(char)(blocksid>>8);
-                                            sampacket.sig_id[2]=(char)(blocksid>>16);
-                                            sampacket.sig_id[3]=(char)(blocksid>>24);
+    pthread_mutex_unlock(&fwsam_mutex);
 
-                                            if( debug->debugfwsam )
-                                                {
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Sending %s",blockmode==FWSAM_STATUS_BLOCK?"BLOCK":"UNBLOCK");
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Snort SeqNo:  %x",station.myseqno);
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Mgmt SeqNo :  %x",station.stationseqno);
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Status     :  %i",blockmode);
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Version    :  %i",station.packetversion);
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Mode       :  %i",blocklog|blockhow|FWSAM_WHO_SRC);
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Duration   :  %li",blockduration);
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Protocol   :  %i",blockproto);
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Src IP     :  %s",inettoa(blockip[ipidx]));
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Src Port   :  %i",0);
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Dest IP    :  %s",inettoa(blockpeer[peeridx]));
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Dest Port  :  %i",blockport);
-                                                    Sagan_Log(DEBUG, "[FWsamBlock] Sig_ID     :  %lu",blocksid);
-                                                }
+    if ( fwsam_init == true )
+        {
+            return;
+        }
 
-                                            encbuf=TwoFishAlloc(sizeof(FWsamPacket),false,false,station.stationfish); /* get the encryption buffer */
-                                            len=TwoFishEncrypt((char *)&sampacket,(char **)&encbuf,sizeof(FWsamPacket),false,station.stationfish); /* encrypt the packet with current key */
+    fwsam_init = true;
 
-                                            if(send(station.stationsocket,encbuf,len,0)!=len)   /* weird...could not send */
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Could not send to host %s" , __FILE__, __LINE__, inet_ntoa(station.stationip));
-                                                    closesocket(station.stationsocket);
-                                                    error=true;
-                                                }
-                                            else
-                                                {
-                                                    i=FWSAM_NETWAIT;
-                                                    ioctlsocket(station.stationsocket,FIONBIO,&i);  /* set non blocking and wait for  */
-                                                    while(i-- >1)                                                   /* the response packet   */
-                                                        {
-                                                            waitms(10); /* wait for response (default maximum 3 secs */
-                                                            if(recv(station.stationsocket,encbuf,len,0)==len)
-                                                                i=0; /* if we received packet we set the counter to 0. */
-                                                            /* by the time we check with if, it's already dec'ed to -1 */
-                                                        }
-                                                    if(!i)   /* id we timed out (i was one, then dec'ed)... */
-                                                        {
+    pthread_attr_init(&fwsam_thread_attr);
+    pthread_attr_setdetachstate(&fwsam_thread_attr,  PTHREAD_CREATE_DETACHED);
 
-                                                            Sagan_Log(WARN, "[%s, line %d] Did not receive response from host %s" , __FILE__, __LINE__, inet_ntoa(station.stationip) );
-                                                            closesocket(station.stationsocket);
-                                                            error=true;
-                                                        }
-                                                    else     /* got a packet */
-                                                        {
-                                                            decbuf=(char *)&sampacket; /* get the pointer to the packet struct */
-                                                            len=TwoFishDecrypt(encbuf,(char **)&decbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,false,station.stationfish); /* try to decrypt the packet with current key */
+    rc = pthread_create( &fwsam_thread, &fwsam_thread_attr, (void *)FWSam_Thread, NULL );
+
+    if ( rc != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Could not pthread_create() for the snortsam thread [error: %d]", __FILE__, __LINE__, rc);
+        }
+
+    pthread_attr_destroy(&fwsam_thread_attr);
+
+}
+
+/****************************************************************************
+ * FWSam_Close - Sends whatever is still queued and checks out of every
+ * station.  Called at shutdown.
+ ****************************************************************************/
+
+void FWSam_Close( void )
+{
+
+    _Sagan_FWSam_Request *request = NULL;
+
+    while ( ( request = FWSam_Take(false) ) != NULL )
+        {
+            FWSam_Send(request);
+        }
+
+    pthread_mutex_lock(&fwsam_mutex);
+    FWSam_Checkout_All();
+    pthread_mutex_unlock(&fwsam_mutex);
+
+}
+
+/****************************************************************************
+ * FWsamBlock - Sends a block for "blockip" over a station's session.
+ * Returns true on error.
+ ****************************************************************************/
+
+static int FWsamBlock(FWsamStation *station, unsigned long blockip, unsigned long blockduration, unsigned long blocksid)
+{
+
+    char *encbuf,*decbuf;
+    int i,error=false,len;
+    ssize_t rc;
+    FWsamPacket sampacket;
 
-                                                            if(len!=sizeof(FWsamPacket))   /* invalid decryption */
+    if(!station->persistentsocket)
+        {
+            /* create a socket for the station */
+            station->stationsocket=socket(PF_INET,SOCK_STREAM,IPPROTO_TCP);
+            if(station->stationsocket==INVALID_SOCKET)
+                {
+                    Sagan_Log(WARN, "[%s, line %d]  Invalid Socket error!", __FILE__, __LINE__ );
+                    error=true;
+                }
+            if(bind(station->stationsocket,(struct sockaddr *)&(station->localsocketaddr),sizeof(struct sockaddr)))
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Can not bind socket!", __FILE__, __LINE__);
+                    FWsamDisconnect(station);
+                    error=true;
+                }
+        }
+    else
+        error=false;
+    if(!error)
+        {
+            if(!station->persistentsocket)
+                {
+                    /* let's connect to the agent */
+                    if(connect(station->stationsocket,(struct sockaddr *)&station->stationsocketaddr,sizeof(struct sockaddr)))
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] Could not send block to host %s.", __FILE__, __LINE__, inet_ntoa(station->stationip));
+                            FWsamDisconnect(station);
+                            error=true;
+                        }
+                }
+
+            if(!error)
+                {
+                    if( debug->debugfwsam )
+                        {
+                            Sagan_Log(DEBUG, "[FWsamBlock] Connected to host %s. %s IP %s", inet_ntoa(station->stationip),blockmode==FWSAM_STATUS_BLOCK?"Blocking":"Unblocking",inettoa(blockip));
+                        }
+
+                    /* now build the packet */
+                    station->myseqno+=station->stationseqno; /* increase my seqno by adding agent seq no */
+                    sampacket.endiancheck=1;                                                /* This is an endian indicator for Snortsam */
+                    sampacket.snortseqno[0]=(char)station->myseqno;
+                    sampacket.snortseqno[1]=(char)(station->myseqno>>8);
+                    sampacket.fwseqno[0]=(char)station->stationseqno;/* fill station seqno */
+                    sampacket.fwseqno[1]=(char)(station->stationseqno>>8);
+                    sampacket.status=blockmode;                     /* set block action */
+                    sampacket.version=station->packetversion;                        /* set packet version */
+                    sampacket.duration[0]=(char)blockduration;              /* set duration */
+                    sampacket.duration[1]=(char)(blockduration>>8);
+                    sampacket.duration[2]=(char)(blockduration>>16);
+                    sampacket.duration[3]=(char)(blockduration>>24);
+                    sampacket.fwmode=blocklog|blockhow|FWSAM_WHO_SRC; /* set the mode */
+                    sampacket.dstip[0]=sampacket.dstip[1]=sampacket.dstip[2]=sampacket.dstip[3]=0; /* destination IP (not used) */
+                    sampacket.srcip[0]=(char)blockip;        /* source IP */
+                    sampacket.srcip[1]=(char)(blockip>>8);
+                    sampacket.srcip[2]=(char)(blockip>>16);
+                    sampacket.srcip[3]=(char)(blockip>>24);
+                    sampacket.protocol[0]=(char)blockproto; /* protocol */
+                    sampacket.protocol[1]=(char)(blockproto>>8);/* protocol */
+
+                    if(blockproto==6 || blockproto==17)
+                        {
+                            sampacket.dstport[0]=(char)blockport;
+                            sampacket.dstport[1]=(char)(blockport>>8);
+                        }
+                    else
+                        sampacket.dstport[0]=sampacket.dstport[1]=0;
+                    sampacket.srcport[0]=sampacket.srcport[1]=0;
+
+                    sampacket.sig_id[0]=(char)blocksid;             /* set signature ID */
+                    sampacket.sig_id[1]=(char)(blocksid>>8);
+                    sampacket.sig_id[2]=(char)(blocksid>>16);
+                    sampacket.sig_id[3]=(char)(blocksid>>24);
+
+                    if( debug->debugfwsam )
+                        {
+                            Sagan_Log(DEBUG, "[FWsamBlock] Sending %s",blockmode==FWSAM_STATUS_BLOCK?"BLOCK":"UNBLOCK");
+                            Sagan_Log(DEBUG, "[FWsamBlock] Snort SeqNo:  %x",station->myseqno);
+                            Sagan_Log(DEBUG, "[FWsamBlock] Mgmt SeqNo :  %x",station->stationseqno);
+                            Sagan_Log(DEBUG, "[FWsamBlock] Status     :  %i",blockmode);
+                            Sagan_Log(DEBUG, "[FWsamBlock] Version    :  %i",station->packetversion);
+                            Sagan_Log(DEBUG, "[FWsamBlock] Mode       :  %i",blocklog|blockhow|FWSAM_WHO_SRC);
+                            Sagan_Log(DEBUG, "[FWsamBlock] Duration   :  %li",blockduration);
+                            Sagan_Log(DEBUG, "[FWsamBlock] Protocol   :  %i",blockproto);
+                            Sagan_Log(DEBUG, "[FWsamBlock] Src IP     :  %s",inettoa(blockip));
+                            Sagan_Log(DEBUG, "[FWsamBlock] Src Port   :  %i",0);
+                            Sagan_Log(DEBUG, "[FWsamBlock] Dest IP    :  %s",inettoa(0));
+                            Sagan_Log(DEBUG, "[FWsamBlock] Dest Port  :  %i",blockport);
+                            Sagan_Log(DEBUG, "[FWsamBlock] Sig_ID     :  %lu",blocksid);
+                        }
+
+                    encbuf=TwoFishAlloc(sizeof(FWsamPacket),false,false,station->stationfish); /* get the encryption buffer */
+                    len=TwoFishEncrypt((char *)&sampacket,(char **)&encbuf,sizeof(FWsamPacket),false,station->stationfish); /* encrypt the packet with current key */
+
+                    if(send(station->stationsocket,encbuf,len,MSG_NOSIGNAL)!=len)   /* weird...could not send */
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] Could not send to host %s" , __FILE__, __LINE__, inet_ntoa(station->stationip));
+                            FWsamDisconnect(station);
+                            error=true;
+                        }
+                    else
+                        {
+                            i=FWSAM_NETWAIT;
+                            ioctlsocket(station->stationsocket,FIONBIO,&i);  /* set non blocking and wait for  */
+                            while(i-- >1)                                                   /* the response packet   */
+                                {
+                                    waitms(10); /* wait for response (default maximum 3 secs */
+                                    rc=recv(station->stationsocket,encbuf,len,0);
+                                    if(rc==len)
+                                        i=0; /* if we received packet we set the counter to 0. */
+                                    /* by the time we check with if, it's already dec'ed to -1 */
+                                    else if(rc==0)
+                                        i=1; /* the agent closed a persistent connection,  don't wait it out */
+                                }
+                            if(!i)   /* id we timed out (i was one, then dec'ed)... */
+                                {
+
+                                    Sagan_Log(WARN, "[%s, line %d] Did not receive response from host %s" , __FILE__, __LINE__, inet_ntoa(station->stationip) );
+                                    FWsamDisconnect(station);
+                                    error=true;
+                                }
+                            else     /* got a packet */
+                                {
+                                    decbuf=(char *)&sampacket; /* get the pointer to the packet struct */
+                                    len=TwoFishDecrypt(encbuf,(char **)&decbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,false,station->stationfish); /* try to decrypt the packet with current key */
+
+                                    if(len!=sizeof(FWsamPacket))   /* invalid decryption */
+                                        {
+                                            strlcpy(station->stationkey,station->initialkey,sizeof(station->stationkey)); /* try the intial key */
+                                            TwoFishDestroy(station->stationfish);
+                                            station->stationfish=TwoFishInit(station->stationkey); /* re-initialize the TwoFish with the intial key */
+                                            len=TwoFishDecrypt(encbuf,(char **)&decbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,false,station->stationfish); /* try again to decrypt */
+                                            if ( debug->debugfwsam )
+                                                Sagan_Log(DEBUG, "FWsamCheckOut] Had to use initial key!");
+                                        }
+                                    if(len==sizeof(FWsamPacket))   /* valid decryption */
+                                        {
+                                            if(sampacket.version==station->packetversion)   /* master speaks my language */
+                                                {
+                                                    if(sampacket.status==FWSAM_STATUS_OK || sampacket.status==FWSAM_STATUS_NEWKEY
+                                                            || sampacket.status==FWSAM_STATUS_RESYNC || sampacket.status==FWSAM_STATUS_HOLD)
+                                                        {
+                                                            station->stationseqno=sampacket.fwseqno[0] | (sampacket.fwseqno[1]<<8); /* get stations seqno */
+                                                            station->lastcontact=(unsigned long)Sagan_Clock_Epoch(); /* set the last contact time (not used yet) */
+                                                            if ( debug->debugfwsam )
                                                                 {
-                                                                    strlcpy(station.stationkey,station.initialkey,sizeof(station.stationkey)); /* try the intial key */
-                                                                    TwoFishDestroy(station.stationfish);
-                                                                    station.stationfish=TwoFishInit(station.stationkey); /* re-initialize the TwoFish with the intial key */
-                                                                    len=TwoFishDecrypt(encbuf,(char **)&decbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,false,station.stationfish); /* try again to decrypt */
-                                                                    if ( debug->debugfwsam )
-                                                                        Sagan_Log(DEBUG, "FWsamCheckOut] Had to use initial key!");
+                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Received %s",sampacket.status==FWSAM_STATUS_OK?"OK":
+                                                                              sampacket.status==FWSAM_STATUS_NEWKEY?"NEWKEY":
+                                                                              sampacket.status==FWSAM_STATUS_RESYNC?"RESYNC":
+                                                                              sampacket.status==FWSAM_STATUS_HOLD?"HOLD":"ERROR");
+                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Snort SeqNo:  %x",sampacket.snortseqno[0]|(sampacket.snortseqno[1]<<8));
+                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Mgmt SeqNo :  %x",station->stationseqno);
+                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Status     :  %i",sampacket.status);
+                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Version    :  %i",sampacket.version);
                                                                 }
-                                                            if(len==sizeof(FWsamPacket))   /* valid decryption */
+
+                                                            if(sampacket.status==FWSAM_STATUS_HOLD)
                                                                 {
-                                                                    if(sampacket.version==station.packetversion)   /* master speaks my language */
+                                                                    i=FWSAM_NETHOLD;                        /* Stay on hold for a maximum of 60 secs (default) */
+                                                                    while(i-- >1)                                                   /* the response packet   */
                                                                         {
-                                                                            if(sampacket.status==FWSAM_STATUS_OK || sampacket.status==FWSAM_STATUS_NEWKEY
-                                                                                    || sampacket.status==FWSAM_STATUS_RESYNC || sampacket.status==FWSAM_STATUS_HOLD)
+                                                                            waitms(10); /* wait for response  */
+                                                                            if(recv(station->stationsocket,encbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,0)==sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE)
+                                                                                i=0; /* if we received packet we set the counter to 0. */
+                                                                        }
+                                                                    if(!i)   /* id we timed out (i was one, then dec'ed)... */
+                                                                        {
+
+                                                                            Sagan_Log(WARN, "[%s, line %d] Did not receive response from host %s" , __FILE__, __LINE__, inet_ntoa(station->stationip) );
+                                                                            error=true;
+                                                                            sampacket.status=FWSAM_STATUS_ERROR;
+                                                                        }
+                                                                    else     /* got a packet */
+                                                                        {
+                                                                            decbuf=(char *)&sampacket; /* get the pointer to the packet struct */
+                                                                            len=TwoFishDecrypt(encbuf,(char **)&decbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,false,station->stationfish); /* try to decrypt the packet with current key */
+
+                                                                            if(len!=sizeof(FWsamPacket))   /* invalid decryption */
                                                                                 {
-                                                                                    station.stationseqno=sampacket.fwseqno[0] | (sampacket.fwseqno[1]<<8); /* get stations seqno */
-                                                                                    station.lastcontact=(unsigned long)time(NULL); /* set the last contact time (not used yet) */
+                                                                                    strlcpy(station->stationkey,station->initialkey,sizeof(station->stationkey)); /* try the intial key */
+                                                                                    TwoFishDestroy(station->stationfish);
+                                                                                    station->stationfish=TwoFishInit(station->stationkey); /* re-initialize the TwoFish with the intial key */
+                                                                                    len=TwoFishDecrypt(encbuf,(char **)&decbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,false,station->stationfish); /* try again to decrypt */
                                                                                     if ( debug->debugfwsam )
-                                                                                        {
-                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Received %s",sampacket.status==FWSAM_STATUS_OK?"OK":
-                                                                                                      sampacket.status==FWSAM_STATUS_NEWKEY?"NEWKEY":
-                                                                                                      sampacket.status==FWSAM_STATUS_RESYNC?"RESYNC":
-                                                                                                      sampacket.status==FWSAM_STATUS_HOLD?"HOLD":"ERROR");
-                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Snort SeqNo:  %x",sampacket.snortseqno[0]|(sampacket.snortseqno[1]<<8));
-                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Mgmt SeqNo :  %x",station.stationseqno);
-                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Status     :  %i",sampacket.status);
-                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Version    :  %i",sampacket.version);
-                                                                                        }
-
-                                                                                    if(sampacket.status==FWSAM_STATUS_HOLD)
-                                                                                        {
-                                                                                            i=FWSAM_NETHOLD;                        /* Stay on hold for a maximum of 60 secs (default) */
-                                                                                            while(i-- >1)                                                   /* the response packet   */
-                                                                                                {
-                                                                                                    waitms(10); /* wait for response  */
-                                                                                                    if(recv(station.stationsocket,encbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,0)==sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE)
-                                                                                                        i=0; /* if we received packet we set the counter to 0. */
-                                                                                                }
-                                                                                            if(!i)   /* id we timed out (i was one, then dec'ed)... */
-                                                                                                {
-
-                                                                                                    Sagan_Log(WARN, "[%s, line %d] Did not receive response from host %s" , __FILE__, __LINE__, inet_ntoa(station.stationip) );
-                                                                                                    error=true;
-                                                                                                    sampacket.status=FWSAM_STATUS_ERROR;
-                                                                                                }
-                                                                                            else     /* got a packet */
-                                                                                                {
-                                                                                                    decbuf=(char *)&sampacket; /* get the pointer to the packet struct */
-                                                                                                    len=TwoFishDecrypt(encbuf,(char **)&decbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,false,station.stationfish); /* try to decrypt the packet with current key */
-
-                                                                                                    if(len!=sizeof(FWsamPacket))   /* invalid decryption */
-                                                                                                        {
-                                                                                                            strlcpy(station.stationkey,station.initialkey,sizeof(station.stationkey)); /* try the intial key */
-                                                                                                            TwoFishDestroy(station.stationfish);
-                                                                                                            station.stationfish=TwoFishInit(station.stationkey); /* re-initialize the TwoFish with the intial key */
-                                                                                                            len=TwoFishDecrypt(encbuf,(char **)&decbuf,sizeof(FWsamPacket)+TwoFish_BLOCK_SIZE,false,station.stationfish); /* try again to decrypt */
-                                                                                                            if ( debug->debugfwsam )
-                                                                                                                Sagan_Log(DEBUG, "[FWsamBlock] Had to use initial key again!");
-                                                                                                        }
-                                                                                                    if( debug->debugfwsam )
-                                                                                                        {
-
-                                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Received %s", sampacket.status==FWSAM_STATUS_OK?"OK": sampacket.status==FWSAM_STATUS_NEWKEY?"NEWKEY": sampacket.status==FWSAM_STATUS_RESYNC?"RESYNC": sampacket.status==FWSAM_STATUS_HOLD?"HOLD":"ERROR");
-                                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Snort SeqNo:  %x",sampacket.snortseqno[0]|(sampacket.snortseqno[1]<<8));
-                                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Mgmt SeqNo :  %x",station.stationseqno);
-                                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Status     :  %i",sampacket.status);
-                                                                                                            Sagan_Log(DEBUG, "[FWsamBlock] Version    :  %i",sampacket.version);
-                                                                                                        }
-                                                                                                    if(len!=sizeof(FWsamPacket))   /* invalid decryption */
-                                                                                                        {
-
-                                                                                                            Sagan_Log(WARN, "[%s, line %d] Password mismatch! Ignoring host %s" , __FILE__, __LINE__, inet_ntoa(station.stationip));
-                                                                                                            error=true;
-                                                                                                            sampacket.status=FWSAM_STATUS_ERROR;
-                                                                                                        }
-                                                                                                    else if(sampacket.version!=station.packetversion)     /* invalid protocol version */
-                                                                                                        {
-                                                                                                            Sagan_Log(WARN, "[%s, line %d] Protocol version error! Ignoring host %s" , __FILE__, __LINE__, inet_ntoa(station.stationip));
-                                                                                                            error=true;
-                                                                                                            sampacket.status=FWSAM_STATUS_ERROR;
-                                                                                                        }
-                                                                                                    else if(sampacket.status!=FWSAM_STATUS_OK && sampacket.status!=FWSAM_STATUS_NEWKEY && sampacket.status!=FWSAM_STATUS_RESYNC)
-                                                                                                        {
-                                                                                                            Sagan_Log(WARN, "[%s, line %d] Funky handshake error! Ignoring host %s" , __FILE__, __LINE__, inet_ntoa(station.stationip));
-                                                                                                            error=true;
-                                                                                                            sampacket.status=FWSAM_STATUS_ERROR;
-                                                                                                        }
-                                                                                                }
-                                                                                        }
-                                                                                    if(sampacket.status==FWSAM_STATUS_RESYNC)   /* if station want's to resync... */
-                                                                                        {
-                                                                                            strlcpy(station.stationkey,station.initialkey,sizeof(station.stationkey)); /* ...we use the intial key... */
-                                                                                            memcpy(station.fwkeymod,sampacket.duration,4);   /* and note the random key modifier */
-                                                                                        }
-                                                                                    if(sampacket.status==FWSAM_STATUS_NEWKEY || sampacket.status==FWSAM_STATUS_RESYNC)
-                                                                                        {
-                                                                                            FWsamNewStationKey(&station,&sampacket); /* generate new TwoFish keys */
-                                                                                            if( debug->debugfwsam )
-                                                                                                Sagan_Log(NORMAL, "[%s, line %d] Generated new encryption key.... " , __FILE__, __LINE__);
-                                                                                        }
-                                                                                    if(!station.persistentsocket)
-                                                                                        closesocket(station.stationsocket);
+                                                                                        Sagan_Log(DEBUG, "[FWsamBlock] Had to use initial key again!");
                                                                                 }
-                                                                            else if(sampacket.status==FWSAM_STATUS_ERROR)     /* if SnortSam reports an error on second try, */
+                                                                            if( debug->debugfwsam )
                                                                                 {
-                                                                                    closesocket(station.stationsocket);                               /* something is messed up and ... */
+
+                                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Received %s", sampacket.status==FWSAM_STATUS_OK?"OK": sampacket.status==FWSAM_STATUS_NEWKEY?"NEWKEY": sampacket.status==FWSAM_STATUS_RESYNC?"RESYNC": sampacket.status==FWSAM_STATUS_HOLD?"HOLD":"ERROR");
+                                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Snort SeqNo:  %x",sampacket.snortseqno[0]|(sampacket.snortseqno[1]<<8));
+                                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Mgmt SeqNo :  %x",station->stationseqno);
+                                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Status     :  %i",sampacket.status);
+                                                                                    Sagan_Log(DEBUG, "[FWsamBlock] Version    :  %i",sampacket.version);
+                                                                                }
+                                                                            if(len!=sizeof(FWsamPacket))   /* invalid decryption */
+                                                                                {
+
+                                                                                    Sagan_Log(WARN, "[%s, line %d] Password mismatch! Ignoring host %s" , __FILE__, __LINE__, inet_ntoa(station->stationip));
                                                                                     error=true;
-                                                                                    Sagan_Log(WARN, "[%s, line %d] Undetermined error right after CheckIn! Ignoring host %s" , __FILE__, __LINE__, inet_ntoa(station.stationip));
+                                                                                    sampacket.status=FWSAM_STATUS_ERROR;
                                                                                 }
-                                                                            else     /* an unknown status means trouble... */
+                                                                            else if(sampacket.version!=station->packetversion)     /* invalid protocol version */
                                                                                 {
-                                                                                    Sagan_Log(WARN, "[%s, line %d] Funky handshake error! Ignoring host %s!" , __FILE__, __LINE__, inet_ntoa(station.stationip));
-                                                                                    closesocket(station.stationsocket);
+                                                                                    Sagan_Log(WARN, "[%s, line %d] Protocol version error! Ignoring host %s" , __FILE__, __LINE__, inet_ntoa(station->stationip));
                                                                                     error=true;
+                                                                                    sampacket.status=FWSAM_STATUS_ERROR;
+                                                                                }
+                                                                            else if(sampacket.status!=FWSAM_STATUS_OK && sampacket.status!=FWSAM_STATUS_NEWKEY && sampacket.status!=FWSAM_STATUS_RESYNC)
+                                                                                {
+                                                                                    Sagan_Log(WARN, "[%s, line %d] Funky handshake error! Ignoring host %s" , __FILE__, __LINE__, inet_ntoa(station->stationip));
+                                                                                    error=true;
+                                                                                    sampacket.status=FWSAM_STATUS_ERROR;
                                                                                 }
-                                                                        }
-                                                                    else     /* if the SnortSam agent uses a different packet version, we have no choice but to ignore it. */
-                                                                        {
-
-                                                                            Sagan_Log(WARN, "[%s, line %d] Protocol version errror! Ignoring host %s!" , __FILE__, __LINE__, inet_ntoa(station.stationip));
-                                                                            closesocket(station.stationsocket);
-                                                                            error=true;
                                                                         }
                                                                 }
-                                                            else     /* if the intial key failed to decrypt as well, the keys are not configured the same, and we ignore that SnortSam station. */
+                                                            if(sampacket.status==FWSAM_STATUS_RESYNC)   /* if station want's to resync... */
                                                                 {
-                                                                    Sagan_Log(WARN, "[%s, line %d] Password mismatch! Ignoring host %s!" , __FILE__, __LINE__, inet_ntoa(station.stationip));
-
-                                                                    closesocket(station.stationsocket);
-                                                                    error=true;
+                                                                    strlcpy(station->stationkey,station->initialkey,sizeof(station->stationkey)); /* ...we use the intial key... */
+                                                                    memcpy(station->fwkeymod,sampacket.duration,4);   /* and note the random key modifier */
                                                                 }
+                                                            if(sampacket.status==FWSAM_STATUS_NEWKEY || sampacket.status==FWSAM_STATUS_RESYNC)
+                                                                {
+                                                                    FWsamNewStationKey(station,&sampacket); /* generate new TwoFish keys */
+                                                                    if( debug->debugfwsam )
+                                                                        Sagan_Log(NORMAL, "[%s, line %d] Generated new encryption key.... " , __FILE__, __LINE__);
+                                                                }
+                                                            if(!station->persistentsocket)
+                                                                FWsamDisconnect(station);
+                                                        }
+                                                    else if(sampacket.status==FWSAM_STATUS_ERROR)     /* if SnortSam reports an error on second try, */
+                                                        {
+                                                            FWsamDisconnect(station);                               /* something is messed up and ... */
+                                                            error=true;
+                                                            Sagan_Log(WARN, "[%s, line %d] Undetermined error right after CheckIn! Ignoring host %s" , __FILE__, __LINE__, inet_ntoa(station->stationip));
+                                                        }
+                                                    else     /* an unknown status means trouble... */
+                                                        {
+                                                            Sagan_Log(WARN, "[%s, line %d] Funky handshake error! Ignoring host %s!" , __FILE__, __LINE__, inet_ntoa(station->stationip));
+                                                            FWsamDisconnect(station);
+                                                            error=true;
                                                         }
                                                 }
-                                            free(encbuf); /* release of the TwoFishAlloc'ed encryption buffer */
-                                        }
-                                }
+                                            else     /* if the SnortSam agent uses a different packet version, we have no choice but to ignore it. */
+                                                {
 
-                            ipidx++;
-                        }
-                    while(!error && ipidx<NUM_HOSTS && blockip[ipidx]);
-                    peeridx++;
-                }
-            while(!error && peeridx<NUM_HOSTS && blockpeer[peeridx]);
+                                                    Sagan_Log(WARN, "[%s, line %d] Protocol version errror! Ignoring host %s!" , __FILE__, __LINE__, inet_ntoa(station->stationip));
+                                                    FWsamDisconnect(station);
+                                                    error=true;
+                                                }
+                                        }
+                                    else     /* if the intial key failed to decrypt as well, the keys are not configured the same, and we ignore that SnortSam station-> */
+                                        {
+                                            Sagan_Log(WARN, "[%s, line %d] Password mismatch! Ignoring host %s!" , __FILE__, __LINE__, inet_ntoa(station->stationip));
 
-            if(!error)
-                {
-                    if(checkout)
-                        FWsamCheckOut(&station);
-                    else
-                        {
-                            closesocket(station.stationsocket);
-                            station.persistentsocket=false;
+                                            FWsamDisconnect(station);
+                                            error=true;
+                                        }
+                                }
                         }
+                    free(encbuf); /* release of the TwoFishAlloc'ed encryption buffer */
                 }
         }
-    TwoFishDestroy(station.stationfish);
 
     return error;
 }
@@ -534,6 +1057,7 @@ int FWsamCheckIn(FWsamStation *station)
             if(bind(station->stationsocket,(struct sockaddr *)&(station->localsocketaddr),sizeof(struct sockaddr)))
                 {
                     Sagan_Log(WARN, "[%s, line %d] Can not bind to socket!" , __FILE__, __LINE__);
+                    FWsamDisconnect(station);
                     return false;
                 }
 
@@ -541,6 +1065,7 @@ int FWsamCheckIn(FWsamStation *station)
             if(connect(station->stationsocket,(struct sockaddr *)&station->stationsocketaddr,sizeof(struct sockaddr)))
                 {
                     Sagan_Log(WARN, "[%s, line %d] Could not connect to host %s", __FILE__, __LINE__, inet_ntoa(station->stationip));
+                    FWsamDisconnect(station);
                     return false;
                 }
             else
@@ -568,7 +1093,7 @@ int FWsamCheckIn(FWsamStation *station)
 
                     encbuf=TwoFishAlloc(sizeof(FWsamPacket),false,false,station->stationfish); /* get buffer for encryption */
                     len=TwoFishEncrypt((char *)&sampacket,(char **)&encbuf,sizeof(FWsamPacket),false,station->stationfish); /* encrypt with initial key */
-                    if(send(station->stationsocket,encbuf,len,0)!=len) /* weird...could not send */
+                    if(send(station->stationsocket,encbuf,len,MSG_NOSIGNAL)!=len) /* weird...could not send */
                         Sagan_Log(WARN, "Could not send to host %s", inet_ntoa(station->stationip));
                     else
                         {
@@ -605,7 +1130,7 @@ int FWsamCheckIn(FWsamStation *station)
                                                     if(sampacket.status==FWSAM_STATUS_OK || sampacket.status==FWSAM_STATUS_NEWKEY || sampacket.status==FWSAM_STATUS_RESYNC)
                                                         {
                                                             station->stationseqno=sampacket.fwseqno[0]|(sampacket.fwseqno[1]<<8); /* get stations seqno */
-                                                            station->lastcontact=(unsigned long)time(NULL);
+                                                            station->lastcontact=(unsigned long)Sagan_Clock_Epoch();
                                                             stationok=true;
                                                             station->packetversion=sampacket.version;
                                                             if(sampacket.version==FWSAM_PACKETVERSION)
@@ -644,7 +1169,7 @@ int FWsamCheckIn(FWsamStation *station)
                     free(encbuf); /* release TwoFishAlloc'ed buffer */
                 }
             if(!(stationok && station->persistentsocket))
-                closesocket(station->stationsocket);
+                FWsamDisconnect(station);
         }
     while(again);
     return stationok;
@@ -736,6 +1261,7 @@ void FWsamCheckOut(FWsamStation *station)
             if(bind(station->stationsocket,(struct sockaddr *)&(station->localsocketaddr),sizeof(struct sockaddr)))
                 {
                     Sagan_Log(WARN, "[%s, line %d] Can not bind socket!" , __FILE__, __LINE__);
+                    FWsamDisconnect(station);
                     return;
                 }
             /* let's connect to the agent */
@@ -768,7 +1294,7 @@ void FWsamCheckOut(FWsamStation *station)
 
             encbuf=TwoFishAlloc(sizeof(FWsamPacket),false,false,station->stationfish); /* get encryption buffer */
             len=TwoFishEncrypt((char *)&sampacket,(char **)&encbuf,sizeof(FWsamPacket),false,station->stationfish); /* encrypt packet with current key */
-            if(send(station->stationsocket,encbuf,len,0)==len)
+            if(send(station->stationsocket,encbuf,len,MSG_NOSIGNAL)==len)
                 {
                     i=FWSAM_NETWAIT;
                     ioctlsocket(station->stationsocket,FIONBIO,&i); /* set non blocking and wait for  */
@@ -806,7 +1332,7 @@ void FWsamCheckOut(FWsamStation *station)
     else
         Sagan_Log(WARN, "[%s, line %d] Could not connect to host %s for CheckOut", __FILE__, __LINE__, inet_ntoa(station->stationip));
 
-    closesocket(station->stationsocket);
+    FWsamDisconnect(station);
     station->persistentsocket=false;
 }
 #endif
@@ -58,6 +58,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <sys/time.h>
 
 
 #ifdef WIN32		/* ------------------ Windows platform specific stuff ----------------------- */
@@ -511,7 +512,8 @@ void sig_usr2_flagger(int i);
 #endif  /* __SNORTSAM_H__ */
 
 void FWSam( _Sagan_Event * );
-int FWsamBlock(char *);
+void FWSam_Init( void );
+void FWSam_Close( void );
 
 /* Typedefs */
 
@@ -532,8 +534,32 @@ typedef struct _FWsamstation            /* structure of a mgmt station */
     time_t                          lastcontact;
     int                             persistentsocket; /* Flag for permanent connection */
     unsigned char                   packetversion;  /* The packet version the sensor uses. */
+    int                             checkedin;      /* Session established */
 }       FWsamStation;
 
+/* A block waiting for the snortsam thread */
+
+typedef struct _Sagan_FWSam_Request _Sagan_FWSam_Request;
+struct _Sagan_FWSam_Request
+{
+    unsigned long ip;
+    unsigned long duration;
+    unsigned long sid;
+    uint64_t queued;			/* Sagan_Clock_Mono_NS() */
+    struct _Sagan_FWSam_Request *next;
+};
+
+/* An IP/duration that has been blocked,  suppressed until "expires" */
+
+typedef struct _Sagan_FWSam_Seen _Sagan_FWSam_Seen;
+struct _Sagan_FWSam_Seen
+{
+    unsigned long ip;
+    unsigned long duration;
+    time_t expires;
+    struct _Sagan_FWSam_Seen *next;
+};
+
 void FWsamNewStationKey(FWsamStation *,FWsamPacket *);
 void FWsamCheckOut(FWsamStation *);
 int FWsamCheckIn(FWsamStation *);
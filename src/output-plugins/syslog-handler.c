@@ -43,7 +43,6 @@
 
 #include "output-plugins/syslog-handler.h"
 
-struct _Rule_Struct *rulestruct;
 struct _SaganConfig *config;
 
 void Alert_Syslog( _Sagan_Event *Event )
@@ -52,7 +51,7 @@ void Alert_Syslog( _Sagan_Event *Event )
     char syslog_message_output[1024] = { 0 };
     char *tmp_proto = NULL;
 
-    char classbuf[64];
+    const char *classbuf = NULL;
 
     /* Template to mimic Snort syslog output */
 
@@ -78,7 +77,7 @@ void Alert_Syslog( _Sagan_Event *Event )
             tmp_proto = "{UDP}";
         }
 
-    Classtype_Lookup( Event->class, classbuf, sizeof(classbuf) );
+    classbuf = Classtype_Lookup( Event->class_id );
 
     snprintf(syslog_message_output, sizeof(syslog_message_output), syslog_template, Event->generatorid, Event->sid, Event->rev, Event->f_msg, classbuf, Event->pri, tmp_proto, Event->ip_src, Event->src_port, Event->ip_dst, Event->dst_port, Event->message);
 
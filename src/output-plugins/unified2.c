@@ -52,6 +52,7 @@
 #include "sagan-config.h"
 
 #include "classifications.h"
+#include "util-time.h"
 
 #include "output-plugins/unified2.h"
 
@@ -60,7 +61,6 @@ sbool endian;
 
 uint64_t unified_event_id;
 
-struct _Rule_Struct *rulestruct;
 struct _Class_Struct *classstruct;
 struct _SaganCounters *counters;
 struct _SaganConfig *config;
@@ -96,7 +96,7 @@ void Unified2InitFile( void )
             Sagan_Log(ERROR, "[%s, line %d] Could not init Unified2. Config data is null", __FILE__, __LINE__ );
         }
 
-    config->unified2_timestamp = (uint32_t)time(NULL);
+    config->unified2_timestamp = (uint32_t)Sagan_Clock_Epoch();
 
     if (!config->unified2_nostamp)
         {
@@ -126,7 +126,6 @@ void Unified2( _Sagan_Event *Event )
 {
 
 
-    int i=0;
     uint32_t write_len = 0;
     unsigned char ip_src[MAXIPBIT] = {0};
     unsigned char ip_dst[MAXIPBIT] = {0};
@@ -148,16 +147,11 @@ void Unified2( _Sagan_Event *Event )
     UNIFIED_SET(alertdata, type, signature_id, htonl(atoi(Event->sid)));
     UNIFIED_SET(alertdata, type, signature_revision, htonl(atoi(Event->rev)));			// Rule Revision
 
-    /* Search for the classification type. */
+    /* Classification type,  resolved when the rule was loaded */
 
-    /* There's probably a better way to do this - Champ Clark III - 02/17/2011 */
-
-    for(i=0; i < counters->classcount; i++)
+    if ( Event->class_id >= 0 )
         {
-            if (!strcmp(Event->class, classstruct[i].s_shortname))
-                {
-                    UNIFIED_SET(alertdata, type, classification_id, htonl(i + 1));
-                }
+            UNIFIED_SET(alertdata, type, classification_id, htonl(Event->class_id + 1));
         }
 
     UNIFIED_SET(alertdata, type, priority_id, htonl(Event->pri));					// Priority
@@ -20,24 +20,43 @@
 
 /* output.c
 *
-* This becomes a threaded operation.  This handles all I/O intensive output plugins
+* Output stage.  Workers copy each alert into a compact record and push it
+* onto a lock free ring per worker,  per output plugin.  Every plugin has its
+* own thread that drains its rings in batches,  so a slow disk,  SMTP server
+* or external program no longer holds up rule evaluation.
 */
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"             /* From autoconf */
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 #include <pthread.h>
 
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
 #include "sagan.h"
+#include "sagan-defs.h"
 #include "output.h"
+#include "aggregate.h"
 #include "rules.h"
 #include "sagan-config.h"
+#include "util-time.h"
+#include "util-stream.h"
 
 #include "output-plugins/alert.h"
 #include "output-plugins/external.h"
 #include "output-plugins/fast.h"
+#include "json-handler.h"
 #include "output-plugins/eve.h"
 
 #ifdef WITH_SNORTSAM
@@ -58,44 +77,447 @@ uint64_t unified_event_id;
 #endif
 
 struct _SaganCounters *counters;
-struct _Rule_Struct *rulestruct;
 struct _SaganConfig *config;
 
-sbool nonthread_alert_lock = false;
+static _Sagan_Output_Plugin SaganOutputPlugins[SAGAN_OUTPUT_MAX];
 
-pthread_mutex_t SaganOutputNonThreadMutex=PTHREAD_MUTEX_INITIALIZER;
+static const char *output_plugin_names[SAGAN_OUTPUT_MAX] = { "alert", "eve", "fast", "unified2", "syslog", "snortsam", "esmtp", "external" };
 
-void Output( _Sagan_Event *Event )
+static int output_slot_count = 0;
+static int output_slot_next = 0;
+static uint64_t output_ring_mask = 0;
+
+static __thread int output_slot = -1;
+
+/* Producers without a slot of their own share slot 0 */
+
+static pthread_mutex_t SaganOutputSharedMutex=PTHREAD_MUTEX_INITIALIZER;
+
+/* Every "char *" in _Sagan_Event.  These are copied into the record */
+
+static const size_t output_string_fields[] =
 {
+    offsetof(_Sagan_Event, ip_src),
+    offsetof(_Sagan_Event, ip_dst),
+    offsetof(_Sagan_Event, selector),
+    offsetof(_Sagan_Event, fpri),
+    offsetof(_Sagan_Event, f_msg),
+    offsetof(_Sagan_Event, time),
+    offsetof(_Sagan_Event, date),
+    offsetof(_Sagan_Event, priority),
+    offsetof(_Sagan_Event, host),
+    offsetof(_Sagan_Event, facility),
+    offsetof(_Sagan_Event, level),
+    offsetof(_Sagan_Event, tag),
+    offsetof(_Sagan_Event, program),
+    offsetof(_Sagan_Event, message),
+    offsetof(_Sagan_Event, sid),
+    offsetof(_Sagan_Event, rev),
+    offsetof(_Sagan_Event, class),
+    offsetof(_Sagan_Event, normalize_http_uri),
+    offsetof(_Sagan_Event, normalize_http_hostname)
+};
+
+static void Output_Thread( _Sagan_Output_Plugin * );
+
+/****************************************************************************
+ * Output_Init - Allocates the rings and starts one thread per output
+ * plugin.  Slots cover every worker plus a few other alerting threads.
+ ****************************************************************************/
+
+void Output_Init( void )
+{
+
+    pthread_t output_thread;
+    pthread_attr_t output_thread_attr;
 
-    /******************************/
-    /* Single threaded operations */
-    /******************************/
+    _Sagan_Output_Plugin *plugin = NULL;
 
-    /* Single threaded */
+    uint64_t ring_size = 1;
 
-    pthread_mutex_lock(&SaganOutputNonThreadMutex);
-    nonthread_alert_lock = true;
+    int i = 0;
+    int slot = 0;
+    int rc = 0;
 
-    if ( config->alert_flag )
+    while ( ring_size < config->output_queue_size )
         {
-            Alert_File(Event);
+            ring_size <<= 1;
         }
 
-    if ( config->eve_flag && config->eve_alerts && rulestruct[Event->found].xbit_noeve == false )
+    output_ring_mask = ring_size - 1;
+    output_slot_count = config->max_processor_threads + SAGAN_OUTPUT_EXTRA_SLOTS;
+
+    pthread_attr_init(&output_thread_attr);
+    pthread_attr_setdetachstate(&output_thread_attr,  PTHREAD_CREATE_DETACHED);
+
+    for ( i = 0; i < SAGAN_OUTPUT_MAX; i++ )
         {
-            Alert_JSON(Event);
+
+            plugin = &SaganOutputPlugins[i];
+
+            plugin->name = output_plugin_names[i];
+
+            plugin->rings = calloc(output_slot_count, sizeof(_Sagan_Output_Ring));
+
+            if ( plugin->rings == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for output rings. Abort!", __FILE__, __LINE__);
+                }
+
+            for ( slot = 0; slot < output_slot_count; slot++ )
+                {
+
+                    plugin->rings[slot].records = calloc(ring_size, sizeof(_Sagan_Output_Record *));
+
+                    if ( plugin->rings[slot].records == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for output ring. Abort!", __FILE__, __LINE__);
+                        }
+                }
+
+            pthread_mutex_init(&plugin->batch_mutex, NULL);
+            pthread_mutex_init(&plugin->wake_mutex, NULL);
+            pthread_cond_init(&plugin->wake_cond, NULL);
+
+            rc = pthread_create( &output_thread, &output_thread_attr, (void *)Output_Thread, plugin );
+
+            if ( rc != 0 )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Could not pthread_create() for output thread '%s' [error: %d]", __FILE__, __LINE__, plugin->name, rc);
+                }
         }
 
-    if ( config->fast_flag )
+    pthread_attr_destroy(&output_thread_attr);
+
+    Sagan_Log(NORMAL, "Output queues: %" PRIu64 " alerts per worker, per plugin (overflow: %s).", ring_size,
+              config->output_overflow == OUTPUT_OVERFLOW_DROP ? "drop" : "block");
+
+}
+
+/****************************************************************************
+ * Output_Wanted - Does "type" want this event?  Evaluated by the worker so
+ * records are only queued where they are needed.
+ ****************************************************************************/
+
+static sbool Output_Wanted( int type, _Sagan_Event *Event )
+{
+
+    switch ( type )
         {
-            Fast_File(Event);
-        }
+
+        case SAGAN_OUTPUT_ALERT:
+            return( config->alert_flag );
+
+        case SAGAN_OUTPUT_EVE:
+            return( config->eve_flag && config->eve_alerts && rulestruct[Event->found].xbit_noeve == false );
+
+        case SAGAN_OUTPUT_FAST:
+            return( config->fast_flag );
 
 #if defined(HAVE_DNET_H) || defined(HAVE_DUMBNET_H)
 
-    if ( config->sagan_unified2_flag && rulestruct[Event->found].xbit_nounified2 == false )
+        case SAGAN_OUTPUT_UNIFIED2:
+            return( config->sagan_unified2_flag && rulestruct[Event->found].xbit_nounified2 == false );
+
+#endif
+
+#ifdef WITH_SYSLOG
+
+        case SAGAN_OUTPUT_SYSLOG:
+            return( config->sagan_syslog_flag );
+
+#endif
+
+#ifdef WITH_SNORTSAM
+
+        case SAGAN_OUTPUT_SNORTSAM:
+            return( config->sagan_fwsam_flag && rulestruct[Event->found].fwsam_src_or_dst );
+
+#endif
+
+#ifdef HAVE_LIBESMTP
+
+        case SAGAN_OUTPUT_ESMTP:
+            return( config->sagan_esmtp_flag && rulestruct[Event->found].email_flag );
+
+#endif
+
+        case SAGAN_OUTPUT_EXTERNAL:
+            return( config->sagan_external_output_flag || rulestruct[Event->found].external_flag );
+
+        }
+
+    return(false);
+}
+
+/****************************************************************************
+ * Output_Record_New - Copies "Event" and every string it points to into
+ * one allocation.  json_normalize is kept as text and re-parsed by the
+ * plugins that need it,  since json-c reference counts aren't thread safe.
+ ****************************************************************************/
+
+_Sagan_Output_Record *Output_Record_New( _Sagan_Event *Event )
+{
+
+    _Sagan_Output_Record *record = NULL;
+
+    const char *normalize = NULL;
+    char **field = NULL;
+    char *p = NULL;
+
+    size_t size = 0;
+    size_t len = 0;
+    int i = 0;
+
+    if ( Event->json_normalize != NULL )
+        {
+            normalize = json_object_to_json_string_ext(Event->json_normalize, FJSON_TO_STRING_PLAIN);
+            size += strlen(normalize) + 1;
+        }
+
+    for ( i = 0; i < sizeof(output_string_fields) / sizeof(output_string_fields[0]); i++ )
+        {
+
+            field = (char **)((char *)Event + output_string_fields[i]);
+
+            if ( *field != NULL )
+                {
+                    size += strlen(*field) + 1;
+                }
+        }
+
+    record = malloc(sizeof(_Sagan_Output_Record) + size);
+
+    if ( record == NULL )
         {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for output record. Abort!", __FILE__, __LINE__);
+        }
+
+    memcpy(&record->event, Event, sizeof(_Sagan_Event));
+    record->event.json_normalize = NULL;
+    record->normalize = NULL;
+    record->rules = Rules_Hold();
+    record->size = sizeof(_Sagan_Output_Record) + size;
+
+    p = record->data;
+
+    for ( i = 0; i < sizeof(output_string_fields) / sizeof(output_string_fields[0]); i++ )
+        {
+
+            field = (char **)((char *)&record->event + output_string_fields[i]);
+
+            if ( *field != NULL )
+                {
+                    len = strlen(*field) + 1;
+                    memcpy(p, *field, len);
+                    *field = p;
+                    p += len;
+                }
+        }
+
+    if ( normalize != NULL )
+        {
+            len = strlen(normalize) + 1;
+            memcpy(p, normalize, len);
+            record->normalize = p;
+        }
+
+    return(record);
+}
+
+/****************************************************************************
+ * Output_Record_Free - Frees a record and lets go of its rules
+ ****************************************************************************/
+
+void Output_Record_Free( _Sagan_Output_Record *record )
+{
+
+    Rules_Release(record->rules);
+    free(record);
+
+}
+
+/****************************************************************************
+ * Output_Record_Release - Drops one reference to "record"
+ ****************************************************************************/
+
+static void Output_Record_Release( _Sagan_Output_Record *record )
+{
+
+    if ( __atomic_sub_fetch(&record->refcount, 1, __ATOMIC_ACQ_REL) == 0 )
+        {
+            Output_Record_Free(record);
+        }
+
+}
+
+/****************************************************************************
+ * Output_Push - Puts "record" on this thread's ring for "plugin".  When
+ * the ring is full we either wait for the output thread or drop the
+ * record,  depending on "output-overflow".
+ ****************************************************************************/
+
+static void Output_Push( _Sagan_Output_Plugin *plugin, int slot, _Sagan_Output_Record *record )
+{
+
+    _Sagan_Output_Ring *ring = &plugin->rings[slot];
+
+    struct timespec wait = { 0, 100000 };		/* 100 microseconds */
+
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    while ( tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > output_ring_mask )
+        {
+
+            if ( config->output_overflow == OUTPUT_OVERFLOW_DROP )
+                {
+                    __atomic_add_fetch(&plugin->dropped, 1, __ATOMIC_RELAXED);
+                    __atomic_add_fetch(&counters->sagan_output_drop, 1, __ATOMIC_RELAXED);
+                    Output_Record_Release(record);
+                    return;
+                }
+
+            pthread_mutex_lock(&plugin->wake_mutex);
+            pthread_cond_signal(&plugin->wake_cond);
+            pthread_mutex_unlock(&plugin->wake_mutex);
+
+            nanosleep(&wait, NULL);
+        }
+
+    ring->records[tail & output_ring_mask] = record;
+
+    /* Sequentially consistent so either we see the output thread going to
+     * sleep,  or it sees the new record when it checks one last time */
+
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    if ( __atomic_load_n(&plugin->sleeping, __ATOMIC_SEQ_CST) )
+        {
+            pthread_mutex_lock(&plugin->wake_mutex);
+            pthread_cond_signal(&plugin->wake_cond);
+            pthread_mutex_unlock(&plugin->wake_mutex);
+        }
+
+}
+
+/****************************************************************************
+ * Output_Send - Copies the event and queues it for each output plugin
+ * that wants it.  "aggregate" passes it through alert aggregation first.
+ ****************************************************************************/
+
+static void Output_Send( _Sagan_Event *Event, sbool aggregate )
+{
+
+    _Sagan_Output_Record *record = NULL;
+
+    sbool wanted[SAGAN_OUTPUT_MAX] = { 0 };
+    int wanted_count = 0;
+    int i = 0;
+
+    for ( i = 0; i < SAGAN_OUTPUT_MAX; i++ )
+        {
+
+            wanted[i] = Output_Wanted(i, Event);
+
+            if ( wanted[i] == true )
+                {
+                    wanted_count++;
+                }
+        }
+
+    if ( wanted_count == 0 )
+        {
+            return;
+        }
+
+    if ( aggregate == true && config->aggregate_by != 0 && Aggregate_Event(Event) == false )
+        {
+            return;
+        }
+
+    if ( output_slot == -1 )
+        {
+
+            output_slot = __atomic_add_fetch(&output_slot_next, 1, __ATOMIC_RELAXED);
+
+            if ( output_slot >= output_slot_count )
+                {
+                    output_slot = 0;
+                }
+        }
+
+    record = Output_Record_New(Event);
+    record->enqueue_time = Sagan_Clock_Mono_NS() / 1000;
+
+    /* Every plugin holds a reference until it's done with the record */
+
+    record->refcount = wanted_count;
+
+    if ( output_slot == 0 )
+        {
+            pthread_mutex_lock(&SaganOutputSharedMutex);
+        }
+
+    for ( i = 0; i < SAGAN_OUTPUT_MAX; i++ )
+        {
+
+            if ( wanted[i] == true )
+                {
+                    Output_Push(&SaganOutputPlugins[i], output_slot, record);
+                }
+        }
+
+    if ( output_slot == 0 )
+        {
+            pthread_mutex_unlock(&SaganOutputSharedMutex);
+        }
+
+}
+
+/****************************************************************************
+ * Output - Called by the workers for every alert
+ ****************************************************************************/
+
+void Output( _Sagan_Event *Event )
+{
+    Output_Send(Event, true);
+}
+
+/****************************************************************************
+ * Output_Summary - Called by aggregation for its summary alerts,  which
+ * must not be aggregated again
+ ****************************************************************************/
+
+void Output_Summary( _Sagan_Event *Event )
+{
+    Output_Send(Event, false);
+}
+
+/****************************************************************************
+ * Output_Write - Hands one event to the plugin
+ ****************************************************************************/
+
+static void Output_Write( int type, _Sagan_Event *Event )
+{
+
+    switch ( type )
+        {
+
+        case SAGAN_OUTPUT_ALERT:
+            Alert_File(Event);
+            break;
+
+        case SAGAN_OUTPUT_EVE:
+            Alert_JSON(Event);
+            break;
+
+        case SAGAN_OUTPUT_FAST:
+            Fast_File(Event);
+            break;
+
+#if defined(HAVE_DNET_H) || defined(HAVE_DUMBNET_H)
+
+        case SAGAN_OUTPUT_UNIFIED2:
 
             Unified2( Event );
             Unified2LogPacketAlert( Event );
@@ -132,72 +554,314 @@ void Output( _Sagan_Event *Event )
                 }
 
             unified_event_id++;
-        }
+            break;
 
 #endif
 
-    nonthread_alert_lock = false;
-    pthread_mutex_unlock(&SaganOutputNonThreadMutex);
+#ifdef WITH_SYSLOG
 
-    /* End single threaded */
+        case SAGAN_OUTPUT_SYSLOG:
+            Alert_Syslog( Event );
+            break;
 
-    /****************************************************************************/
-    /* Syslog output                                                            */
-    /****************************************************************************/
+#endif
 
-#ifdef WITH_SYSLOG
+#ifdef WITH_SNORTSAM
 
-    if ( config->sagan_syslog_flag )
-        {
-            Alert_Syslog( Event );
-        }
+        case SAGAN_OUTPUT_SNORTSAM:
+            FWSam( Event );
+            break;
 
 #endif
 
-    /****************************************************************************/
-    /* Snortsam Support	                                                        */
-    /****************************************************************************/
+#ifdef HAVE_LIBESMTP
+
+        case SAGAN_OUTPUT_ESMTP:
+            ESMTP_Thread( Event );
+            break;
 
-    /* If we have a snortsam server && the rule requires snortsam..... */
+#endif
 
-#ifdef WITH_SNORTSAM
+        case SAGAN_OUTPUT_EXTERNAL:
 
-    if ( config->sagan_fwsam_flag && rulestruct[Event->found].fwsam_src_or_dst )
+            if ( config->sagan_external_output_flag )
+                {
+                    External_Thread( Event, config->sagan_external_command );
+                }
+
+            if (  rulestruct[Event->found].external_flag )
+                {
+                    External_Thread( Event, rulestruct[Event->found].external_program );
+                }
+
+            break;
+        }
+
+}
+
+/****************************************************************************
+ * Output_Flush - Called once per batch rather than once per alert.  EVE
+ * does its own buffering.  A batch always ends on a record boundary,  so
+ * this is where compressed/rotated files get rotated.
+ ****************************************************************************/
+
+static void Output_Flush( int type )
+{
+
+    switch ( type )
         {
-            FWSam( Event );
+
+        case SAGAN_OUTPUT_ALERT:
+            fflush(config->sagan_alert_stream);
+            Sagan_Stream_Maintain(config->sagan_alert_stream);
+            break;
+
+        case SAGAN_OUTPUT_FAST:
+            fflush(config->sagan_fast_stream);
+            Sagan_Stream_Maintain(config->sagan_fast_stream);
+            break;
+
         }
 
-#endif
+}
 
-    /****************************************************************************/
-    /* SMTP/Email support (libesmtp)                                            */
-    /****************************************************************************/
+/****************************************************************************
+ * Output_Depth - Number of records queued for "plugin"
+ ****************************************************************************/
 
-#ifdef HAVE_LIBESMTP
+static uint64_t Output_Depth( _Sagan_Output_Plugin *plugin )
+{
+
+    uint64_t depth = 0;
+    int slot = 0;
 
-    if ( config->sagan_esmtp_flag && rulestruct[Event->found].email_flag )
+    for ( slot = 0; slot < output_slot_count; slot++ )
         {
-            ESMTP_Thread( Event );
+            depth += __atomic_load_n(&plugin->rings[slot].tail, __ATOMIC_SEQ_CST) -
+                     __atomic_load_n(&plugin->rings[slot].head, __ATOMIC_SEQ_CST);
         }
 
+    return(depth);
+}
+
+/****************************************************************************
+ * Output_Thread - Drains every ring for one plugin,  flushes,  and sleeps
+ * when there is nothing left.
+ ****************************************************************************/
+
+static void Output_Thread( _Sagan_Output_Plugin *plugin )
+{
+
+    _Sagan_Output_Ring *ring = NULL;
+    _Sagan_Output_Record *record = NULL;
+    _Sagan_Event Event;
+
+    int type = plugin - SaganOutputPlugins;
+    int slot = 0;
+    int slots = 0;
+
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    uint64_t batch = 0;
+    uint64_t latency = 0;
+
+    struct timespec deadline;
+
+    (void)SetThreadName("SaganOutput");
+
+    for (;;)
+        {
+
+            batch = 0;
+
+            pthread_mutex_lock(&plugin->batch_mutex);
+
+            slots = __atomic_load_n(&output_slot_next, __ATOMIC_RELAXED) + 1;
+
+            if ( slots > output_slot_count )
+                {
+                    slots = output_slot_count;
+                }
+
+            for ( slot = 0; slot < slots; slot++ )
+                {
+
+                    ring = &plugin->rings[slot];
+
+                    head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+                    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+                    for ( ; head != tail; head++ )
+                        {
+
+                            record = ring->records[head & output_ring_mask];
+
+                            /* Hand the slot back right away so the worker
+                             * doesn't wait on the write */
+
+                            __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+                            memcpy(&Event, &record->event, sizeof(_Sagan_Event));
+
+                            /* The rules the alert came from,  even if they
+                             * have been replaced since */
+
+                            Rules_Use(record->rules);
+
+#if defined HAVE_LIBLOGNORM || defined WITH_BLUEDOT
+
+                            if ( record->normalize != NULL && ( type == SAGAN_OUTPUT_EVE || type == SAGAN_OUTPUT_EXTERNAL ) )
+                                {
+                                    Event.json_normalize = json_tokener_parse(record->normalize);
+                                }
+
 #endif
 
-    /****************************************************************************/
-    /* External program support                                                 */
-    /****************************************************************************/
+                            Output_Write(type, &Event);
+
+#if defined HAVE_LIBLOGNORM || defined WITH_BLUEDOT
+
+                            if ( Event.json_normalize != NULL )
+                                {
+                                    json_object_put(Event.json_normalize);
+                                }
+
+#endif
+
+                            latency = Sagan_Clock_Mono_NS() / 1000 - record->enqueue_time;
+
+                            plugin->written++;
+                            plugin->latency_total += latency;
+
+                            if ( latency > plugin->latency_max )
+                                {
+                                    plugin->latency_max = latency;
+                                }
+
+                            Output_Record_Release(record);
+                            batch++;
+                        }
+                }
+
+            if ( batch != 0 )
+                {
+                    Output_Flush(type);
+                }
+
+            pthread_mutex_unlock(&plugin->batch_mutex);
+
+            if ( batch != 0 )
+                {
+                    continue;
+                }
+
+            /* Nothing queued.  Check once more after we say we're going to
+             * sleep;  the timeout covers anything we still miss */
+
+            pthread_mutex_lock(&plugin->wake_mutex);
+
+            __atomic_store_n(&plugin->sleeping, 1, __ATOMIC_SEQ_CST);
+
+            if ( Output_Depth(plugin) == 0 )
+                {
+
+                    clock_gettime(CLOCK_REALTIME, &deadline);
+                    deadline.tv_nsec += 100000000L;		/* 100ms */
 
-    if ( config->sagan_external_output_flag )
+                    if ( deadline.tv_nsec >= 1000000000L )
+                        {
+                            deadline.tv_sec++;
+                            deadline.tv_nsec -= 1000000000L;
+                        }
+
+                    pthread_cond_timedwait(&plugin->wake_cond, &plugin->wake_mutex, &deadline);
+                }
+
+            __atomic_store_n(&plugin->sleeping, 0, __ATOMIC_SEQ_CST);
+
+            pthread_mutex_unlock(&plugin->wake_mutex);
+
+        }
+
+}
+
+/****************************************************************************
+ * Output_Pause - Waits (for a while) for the queues to empty and then stops
+ * the output threads.  Used by SIGHUP so records aren't written while log
+ * files are reopened and rules are reloaded.
+ ****************************************************************************/
+
+void Output_Pause( void )
+{
+
+    struct timespec wait = { 0, 1000000 };		/* 1ms */
+
+    uint64_t depth = 0;
+    int waited = 0;
+    int i = 0;
+
+    do
         {
-            External_Thread( Event, config->sagan_external_command );
+
+            depth = 0;
+
+            for ( i = 0; i < SAGAN_OUTPUT_MAX; i++ )
+                {
+                    depth += Output_Depth(&SaganOutputPlugins[i]);
+                }
+
+            if ( depth == 0 )
+                {
+                    break;
+                }
+
+            nanosleep(&wait, NULL);
+
+        }
+    while ( ++waited < OUTPUT_DRAIN_TIMEOUT * 1000 );
+
+    if ( depth != 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] %" PRIu64 " alert(s) still queued for output after %d seconds.", __FILE__, __LINE__, depth, OUTPUT_DRAIN_TIMEOUT);
         }
 
-    /****************************************************************************/
-    /* External program via rule                                                */
-    /****************************************************************************/
+    for ( i = 0; i < SAGAN_OUTPUT_MAX; i++ )
+        {
+            pthread_mutex_lock(&SaganOutputPlugins[i].batch_mutex);
+        }
+
+}
+
+/****************************************************************************
+ * Output_Resume - Lets the output threads go again
+ ****************************************************************************/
 
-    if (  rulestruct[Event->found].external_flag )
+void Output_Resume( void )
+{
+
+    int i = 0;
+
+    for ( i = 0; i < SAGAN_OUTPUT_MAX; i++ )
         {
-            External_Thread( Event, rulestruct[Event->found].external_program );
+            pthread_mutex_unlock(&SaganOutputPlugins[i].batch_mutex);
         }
+
 }
 
+/****************************************************************************
+ * Output_Plugin_Stats - Queue depth,  drop and latency counters for "type"
+ ****************************************************************************/
+
+void Output_Plugin_Stats( int type, _Sagan_Output_Stats *stats )
+{
+
+    _Sagan_Output_Plugin *plugin = &SaganOutputPlugins[type];
+
+    stats->name = output_plugin_names[type];
+    stats->depth = Output_Depth(plugin);
+    stats->written = plugin->written;
+    stats->dropped = __atomic_load_n(&plugin->dropped, __ATOMIC_RELAXED);
+    stats->latency_avg = plugin->written != 0 ? plugin->latency_total / plugin->written : 0;
+    stats->latency_max = plugin->latency_max;
+
+}
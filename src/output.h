@@ -22,4 +22,84 @@
 #include "config.h"             /* From autoconf */
 #endif
 
+/* Output plugins.  Each one has its own output thread */
+
+#define SAGAN_OUTPUT_ALERT		0
+#define SAGAN_OUTPUT_EVE		1
+#define SAGAN_OUTPUT_FAST		2
+#define SAGAN_OUTPUT_UNIFIED2		3
+#define SAGAN_OUTPUT_SYSLOG		4
+#define SAGAN_OUTPUT_SNORTSAM		5
+#define SAGAN_OUTPUT_ESMTP		6
+#define SAGAN_OUTPUT_EXTERNAL		7
+
+#define SAGAN_OUTPUT_MAX		8
+
+/* Slots for threads other than the workers (track-clients, etc).  Slot 0
+ * is shared by anything that doesn't get a slot of its own */
+
+#define SAGAN_OUTPUT_EXTRA_SLOTS	4
+
+/* A copy of a _Sagan_Event.  The strings the event points to are packed
+ * into "data" so the record doesn't depend on the worker's buffers */
+
+typedef struct _Sagan_Output_Record _Sagan_Output_Record;
+struct _Sagan_Output_Record
+{
+    struct _Sagan_Event event;
+    char *normalize;		/* JSON text of event.json_normalize or NULL */
+    uint64_t enqueue_time;	/* Microseconds,  CLOCK_MONOTONIC */
+    int refcount;		/* Output threads still holding the record */
+    struct _Rules_Version *rules;	/* Held,  "event.found" is one of its rules */
+    size_t size;		/* Bytes allocated,  including "data" */
+    char data[];
+};
+
+/* Single producer / single consumer ring.  "tail" is only written by
+ * the worker that owns the slot,  "head" only by the output thread */
+
+typedef struct _Sagan_Output_Ring _Sagan_Output_Ring;
+struct _Sagan_Output_Ring
+{
+    _Sagan_Output_Record **records;
+    uint64_t head __attribute__ ((aligned (64)));
+    uint64_t tail __attribute__ ((aligned (64)));
+};
+
+typedef struct _Sagan_Output_Plugin _Sagan_Output_Plugin;
+struct _Sagan_Output_Plugin
+{
+    const char *name;
+
+    _Sagan_Output_Ring *rings;			/* One per slot */
+
+    pthread_mutex_t batch_mutex;		/* Held while a batch is written */
+    pthread_mutex_t wake_mutex;
+    pthread_cond_t wake_cond;
+    int sleeping;
+
+    uint64_t written;
+    uint64_t dropped;
+    uint64_t latency_total;			/* Microseconds */
+    uint64_t latency_max;
+};
+
+typedef struct _Sagan_Output_Stats _Sagan_Output_Stats;
+struct _Sagan_Output_Stats
+{
+    const char *name;
+    uint64_t depth;
+    uint64_t written;
+    uint64_t dropped;
+    uint64_t latency_avg;
+    uint64_t latency_max;
+};
+
+void Output_Init( void );
 void Output( _Sagan_Event * );
+void Output_Summary( _Sagan_Event * );
+_Sagan_Output_Record *Output_Record_New( _Sagan_Event * );
+void Output_Record_Free( _Sagan_Output_Record * );
+void Output_Pause( void );
+void Output_Resume( void );
+void Output_Plugin_Stats( int, _Sagan_Output_Stats * );
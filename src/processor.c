@@ -41,6 +41,8 @@
 #include "sagan-defs.h"
 #include "ignore-list.h"
 #include "sagan-config.h"
+#include "rules.h"
+#include "util-rcu.h"
 #include "parsers/parsers.h"
 
 #include "processors/engine.h"
@@ -48,23 +50,16 @@
 #include "processors/blacklist.h"
 #include "processors/dynamic-rules.h"
 
-struct _Sagan_Ignorelist *SaganIgnorelist;
 struct _SaganCounters *counters;
 struct _Sagan_Proc_Syslog *SaganProcSyslog;
 struct _SaganConfig *config;
-struct _Rule_Struct *rulestruct;
 
 int proc_msgslot; 		/* Comes from sagan.c */
 int proc_running;       /* Comes from sagan.c */
-unsigned char dynamic_rule_flag; /* Comes from sagan.c */
 
 pthread_cond_t SaganProcDoWork;
 pthread_mutex_t SaganProcWorkMutex;
 
-pthread_cond_t SaganReloadCond;
-pthread_mutex_t SaganReloadMutex;
-
-pthread_mutex_t SaganDynamicFlag;
 
 pthread_mutex_t SaganIgnoreCounter=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t SaganClientTracker=PTHREAD_MUTEX_INITIALIZER;
@@ -75,6 +70,8 @@ void Processor ( void )
 
     (void)SetThreadName("SaganWorker");
 
+    Sagan_RCU_Register();
+
     struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL = NULL;
     SaganProcSyslog_LOCAL = malloc(sizeof(struct _Sagan_Proc_Syslog));
 
@@ -92,15 +89,16 @@ void Processor ( void )
     for (;;)
         {
 
+            /* Between events we hold no references into the intel stores.
+             * Going offline while we wait lets a reload free old copies
+             * without waiting on idle workers */
+
+            Sagan_RCU_Offline();
+
             pthread_mutex_lock(&SaganProcWorkMutex);
 
             while ( proc_msgslot == 0 ) pthread_cond_wait(&SaganProcDoWork, &SaganProcWorkMutex);
 
-            if ( config->sagan_reload )
-                {
-                    pthread_cond_wait(&SaganReloadCond, &SaganReloadMutex);
-                }
-
             proc_running++;
             proc_msgslot--;	/* This was ++ before coming over, so we now -- it to get to
 					 * original value */
@@ -115,19 +113,31 @@ void Processor ( void )
             strlcpy(SaganProcSyslog_LOCAL->syslog_program, SaganProcSyslog[proc_msgslot].syslog_program, sizeof(SaganProcSyslog_LOCAL->syslog_program));
             strlcpy(SaganProcSyslog_LOCAL->syslog_message, SaganProcSyslog[proc_msgslot].syslog_message, sizeof(SaganProcSyslog_LOCAL->syslog_message));
 
+            SaganProcSyslog_LOCAL->bluedot_deferred_rule = SaganProcSyslog[proc_msgslot].bluedot_deferred_rule;
+            SaganProcSyslog_LOCAL->bluedot_deferred_rules = SaganProcSyslog[proc_msgslot].bluedot_deferred_rules;
+
             pthread_mutex_unlock(&SaganProcWorkMutex);
 
-            /* Check for general "drop" items.  We do this first so we can save CPU later */
+            Sagan_RCU_Online();
 
-            if ( config->sagan_droplist_flag )
-                {
+            /* Pick up the newest rules,  along with the ignore list and
+             * classifications loaded with them.  A log line replayed by
+             * Bluedot is run against the rules that deferred it */
+
+            Rules_Use(SaganProcSyslog_LOCAL->bluedot_deferred_rules);
+
+            /* Check for general "drop" items.  We do this first so we can save CPU later.
+             * The list is only loaded when "droplist" is enabled */
 
-                    ignore_flag = false;
+            ignore_flag = false;
 
-                    for (i = 0; i < counters->droplist_count; i++)
+            if ( rules_active->ignore_count != 0 )
+                {
+
+                    for (i = 0; i < rules_active->ignore_count; i++)
                         {
 
-                            if (Sagan_strstr(SaganProcSyslog_LOCAL->syslog_message, SaganIgnorelist[i].ignore_string))
+                            if (Sagan_strstr(SaganProcSyslog_LOCAL->syslog_message, rules_active->ignore[i].ignore_string))
                                 {
 
                                     pthread_mutex_lock(&SaganIgnoreCounter);
@@ -147,26 +157,23 @@ outside_loop:
             if ( ignore_flag == false )
                 {
 
-                    (void)Sagan_Engine(SaganProcSyslog_LOCAL, dynamic_rule_flag );
-
-                    /* If this is a dynamic run,  reset back to normal */
-
-                    if ( dynamic_rule_flag == DYNAMIC_RULE )
-                        {
-
-                            pthread_mutex_lock(&SaganDynamicFlag);
-                            dynamic_rule_flag = 0;
-                            pthread_mutex_unlock(&SaganDynamicFlag);
+                    (void)Sagan_Engine(SaganProcSyslog_LOCAL, false);
 
-                        }
+                    /* Events replayed by Bluedot were already counted */
 
-                    if ( config->sagan_track_clients_flag )
+                    if ( config->sagan_track_clients_flag && SaganProcSyslog_LOCAL->bluedot_deferred_rule == 0 )
                         {
                             Track_Clients( SaganProcSyslog_LOCAL->syslog_host );
                         }
 
                 } // End if if (ignore_Flag)
 
+            if ( SaganProcSyslog_LOCAL->bluedot_deferred_rules != NULL )
+                {
+                    Rules_Release(SaganProcSyslog_LOCAL->bluedot_deferred_rules);
+                    SaganProcSyslog_LOCAL->bluedot_deferred_rules = NULL;
+                }
+
 
             pthread_mutex_lock(&SaganProcWorkMutex);
             proc_running--;
@@ -25,6 +25,9 @@
 * known bad IP/Networks.  This processor uses the CIDR format:
 * 192.168.1.1/32 (single ip) or 192.168.1.0./24.
 *
+* Networks are kept in a Patricia trie,  so lookups cost O(prefix length)
+* regardless of how many networks are loaded.
+*
 */
 
 #ifdef HAVE_CONFIG_H
@@ -32,6 +35,8 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <math.h>
 #include <pthread.h>
@@ -41,6 +46,8 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-rcu.h"
+#include "intel-db.h"
 #include "parsers/parsers.h"
 
 #include "processors/blacklist.h"
@@ -48,10 +55,275 @@
 struct _SaganCounters *counters;
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
-struct _Sagan_Blacklist *SaganBlacklist;
+struct _Sagan_Blacklist_Store *SaganBlacklistStore;
 
 pthread_mutex_t    CounterBlacklistGenericMutex=PTHREAD_MUTEX_INITIALIZER;
 
+/* The trie being loaded.  Workers only ever see it once it has been
+ * published as SaganBlacklistStore */
+
+static _Sagan_Blacklist *blacklist_build = NULL;
+static uint32_t blacklist_node_count = 0;
+static uint32_t blacklist_node_max = 0;
+
+#define BLACKLIST_INSERTED	0
+#define BLACKLIST_DUPLICATE	1
+#define BLACKLIST_COVERED	2
+
+/****************************************************************************
+ * Blacklist_Bit - Returns bit "pos" (0 == most significant) of an address
+ ****************************************************************************/
+
+static inline int Blacklist_Bit ( const unsigned char *ipbits, int pos )
+{
+    return ( ipbits[pos >> 3] >> ( 7 - ( pos & 7 ) ) ) & 1;
+}
+
+/****************************************************************************
+ * Blacklist_Common_Bits - Returns how many leading bits (up to "max") two
+ * addresses have in common
+ ****************************************************************************/
+
+static int Blacklist_Common_Bits ( const unsigned char *a, const unsigned char *b, int max )
+{
+
+    int i = 0;
+    int bits = 0;
+    unsigned char diff = 0;
+
+    for ( i = 0; i < MAXIPBIT && bits < max; i++ )
+        {
+
+            diff = a[i] ^ b[i];
+
+            if ( diff == 0 )
+                {
+                    bits += 8;
+                    continue;
+                }
+
+            while ( ( diff & 0x80 ) == 0 )
+                {
+                    diff <<= 1;
+                    bits++;
+                }
+
+            break;
+        }
+
+    return( bits < max ? bits : max );
+}
+
+/****************************************************************************
+ * Blacklist_Prefix_Match - Does "ipaddr" fall within node "n"?
+ ****************************************************************************/
+
+static inline sbool Blacklist_Prefix_Match ( const unsigned char *ipaddr, const _Sagan_Blacklist *n )
+{
+
+    int bytes = n->prefix_len >> 3;
+    int rem = n->prefix_len & 7;
+    unsigned char mask = 0;
+
+    if ( bytes != 0 && memcmp(ipaddr, n->ipbits, bytes) )
+        {
+            return(false);
+        }
+
+    if ( rem != 0 )
+        {
+            mask = (unsigned char)( 0xff << ( 8 - rem ) );
+
+            if ( ( ipaddr[bytes] & mask ) != n->ipbits[bytes] )
+                {
+                    return(false);
+                }
+        }
+
+    return(true);
+}
+
+/****************************************************************************
+ * Blacklist_New_Node - Allocates a node from the node array.  The array is
+ * grown geometrically so loading large feeds doesn't realloc() per entry.
+ ****************************************************************************/
+
+static uint32_t Blacklist_New_Node ( const unsigned char *ipbits, int prefix_len, sbool terminal )
+{
+
+    int i = 0;
+    uint32_t node = 0;
+
+    if ( blacklist_node_count == blacklist_node_max )
+        {
+
+            blacklist_node_max = blacklist_node_max == 0 ? 1024 : blacklist_node_max * 2;
+
+            blacklist_build = (_Sagan_Blacklist *) realloc(blacklist_build, blacklist_node_max * sizeof(_Sagan_Blacklist));
+
+            if ( blacklist_build == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for blacklist trie. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    node = blacklist_node_count++;
+
+    memset(&blacklist_build[node], 0, sizeof(_Sagan_Blacklist));
+
+    /* Store the network masked to its prefix,  "10.1.2.3/8" is 10.0.0.0/8 */
+
+    for ( i = 0; i < MAXIPBIT; i++ )
+        {
+
+            if ( prefix_len >= ( i + 1 ) * 8 )
+                {
+                    blacklist_build[node].ipbits[i] = ipbits[i];
+                }
+            else if ( prefix_len > i * 8 )
+                {
+                    blacklist_build[node].ipbits[i] = ipbits[i] & (unsigned char)( 0xff << ( 8 - ( prefix_len - i * 8 ) ) );
+                }
+        }
+
+    blacklist_build[node].prefix_len = prefix_len;
+    blacklist_build[node].terminal = terminal;
+
+    return(node);
+}
+
+/****************************************************************************
+ * Blacklist_Insert - Adds a network to the trie.  Duplicates are rejected,
+ * networks already covered by a loaded (shorter) range are dropped and more
+ * specific ranges covered by the new network are pruned.  This way every
+ * terminal node is a leaf and a lookup can stop at the first one it finds.
+ ****************************************************************************/
+
+static int Blacklist_Insert ( const unsigned char *ipbits, int prefix_len )
+{
+
+    uint32_t cur = 0;
+    uint32_t next = 0;
+    uint32_t split = 0;
+    uint32_t leaf = 0;
+    int bit = 0;
+    int common = 0;
+
+    for (;;)
+        {
+
+            if ( blacklist_build[cur].prefix_len == prefix_len )
+                {
+
+                    if ( blacklist_build[cur].terminal )
+                        {
+                            return(BLACKLIST_DUPLICATE);
+                        }
+
+                    blacklist_build[cur].terminal = true;
+                    blacklist_build[cur].child[0] = 0;
+                    blacklist_build[cur].child[1] = 0;
+                    return(BLACKLIST_INSERTED);
+                }
+
+            if ( blacklist_build[cur].terminal )
+                {
+                    return(BLACKLIST_COVERED);
+                }
+
+            bit = Blacklist_Bit(ipbits, blacklist_build[cur].prefix_len);
+            next = blacklist_build[cur].child[bit];
+
+            if ( next == 0 )
+                {
+                    leaf = Blacklist_New_Node(ipbits, prefix_len, true);
+                    blacklist_build[cur].child[bit] = leaf;
+                    return(BLACKLIST_INSERTED);
+                }
+
+            common = Blacklist_Common_Bits(ipbits, blacklist_build[next].ipbits,
+                                           prefix_len < blacklist_build[next].prefix_len ? prefix_len : blacklist_build[next].prefix_len);
+
+            /* The child is a parent network of what we are adding,  keep walking */
+
+            if ( common == blacklist_build[next].prefix_len )
+                {
+                    cur = next;
+                    continue;
+                }
+
+            /* What we are adding covers the child.  Replace the child (and
+             * everything below it) with the new range */
+
+            if ( common == prefix_len )
+                {
+                    leaf = Blacklist_New_Node(ipbits, prefix_len, true);
+                    blacklist_build[cur].child[bit] = leaf;
+                    return(BLACKLIST_INSERTED);
+                }
+
+            /* Branches diverge.  Add an interior node at the common prefix */
+
+            split = Blacklist_New_Node(ipbits, common, false);
+            leaf = Blacklist_New_Node(ipbits, prefix_len, true);
+
+            blacklist_build[split].child[Blacklist_Bit(blacklist_build[next].ipbits, common)] = next;
+            blacklist_build[split].child[Blacklist_Bit(ipbits, common)] = leaf;
+            blacklist_build[cur].child[bit] = split;
+
+            return(BLACKLIST_INSERTED);
+        }
+}
+
+/****************************************************************************
+ * Blacklist_Compact - Copies reachable nodes into a new array in depth first
+ * order.  This drops nodes pruned by Blacklist_Insert() and keeps the nodes
+ * a lookup walks close together in memory.
+ ****************************************************************************/
+
+static uint32_t Blacklist_Compact_Copy ( _Sagan_Blacklist *dst, uint32_t *dst_count, uint32_t node )
+{
+
+    uint32_t new_node = (*dst_count)++;
+
+    memcpy(&dst[new_node], &blacklist_build[node], sizeof(_Sagan_Blacklist));
+
+    if ( blacklist_build[node].child[0] != 0 )
+        {
+            dst[new_node].child[0] = Blacklist_Compact_Copy(dst, dst_count, blacklist_build[node].child[0]);
+        }
+
+    if ( blacklist_build[node].child[1] != 0 )
+        {
+            dst[new_node].child[1] = Blacklist_Compact_Copy(dst, dst_count, blacklist_build[node].child[1]);
+        }
+
+    return(new_node);
+}
+
+static void Blacklist_Compact ( void )
+{
+
+    _Sagan_Blacklist *compact = NULL;
+    uint32_t compact_count = 0;
+
+    compact = malloc(blacklist_node_count * sizeof(_Sagan_Blacklist));
+
+    if ( compact == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for compact blacklist. Abort!", __FILE__, __LINE__);
+        }
+
+    (void)Blacklist_Compact_Copy(compact, &compact_count, 0);
+
+    free(blacklist_build);
+
+    blacklist_build = compact;
+    blacklist_node_count = compact_count;
+    blacklist_node_max = blacklist_node_count;
+
+}
+
 /****************************************************************************
  * Sagan_Blacklist_Init - Init any global memory structures we might need
  ****************************************************************************/
@@ -59,15 +331,172 @@ pthread_mutex_t    CounterBlacklistGenericMutex=PTHREAD_MUTEX_INITIALIZER;
 void Sagan_Blacklist_Init ( void )
 {
 
+    unsigned char root[MAXIPBIT] = { 0 };
+
+    free(blacklist_build);
+
+    blacklist_build = NULL;
+    blacklist_node_count = 0;
+    blacklist_node_max = 0;
+
+    (void)Blacklist_New_Node(root, 0, false);
+
+}
+
+/****************************************************************************
+ * Blacklist_Publish - Swaps "store" in for the trie the workers are using.
+ * The old trie is retired and free()'ed by Sagan_RCU_Reclaim() once no
+ * worker can still be walking it.
+ ****************************************************************************/
+
+static void Blacklist_Store_Free ( void *ptr )
+{
+
+    _Sagan_Blacklist_Store *store = (_Sagan_Blacklist_Store *)ptr;
+
+    if ( store->db != NULL )
+        {
+            Intel_DB_Close(store->db);
+        }
+    else
+        {
+            free(store->nodes);
+        }
+
+    free(store);
+
+}
+
+static void Blacklist_Publish ( _Sagan_Blacklist_Store *store )
+{
+
+    _Sagan_Blacklist_Store *old = SaganBlacklistStore;
+
+    Sagan_RCU_Assign(SaganBlacklistStore, store);
+
     pthread_mutex_lock(&CounterBlacklistGenericMutex);
-    counters->blacklist_count=0;
+    counters->blacklist_count = store != NULL ? store->count : 0;
     pthread_mutex_unlock(&CounterBlacklistGenericMutex);
 
+    Sagan_RCU_Retire(old, Blacklist_Store_Free);
+
+}
+
+/****************************************************************************
+ * Sagan_Blacklist_Free - Unpublishes and releases the blacklist.  Used when
+ * a reload (SIGHUP) disables the processor.
+ ****************************************************************************/
+
+void Sagan_Blacklist_Free ( void )
+{
+
+    Blacklist_Publish(NULL);
+
+}
+
+/****************************************************************************
+ * Blacklist_Check_DB - Validates a mapped trie before Blacklist_Search()
+ * trusts it.  Every child index must be in range and every child must be
+ * more specific than its parent,  so a walk always stops.
+ ****************************************************************************/
+
+static void Blacklist_Check_DB ( const _Sagan_Blacklist *nodes, uint64_t node_count )
+{
+
+    uint64_t i;
+    int j;
+
+    for ( i = 0; i < node_count; i++ )
+        {
+
+            if ( nodes[i].prefix_len > MAXIPBIT * 8 )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt blacklist trie. Abort!", __FILE__, __LINE__, config->blacklist_db);
+                }
+
+            for ( j = 0; j < 2; j++ )
+                {
+
+                    if ( nodes[i].child[j] == 0 )
+                        {
+                            continue;
+                        }
+
+                    if ( nodes[i].child[j] >= node_count ||
+                            nodes[nodes[i].child[j]].prefix_len <= nodes[i].prefix_len )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt blacklist trie. Abort!", __FILE__, __LINE__, config->blacklist_db);
+                        }
+                }
+        }
+
+}
+
+/****************************************************************************
+ * Blacklist_Load_DB - Maps the trie from a precompiled intel image (see
+ * intel-db.c) instead of parsing the blacklist files.
+ ****************************************************************************/
+
+static void Blacklist_Load_DB ( void )
+{
+
+    _Sagan_Blacklist_Store *store = NULL;
+    uint64_t node_count = 0;
+    uint64_t count = 0;
+
+    store = calloc(1, sizeof(_Sagan_Blacklist_Store));
+
+    if ( store == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for blacklist store. Abort!", __FILE__, __LINE__);
+        }
+
+    store->db = Intel_DB_Open(config->blacklist_db);
+    store->nodes = (_Sagan_Blacklist *) Intel_DB_Section(store->db, INTEL_DB_BLACKLIST_NODES, sizeof(_Sagan_Blacklist), &node_count, &count);
+
+    if ( store->nodes == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Intel database %s has no blacklist data. Abort!", __FILE__, __LINE__, config->blacklist_db);
+        }
+
+    if ( node_count > UINT32_MAX )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt blacklist trie. Abort!", __FILE__, __LINE__, config->blacklist_db);
+        }
+
+    Blacklist_Check_DB(store->nodes, node_count);
+
+    store->node_count = node_count;
+    store->count = count;
+
+    Sagan_Log(NORMAL, "Blacklist Processor mapped %s (Total: %d, Trie nodes: %u)", config->blacklist_db, store->count, store->node_count);
+
+    Blacklist_Publish(store);
+
+}
+
+/****************************************************************************
+ * Sagan_Blacklist_Save - Writes the loaded trie to an intel image.  Used by
+ * saganintel.
+ ****************************************************************************/
+
+void Sagan_Blacklist_Save ( _Sagan_Intel_DB_Writer *writer )
+{
+
+    _Sagan_Blacklist_Store *store = Sagan_RCU_Dereference(SaganBlacklistStore);
+
+    if ( store == NULL )
+        {
+            return;
+        }
+
+    Intel_DB_Add(writer, INTEL_DB_BLACKLIST_NODES, store->nodes, sizeof(_Sagan_Blacklist), store->node_count, store->count);
+
 }
 
 /****************************************************************************
- * Sagan_Blacklist_Load - Loads 32 bit IP addresses into memory so that they
- * can be queried later
+ * Sagan_Blacklist_Load - Loads IPv4/IPv6 networks into the blacklist trie
+ * so that they can be queried later
  ****************************************************************************/
 
 void Sagan_Blacklist_Load ( void )
@@ -88,13 +517,23 @@ void Sagan_Blacklist_Load ( void )
 
     int line_count;
     int item_count;
-    int i;
+    int total_count = 0;
+    int covered_count = 0;
 
     sbool found = 0;
 
-    pthread_mutex_lock(&CounterBlacklistGenericMutex);
-    counters->blacklist_count=0;
-    pthread_mutex_unlock(&CounterBlacklistGenericMutex);
+    _Sagan_Blacklist_Store *store = NULL;
+
+    if ( config->blacklist_db[0] != '\0' )
+        {
+            Blacklist_Load_DB();
+            return;
+        }
+
+    if ( blacklist_build == NULL )
+        {
+            Sagan_Blacklist_Init();
+        }
 
     blacklist_filename = strtok_r(config->blacklist_files, ",", &ptmp);
 
@@ -126,19 +565,8 @@ void Sagan_Blacklist_Load ( void )
                     else
                         {
 
-                            /* Allocate memory for Blacklists,  not comments */
-
                             line_count++;
 
-                            SaganBlacklist = (_Sagan_Blacklist *) realloc(SaganBlacklist, (counters->blacklist_count+1) * sizeof(_Sagan_Blacklist));
-
-                            if ( SaganBlacklist == NULL )
-                                {
-                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for SaganBlacklist. Abort!", __FILE__, __LINE__);
-                                }
-
-                            memset(&SaganBlacklist[counters->blacklist_count], 0, sizeof(_Sagan_Blacklist));
-
                             Remove_Return(blacklistbuf);
 
                             iprange = NULL;
@@ -173,7 +601,10 @@ void Sagan_Blacklist_Load ( void )
                                     found = 1;
                                 }
 
-                            if ( mask == 0 || !Mask2Bit(mask, maskbits))
+                            /* A literal "/0" is the whole address space (the trie root).  Anything
+                             * else atoi() turns into 0 is a bad mask */
+
+                            if ( mask == 0 ? strcmp(tmpmask, "0") != 0 : !Mask2Bit(mask, maskbits) )
                                 {
 
                                     Sagan_Log(ERROR, "[%s, line %d] Invalid mask in %s at line %d, skipping....", __FILE__, __LINE__, blacklist_filename, line_count);
@@ -181,15 +612,6 @@ void Sagan_Blacklist_Load ( void )
 
                                 }
 
-                            /* Record lower and upper range based on the /CIDR.  We then use IP2Bit(ipaddr) to determine
-                             * if it's within the blacklist range.
-                             *
-                             * Idea came from "ashitpro"
-                             * http://bytes.com/topic/c/answers/765104-determining-whether-given-ip-exist-cidr-ip-range
-                             *
-                             */
-
-
                             if ( found == 0 )
                                 {
 
@@ -197,75 +619,139 @@ void Sagan_Blacklist_Load ( void )
                                         {
 
                                             Sagan_Log(WARN, "[%s, line %d] Got invalid blacklist address %s/%s in %s on line %d, skipping....", __FILE__, __LINE__, iprange, tmpmask, blacklist_filename, line_count);
-                                            found = 1;
 
                                         }
                                     else
                                         {
-                                            for ( i = 0; i < counters->blacklist_count; i++ )
+
+                                            switch ( Blacklist_Insert(ipbits, mask) )
                                                 {
 
-                                                    if ( !memcmp(SaganBlacklist[i].range.ipbits, ipbits, MAXIPBIT ) &&
-                                                            !memcmp(SaganBlacklist[i].range.maskbits, maskbits, MAXIPBIT ) )
+                                                case BLACKLIST_DUPLICATE:
+                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate blacklist address %s/%s in %s on line %d, skipping....", __FILE__, __LINE__, iprange, tmpmask, blacklist_filename, line_count);
+                                                    break;
+
+                                                case BLACKLIST_COVERED:
+
+                                                    covered_count++;
+
+                                                    if ( debug->debugload )
                                                         {
-                                                            Sagan_Log(WARN, "[%s, line %d] Got duplicate blacklist address %s/%s in %s on line %d, skipping....", __FILE__, __LINE__, iprange, tmpmask, blacklist_filename, line_count);
-                                                            found = 1;
+                                                            Sagan_Log(DEBUG, "[%s, line %d] Blacklist address %s/%s in %s on line %d is covered by a larger range, skipping....", __FILE__, __LINE__, iprange, tmpmask, blacklist_filename, line_count);
                                                         }
-                                                }
-                                        }
-                                }
-
-                            if ( found == 0 )
-                                {
 
-                                    memcpy(SaganBlacklist[counters->blacklist_count].range.ipbits, ipbits, sizeof(ipbits));
-                                    memcpy(SaganBlacklist[counters->blacklist_count].range.maskbits, maskbits, sizeof(maskbits));
+                                                    break;
 
-                                    item_count++;
+                                                default:
 
-                                    pthread_mutex_lock(&CounterBlacklistGenericMutex);
-                                    counters->blacklist_count++;
-                                    pthread_mutex_unlock(&CounterBlacklistGenericMutex);
+                                                    item_count++;
+                                                    total_count++;
 
+                                                }
+                                        }
                                 }
                         }
                 }
 
             fclose(blacklist);
 
-            Sagan_Log(NORMAL, "Blacklist Processor Loaded File: %s (File: %d, Total: %d)", blacklist_filename, item_count, counters->blacklist_count++);
+            Sagan_Log(NORMAL, "Blacklist Processor Loaded File: %s (File: %d, Total: %d)", blacklist_filename, item_count, total_count);
 
             blacklist_filename = strtok_r(NULL, ",", &ptmp);
 
         }
 
-}
+    Blacklist_Compact();
+
+    Sagan_Log(NORMAL, "Blacklist Processor merged %d overlapping range(s).  Trie nodes: %u", covered_count, blacklist_node_count);
+
+    store = calloc(1, sizeof(_Sagan_Blacklist_Store));
+
+    if ( store == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for blacklist store. Abort!", __FILE__, __LINE__);
+        }
+
+    store->nodes = blacklist_build;
+    store->node_count = blacklist_node_count;
+    store->count = total_count;
 
+    /* The next load starts a fresh trie */
+
+    blacklist_build = NULL;
+    blacklist_node_count = 0;
+    blacklist_node_max = 0;
+
+    Blacklist_Publish(store);
+
+}
 
 /***************************************************************************
- * Sagan_Blacklist_IPADDR - Looks up the IP address in the Blacklist
- * array.  If found,  returns TRUE.
+ * Blacklist_Search - Walks the trie.  Since terminal nodes are always
+ * leaves,  the walk ends at the first terminal node that contains "ipaddr".
+ * That can be the root itself when a /0 is loaded.
  ***************************************************************************/
 
-sbool Sagan_Blacklist_IPADDR ( unsigned char *ipaddr )
+static sbool Blacklist_Search ( const _Sagan_Blacklist_Store *store, unsigned char *ipaddr )
 {
 
-    int i = 0;
+    const _Sagan_Blacklist *nodes = NULL;
 
-    counters->blacklist_lookup_count++;
+    uint32_t cur = 0;
+    uint32_t next = 0;
 
-    for ( i = 0; i < counters->blacklist_count; i++)
+    if ( store == NULL )
         {
+            return(false);
+        }
 
-            if ( is_inrange(ipaddr, (unsigned char *)&SaganBlacklist[i].range, 1) )
-                {
+    nodes = store->nodes;
 
-                    pthread_mutex_lock(&CounterBlacklistGenericMutex);
-                    counters->blacklist_hit_count++;
-                    pthread_mutex_unlock(&CounterBlacklistGenericMutex);
+    /* "cur" always contains "ipaddr" (the root contains everything) */
+
+    for (;;)
+        {
 
+            if ( nodes[cur].terminal )
+                {
                     return(true);
                 }
+
+            if ( nodes[cur].prefix_len >= MAXIPBIT * 8 )
+                {
+                    return(false);
+                }
+
+            next = nodes[cur].child[ Blacklist_Bit(ipaddr, nodes[cur].prefix_len) ];
+
+            if ( next == 0 || !Blacklist_Prefix_Match(ipaddr, &nodes[next]) )
+                {
+                    return(false);
+                }
+
+            cur = next;
+        }
+
+}
+
+/***************************************************************************
+ * Sagan_Blacklist_IPADDR - Looks up the IP address in the Blacklist
+ * trie.  If found,  returns TRUE.
+ ***************************************************************************/
+
+sbool Sagan_Blacklist_IPADDR ( unsigned char *ipaddr )
+{
+
+    counters->blacklist_lookup_count++;
+
+    if ( Blacklist_Search(Sagan_RCU_Dereference(SaganBlacklistStore), ipaddr) )
+        {
+
+            pthread_mutex_lock(&CounterBlacklistGenericMutex);
+            counters->blacklist_hit_count++;
+            pthread_mutex_unlock(&CounterBlacklistGenericMutex);
+
+            return(true);
         }
 
     return(false);
@@ -273,32 +759,28 @@ sbool Sagan_Blacklist_IPADDR ( unsigned char *ipaddr )
 }
 
 /***************************************************************************
- * Sagan_Blacklist_IPADDR_All - Check all IPv4 addresses against the
- * blacklist IP's in memory!
+ * Sagan_Blacklist_IPADDR_All - Check all IP addresses found in the log
+ * line against the blacklist trie
  ***************************************************************************/
 
 sbool Sagan_Blacklist_IPADDR_All ( char *syslog_message, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size )
 {
 
+    const _Sagan_Blacklist_Store *store = Sagan_RCU_Dereference(SaganBlacklistStore);
+
     int i;
-    int b;
 
     for (i = 0; i < lookup_cache_size; i++)
         {
 
-            for ( b = 0; b < counters->blacklist_count; b++ )
+            if ( Blacklist_Search(store, lookup_cache[i].ip_bits) )
                 {
 
-                    if ( is_inrange(lookup_cache[i].ip_bits, (unsigned char *)&SaganBlacklist[b].range, 1) )
-
-                        {
-
-                            pthread_mutex_lock(&CounterBlacklistGenericMutex);
-                            counters->blacklist_hit_count++;
-                            pthread_mutex_unlock(&CounterBlacklistGenericMutex);
+                    pthread_mutex_lock(&CounterBlacklistGenericMutex);
+                    counters->blacklist_hit_count++;
+                    pthread_mutex_unlock(&CounterBlacklistGenericMutex);
 
-                            return(true);
-                        }
+                    return(true);
                 }
 
         }
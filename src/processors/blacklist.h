@@ -22,18 +22,39 @@
 
 void Sagan_Blacklist_Load ( void );
 void Sagan_Blacklist_Init( void );
+void Sagan_Blacklist_Free( void );
+struct _Sagan_Intel_DB_Writer;		/* intel-db.h */
+void Sagan_Blacklist_Save( struct _Sagan_Intel_DB_Writer * );
 sbool Sagan_Blacklist_IPADDR( unsigned char * );
 sbool Sagan_Blacklist_IPADDR_All ( char *, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size );
 
+/* The blacklist is stored as a path compressed binary (Patricia) trie.  Each
+ * node holds its full network prefix so a lookup only has to compare the
+ * bits a node adds.  Nodes live in one array and reference each other by
+ * index,  so the whole trie can be grown with realloc() and free()'ed at once.
+ * Node 0 is always the root (the /0 network). */
+
 typedef struct _Sagan_Blacklist _Sagan_Blacklist;
 struct _Sagan_Blacklist
 {
 
-    struct
-    {
-        unsigned char ipbits[MAXIPBIT];
-        unsigned char maskbits[MAXIPBIT];
-    } range;
+    unsigned char ipbits[MAXIPBIT];	/* Network,  masked to prefix_len */
+    unsigned char prefix_len;		/* Significant bits in ipbits (0 - 128) */
+    sbool terminal;			/* A blacklist range ends at this node */
+    uint32_t child[2];			/* Index of the 0/1 branch,  0 == none */
 
 };
 
+/* A loaded trie.  Workers reach it through SaganBlacklistStore,  which a
+ * reload replaces as a whole (see util-rcu.c) */
+
+typedef struct _Sagan_Blacklist_Store _Sagan_Blacklist_Store;
+struct _Sagan_Blacklist_Store
+{
+
+    _Sagan_Blacklist *nodes;		/* Read only when mapped from "db" */
+    uint32_t node_count;
+    int count;				/* Networks loaded */
+    struct _Sagan_Intel_DB *db;		/* Precompiled image,  NULL if parsed */
+
+};
@@ -40,11 +40,16 @@
 #include <curl/curl.h>
 #include <json.h>
 #include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "rules.h"
+#include "util-cache.h"
+#include "util-rcu.h"
 
 #include "processors/bluedot.h"
 
@@ -54,262 +59,88 @@ struct _SaganCounters *counters;
 struct _SaganConfig *config;
 struct _SaganDebug *debug;
 
-struct _Sagan_Bluedot_IP_Cache *SaganBluedotIPCache = NULL;
-struct _Sagan_Bluedot_Hash_Cache *SaganBluedotHashCache = NULL;
-struct _Sagan_Bluedot_URL_Cache *SaganBluedotURLCache = NULL;
-struct _Sagan_Bluedot_Filename_Cache *SaganBluedotFilenameCache = NULL;
-struct _Sagan_Bluedot_Cat_List *SaganBluedotCatList = NULL;
+struct _Sagan_Cache SaganBluedotIPCache;
+struct _Sagan_Cache SaganBluedotHashCache;
+struct _Sagan_Cache SaganBluedotURLCache;
+struct _Sagan_Cache SaganBluedotFilenameCache;
+struct _Sagan_Bluedot_Cat_Store *SaganBluedotCatStore = NULL;
 
-struct _Sagan_Bluedot_IP_Queue *SaganBluedotIPQueue = NULL;
-struct _Sagan_Bluedot_Hash_Queue *SaganBluedotHashQueue = NULL;
-struct _Sagan_Bluedot_URL_Queue *SaganBluedotURLQueue = NULL;
-struct _Sagan_Bluedot_Filename_Queue *SaganBluedotFilenameQueue = NULL;
+/* Used to hand deferred log lines back to the processor threads */
 
-struct _Rule_Struct *rulestruct;
+struct _Sagan_Proc_Syslog *SaganProcSyslog;
+int proc_msgslot;
+pthread_cond_t SaganProcDoWork;
+pthread_mutex_t SaganProcWorkMutex;
 
 pthread_mutex_t SaganProcBluedotWorkMutex=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t CounterBluedotGenericMutex=PTHREAD_MUTEX_INITIALIZER;
 
-pthread_mutex_t SaganProcBluedotIPWorkMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t SaganProcBluedotHashWorkMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t SaganProcBluedotURLWorkMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t SaganProcBluedotFilenameWorkMutex=PTHREAD_MUTEX_INITIALIZER;
+/* Lookups waiting for the Bluedot thread.  "bluedot_request_seq" is the
+ * sequence number of the last lookup queued */
+
+pthread_mutex_t SaganBluedotQueueMutex=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t SaganBluedotQueueCond=PTHREAD_COND_INITIALIZER;
+
+struct _Sagan_Bluedot_Request *SaganBluedotQueueHead = NULL;
+struct _Sagan_Bluedot_Request *SaganBluedotQueueTail = NULL;
+uint64_t bluedot_request_seq = 0;
+
+/* Log lines waiting on a lookup (pending-policy: defer) */
+
+pthread_mutex_t SaganBluedotDeferMutex=PTHREAD_MUTEX_INITIALIZER;
+
+struct _Sagan_Bluedot_Deferred *SaganBluedotDeferHead = NULL;
+struct _Sagan_Bluedot_Deferred *SaganBluedotDeferTail = NULL;
+int bluedot_deferred_count = 0;
 
 sbool bluedot_cache_clean_lock=0;
-sbool bluedot_dns_global=0;
 
 /****************************************************************************
  * Sagan_Bluedot_Init() - init's some global variables and other items
  * that need to be done only once. - Champ Clark 05/15/2013
  ****************************************************************************/
 
+static sbool bluedot_cache_init = false;
+
 void Sagan_Bluedot_Init(void)
 {
 
-    char  timet[20] = { 0 };
-
-    time_t t;
-    struct tm *now = NULL;
+    config->bluedot_last_time = Sagan_Clock_Epoch();
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    /* Bluedot caches.  IP addresses are compared as bits,  everything else
+     * case insensitive.  The lookup thread keeps using them across reloads,
+     * so they are only set up once */
 
-    config->bluedot_last_time = atol(timet);
-
-    /* Bluedot IP Cache */
-
-    SaganBluedotIPCache = malloc(config->bluedot_ip_max_cache * sizeof(struct _Sagan_Bluedot_IP_Cache));
-
-    if ( SaganBluedotIPCache == NULL )
+    if ( bluedot_cache_init == true )
         {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotIPCache. Abort!", __FILE__, __LINE__);
+            return;
         }
 
-    memset(SaganBluedotIPCache, 0, config->bluedot_ip_max_cache * sizeof(_Sagan_Bluedot_IP_Cache));
-
-    /* Bluedot Hash Cache */
-
-    SaganBluedotHashCache = malloc(config->bluedot_hash_max_cache * sizeof(struct _Sagan_Bluedot_Hash_Cache));
-
-    if ( SaganBluedotHashCache == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotHashCache. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(SaganBluedotHashCache, 0, config->bluedot_hash_max_cache * sizeof(_Sagan_Bluedot_Hash_Cache));
-
-    /* Bluedot URL Cache */
-
-    SaganBluedotURLCache = malloc(config->bluedot_url_max_cache * sizeof(struct _Sagan_Bluedot_URL_Cache));
-
-    if ( SaganBluedotURLCache == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotURLCache. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(SaganBluedotURLCache, 0, config->bluedot_url_max_cache * sizeof(_Sagan_Bluedot_URL_Cache));
-
-    /* Bluedot Filename Cache */
-
-    SaganBluedotFilenameCache = malloc(config->bluedot_filename_max_cache * sizeof(struct _Sagan_Bluedot_Filename_Cache));
-
-    if ( SaganBluedotFilenameCache == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotFilenameCache. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(SaganBluedotFilenameCache, 0, config->bluedot_filename_max_cache * sizeof(_Sagan_Bluedot_Filename_Cache));
-
-    /* Bluedot IP Queue */
-
-    SaganBluedotIPQueue = malloc(config->bluedot_ip_queue * sizeof(struct _Sagan_Bluedot_IP_Queue));
-
-    if ( SaganBluedotIPQueue == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotIPQueue. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(SaganBluedotIPQueue, 0, config->bluedot_ip_queue * sizeof(_Sagan_Bluedot_IP_Queue));
-
-
-    /* Bluedot Hash Queue */
-
-    SaganBluedotHashQueue = malloc(config->bluedot_hash_queue * sizeof(struct _Sagan_Bluedot_Hash_Queue));
-
-    if ( SaganBluedotHashQueue == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotHashQueue. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(SaganBluedotHashQueue, 0, config->bluedot_hash_queue * sizeof(_Sagan_Bluedot_Hash_Queue));
-
-    /* Bluedot URL Queue */
-
-    SaganBluedotURLQueue = malloc(config->bluedot_url_queue * sizeof(struct _Sagan_Bluedot_URL_Queue));
-
-    if ( SaganBluedotURLQueue == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotURLQueue. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(SaganBluedotURLQueue, 0, config->bluedot_url_queue * sizeof(_Sagan_Bluedot_URL_Queue));
-
-    /* Bluedot Filename Queue */
-
-    SaganBluedotFilenameQueue = malloc(config->bluedot_filename_queue * sizeof(struct _Sagan_Bluedot_Filename_Queue));
+    Sagan_Cache_Init(&SaganBluedotIPCache, config->bluedot_ip_max_cache, sizeof(_Sagan_Bluedot_Cache_Entry), false);
+    Sagan_Cache_Init(&SaganBluedotHashCache, config->bluedot_hash_max_cache, sizeof(_Sagan_Bluedot_Cache_Entry), true);
+    Sagan_Cache_Init(&SaganBluedotURLCache, config->bluedot_url_max_cache, sizeof(_Sagan_Bluedot_Cache_Entry), true);
+    Sagan_Cache_Init(&SaganBluedotFilenameCache, config->bluedot_filename_max_cache, sizeof(_Sagan_Bluedot_Cache_Entry), true);
 
-    if ( SaganBluedotFilenameQueue == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganBluedotFilenameQueue. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(SaganBluedotFilenameQueue, 0, config->bluedot_filename_queue * sizeof(_Sagan_Bluedot_Filename_Queue));
+    bluedot_cache_init = true;
 
 }
 
-
 /****************************************************************************
- * Sagan_Bluedot_Clean_Queue - Clean's the "queue" of the type of lookup
- * that happened.  This is called after a successful lookup.  We do this to
- * prevent multiple lookups (at the same time!) of the same item!  This
- * happens a lot with IP address looks
+ * Sagan_Bluedot_Load_Cat() - load all "Bluedot" categories in memory.  On
+ * reload the new list replaces the old one,  which is retired until no
+ * thread can still be reading it.
  ****************************************************************************/
 
-int Sagan_Bluedot_Clean_Queue ( char *data, unsigned char type, unsigned char *ip )
+static void Sagan_Bluedot_Cat_Free( void *ptr )
 {
 
-    uint32_t ip_u32;
-    int i=0;
+    _Sagan_Bluedot_Cat_Store *store = (_Sagan_Bluedot_Cat_Store *)ptr;
 
-    unsigned char ip_convert[MAXIPBIT] = { 0 };
+    free(store->cats);
+    free(store);
 
-    char str[INET_ADDRSTRLEN];
-
-    int tmp_bluedot_queue_count=0;
-
-    if ( type == BLUEDOT_LOOKUP_IP )
-        {
-
-            memset(ip_convert, 0, MAXIPBIT);
-            memcpy(ip_convert, ip, MAXIPBIT);
-
-            for (i=0; i<config->bluedot_ip_queue; i++)
-                {
-
-                    if ( !memcmp(ip_convert, SaganBluedotIPQueue[i].ip, MAXIPBIT) )
-                        {
-
-                            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-                            memset(SaganBluedotIPQueue[i].ip, 0, MAXIPBIT);
-                            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
-
-                        }
-
-                }
-
-            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-            counters->bluedot_ip_queue_current--;
-            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
-
-
-
-        }
-
-    else if ( type == BLUEDOT_LOOKUP_HASH )
-        {
-
-            for (i=0; i<config->bluedot_hash_queue; i++)
-                {
-
-                    if ( !strcasecmp(data, SaganBluedotHashQueue[i].hash ) )
-                        {
-
-                            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-                            memset(SaganBluedotHashQueue[i].hash, 0, SHA256_HASH_SIZE+1);
-                            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
-
-                        }
-
-                }
-
-            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-            counters->bluedot_hash_queue_current--;
-            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
-
-
-        }
-
-    else if ( type == BLUEDOT_LOOKUP_URL )
-        {
-
-            for (i =0; i<config->bluedot_url_queue; i++)
-                {
-
-                    if ( !strcasecmp(data, SaganBluedotURLQueue[i].url ) )
-                        {
-
-                            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
-                            memset(SaganBluedotURLQueue[i].url, 0, sizeof(SaganBluedotURLQueue[i].url));
-                            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
-                        }
-                }
-
-            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
-            counters->bluedot_url_queue_current--;
-            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
-
-        }
-
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
-        {
-
-            for  (i=0; i<config->bluedot_filename_queue; i++)
-                {
-
-                    if ( !strcasecmp(data, SaganBluedotFilenameQueue[i].filename ) )
-                        {
-
-                            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
-                            memset(SaganBluedotFilenameQueue[i].filename, 0, sizeof(SaganBluedotFilenameQueue[i].filename));
-                            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
-                        }
-
-                }
-
-            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
-            counters->bluedot_filename_queue_current--;
-            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
-
-        }
-
-    return(true);
 }
 
-/****************************************************************************
- * Sagan_Bluedot_Load_Cat() - load all "Bluedot" categories in memory
- ****************************************************************************/
-
 void Sagan_Bluedot_Load_Cat(void)
 {
 
@@ -320,6 +151,16 @@ void Sagan_Bluedot_Load_Cat(void)
     char *bluedot_tok1 = NULL;
     char *bluedot_tok2 = NULL;
 
+    _Sagan_Bluedot_Cat_Store *store = NULL;
+    _Sagan_Bluedot_Cat_Store *old = NULL;
+
+    store = calloc(1, sizeof(_Sagan_Bluedot_Cat_Store));
+
+    if ( store == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot categories. Abort!", __FILE__, __LINE__);
+        }
+
     if (( bluedot_cat_file = fopen(config->bluedot_cat, "r" )) == NULL )
         {
             Sagan_Log(ERROR, "[%s, line %d] No Bluedot categories list to load (%s)!", __FILE__, __LINE__, config->bluedot_cat);
@@ -340,14 +181,14 @@ void Sagan_Bluedot_Load_Cat(void)
 
                     /* Allocate memory for references,  not comments */
 
-                    SaganBluedotCatList = (_Sagan_Bluedot_Cat_List *) realloc(SaganBluedotCatList, (counters->bluedot_cat_count+1) * sizeof(_Sagan_Bluedot_Cat_List));
+                    store->cats = (_Sagan_Bluedot_Cat_List *) realloc(store->cats, (store->count+1) * sizeof(_Sagan_Bluedot_Cat_List));
 
-                    if ( SaganBluedotCatList == NULL )
+                    if ( store->cats == NULL )
                         {
-                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for SaganBluedotCatList. Abort!", __FILE__, __LINE__);
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Bluedot categories. Abort!", __FILE__, __LINE__);
                         }
 
-                    memset(&SaganBluedotCatList[counters->bluedot_cat_count], 0, sizeof(_Sagan_Bluedot_Cat_List));
+                    memset(&store->cats[store->count], 0, sizeof(_Sagan_Bluedot_Cat_List));
 
                     /* Normalize the list for later use.  Better to do this here than when processing rules */
 
@@ -361,7 +202,7 @@ void Sagan_Bluedot_Load_Cat(void)
                     Remove_Return(bluedot_tok1);
                     Remove_Spaces(bluedot_tok1);
 
-                    SaganBluedotCatList[counters->bluedot_cat_count].cat_number = atoi(bluedot_tok1);
+                    store->cats[store->count].cat_number = atoi(bluedot_tok1);
 
                     bluedot_tok2 = strtok_r(NULL, "|", &saveptr);
 
@@ -374,24 +215,53 @@ void Sagan_Bluedot_Load_Cat(void)
                     Remove_Spaces(bluedot_tok2);
                     To_LowerC(bluedot_tok2);
 
-                    strlcpy(SaganBluedotCatList[counters->bluedot_cat_count].cat, bluedot_tok2, sizeof(SaganBluedotCatList[counters->bluedot_cat_count].cat));
+                    strlcpy(store->cats[store->count].cat, bluedot_tok2, sizeof(store->cats[store->count].cat));
 
-                    pthread_mutex_lock(&CounterBluedotGenericMutex);
-                    counters->bluedot_cat_count++;
-                    pthread_mutex_unlock(&CounterBluedotGenericMutex);
+                    store->count++;
                 }
         }
 
+    fclose(bluedot_cat_file);
+
+    old = SaganBluedotCatStore;
+
+    Sagan_RCU_Assign(SaganBluedotCatStore, store);
+
+    pthread_mutex_lock(&CounterBluedotGenericMutex);
+    counters->bluedot_cat_count = store->count;
+    pthread_mutex_unlock(&CounterBluedotGenericMutex);
+
+    Sagan_RCU_Retire(old, Sagan_Bluedot_Cat_Free);
+
 }
 
 /****************************************************************************
- * write_callback_func() - Callback for data received via libcurl
+ * write_callback_func() - Callback for data received via libcurl.  The
+ * body can arrive in several pieces,  so they are appended.
  ****************************************************************************/
 
 size_t static write_callback_func(void *buffer, size_t size, size_t nmemb, void *userp)
 {
-    char **response_ptr =  (char**)userp;
-    *response_ptr = strndup(buffer, (size_t)(size *nmemb));     /* Return the string */
+
+    _Sagan_Bluedot_Request *request = (_Sagan_Bluedot_Request *)userp;
+    size_t len = size * nmemb;
+    char *tmp = NULL;
+
+    tmp = realloc(request->response, request->response_len + len + 1);
+
+    if ( tmp == NULL )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Failed to allocate memory for Bluedot response.", __FILE__, __LINE__);
+            return(0);		/* Aborts the transfer */
+        }
+
+    request->response = tmp;
+
+    memcpy(request->response + request->response_len, buffer, len);
+    request->response_len += len;
+    request->response[request->response_len] = '\0';
+
+    return(len);
 }
 
 /****************************************************************************
@@ -402,16 +272,11 @@ size_t static write_callback_func(void *buffer, size_t size, size_t nmemb, void
 void Sagan_Bluedot_Check_Cache_Time (void)
 {
 
-    time_t t;
-    struct tm *now = NULL;
+    uint64_t epoch_time = 0;
 
-    char  timet[20] = { 0 };
+    epoch_time = Sagan_Clock_Epoch();
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
-    if ( bluedot_cache_clean_lock == 0 && atol(timet) > ( config->bluedot_last_time + config->bluedot_timeout ) )
+    if ( bluedot_cache_clean_lock == 0 && epoch_time > ( config->bluedot_last_time + config->bluedot_timeout ) )
         {
 
             pthread_mutex_lock(&SaganProcBluedotWorkMutex);
@@ -427,26 +292,6 @@ void Sagan_Bluedot_Check_Cache_Time (void)
 
         }
 
-    if ( counters->bluedot_ip_cache_count >= config->bluedot_ip_max_cache )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of IP cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
-
-    if ( counters->bluedot_hash_cache_count >= config->bluedot_hash_max_cache )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of hash cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
-
-    if ( counters->bluedot_url_cache_count >= config->bluedot_url_max_cache )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of URL cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
-
-    if ( counters->bluedot_filename_cache_count >= config->bluedot_filename_max_cache )
-        {
-            Sagan_Log(NORMAL, "[%s, line %d] Out of URL cache space! Considering increasing cache size!", __FILE__, __LINE__);
-        }
-
 }
 
 /****************************************************************************
@@ -457,23 +302,11 @@ void Sagan_Bluedot_Check_Cache_Time (void)
 void Sagan_Bluedot_Clean_Cache ( void )
 {
 
-    int i;
-    int deleted_count=0;
-
-    int new_bluedot_ip_max_cache = 0;
-    int new_bluedot_hash_max_cache = 0;
-    int new_bluedot_url_max_cache = 0;
-    int new_bluedot_filename_max_cache = 0;
+    uint64_t deleted_count = 0;
 
-    char  timet[20] = { 0 };
-    time_t t;
-    struct tm *now=NULL;
     uint64_t timeint;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-    timeint = atol(timet);
+    timeint = Sagan_Clock_Epoch();
 
     if (debug->debugbluedot)
         {
@@ -483,175 +316,186 @@ void Sagan_Bluedot_Clean_Cache ( void )
 
     config->bluedot_last_time = timeint;
 
-    deleted_count = 0;
+    /* Entries carry their own expire time,  so this only reclaims the
+     * memory of stale entries.  Lookups never return them. */
 
-    for (i=0; i < config->bluedot_ip_max_cache; i++ )
-        {
+    deleted_count = Sagan_Cache_Expire(&SaganBluedotIPCache, timeint);
+    Sagan_Bluedot_Cache_Stats();
 
-            if ( ( timeint - SaganBluedotIPCache[i].cache_utime ) > config->bluedot_timeout )
-                {
+    Sagan_Log(NORMAL, "[%s, line %d] Deleted %" PRIu64 " IP addresses from Bluedot cache. New IP cache count is %" PRIu64 ".",__FILE__, __LINE__, deleted_count, counters->bluedot_ip_cache_count);
 
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting IP address from cache -> %u",  __FILE__, __LINE__, SaganBluedotIPCache[i].ip);
-                        }
+    deleted_count = Sagan_Cache_Expire(&SaganBluedotHashCache, timeint);
+    Sagan_Bluedot_Cache_Stats();
 
-                    pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
+    Sagan_Log(NORMAL, "[%s, line %d] Deleted %" PRIu64 " hashes from Bluedot cache. New hash cache count is %" PRIu64 ".",__FILE__, __LINE__, deleted_count, counters->bluedot_hash_cache_count);
 
-                    memset(SaganBluedotIPCache[i].ip, 0, MAXIPBIT);
-                    SaganBluedotIPCache[i].mdate_utime = 0;
-                    SaganBluedotIPCache[i].cdate_utime = 0;
-                    SaganBluedotIPCache[i].cache_utime = 0;
-                    SaganBluedotIPCache[i].alertid = 0;
+    deleted_count = Sagan_Cache_Expire(&SaganBluedotURLCache, timeint);
+    Sagan_Bluedot_Cache_Stats();
 
-                    pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    Sagan_Log(NORMAL, "[%s, line %d] Deleted %" PRIu64 " URLs from Bluedot cache. New URL cache count is %" PRIu64 ".",__FILE__, __LINE__, deleted_count, counters->bluedot_url_cache_count);
 
-                    deleted_count++;
+    deleted_count = Sagan_Cache_Expire(&SaganBluedotFilenameCache, timeint);
+    Sagan_Bluedot_Cache_Stats();
 
-                }
-            else
-                {
+    Sagan_Log(NORMAL, "[%s, line %d] Deleted %" PRIu64 " Filenames from Bluedot cache. New Filename cache count is %" PRIu64 ".",__FILE__, __LINE__, deleted_count, counters->bluedot_filename_cache_count);
 
-                    new_bluedot_ip_max_cache++;
+}
 
-                }
-        }
+/****************************************************************************
+ * Sagan_Bluedot_Cache_Stats - Copies cache size, hit, miss and eviction
+ * counts into "counters" for perfmon and stats.
+ ****************************************************************************/
 
-    pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-    deleted_count = counters->bluedot_ip_cache_count - new_bluedot_ip_max_cache;
-    counters->bluedot_ip_cache_count = new_bluedot_ip_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+void Sagan_Bluedot_Cache_Stats ( void )
+{
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d IP addresses from Bluedot cache. New IP cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_ip_cache_count);
+    _Sagan_Cache_Stats stats;
 
-    /* Clean hash cache */
+    Sagan_Cache_Stats(&SaganBluedotIPCache, &stats);
 
-    deleted_count = 0;
+    counters->bluedot_ip_cache_count = stats.count;
+    counters->bluedot_ip_cache_hit = stats.hits;
+    counters->bluedot_ip_cache_miss = stats.misses;
+    counters->bluedot_ip_cache_evict = stats.evictions;
 
-    for (i=0; i < config->bluedot_hash_max_cache; i++ )
-        {
+    Sagan_Cache_Stats(&SaganBluedotHashCache, &stats);
 
-            if ( ( timeint - SaganBluedotHashCache[i].cache_utime ) > config->bluedot_timeout )
-                {
+    counters->bluedot_hash_cache_count = stats.count;
+    counters->bluedot_hash_cache_hit = stats.hits;
+    counters->bluedot_hash_cache_miss = stats.misses;
+    counters->bluedot_hash_cache_evict = stats.evictions;
 
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting Hash address from cache -> %s",  __FILE__, __LINE__, SaganBluedotHashCache[i].hash);
-                        }
+    Sagan_Cache_Stats(&SaganBluedotURLCache, &stats);
 
-                    pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
+    counters->bluedot_url_cache_count = stats.count;
+    counters->bluedot_url_cache_hit = stats.hits;
+    counters->bluedot_url_cache_miss = stats.misses;
+    counters->bluedot_url_cache_evict = stats.evictions;
 
-                    memset(SaganBluedotHashCache[i].hash, 0, SHA256_HASH_SIZE+1);
-                    SaganBluedotHashCache[i].cache_utime = 0;
-                    SaganBluedotHashCache[i].alertid = 0;
+    Sagan_Cache_Stats(&SaganBluedotFilenameCache, &stats);
 
-                    pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+    counters->bluedot_filename_cache_count = stats.count;
+    counters->bluedot_filename_cache_hit = stats.hits;
+    counters->bluedot_filename_cache_miss = stats.misses;
+    counters->bluedot_filename_cache_evict = stats.evictions;
 
-                    deleted_count++;
+}
 
-                }
-            else
-                {
+/***************************************************************************
+ * Sagan_Bluedot_Queue_Current - Returns the "queue_current" counter for
+ * a lookup type.
+ ***************************************************************************/
 
-                    new_bluedot_hash_max_cache++;
+static int *Sagan_Bluedot_Queue_Current ( unsigned char type )
+{
 
-                }
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
+            return(&counters->bluedot_ip_queue_current);
         }
 
-    pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-    deleted_count = counters->bluedot_hash_cache_count - new_bluedot_hash_max_cache;
-    counters->bluedot_hash_cache_count = new_bluedot_hash_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
-
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d hashes from Bluedot cache. New hash cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_hash_cache_count);
-
-    /* Clean URL cache */
-
-    deleted_count = 0;
-
-    for (i=0; i < config->bluedot_url_max_cache; i++ )
+    else if ( type == BLUEDOT_LOOKUP_HASH )
         {
+            return(&counters->bluedot_hash_queue_current);
+        }
 
-            if ( ( timeint - SaganBluedotURLCache[i].cache_utime ) > config->bluedot_timeout )
-                {
-
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting URL address from cache -> %s",  __FILE__, __LINE__, SaganBluedotURLCache[i].url);
-                        }
-
-                    pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            return(&counters->bluedot_url_queue_current);
+        }
 
-                    memset(SaganBluedotURLCache[i].url, 0, sizeof(SaganBluedotURLCache[i].url));
-                    SaganBluedotURLCache[i].cache_utime = 0;
-                    SaganBluedotURLCache[i].alertid = 0;
+    return(&counters->bluedot_filename_queue_current);
+}
 
-                    pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+/***************************************************************************
+ * Sagan_Bluedot_Cache_Of - Returns the cache and key used for a lookup.
+ * IP addresses are keyed by their bits,  everything else by the string.
+ ***************************************************************************/
 
-                    deleted_count++;
+static struct _Sagan_Cache *Sagan_Bluedot_Cache_Of ( unsigned char type, char *data, unsigned char *ip, const void **key, size_t *key_len )
+{
 
-                }
-            else
-                {
+    if ( type == BLUEDOT_LOOKUP_IP )
+        {
+            *key = ip;
+            *key_len = MAXIPBIT;
+            return(&SaganBluedotIPCache);
+        }
 
-                    new_bluedot_url_max_cache++;
+    *key = data;
+    *key_len = strlen(data);
 
-                }
+    if ( type == BLUEDOT_LOOKUP_HASH )
+        {
+            return(&SaganBluedotHashCache);
         }
 
-    pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
-    deleted_count = counters->bluedot_url_cache_count - new_bluedot_url_max_cache;
-    counters->bluedot_url_cache_count = new_bluedot_url_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            return(&SaganBluedotURLCache);
+        }
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d URLs from Bluedot cache. New URL cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_url_cache_count);
+    return(&SaganBluedotFilenameCache);
+}
 
-    /* Clean Filename cache */
+/***************************************************************************
+ * Sagan_Bluedot_Queue_Request - Hands a lookup to the Bluedot thread
+ ***************************************************************************/
 
-    deleted_count = 0;
+static void Sagan_Bluedot_Queue_Request ( unsigned char type, char *data, unsigned char *ip )
+{
 
-    for (i=0; i < config->bluedot_filename_max_cache; i++ )
-        {
+    _Sagan_Bluedot_Request *request = NULL;
 
-            if ( ( timeint - SaganBluedotFilenameCache[i].cache_utime ) > config->bluedot_timeout )
-                {
+    request = malloc(sizeof(_Sagan_Bluedot_Request));
 
-                    if (debug->debugbluedot)
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] == Deleting filename from cache -> %s",  __FILE__, __LINE__, SaganBluedotFilenameCache[i].filename);
-                        }
+    if ( request == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot request. Abort!", __FILE__, __LINE__);
+        }
 
-                    pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
+    memset(request, 0, sizeof(_Sagan_Bluedot_Request));
 
-                    memset(SaganBluedotFilenameCache[i].filename, 0, sizeof(SaganBluedotFilenameCache[i].filename));
-                    SaganBluedotFilenameCache[i].cache_utime = 0;
-                    SaganBluedotFilenameCache[i].alertid = 0;
+    request->type = type;
+    request->data = strdup(data);
 
-                    pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+    if ( request->data == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bluedot request. Abort!", __FILE__, __LINE__);
+        }
 
-                    deleted_count++;
+    if ( ip != NULL )
+        {
+            memcpy(request->ip, ip, MAXIPBIT);
+        }
 
-                }
-            else
-                {
+    pthread_mutex_lock(&SaganBluedotQueueMutex);
 
-                    new_bluedot_filename_max_cache++;
+    request->seq = ++bluedot_request_seq;
 
-                }
+    if ( SaganBluedotQueueTail == NULL )
+        {
+            SaganBluedotQueueHead = request;
         }
+    else
+        {
+            SaganBluedotQueueTail->next = request;
+        }
+
+    SaganBluedotQueueTail = request;
 
-    pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
-    deleted_count = counters->bluedot_filename_cache_count - new_bluedot_filename_max_cache;
-    counters->bluedot_filename_cache_count = new_bluedot_filename_max_cache;
-    pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+    (*Sagan_Bluedot_Queue_Current(type))++;
 
-    Sagan_Log(NORMAL, "[%s, line %d] Deleted %d Filenames from Bluedot cache. New Filename cache count is %d.",__FILE__, __LINE__, deleted_count, counters->bluedot_filename_cache_count);
+    pthread_cond_signal(&SaganBluedotQueueCond);
+    pthread_mutex_unlock(&SaganBluedotQueueMutex);
 
 }
 
 /***************************************************************************
- * Sagan_Bluedot_IP_Lookup - This does the actual Bluedot lookup.  It returns
- * the bluedot_alertid value (0 if not found)
+ * Sagan_Bluedot_Lookup - Returns the bluedot_alertid for "data" (0 if not
+ * found).  Nothing here waits on Bluedot.  On a cache miss the lookup is
+ * queued for the Bluedot thread and BLUEDOT_LOOKUP_PENDING is returned,
+ * as it is for every caller until the answer is cached.
  ***************************************************************************/
 
 /* type
@@ -665,96 +509,23 @@ void Sagan_Bluedot_Clean_Cache ( void )
 unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_position, unsigned char *ip )
 {
 
-    unsigned char ip_convert[MAXIPBIT] = { 0 };
+    struct _Sagan_Cache *cache = NULL;
+    const void *key = NULL;
+    size_t key_len = 0;
 
-    char tmpurl[1024] = { 0 };
-    char tmpdeviceid[64] = { 0 };
-
-    CURL *curl;
-    CURLcode res;
-
-    struct curl_slist *headers = NULL;
-    char *response=NULL;
-
-    struct json_object *json_in = NULL;
-    json_object *string_obj;
+    _Sagan_Bluedot_Cache_Entry cache_entry;
+    _Sagan_Bluedot_Cache_Entry placeholder;
 
-    const char *cat=NULL;
-    const char *cdate_utime=NULL;
-    const char *mdate_utime=NULL;
-
-    uint64_t cdate_utime_u32;
-    uint64_t mdate_utime_u32;
-
-    char cattmp[64] = { 0 };
-    char *saveptr=NULL;
     signed char bluedot_alertid = 0;		/* -128 to 127 */
-    int i;
-
-    char tmp[64] = { 0 };
-    char ip_s[64] = { 0 };
-
-    char  timet[20] = { 0 };
-    time_t t;
-    struct tm *now=NULL;
+    sbool found = false;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    int queue_max = 0;
 
-    uint64_t epoch_time = atol(timet);
-
-    /* Check IP TTL for Bluedot */
-
-    if ( bluedot_dns_global == 0 && epoch_time - config->bluedot_dns_last_lookup > config->bluedot_dns_ttl )
-        {
-
-            if ( debug->debugbluedot )
-                {
-                    Sagan_Log(DEBUG, "[%s, line %d] Bluedot host TTL of %d seconds reached.  Doing new lookup for '%s'.", __FILE__, __LINE__, config->bluedot_dns_ttl, config->bluedot_host);
-                }
-
-
-            pthread_mutex_lock(&SaganProcBluedotWorkMutex);
-            bluedot_dns_global = 1;
-
-            i = DNS_Lookup( config->bluedot_host, tmp, sizeof(tmp) );
-
-            if ( i != 0 )
-                {
-                    Sagan_Log(WARN, "[%s, line %d] Cannot lookup DNS for '%s'.  Staying with old value of %s.", __FILE__, __LINE__, config->bluedot_host, config->bluedot_ip);
-                }
-            else
-                {
-
-                    strlcpy(config->bluedot_ip, tmp, sizeof(config->bluedot_ip));
-
-                    if ( debug->debugbluedot )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Bluedot host IP is now: %s", __FILE__, __LINE__, config->bluedot_ip);
-                        }
-
-                }
-
-            config->bluedot_dns_last_lookup = epoch_time;
-            bluedot_dns_global = 0;
-            pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
-
-        }
-
-
-    /************************************************************************/
-    /* Lookup types                                                         */
-    /************************************************************************/
-
-    /* IP Address Lookup */
+    uint64_t epoch_time = Sagan_Clock_Epoch();
 
     if ( type == BLUEDOT_LOOKUP_IP )
         {
 
-            memset(ip_convert, 0, MAXIPBIT);
-            memcpy(ip_convert, ip, MAXIPBIT);
-
             if ( is_notroutable(ip) )
                 {
 
@@ -766,590 +537,741 @@ unsigned char Sagan_Bluedot_Lookup(char *data,  unsigned char type, int rule_pos
                     return(false);
                 }
 
-            for (i=0; i<config->bluedot_ip_max_cache; i++)
-                {
-
-                    if (!memcmp( ip_convert, SaganBluedotIPCache[i].ip, MAXIPBIT ))
-                        {
-
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled %s from Bluedot cache with category of \"%d\". [cdate: %d / mdate: %d]", __FILE__, __LINE__, data, SaganBluedotIPCache[i].alertid, SaganBluedotIPCache[i].cdate_utime, SaganBluedotIPCache[i].mdate_utime);
-                                }
-
-                            bluedot_alertid = SaganBluedotIPCache[i].alertid;
-
-                            if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_mdate_effective_period != 0 )
-                                {
-
-                                    if ( ( epoch_time - SaganBluedotIPCache[i].mdate_utime ) > rulestruct[rule_position].bluedot_mdate_effective_period )
-                                        {
-
-                                            if ( debug->debugbluedot )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] From Bluedot Cache - qmdate for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_mdate_effective_period);
-                                                }
-
-                                            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-                                            counters->bluedot_mdate_cache++;
-                                            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
-
-                                            bluedot_alertid = 0;
-                                        }
-                                }
-
-                            else if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_cdate_effective_period != 0 )
-                                {
-
-                                    if ( ( epoch_time - SaganBluedotIPCache[i].cdate_utime ) > rulestruct[rule_position].bluedot_cdate_effective_period )
-                                        {
+            queue_max = config->bluedot_ip_queue;
+        }
 
-                                            if ( debug->debugbluedot )
-                                                {
-                                                    Sagan_Log(DEBUG, "[%s, line %d] qcdate for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_cdate_effective_period);
-                                                }
+    else if ( type == BLUEDOT_LOOKUP_HASH )
+        {
+            queue_max = config->bluedot_hash_queue;
+        }
 
-                                            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-                                            counters->bluedot_cdate_cache++;
-                                            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    else if ( type == BLUEDOT_LOOKUP_URL )
+        {
+            queue_max = config->bluedot_url_queue;
+        }
 
-                                            bluedot_alertid = 0;
-                                        }
-                                }
+    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+        {
+            queue_max = config->bluedot_filename_queue;
+        }
 
+    else
+        {
+            return(false);
+        }
 
-                            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
-                            counters->bluedot_ip_cache_hit++;
-                            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    cache = Sagan_Bluedot_Cache_Of(type, data, ip, &key, &key_len);
 
-                            return(bluedot_alertid);
+    /* A miss leaves a "pending" placeholder in the cache.  Whoever stores
+     * it is the only one to queue the lookup;  everyone else sees it as
+     * pending until the Bluedot thread replaces it.  The placeholder
+     * outlives the request timeout to cover time spent in the queue */
 
-                        }
+    memset(&placeholder, 0, sizeof(placeholder));
+    placeholder.pending = true;
 
-                }
+    if ( *Sagan_Bluedot_Queue_Current(type) < queue_max )
+        {
+            found = Sagan_Cache_Lookup_Or_Insert(cache, key, key_len, &cache_entry, &placeholder, epoch_time, config->bluedot_request_timeout * 2);
+        }
+    else
+        {
 
-            /* Check Bluedot IP Queue,  make sure we aren't looking up something that is already being looked up */
+            found = Sagan_Cache_Lookup(cache, key, key_len, &cache_entry, epoch_time);
 
-            for (i=0; i < config->bluedot_ip_queue; i++)
+            if ( found == false )
                 {
-                    if ( !memcmp(ip_convert, SaganBluedotIPQueue[i].ip, MAXIPBIT ))
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s (%u) is already being looked up. Skipping....", __FILE__, __LINE__, data, SaganBluedotIPQueue[i].ip);
-                                }
-
-                            return(false);
-                        }
+                    Sagan_Log(NORMAL, "[%s, line %d] Out of Bluedot queue space! Considering increasing queue size!", __FILE__, __LINE__);
+                    return(false);
                 }
+        }
 
-            /* If not in Bluedot IP queue,  add it */
+    if ( found == false )
+        {
 
-            if ( counters->bluedot_ip_queue_current >= config->bluedot_ip_queue )
+            if (debug->debugbluedot)
                 {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of IP queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
+                    Sagan_Log(DEBUG, "[%s, line %d] Queuing Bluedot lookup for %s.", __FILE__, __LINE__, data);
                 }
 
+            Sagan_Bluedot_Queue_Request(type, data, ip);
+            return(BLUEDOT_LOOKUP_PENDING);
+        }
+
+    if ( cache_entry.pending == true )
+        {
 
-            for (i=0; i < config->bluedot_ip_queue; i++)
+            if (debug->debugbluedot)
                 {
+                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up.", __FILE__, __LINE__, data);
+                }
 
-                    /* Find an empty slot */
+            return(BLUEDOT_LOOKUP_PENDING);
+        }
 
-                    if ( SaganBluedotIPQueue[i].ip[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
+    if (debug->debugbluedot)
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Pulled %s from Bluedot cache with category of \"%d\". [cdate: %" PRIu64 " / mdate: %" PRIu64 "]", __FILE__, __LINE__, data, cache_entry.alertid, cache_entry.cdate_utime, cache_entry.mdate_utime);
+        }
 
-                            memcpy(SaganBluedotIPQueue[i].ip, ip_convert, MAXIPBIT);
-                            counters->bluedot_ip_queue_current++;
+    bluedot_alertid = cache_entry.alertid;
 
-                            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    if ( type == BLUEDOT_LOOKUP_IP && bluedot_alertid != 0 && rulestruct[rule_position].bluedot_mdate_effective_period != 0 )
+        {
 
-                            break;
+            if ( ( epoch_time - cache_entry.mdate_utime ) > rulestruct[rule_position].bluedot_mdate_effective_period )
+                {
 
+                    if ( debug->debugbluedot )
+                        {
+                            Sagan_Log(DEBUG, "[%s, line %d] From Bluedot Cache - qmdate for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_mdate_effective_period);
                         }
-                }
 
+                    pthread_mutex_lock(&SaganProcBluedotWorkMutex);
+                    counters->bluedot_mdate_cache++;
+                    pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_IP_LOOKUP_URL, data);
-
-        }  /* BLUEDOT_LOOKUP_IP */
+                    bluedot_alertid = 0;
+                }
+        }
 
-    else if ( type == BLUEDOT_LOOKUP_HASH )
+    else if ( type == BLUEDOT_LOOKUP_IP && bluedot_alertid != 0 && rulestruct[rule_position].bluedot_cdate_effective_period != 0 )
         {
 
-            for (i=0; i<counters->bluedot_hash_cache_count; i++)
+            if ( ( epoch_time - cache_entry.cdate_utime ) > rulestruct[rule_position].bluedot_cdate_effective_period )
                 {
 
-                    if (!strcasecmp(data, SaganBluedotHashCache[i].hash))
+                    if ( debug->debugbluedot )
                         {
+                            Sagan_Log(DEBUG, "[%s, line %d] qcdate for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_cdate_effective_period);
+                        }
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file hash '%s' from Bluedot hash cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotHashCache[i].alertid);
-                                }
+                    pthread_mutex_lock(&SaganProcBluedotWorkMutex);
+                    counters->bluedot_cdate_cache++;
+                    pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
 
-                            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
-                            counters->bluedot_hash_cache_hit++;
-                            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+                    bluedot_alertid = 0;
+                }
+        }
 
-                            return(SaganBluedotHashCache[i].alertid);
+    return(bluedot_alertid);
+}
 
-                        }
+/***************************************************************************
+ * Sagan_Bluedot_JSON_Value - Copies the value of "key" from a Bluedot
+ * reply into "str".  Bluedot wraps its values ([ "12" ]),  so only what is
+ * between the quotes is kept.
+ ***************************************************************************/
 
-                }
+static sbool Sagan_Bluedot_JSON_Value ( struct json_object *json_in, const char *key, char *str, size_t size )
+{
 
-            /* Check Bluedot Hash Queue,  make sure we aren't looking up something that is already being looked up */
+    json_object *string_obj = NULL;
+    const char *value = NULL;
 
-            for (i=0; i < config->bluedot_hash_queue; i++)
-                {
-                    if ( !strcasecmp(data, SaganBluedotHashQueue[i].hash ) )
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
-                                }
+    char tmp[64] = { 0 };
+    char *saveptr = NULL;
+    char *tok = NULL;
+    char *next = NULL;
 
-                            return(false);
-                        }
-                }
+    if ( !json_object_object_get_ex(json_in, key, &string_obj) )
+        {
+            return(false);
+        }
 
+    value = json_object_get_string(string_obj);
 
-            if ( counters->bluedot_hash_queue_current >= config->bluedot_hash_queue )
-                {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of hash queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
-                }
+    if ( value == NULL )
+        {
+            return(false);
+        }
 
-            /* If not in Bluedot Hash queue,  add it */
+    strlcpy(tmp, value, sizeof(tmp));
 
-            for (i=0; i < config->bluedot_ip_queue; i++)
-                {
-                    /* Find an empty slot */
+    tok = strtok_r(tmp, "\"", &saveptr);
+    next = strtok_r(NULL, "\"", &saveptr);
 
-                    if ( SaganBluedotHashQueue[i].hash[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
+    if ( next != NULL )
+        {
+            tok = next;
+        }
+
+    if ( tok == NULL )
+        {
+            return(false);
+        }
 
-                            strlcpy(SaganBluedotHashQueue[i].hash, data, sizeof(SaganBluedotHashQueue[i].hash));
-                            counters->bluedot_hash_queue_current++;
+    strlcpy(str, tok, size);
+    return(true);
+}
 
-                            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+/***************************************************************************
+ * Sagan_Bluedot_DNS_Refresh - Looks up the Bluedot host again once its TTL
+ * has passed.  Only the Bluedot thread uses "bluedot_ip".
+ ***************************************************************************/
 
-                            break;
+static void Sagan_Bluedot_DNS_Refresh ( uint64_t epoch_time )
+{
 
-                        }
-                }
+    char tmp[64] = { 0 };
 
+    if ( epoch_time - config->bluedot_dns_last_lookup <= config->bluedot_dns_ttl )
+        {
+            return;
+        }
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_HASH_LOOKUP_URL, data);
+    if ( debug->debugbluedot )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Bluedot host TTL of %d seconds reached.  Doing new lookup for '%s'.", __FILE__, __LINE__, config->bluedot_dns_ttl, config->bluedot_host);
         }
 
-    else if ( type == BLUEDOT_LOOKUP_URL )
+    if ( DNS_Lookup( config->bluedot_host, tmp, sizeof(tmp) ) != 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot lookup DNS for '%s'.  Staying with old value of %s.", __FILE__, __LINE__, config->bluedot_host, config->bluedot_ip);
+        }
+    else
         {
 
-            for (i=0; i<counters->bluedot_url_cache_count; i++)
+            strlcpy(config->bluedot_ip, tmp, sizeof(config->bluedot_ip));
+
+            if ( debug->debugbluedot )
                 {
+                    Sagan_Log(DEBUG, "[%s, line %d] Bluedot host IP is now: %s", __FILE__, __LINE__, config->bluedot_ip);
+                }
 
-                    if (!strcasecmp(data, SaganBluedotURLCache[i].url))
-                        {
+        }
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file URL '%s' from Bluedot URL cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotURLCache[i].alertid);
-                                }
+    config->bluedot_dns_last_lookup = epoch_time;
 
-                            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
-                            counters->bluedot_url_cache_hit++;
-                            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+}
 
-                            return(SaganBluedotURLCache[i].alertid);
+/***************************************************************************
+ * Sagan_Bluedot_Start - Builds the HTTP request and adds it to the
+ * curl-multi handle.
+ ***************************************************************************/
 
-                        }
+static sbool Sagan_Bluedot_Start ( CURLM *multi, _Sagan_Bluedot_Request *request )
+{
 
+    char tmpurl[1024] = { 0 };
+    char tmpdeviceid[64] = { 0 };
 
-                }
+    const char *lookup_url = BLUEDOT_FILENAME_LOOKUP_URL;
 
-            /* Check Bluedot Hash Queue,  make sure we aren't looking up something that is already being looked up */
+    if ( request->type == BLUEDOT_LOOKUP_IP )
+        {
+            lookup_url = BLUEDOT_IP_LOOKUP_URL;
+        }
 
-            for (i=0; i < config->bluedot_url_queue; i++)
-                {
-                    if ( !strcasecmp(data, SaganBluedotURLQueue[i].url ) )
-                        {
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
-                                }
+    else if ( request->type == BLUEDOT_LOOKUP_HASH )
+        {
+            lookup_url = BLUEDOT_HASH_LOOKUP_URL;
+        }
 
-                            return(false);
-                        }
-                }
+    else if ( request->type == BLUEDOT_LOOKUP_URL )
+        {
+            lookup_url = BLUEDOT_URL_LOOKUP_URL;
+        }
 
+    snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, lookup_url, request->data);
+    snprintf(tmpdeviceid, sizeof(tmpdeviceid), "X-BLUEDOT-DEVICEID: %s", config->bluedot_device_id);
 
-            /* If not in Bluedot URL queue,  add it */
+    request->curl = curl_easy_init();
 
-            if ( counters->bluedot_url_queue_current >= config->bluedot_url_queue )
-                {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of URL queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
-                }
+    if ( request->curl == NULL )
+        {
+            Sagan_Log(WARN, "[%s, line %d] curl_easy_init() failed for Bluedot lookup of %s.", __FILE__, __LINE__, request->data);
+            return(false);
+        }
 
+    request->headers = curl_slist_append (request->headers, BLUEDOT_PROCESSOR_USER_AGENT);
+    request->headers = curl_slist_append (request->headers, tmpdeviceid);
+//  request->headers = curl_slist_append (request->headers, "X-Bluedot-Verbose: 1");		/* For more verbose output */
 
-            for (i=0; i < config->bluedot_url_queue; i++)
-                {
+    curl_easy_setopt(request->curl, CURLOPT_URL, tmpurl);
+    curl_easy_setopt(request->curl, CURLOPT_WRITEFUNCTION, write_callback_func);
+    curl_easy_setopt(request->curl, CURLOPT_WRITEDATA, request);
+    curl_easy_setopt(request->curl, CURLOPT_PRIVATE, request);
+    curl_easy_setopt(request->curl, CURLOPT_NOSIGNAL, 1);    /* WIll send SIGALRM if not set */
+    curl_easy_setopt(request->curl, CURLOPT_TIMEOUT, (long)config->bluedot_request_timeout);
+    curl_easy_setopt(request->curl, CURLOPT_HTTPHEADER, request->headers);
 
-                    /* Find an empty slot */
+    if ( curl_multi_add_handle(multi, request->curl) != CURLM_OK )
+        {
+            Sagan_Log(WARN, "[%s, line %d] curl_multi_add_handle() failed for Bluedot lookup of %s.", __FILE__, __LINE__, request->data);
+            return(false);
+        }
 
-                    if ( SaganBluedotURLQueue[i].url[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
+    return(true);
+}
+
+/***************************************************************************
+ * Sagan_Bluedot_Finish - Parses a finished lookup and replaces its
+ * "pending" placeholder.  Failures are cached as "not found" for
+ * "negative-cache-timeout" so a broken or slow Bluedot isn't hammered.
+ ***************************************************************************/
 
-                            strlcpy(SaganBluedotURLQueue[i].url, data, sizeof(SaganBluedotURLQueue[i].url));
-                            counters->bluedot_url_queue_current++;
+static void Sagan_Bluedot_Finish ( _Sagan_Bluedot_Request *request, CURLcode result, long http_code )
+{
 
-                            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+    struct _Sagan_Cache *cache = NULL;
+    const void *key = NULL;
+    size_t key_len = 0;
 
-                            break;
+    _Sagan_Bluedot_Cache_Entry cache_entry;
+    struct json_object *json_in = NULL;
 
-                        }
-                }
+    const char *code_key = "qfilenamecode";
+    char tmp[64] = { 0 };
 
+    uint64_t ttl = config->bluedot_negative_ttl;
+    uint64_t epoch_time = Sagan_Clock_Epoch();
 
+    sbool valid = false;
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_URL_LOOKUP_URL, data);
+    memset(&cache_entry, 0, sizeof(cache_entry));
 
+    if ( request->type == BLUEDOT_LOOKUP_IP )
+        {
+            code_key = "qipcode";
         }
 
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
+    else if ( request->type == BLUEDOT_LOOKUP_HASH )
         {
+            code_key = "qhashcode";
+        }
 
-            for (i=0; i<counters->bluedot_filename_cache_count; i++)
-                {
+    else if ( request->type == BLUEDOT_LOOKUP_URL )
+        {
+            code_key = "qurlcode";
+        }
 
-                    if (!strcasecmp(data, SaganBluedotFilenameCache[i].filename))
-                        {
+    if ( result != CURLE_OK )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Bluedot lookup for %s failed: %s", __FILE__, __LINE__, request->data, curl_easy_strerror(result));
+        }
 
-                            if (debug->debugbluedot)
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] Pulled file filename '%s' from Bluedot filename cache with category of \"%d\".", __FILE__, __LINE__, data, SaganBluedotFilenameCache[i].alertid);
-                                }
+    else if ( http_code != 200 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Bluedot returned HTTP status %ld for %s.", __FILE__, __LINE__, http_code, request->data);
+        }
 
-                            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
-                            counters->bluedot_filename_cache_hit++;
-                            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+    else if ( request->response == NULL )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Bluedot returned a empty \"response\".", __FILE__, __LINE__);
+        }
 
-                            return(SaganBluedotFilenameCache[i].alertid);
+    else
+        {
 
-                        }
+            json_in = json_tokener_parse(request->response);
 
+            if ( json_in == NULL || Sagan_Bluedot_JSON_Value(json_in, code_key, tmp, sizeof(tmp)) == false )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Bluedot returned no category (%s) for %s.", __FILE__, __LINE__, code_key, request->data);
                 }
+            else
+                {
 
-            /* Check Bluedot File Queue,  make sure we aren't looking up something that is already being looked up */
+                    cache_entry.alertid = (signed char)atoi(tmp);
 
-            for (i=0; i < config->bluedot_filename_queue; i++)
-                {
-                    if ( !strcasecmp(SaganBluedotFilenameQueue[i].filename, data ) )
+                    if ( cache_entry.alertid == -1 )
                         {
-                            if (debug->debugbluedot)
+                            Sagan_Log(WARN, "Bluedot reports an invalid API key.  Lookup aborted!");
+                        }
+                    else
+                        {
+
+                            valid = true;
+                            ttl = config->bluedot_timeout;
+
+                            if ( request->type == BLUEDOT_LOOKUP_IP )
                                 {
-                                    Sagan_Log(DEBUG, "[%s, line %d] %s is already being looked up. Skipping....", __FILE__, __LINE__, data);
+
+                                    if ( Sagan_Bluedot_JSON_Value(json_in, "qcdate", tmp, sizeof(tmp)) == true )
+                                        {
+                                            cache_entry.cdate_utime = atol(tmp);
+                                        }
+                                    else
+                                        {
+                                            Sagan_Log(WARN, "Bluedot return a bad qcdate.");
+                                        }
+
+                                    if ( Sagan_Bluedot_JSON_Value(json_in, "qmdate", tmp, sizeof(tmp)) == true )
+                                        {
+                                            cache_entry.mdate_utime = atol(tmp);
+                                        }
+                                    else
+                                        {
+                                            Sagan_Log(WARN, "Bluedot return a bad qmdate.");
+                                        }
                                 }
 
-                            return(false);
                         }
                 }
 
-
-            /* If not in Bluedot Filename queue,  add it */
-
-            if ( counters->bluedot_filename_queue_current >= config->bluedot_filename_queue )
+            if ( json_in != NULL )
                 {
-                    Sagan_Log(NORMAL, "[%s, line %d] Out of filename queue space! Considering increasing cache size!", __FILE__, __LINE__);
-                    return(false);
+                    json_object_put(json_in);
                 }
+        }
 
+    pthread_mutex_lock(&SaganProcBluedotWorkMutex);
 
-            for (i=0; i < config->bluedot_filename_queue; i++)
-                {
-
-                    /* Find an empty slot */
+    if ( valid == false )
+        {
+            cache_entry.alertid = 0;
+            counters->bluedot_error_count++;
+        }
 
-                    if ( SaganBluedotFilenameQueue[i].filename[0] == 0 )
-                        {
-                            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
+    else if ( request->type == BLUEDOT_LOOKUP_IP )
+        {
+            counters->bluedot_ip_total++;
+        }
 
-                            strlcpy(SaganBluedotFilenameQueue[i].filename, data, sizeof(SaganBluedotFilenameQueue[i].filename));
-                            counters->bluedot_filename_queue_current++;
+    else if ( request->type == BLUEDOT_LOOKUP_HASH )
+        {
+            counters->bluedot_hash_total++;
+        }
 
-                            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
+    else if ( request->type == BLUEDOT_LOOKUP_URL )
+        {
+            counters->bluedot_url_total++;
+        }
 
-                            break;
+    else if ( request->type == BLUEDOT_LOOKUP_FILENAME )
+        {
+            counters->bluedot_filename_total++;
+        }
 
-                        }
-                }
+    pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
 
-            snprintf(tmpurl, sizeof(tmpurl), "http://%s/%s%s%s", config->bluedot_ip, config->bluedot_uri, BLUEDOT_FILENAME_LOOKUP_URL, data);
+    if ( debug->debugbluedot )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Bluedot return category \"%d\" for %s. [cdate: %" PRIu64 " / mdate: %" PRIu64 "]", __FILE__, __LINE__, cache_entry.alertid, request->data, cache_entry.cdate_utime, cache_entry.mdate_utime);
         }
 
-    snprintf(tmpdeviceid, sizeof(tmpdeviceid), "X-BLUEDOT-DEVICEID: %s", config->bluedot_device_id);
+    cache_entry.pending = false;
 
-    /* Do the Bluedot API call */
+    cache = Sagan_Bluedot_Cache_Of(request->type, request->data, request->ip, &key, &key_len);
+    Sagan_Cache_Insert(cache, key, key_len, &cache_entry, epoch_time, ttl);
 
-    curl = curl_easy_init();
+    pthread_mutex_lock(&SaganBluedotQueueMutex);
+    (*Sagan_Bluedot_Queue_Current(request->type))--;
+    pthread_mutex_unlock(&SaganBluedotQueueMutex);
 
-    if (curl)
-        {
+}
 
-            curl_easy_setopt(curl, CURLOPT_URL, tmpurl);
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback_func);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-            curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);    /* WIll send SIGALRM if not set */
+/***************************************************************************
+ * Sagan_Bluedot_Free_Request - Releases a finished lookup
+ ***************************************************************************/
 
-            headers = NULL;
+static void Sagan_Bluedot_Free_Request ( CURLM *multi, _Sagan_Bluedot_Request *request )
+{
 
-            headers = curl_slist_append (headers, BLUEDOT_PROCESSOR_USER_AGENT);
-            headers = curl_slist_append (headers, tmpdeviceid);
-//	    headers = curl_slist_append (headers, "X-Bluedot-Verbose: 1");		/* For more verbose output */
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER , headers );
-            res = curl_easy_perform(curl);
+    if ( request->curl != NULL )
+        {
+            curl_multi_remove_handle(multi, request->curl);
+            curl_easy_cleanup(request->curl);
         }
 
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
-    curl_global_cleanup();
+    curl_slist_free_all(request->headers);
 
-    if ( response == NULL )
-        {
-            Sagan_Log(WARN, "[%s, line %d] Bluedot returned a empty \"response\".", __FILE__, __LINE__);
+    free(request->response);
+    free(request->data);
+    free(request);
 
-            pthread_mutex_lock(&SaganProcBluedotWorkMutex);
-            counters->bluedot_error_count++;
-            pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
+}
 
-            Sagan_Bluedot_Clean_Queue(data, type, ip);
+/***************************************************************************
+ * Sagan_Bluedot_Replay - Hands deferred log lines back to the processor
+ * threads once every lookup queued before them is done (or they have
+ * waited too long).  If the processors are busy we try again next pass.
+ ***************************************************************************/
 
-            return(false);
-        }
+static void Sagan_Bluedot_Replay ( uint64_t done_seq, uint64_t epoch_time )
+{
 
-    json_in = json_tokener_parse(response);
+    _Sagan_Bluedot_Deferred *deferred = NULL;
+    _Sagan_Bluedot_Deferred *prev = NULL;
+    _Sagan_Bluedot_Deferred *next = NULL;
 
-    if ( type == BLUEDOT_LOOKUP_IP )
-        {
-            json_object_object_get_ex(json_in, "qipcode", &string_obj);
-            cat = json_object_get_string(string_obj);
+    uint64_t max_age = config->bluedot_request_timeout * 2;
 
-            json_object_object_get_ex(json_in, "qcdate", &string_obj);
-            cdate_utime = json_object_get_string(string_obj);
+    pthread_mutex_lock(&SaganBluedotDeferMutex);
 
-            if ( cdate_utime != NULL )
-                {
+    for ( deferred = SaganBluedotDeferHead; deferred != NULL; deferred = next )
+        {
 
-                    snprintf(tmp, sizeof(tmp), "%s", cdate_utime);
-                    strtok_r(tmp, "\"", &saveptr);
-                    cdate_utime_u32 = atol(strtok_r(NULL, "\"", &saveptr));
+            next = deferred->next;
 
-                }
-            else
+            if ( deferred->seq > done_seq && epoch_time - deferred->deferred_time < max_age )
                 {
-
-                    Sagan_Log(WARN, "Bluedot return a bad qcdate.");
-
+                    prev = deferred;
+                    continue;
                 }
 
-            json_object_object_get_ex(json_in, "qmdate", &string_obj);
-            mdate_utime = json_object_get_string(string_obj);
+            pthread_mutex_lock(&SaganProcWorkMutex);
 
-            if ( mdate_utime != NULL )
+            if ( proc_msgslot >= config->max_processor_threads )
                 {
+                    pthread_mutex_unlock(&SaganProcWorkMutex);
+                    break;
+                }
+
+            memcpy(&SaganProcSyslog[proc_msgslot], &deferred->event, sizeof(_Sagan_Proc_Syslog));
+            proc_msgslot++;
 
-                    snprintf(tmp, sizeof(tmp), "%s", mdate_utime);
-                    strtok_r(tmp, "\"", &saveptr);
-                    mdate_utime_u32 = atol(strtok_r(NULL, "\"", &saveptr));
+            pthread_cond_signal(&SaganProcDoWork);
+            pthread_mutex_unlock(&SaganProcWorkMutex);
 
+            if ( prev == NULL )
+                {
+                    SaganBluedotDeferHead = next;
                 }
             else
                 {
+                    prev->next = next;
+                }
 
-                    Sagan_Log(WARN, "Bluedot return a bad qmdate.");
-
+            if ( SaganBluedotDeferTail == deferred )
+                {
+                    SaganBluedotDeferTail = prev;
                 }
 
+            free(deferred);
+            bluedot_deferred_count--;
         }
 
-    else if ( type == BLUEDOT_LOOKUP_HASH )
-        {
-            json_object_object_get_ex(json_in, "qhashcode", &string_obj);
-            cat = json_object_get_string(string_obj);
-        }
+    pthread_mutex_unlock(&SaganBluedotDeferMutex);
 
-    else if ( type == BLUEDOT_LOOKUP_URL )
-        {
-            json_object_object_get_ex(json_in, "qurlcode", &string_obj);
-            cat = json_object_get_string(string_obj);
-        }
+}
 
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
-        {
-            json_object_object_get_ex(json_in, "qfilenamecode", &string_obj);
-            cat = json_object_get_string(string_obj);
-        }
+/***************************************************************************
+ * Sagan_Bluedot_Defer - Holds a log line until the lookups it is waiting
+ * on are done,  then it is run against "rule_position" again.  Returns
+ * false if the deferred list is full.
+ ***************************************************************************/
+
+sbool Sagan_Bluedot_Defer ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int rule_position )
+{
 
-    if ( cat == NULL )
+    _Sagan_Bluedot_Deferred *deferred = NULL;
+
+    pthread_mutex_lock(&SaganBluedotDeferMutex);
+
+    if ( bluedot_deferred_count >= config->bluedot_max_deferred )
         {
-            Sagan_Log(WARN, "Bluedot return a qipcode category.");
+
+            pthread_mutex_unlock(&SaganBluedotDeferMutex);
 
             pthread_mutex_lock(&SaganProcBluedotWorkMutex);
-            counters->bluedot_error_count++;
+            counters->bluedot_deferred_drop++;
             pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
 
-            Sagan_Bluedot_Clean_Queue(data, type, ip);
-
             return(false);
         }
 
-    /* strtok_r() doesn't like const char *cat */
+    deferred = malloc(sizeof(_Sagan_Bluedot_Deferred));
+
+    if ( deferred == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for deferred Bluedot event. Abort!", __FILE__, __LINE__);
+        }
+
+    memcpy(&deferred->event, SaganProcSyslog_LOCAL, sizeof(_Sagan_Proc_Syslog));
+
+    deferred->event.bluedot_deferred_rule = rule_position + 1;
 
-    snprintf(cattmp, sizeof(cattmp), "%s", cat);
-    strtok_r(cattmp, "\"", &saveptr);
+    /* "rule_position" is only good for these rules,  so keep them around
+     * for the replay even if a reload replaces them */
 
-    bluedot_alertid  = atoi(strtok_r(NULL, "\"", &saveptr));
+    deferred->event.bluedot_deferred_rules = Rules_Hold();
+    deferred->deferred_time = Sagan_Clock_Epoch();
+    deferred->next = NULL;
 
-    if ( debug->debugbluedot)
+    if ( SaganBluedotDeferTail == NULL )
         {
-            Sagan_Log(DEBUG, "[%s, line %d] Bluedot return category \"%d\" for %s. [cdate: %d / mdate: %d]", __FILE__, __LINE__, bluedot_alertid, data, cdate_utime_u32, mdate_utime_u32);
+            SaganBluedotDeferHead = deferred;
         }
-
-    if ( bluedot_alertid == -1 )
+    else
         {
-            Sagan_Log(WARN, "Bluedot reports an invalid API key.  Lookup aborted!");
-            Sagan_Bluedot_Clean_Queue(data, type, ip);
-            counters->bluedot_error_count++;
-            return(false);
+            SaganBluedotDeferTail->next = deferred;
         }
 
+    SaganBluedotDeferTail = deferred;
+    bluedot_deferred_count++;
 
-    /************************************************************************/
-    /* Add entries to cache                                                 */
-    /************************************************************************/
+    /* Every lookup this log line waits on was queued before now */
 
-    /* IP Address lookup */
+    pthread_mutex_lock(&SaganBluedotQueueMutex);
+    deferred->seq = bluedot_request_seq;
+    pthread_cond_signal(&SaganBluedotQueueCond);
+    pthread_mutex_unlock(&SaganBluedotQueueMutex);
 
-    if ( type == BLUEDOT_LOOKUP_IP )
-        {
+    pthread_mutex_unlock(&SaganBluedotDeferMutex);
 
-            pthread_mutex_lock(&SaganProcBluedotIPWorkMutex);
+    pthread_mutex_lock(&SaganProcBluedotWorkMutex);
+    counters->bluedot_deferred++;
+    pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
 
-            /* Store data into cache */
+    return(true);
+}
 
-            memcpy(SaganBluedotIPCache[counters->bluedot_ip_cache_count].ip, ip_convert, MAXIPBIT);
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].cache_utime = epoch_time;                   /* store utime */
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].cdate_utime = cdate_utime_u32;
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].mdate_utime = mdate_utime_u32;
-            SaganBluedotIPCache[counters->bluedot_ip_cache_count].alertid = bluedot_alertid;
+/***************************************************************************
+ * Sagan_Bluedot_Thread - Runs every Bluedot lookup through one curl-multi
+ * handle,  up to "max-connections" at a time.  The processor threads
+ * never wait on the network.
+ ***************************************************************************/
 
-            counters->bluedot_ip_total++;
-            counters->bluedot_ip_cache_count++;
+void Sagan_Bluedot_Thread ( void )
+{
 
-            pthread_mutex_unlock(&SaganProcBluedotIPWorkMutex);
+    CURLM *multi = NULL;
+    CURLMsg *msg = NULL;
 
-            if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_mdate_effective_period != 0 )
-                {
+    _Sagan_Bluedot_Request *active = NULL;		/* Requests on "multi" */
+    _Sagan_Bluedot_Request *request = NULL;
+    _Sagan_Bluedot_Request *prev = NULL;
+    _Sagan_Bluedot_Request *started = NULL;
 
-                    if ( ( epoch_time - mdate_utime_u32 ) > rulestruct[rule_position].bluedot_mdate_effective_period )
-                        {
+    int active_count = 0;
+    int running = 0;
+    int msgs_left = 0;
 
-                            if ( debug->debugbluedot )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] qmdate for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_mdate_effective_period);
-                                }
+    long http_code = 0;
 
-                            pthread_mutex_lock(&SaganProcBluedotWorkMutex);
-                            counters->bluedot_mdate++;
-                            pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
+    uint64_t queued_seq = 0;
+    uint64_t done_seq = 0;
 
-                            bluedot_alertid = 0;
-                        }
-                }
+    multi = curl_multi_init();
+
+    if ( multi == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] curl_multi_init() failed. Abort!", __FILE__, __LINE__);
+        }
 
-            else if ( bluedot_alertid != 0 && rulestruct[rule_position].bluedot_cdate_effective_period != 0 )
+    for (;;)
+        {
+
+            pthread_mutex_lock(&SaganBluedotQueueMutex);
+
+            while ( SaganBluedotQueueHead == NULL && active_count == 0 && bluedot_deferred_count == 0 )
                 {
+                    pthread_cond_wait(&SaganBluedotQueueCond, &SaganBluedotQueueMutex);
+                }
 
-                    if ( ( epoch_time - cdate_utime_u32 ) > rulestruct[rule_position].bluedot_cdate_effective_period )
-                        {
+            /* Move as many queued lookups as we have connections for onto
+             * the "started" list */
 
-                            if ( debug->debugbluedot )
-                                {
-                                    Sagan_Log(DEBUG, "[%s, line %d] qcdate for %s is over %d seconds.  Not alerting.", __FILE__, __LINE__, data, rulestruct[rule_position].bluedot_cdate_effective_period);
-                                }
+            started = NULL;
 
-                            pthread_mutex_lock(&SaganProcBluedotWorkMutex);
-                            counters->bluedot_cdate++;
-                            pthread_mutex_unlock(&SaganProcBluedotWorkMutex);
+            while ( SaganBluedotQueueHead != NULL && active_count < config->bluedot_max_connections )
+                {
 
-                            bluedot_alertid = 0;
+                    request = SaganBluedotQueueHead;
+                    SaganBluedotQueueHead = request->next;
+
+                    if ( SaganBluedotQueueHead == NULL )
+                        {
+                            SaganBluedotQueueTail = NULL;
                         }
+
+                    request->next = started;
+                    started = request;
+                    active_count++;
                 }
 
-        }
+            /* Everything up to "queued_seq" has left the queue */
 
-    /* File hash lookup */
+            queued_seq = SaganBluedotQueueHead != NULL ? SaganBluedotQueueHead->seq - 1 : bluedot_request_seq;
 
-    else if ( type == BLUEDOT_LOOKUP_HASH )
-        {
+            pthread_mutex_unlock(&SaganBluedotQueueMutex);
 
-            pthread_mutex_lock(&SaganProcBluedotHashWorkMutex);
+            Sagan_Bluedot_DNS_Refresh( Sagan_Clock_Epoch() );
 
-            counters->bluedot_hash_total++;
+            while ( started != NULL )
+                {
 
-            strlcpy(SaganBluedotHashCache[counters->bluedot_hash_cache_count].hash, data, sizeof(SaganBluedotHashCache[counters->bluedot_hash_cache_count].hash));
-            SaganBluedotHashCache[counters->bluedot_hash_cache_count].cache_utime = epoch_time;
-            SaganBluedotHashCache[counters->bluedot_hash_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_hash_cache_count++;
+                    request = started;
+                    started = request->next;
 
-            pthread_mutex_unlock(&SaganProcBluedotHashWorkMutex);
+                    if ( Sagan_Bluedot_Start(multi, request) == false )
+                        {
+                            Sagan_Bluedot_Finish(request, CURLE_FAILED_INIT, 0);
+                            Sagan_Bluedot_Free_Request(multi, request);
+                            active_count--;
+                            continue;
+                        }
 
-        }
+                    request->next = active;
+                    active = request;
+                }
 
-    /* URL lookup */
+            curl_multi_perform(multi, &running);
 
-    else if ( type == BLUEDOT_LOOKUP_URL )
-        {
-            pthread_mutex_lock(&SaganProcBluedotURLWorkMutex);
+            while ( ( msg = curl_multi_info_read(multi, &msgs_left) ) != NULL )
+                {
 
-            counters->bluedot_url_total++;
+                    if ( msg->msg != CURLMSG_DONE )
+                        {
+                            continue;
+                        }
 
-            strlcpy(SaganBluedotURLCache[counters->bluedot_url_cache_count].url, data, sizeof(SaganBluedotURLCache[counters->bluedot_url_cache_count].url));
-            SaganBluedotURLCache[counters->bluedot_url_cache_count].cache_utime = epoch_time;
-            SaganBluedotURLCache[counters->bluedot_url_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_url_cache_count++;
+                    request = NULL;
+                    http_code = 0;
 
-            pthread_mutex_unlock(&SaganProcBluedotURLWorkMutex);
+                    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&request);
+                    curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &http_code);
 
-        }
+                    Sagan_Bluedot_Finish(request, msg->data.result, http_code);
 
-    /* Filename Lookup */
+                    /* Unlink from the active list */
 
-    else if ( type == BLUEDOT_LOOKUP_FILENAME )
-        {
+                    if ( active == request )
+                        {
+                            active = request->next;
+                        }
+                    else
+                        {
+                            for ( prev = active; prev->next != request; prev = prev->next );
+                            prev->next = request->next;
+                        }
+
+                    Sagan_Bluedot_Free_Request(multi, request);
+                    active_count--;
+                }
 
-            pthread_mutex_lock(&SaganProcBluedotFilenameWorkMutex);
+            /* Deferred log lines are ready once nothing queued before them
+             * is still queued or running */
 
-            counters->bluedot_filename_total++;
+            done_seq = queued_seq;
 
-            strlcpy(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].filename, data, sizeof(SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].filename));
-            SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].cache_utime = epoch_time;
-            SaganBluedotFilenameCache[counters->bluedot_filename_cache_count].alertid = bluedot_alertid;
-            counters->bluedot_filename_cache_count++;
+            for ( request = active; request != NULL; request = request->next )
+                {
+                    if ( request->seq - 1 < done_seq )
+                        {
+                            done_seq = request->seq - 1;
+                        }
+                }
 
-            pthread_mutex_unlock(&SaganProcBluedotFilenameWorkMutex);
-        }
+            if ( bluedot_deferred_count != 0 )
+                {
+                    Sagan_Bluedot_Replay( done_seq, Sagan_Clock_Epoch() );
+                }
+
+            if ( active_count != 0 )
+                {
+                    curl_multi_wait(multi, NULL, 0, BLUEDOT_MULTI_WAIT_MS, NULL);
+                }
 
+            else if ( bluedot_deferred_count != 0 )
+                {
+                    usleep(BLUEDOT_MULTI_WAIT_MS * 1000);	/* Processors are busy */
+                }
 
-    Sagan_Bluedot_Clean_Queue(data, type, ip);	/* Remove item for "queue" */
+        }
 
-    json_object_put(json_in);       		/* Clear json_in as we're done with it */
-    return(bluedot_alertid);
 }
 
 /***************************************************************************
@@ -1440,10 +1362,11 @@ int Sagan_Bluedot_Cat_Compare ( unsigned char bluedot_results, int rule_position
 
 /***************************************************************************
  * Sagan_Bluedot_Lookup_All - Find _all_ IPv4 addresses in a syslog
- * message and preforms a Bluedot query.
+ * message and preforms a Bluedot query.  "pending" is set if any of them
+ * is still being looked up.
  ***************************************************************************/
 
-int Sagan_Bluedot_IP_Lookup_All ( char *syslog_message, int rule_position, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size )
+int Sagan_Bluedot_IP_Lookup_All ( char *syslog_message, int rule_position, _Sagan_Lookup_Cache_Entry *lookup_cache, int lookup_cache_size, sbool *pending )
 {
 
     int i;
@@ -1458,6 +1381,12 @@ int Sagan_Bluedot_IP_Lookup_All ( char *syslog_message, int rule_position, _Saga
         {
 
             bluedot_results = Sagan_Bluedot_Lookup(lookup_cache[i].ip, BLUEDOT_LOOKUP_IP, rule_position, lookup_cache[i].ip_bits);
+
+            if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                {
+                    *pending = true;
+                }
+
             bluedot_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, rule_position, BLUEDOT_LOOKUP_IP );
 
             if ( bluedot_flag == 1 )
@@ -1481,6 +1410,13 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
 
     sbool found;
 
+    _Sagan_Bluedot_Cat_Store *store = Sagan_RCU_Dereference(SaganBluedotCatStore);
+
+    if ( store == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Bluedot categories are not loaded. Abort!", __FILE__, __LINE__);
+        }
+
     tmptoken = strtok_r(categories, "," , &saveptrrule);
 
     while ( tmptoken != NULL )
@@ -1493,11 +1429,11 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
 
             found = 0;
 
-            for ( i = 0; i < counters->bluedot_cat_count; i++ )
+            for ( i = 0; i < store->count; i++ )
                 {
 
 
-                    if (!strcmp(SaganBluedotCatList[i].cat, tmptoken))
+                    if (!strcmp(store->cats[i].cat, tmptoken))
                         {
                             found = 1;
 
@@ -1506,7 +1442,7 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
 
                                     if ( rulestruct[rule_number].bluedot_ip_cat_count <= BLUEDOT_MAX_CAT )
                                         {
-                                            rulestruct[rule_number].bluedot_ip_cats[rulestruct[rule_number].bluedot_ip_cat_count] =  SaganBluedotCatList[i].cat_number;
+                                            rulestruct[rule_number].bluedot_ip_cats[rulestruct[rule_number].bluedot_ip_cat_count] =  store->cats[i].cat_number;
                                             rulestruct[rule_number].bluedot_ip_cat_count++;
                                         }
                                     else
@@ -1519,7 +1455,7 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
                                 {
                                     if ( rulestruct[rule_number].bluedot_hash_cat_count <= BLUEDOT_MAX_CAT )
                                         {
-                                            rulestruct[rule_number].bluedot_hash_cats[rulestruct[rule_number].bluedot_hash_cat_count] =  SaganBluedotCatList[i].cat_number;
+                                            rulestruct[rule_number].bluedot_hash_cats[rulestruct[rule_number].bluedot_hash_cat_count] =  store->cats[i].cat_number;
                                             rulestruct[rule_number].bluedot_hash_cat_count++;
                                         }
                                     else
@@ -1532,7 +1468,7 @@ void Sagan_Verify_Categories( char *categories, int rule_number, const char *rul
                                 {
                                     if ( rulestruct[rule_number].bluedot_url_cat_count <= BLUEDOT_MAX_CAT )
                                         {
-                                            rulestruct[rule_number].bluedot_url_cats[rulestruct[rule_number].bluedot_url_cat_count] =  SaganBluedotCatList[i].cat_number;
+                                            rulestruct[rule_number].bluedot_url_cats[rulestruct[rule_number].bluedot_url_cat_count] =  store->cats[i].cat_number;
                                             rulestruct[rule_number].bluedot_url_cat_count++;
                                         }
                                     else
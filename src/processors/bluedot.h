@@ -28,6 +28,8 @@
 
 #ifdef WITH_BLUEDOT
 
+#include <curl/curl.h>
+
 #define BLUEDOT_PROCESSOR_USER_AGENT "User-Agent: Sagan-SIEM"
 
 /* Extensions on URL passed depending on what type of query we want to do */
@@ -42,18 +44,26 @@
 #define BLUEDOT_LOOKUP_URL 3
 #define BLUEDOT_LOOKUP_FILENAME 4
 
+/* Returned by Sagan_Bluedot_Lookup() while the indicator is still being
+ * looked up.  It never matches a category */
+
+#define BLUEDOT_LOOKUP_PENDING 255
+
+#define BLUEDOT_MULTI_WAIT_MS	50		/* Max time curl_multi_wait() blocks */
+
 int Sagan_Bluedot_Cat_Compare ( unsigned char, int, unsigned char );
 int Sagan_Bluedot ( _Sagan_Proc_Syslog *, int  );
 unsigned char Sagan_Bluedot_Lookup(char *, unsigned char, int, unsigned char *ip_bits);			/* what to lookup,  lookup type */
-int Sagan_Bluedot_IP_Lookup_All ( char *, int , _Sagan_Lookup_Cache_Entry *, int );
+int Sagan_Bluedot_IP_Lookup_All ( char *, int , _Sagan_Lookup_Cache_Entry *, int, sbool * );
 
 void Sagan_Bluedot_Clean_Cache ( void );
 void Sagan_Bluedot_Init(void);
 void Sagan_Bluedot_Load_Cat(void);
 void Sagan_Verify_Categories( char *, int , const char *, int, unsigned char );
 void Sagan_Bluedot_Check_Cache_Time (void);
-
-int Sagan_Bluedot_Clean_Queue ( char *, unsigned char, unsigned char *ip );
+void Sagan_Bluedot_Cache_Stats (void);
+void Sagan_Bluedot_Thread (void);
+sbool Sagan_Bluedot_Defer ( _Sagan_Proc_Syslog *, int );
 
 
 typedef struct _Sagan_Bluedot_Cat_List _Sagan_Bluedot_Cat_List;
@@ -63,66 +73,57 @@ struct _Sagan_Bluedot_Cat_List
     char	cat[50];
 };
 
+/* Loaded categories.  Replaced as a whole on reload (see util-rcu.c) */
 
-typedef struct _Sagan_Bluedot_IP_Cache _Sagan_Bluedot_IP_Cache;
-struct _Sagan_Bluedot_IP_Cache
+typedef struct _Sagan_Bluedot_Cat_Store _Sagan_Bluedot_Cat_Store;
+struct _Sagan_Bluedot_Cat_Store
 {
-    unsigned char ip[MAXIPBIT];
-    uint64_t mdate_utime;
-    uint64_t cdate_utime;
-    uint64_t cache_utime;
-    int	alertid;
+    _Sagan_Bluedot_Cat_List *cats;
+    int count;
 };
 
-typedef struct _Sagan_Bluedot_Hash_Cache _Sagan_Bluedot_Hash_Cache;
-struct _Sagan_Bluedot_Hash_Cache
-{
-    char hash[SHA256_HASH_SIZE+1];
-    uint64_t cache_utime;
-    int alertid;
-};
 
-typedef struct _Sagan_Bluedot_URL_Cache _Sagan_Bluedot_URL_Cache;
-struct _Sagan_Bluedot_URL_Cache
-{
-    char url[8192];
-    uint64_t cache_utime;
-    int alertid;
-};
+/* Value stored in the Bluedot caches.  The key (IP bits,  hash,  URL or
+ * filename) is kept by the cache itself */
 
-
-typedef struct _Sagan_Bluedot_Filename_Cache _Sagan_Bluedot_Filename_Cache;
-struct _Sagan_Bluedot_Filename_Cache
+typedef struct _Sagan_Bluedot_Cache_Entry _Sagan_Bluedot_Cache_Entry;
+struct _Sagan_Bluedot_Cache_Entry
 {
-    char filename[256];
-    uint64_t cache_utime;
-    int alertid;
+    uint64_t mdate_utime;
+    uint64_t cdate_utime;
+    int	alertid;
+    sbool pending;		/* Lookup in flight,  no result yet */
 };
 
-typedef struct _Sagan_Bluedot_IP_Queue _Sagan_Bluedot_IP_Queue;
-struct _Sagan_Bluedot_IP_Queue
+/* A lookup waiting for,  or running on,  the Bluedot thread */
+
+typedef struct _Sagan_Bluedot_Request _Sagan_Bluedot_Request;
+struct _Sagan_Bluedot_Request
 {
+    unsigned char type;
     unsigned char ip[MAXIPBIT];
-};
+    char *data;
+    uint64_t seq;
 
-typedef struct _Sagan_Bluedot_Hash_Queue _Sagan_Bluedot_Hash_Queue;
-struct _Sagan_Bluedot_Hash_Queue
-{
-    char hash[SHA256_HASH_SIZE+1];
-};
+    CURL *curl;
+    struct curl_slist *headers;
+    char *response;
+    size_t response_len;
 
-typedef struct _Sagan_Bluedot_URL_Queue _Sagan_Bluedot_URL_Queue;
-struct _Sagan_Bluedot_URL_Queue
-{
-    char url[8192];
+    _Sagan_Bluedot_Request *next;
 };
 
-typedef struct _Sagan_Bluedot_Filename_Queue _Sagan_Bluedot_Filename_Queue;
-struct _Sagan_Bluedot_Filename_Queue
+/* A log line held back until the lookups it was waiting on are done */
+
+typedef struct _Sagan_Bluedot_Deferred _Sagan_Bluedot_Deferred;
+struct _Sagan_Bluedot_Deferred
 {
-    char filename[256];
-};
+    _Sagan_Proc_Syslog event;
+    uint64_t seq;		/* Ready once every request up to "seq" is done */
+    uint64_t deferred_time;
 
+    _Sagan_Bluedot_Deferred *next;
+};
 
 #endif
 
@@ -33,8 +33,11 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdint.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <pthread.h>
@@ -43,6 +46,10 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-hash.h"
+#include "util-ahocorasick.h"
+#include "util-rcu.h"
+#include "intel-db.h"
 
 #include "parsers/parsers.h"
 
@@ -56,25 +63,636 @@ struct _SaganDebug *debug;
 
 struct _Sagan_Processor_Info *processor_info_brointel = NULL;
 
-struct _Sagan_BroIntel_Intel_Addr *Sagan_BroIntel_Intel_Addr;
-struct _Sagan_BroIntel_Intel_Domain *Sagan_BroIntel_Intel_Domain;
-struct _Sagan_BroIntel_Intel_File_Hash *Sagan_BroIntel_Intel_File_Hash;
-struct _Sagan_BroIntel_Intel_URL *Sagan_BroIntel_Intel_URL;
-struct _Sagan_BroIntel_Intel_Software *Sagan_BroIntel_Intel_Software;
-struct _Sagan_BroIntel_Intel_Email *Sagan_BroIntel_Intel_Email;
-struct _Sagan_BroIntel_Intel_User_Name *Sagan_BroIntel_Intel_User_Name;
-struct _Sagan_BroIntel_Intel_File_Name *Sagan_BroIntel_Intel_File_Name;
-struct _Sagan_BroIntel_Intel_Cert_Hash *Sagan_BroIntel_Intel_Cert_Hash;
 
 pthread_mutex_t CounterBroIntelGenericMutex=PTHREAD_MUTEX_INITIALIZER;
 
+/* Each indicator type gets a hash index over its array.  Indicators that
+ * can't be found by tokenizing a log line (ie - a file name with a space in
+ * it) are also kept on a "fallback" list and searched the old way */
+
+typedef struct _Sagan_BroIntel_Index _Sagan_BroIntel_Index;
+struct _Sagan_BroIntel_Index
+{
+    _Sagan_Hash_Index index;
+    int size;				/* Allocated array elements */
+    int *fallback;
+    int fallback_count;
+};
+
+
+/* Everything loaded from the Bro Intel files.  Workers reach it through
+ * SaganBroIntelStore,  which a reload replaces as a whole (see util-rcu.c).
+ * DOMAIN and URL indicators are substrings of the log line,  so they are
+ * compiled into Aho-Corasick automatons */
+
+typedef struct _Sagan_BroIntel_Store _Sagan_BroIntel_Store;
+struct _Sagan_BroIntel_Store
+{
+    _Sagan_BroIntel_Intel_Addr *addr;
+    _Sagan_BroIntel_Intel_Domain *domain;
+    _Sagan_BroIntel_Intel_File_Hash *file_hash;
+    _Sagan_BroIntel_Intel_URL *url;
+    _Sagan_BroIntel_Intel_Software *software;
+    _Sagan_BroIntel_Intel_Email *email;
+    _Sagan_BroIntel_Intel_User_Name *user_name;
+    _Sagan_BroIntel_Intel_File_Name *file_name;
+    _Sagan_BroIntel_Intel_Cert_Hash *cert_hash;
+
+    int addr_count;
+    int domain_count;
+    int file_hash_count;
+    int url_count;
+    int software_count;
+    int email_count;
+    int user_name_count;
+    int file_name_count;
+    int cert_hash_count;
+
+    _Sagan_BroIntel_Index addr_index;
+    _Sagan_BroIntel_Index domain_index;
+    _Sagan_BroIntel_Index file_hash_index;
+    _Sagan_BroIntel_Index url_index;
+    _Sagan_BroIntel_Index software_index;
+    _Sagan_BroIntel_Index email_index;
+    _Sagan_BroIntel_Index user_name_index;
+    _Sagan_BroIntel_Index file_name_index;
+    _Sagan_BroIntel_Index cert_hash_index;
+
+    _Sagan_Aho_Corasick domain_ac;
+    _Sagan_Aho_Corasick url_ac;
+
+    _Sagan_Intel_DB *db;		/* Precompiled image everything above
+					 * points into,  NULL if parsed */
+};
+
+/* Indicator types,  in intel image section order (see intel-db.h) */
+
+#define BROINTEL_TYPE_ADDR		0
+#define BROINTEL_TYPE_DOMAIN		1
+#define BROINTEL_TYPE_FILE_HASH		2
+#define BROINTEL_TYPE_URL		3
+#define BROINTEL_TYPE_SOFTWARE		4
+#define BROINTEL_TYPE_EMAIL		5
+#define BROINTEL_TYPE_USER_NAME		6
+#define BROINTEL_TYPE_FILE_NAME		7
+#define BROINTEL_TYPE_CERT_HASH		8
+
+static _Sagan_BroIntel_Store *SaganBroIntelStore = NULL;
+
+/* Store the Hash_Index_Find() match callbacks compare against.  Set by the
+ * loader and by each lookup */
+
+static __thread _Sagan_BroIntel_Store *brointel_match_store = NULL;
+
+/* Characters that make up a "token" for each indicator type */
+
+static sbool BroIntel_Class_Hash[256];
+static sbool BroIntel_Class_Email[256];
+static sbool BroIntel_Class_User_Name[256];
+static sbool BroIntel_Class_File_Name[256];
+
 /*****************************************************************************
- * Sagan_BroIntel_Init - Sets up globals.  Not really used yet.
+ * Sagan_BroIntel_Init - Sets up the token character classes used when
+ * searching log lines.
  *****************************************************************************/
 
 void Sagan_BroIntel_Init(void)
 {
 
+    int c;
+
+    for ( c = 0; c < 256; c++ )
+        {
+
+            BroIntel_Class_Hash[c] = isxdigit(c) ? true : false;
+
+            BroIntel_Class_Email[c] = ( isalnum(c) || strchr("._%+-@", c) ) && c != '\0' ? true : false;
+
+            BroIntel_Class_User_Name[c] = ( isalnum(c) || strchr("._-$", c) ) && c != '\0' ? true : false;
+
+            BroIntel_Class_File_Name[c] = ( isgraph(c) && !strchr("\"'<>|/\\=,;:()[]{}*?", c) ) || c >= 128 ? true : false;
+
+        }
+
+}
+
+/*****************************************************************************
+ * BroIntel_Store_Free - Releases all Bro Intel arrays and indexes of a
+ * store that is no longer published.
+ *****************************************************************************/
+
+static void BroIntel_Index_Free( _Sagan_BroIntel_Index *intel_index )
+{
+
+    Hash_Index_Free(&intel_index->index);
+    free(intel_index->fallback);
+
+    memset(intel_index, 0, sizeof(_Sagan_BroIntel_Index));
+
+}
+
+static void BroIntel_Store_Free( void *ptr )
+{
+
+    _Sagan_BroIntel_Store *store = (_Sagan_BroIntel_Store *)ptr;
+
+    if ( store->db != NULL )
+        {
+            Intel_DB_Close(store->db);
+            free(store);
+            return;
+        }
+
+    free(store->addr);
+    free(store->domain);
+    free(store->file_hash);
+    free(store->url);
+    free(store->software);
+    free(store->email);
+    free(store->user_name);
+    free(store->file_name);
+    free(store->cert_hash);
+
+    BroIntel_Index_Free(&store->addr_index);
+    BroIntel_Index_Free(&store->domain_index);
+    BroIntel_Index_Free(&store->file_hash_index);
+    BroIntel_Index_Free(&store->url_index);
+    BroIntel_Index_Free(&store->software_index);
+    BroIntel_Index_Free(&store->email_index);
+    BroIntel_Index_Free(&store->user_name_index);
+    BroIntel_Index_Free(&store->file_name_index);
+    BroIntel_Index_Free(&store->cert_hash_index);
+
+    Aho_Corasick_Free(&store->domain_ac);
+    Aho_Corasick_Free(&store->url_ac);
+
+    free(store);
+
+}
+
+/*****************************************************************************
+ * BroIntel_Publish - Swaps "store" in for the one the workers are using and
+ * updates the counters.  The old store is retired and free()'ed by
+ * Sagan_RCU_Reclaim() once no worker can still be searching it.
+ *****************************************************************************/
+
+static void BroIntel_Publish( _Sagan_BroIntel_Store *store )
+{
+
+    _Sagan_BroIntel_Store *old = SaganBroIntelStore;
+
+    Sagan_RCU_Assign(SaganBroIntelStore, store);
+
+    pthread_mutex_lock(&CounterBroIntelGenericMutex);
+    counters->brointel_addr_count = store != NULL ? store->addr_count : 0;
+    counters->brointel_domain_count = store != NULL ? store->domain_count : 0;
+    counters->brointel_file_hash_count = store != NULL ? store->file_hash_count : 0;
+    counters->brointel_url_count = store != NULL ? store->url_count : 0;
+    counters->brointel_software_count = store != NULL ? store->software_count : 0;
+    counters->brointel_email_count = store != NULL ? store->email_count : 0;
+    counters->brointel_user_name_count = store != NULL ? store->user_name_count : 0;
+    counters->brointel_file_name_count = store != NULL ? store->file_name_count : 0;
+    counters->brointel_cert_hash_count = store != NULL ? store->cert_hash_count : 0;
+    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+
+    Sagan_RCU_Retire(old, BroIntel_Store_Free);
+
+}
+
+/*****************************************************************************
+ * Sagan_BroIntel_Free - Unpublishes and releases the Bro Intel data.  Used
+ * when a reload (SIGHUP) disables the processor.
+ *****************************************************************************/
+
+void Sagan_BroIntel_Free(void)
+{
+
+    BroIntel_Publish(NULL);
+
+}
+
+/*****************************************************************************
+ * BroIntel_Map_Type/BroIntel_Map_AC - Point a store's array,  index and
+ * automaton at a precompiled intel image (see intel-db.c).  Nothing is
+ * copied or parsed,  the sections are only checked once before use.
+ *****************************************************************************/
+
+static void BroIntel_Map_Type( _Sagan_Intel_DB *db, int type, void **array, size_t element_size, int *count, _Sagan_BroIntel_Index *intel_index )
+{
+
+    uint64_t n = 0;
+    uint64_t aux = 0;
+    uint64_t used = 0;
+    uint64_t i;
+
+    *array = (void *) Intel_DB_Section(db, INTEL_DB_BROINTEL_ARRAY + type, element_size, &n, NULL);
+
+    if ( n > INT32_MAX )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel array. Abort!", __FILE__, __LINE__, config->brointel_db);
+        }
+
+    *count = n;
+
+    intel_index->size = n;
+
+    intel_index->index.slots = (_Sagan_Hash_Slot *) Intel_DB_Section(db, INTEL_DB_BROINTEL_INDEX + type, sizeof(_Sagan_Hash_Slot), &n, &aux);
+
+    /* Lookups rely on a power of 2 sized index,  with at least one empty
+     * slot to stop a probe,  pointing only at entries in the array */
+
+    if ( n > UINT32_MAX || ( n & ( n - 1 ) ) != 0 || aux * 2 > n )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel index. Abort!", __FILE__, __LINE__, config->brointel_db);
+        }
+
+    for ( i = 0; i < n; i++ )
+        {
+
+            if ( intel_index->index.slots[i].index == 0 )
+                {
+                    continue;
+                }
+
+            if ( intel_index->index.slots[i].index > (uint64_t)*count || ++used > aux )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel index. Abort!", __FILE__, __LINE__, config->brointel_db);
+                }
+        }
+
+    intel_index->index.size = n;
+    intel_index->index.count = aux;
+
+    intel_index->fallback = (int *) Intel_DB_Section(db, INTEL_DB_BROINTEL_FALLBACK + type, sizeof(int), &n, NULL);
+
+    for ( i = 0; i < n; i++ )
+        {
+
+            if ( intel_index->fallback[i] < 0 || intel_index->fallback[i] >= *count )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel index. Abort!", __FILE__, __LINE__, config->brointel_db);
+                }
+        }
+
+    intel_index->fallback_count = n;
+
+}
+
+/*****************************************************************************
+ * BroIntel_Check_AC - Validates a mapped automaton before
+ * Aho_Corasick_Search() trusts it.  Edges and links must be in range,  a
+ * child must be one deeper than its parent and fail/dictionary links must
+ * be shallower than their node.  That keeps every fail chain finite and
+ * every match inside the text it was found in.
+ *****************************************************************************/
+
+static void BroIntel_Check_AC( _Sagan_Aho_Corasick *ac, uint64_t edge_count, int array_count )
+{
+
+    const _Sagan_AC_Node *node = NULL;
+    uint64_t i;
+    uint64_t j;
+
+    if ( ac->nodes == NULL || ac->nodes[0].depth != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel automaton. Abort!", __FILE__, __LINE__, config->brointel_db);
+        }
+
+    for ( i = 0; i < 256; i++ )
+        {
+
+            if ( ac->root_next[i] >= ac->node_count ||
+                    ( ac->root_next[i] != 0 && ac->nodes[ac->root_next[i]].depth != 1 ) )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel automaton. Abort!", __FILE__, __LINE__, config->brointel_db);
+                }
+        }
+
+    for ( i = 0; i < ac->node_count; i++ )
+        {
+
+            node = &ac->nodes[i];
+
+            if ( node->edge_start > edge_count || node->edge_count > edge_count - node->edge_start ||
+                    node->fail >= ac->node_count || node->dict >= ac->node_count ||
+                    node->pattern < -1 || node->pattern >= array_count )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel automaton. Abort!", __FILE__, __LINE__, config->brointel_db);
+                }
+
+            if ( i != 0 && ( ac->nodes[node->fail].depth >= node->depth ||
+                             ( node->dict != 0 && ac->nodes[node->dict].depth >= node->depth ) ) )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel automaton. Abort!", __FILE__, __LINE__, config->brointel_db);
+                }
+
+            for ( j = node->edge_start; j < (uint64_t)node->edge_start + node->edge_count; j++ )
+                {
+
+                    if ( ac->edges[j].node == 0 || ac->edges[j].node >= ac->node_count ||
+                            ac->nodes[ac->edges[j].node].depth != node->depth + 1 )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel automaton. Abort!", __FILE__, __LINE__, config->brointel_db);
+                        }
+                }
+        }
+
+}
+
+static void BroIntel_Map_AC( _Sagan_Intel_DB *db, int type, _Sagan_Aho_Corasick *ac, int array_count )
+{
+
+    const uint32_t *root_next = NULL;
+    uint64_t n = 0;
+    uint64_t aux = 0;
+    uint64_t edge_count = 0;
+
+    memset(ac, 0, sizeof(_Sagan_Aho_Corasick));
+
+    ac->nodes = (_Sagan_AC_Node *) Intel_DB_Section(db, INTEL_DB_BROINTEL_AC_NODES + type, sizeof(_Sagan_AC_Node), &n, &aux);
+
+    if ( n > UINT32_MAX )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Intel database %s has a corrupt Bro Intel automaton. Abort!", __FILE__, __LINE__, config->brointel_db);
+        }
+
+    ac->node_count = n;
+    ac->node_size = n;
+    ac->pattern_count = aux;
+
+    ac->edges = (_Sagan_AC_Edge *) Intel_DB_Section(db, INTEL_DB_BROINTEL_AC_EDGES + type, sizeof(_Sagan_AC_Edge), &edge_count, NULL);
+
+    root_next = (const uint32_t *) Intel_DB_Section(db, INTEL_DB_BROINTEL_AC_ROOT + type, sizeof(uint32_t), &n, &aux);
+
+    if ( root_next != NULL && n == 256 && ac->edges != NULL )
+        {
+            memcpy(ac->root_next, root_next, sizeof(ac->root_next));
+            ac->compiled = ( aux != 0 );
+        }
+
+    /* Only a compiled automaton is ever searched */
+
+    if ( ac->compiled != false && ac->pattern_count != 0 )
+        {
+            BroIntel_Check_AC(ac, edge_count, array_count);
+        }
+
+}
+
+/*****************************************************************************
+ * BroIntel_Load_DB - Maps all indicators from a precompiled intel image
+ * instead of parsing the Bro Intel files.
+ *****************************************************************************/
+
+static void BroIntel_Load_DB( void )
+{
+
+    _Sagan_BroIntel_Store *store = NULL;
+
+    store = calloc(1, sizeof(_Sagan_BroIntel_Store));
+
+    if ( store == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bro Intel store. Abort!", __FILE__, __LINE__);
+        }
+
+    store->db = Intel_DB_Open(config->brointel_db);
+
+    BroIntel_Map_Type(store->db, BROINTEL_TYPE_ADDR, (void **)&store->addr, sizeof(_Sagan_BroIntel_Intel_Addr), &store->addr_count, &store->addr_index);
+    BroIntel_Map_Type(store->db, BROINTEL_TYPE_DOMAIN, (void **)&store->domain, sizeof(_Sagan_BroIntel_Intel_Domain), &store->domain_count, &store->domain_index);
+    BroIntel_Map_Type(store->db, BROINTEL_TYPE_FILE_HASH, (void **)&store->file_hash, sizeof(_Sagan_BroIntel_Intel_File_Hash), &store->file_hash_count, &store->file_hash_index);
+    BroIntel_Map_Type(store->db, BROINTEL_TYPE_URL, (void **)&store->url, sizeof(_Sagan_BroIntel_Intel_URL), &store->url_count, &store->url_index);
+    BroIntel_Map_Type(store->db, BROINTEL_TYPE_SOFTWARE, (void **)&store->software, sizeof(_Sagan_BroIntel_Intel_Software), &store->software_count, &store->software_index);
+    BroIntel_Map_Type(store->db, BROINTEL_TYPE_EMAIL, (void **)&store->email, sizeof(_Sagan_BroIntel_Intel_Email), &store->email_count, &store->email_index);
+    BroIntel_Map_Type(store->db, BROINTEL_TYPE_USER_NAME, (void **)&store->user_name, sizeof(_Sagan_BroIntel_Intel_User_Name), &store->user_name_count, &store->user_name_index);
+    BroIntel_Map_Type(store->db, BROINTEL_TYPE_FILE_NAME, (void **)&store->file_name, sizeof(_Sagan_BroIntel_Intel_File_Name), &store->file_name_count, &store->file_name_index);
+    BroIntel_Map_Type(store->db, BROINTEL_TYPE_CERT_HASH, (void **)&store->cert_hash, sizeof(_Sagan_BroIntel_Intel_Cert_Hash), &store->cert_hash_count, &store->cert_hash_index);
+
+    BroIntel_Map_AC(store->db, BROINTEL_TYPE_DOMAIN, &store->domain_ac, store->domain_count);
+    BroIntel_Map_AC(store->db, BROINTEL_TYPE_URL, &store->url_ac, store->url_count);
+
+    Sagan_Log(NORMAL, "Bro Intel Processor mapped %s.", config->brointel_db);
+
+    BroIntel_Publish(store);
+
+}
+
+/*****************************************************************************
+ * Sagan_BroIntel_Save - Writes the loaded indicators to an intel image.
+ * Used by saganintel.
+ *****************************************************************************/
+
+static void BroIntel_Save_Type( _Sagan_Intel_DB_Writer *writer, int type, const void *array, size_t element_size, int count, _Sagan_BroIntel_Index *intel_index )
+{
+
+    Intel_DB_Add(writer, INTEL_DB_BROINTEL_ARRAY + type, array, element_size, count, 0);
+    Intel_DB_Add(writer, INTEL_DB_BROINTEL_INDEX + type, intel_index->index.slots, sizeof(_Sagan_Hash_Slot), intel_index->index.size, intel_index->index.count);
+    Intel_DB_Add(writer, INTEL_DB_BROINTEL_FALLBACK + type, intel_index->fallback, sizeof(int), intel_index->fallback_count, 0);
+
+}
+
+static void BroIntel_Save_AC( _Sagan_Intel_DB_Writer *writer, int type, _Sagan_Aho_Corasick *ac )
+{
+
+    Intel_DB_Add(writer, INTEL_DB_BROINTEL_AC_NODES + type, ac->nodes, sizeof(_Sagan_AC_Node), ac->node_count, ac->pattern_count);
+    Intel_DB_Add(writer, INTEL_DB_BROINTEL_AC_EDGES + type, ac->edges, sizeof(_Sagan_AC_Edge), ac->edges != NULL ? ac->node_count : 0, 0);
+    Intel_DB_Add(writer, INTEL_DB_BROINTEL_AC_ROOT + type, ac->root_next, sizeof(uint32_t), 256, ac->compiled);
+
+}
+
+void Sagan_BroIntel_Save( _Sagan_Intel_DB_Writer *writer )
+{
+
+    _Sagan_BroIntel_Store *store = Sagan_RCU_Dereference(SaganBroIntelStore);
+
+    if ( store == NULL )
+        {
+            return;
+        }
+
+    BroIntel_Save_Type(writer, BROINTEL_TYPE_ADDR, store->addr, sizeof(_Sagan_BroIntel_Intel_Addr), store->addr_count, &store->addr_index);
+    BroIntel_Save_Type(writer, BROINTEL_TYPE_DOMAIN, store->domain, sizeof(_Sagan_BroIntel_Intel_Domain), store->domain_count, &store->domain_index);
+    BroIntel_Save_Type(writer, BROINTEL_TYPE_FILE_HASH, store->file_hash, sizeof(_Sagan_BroIntel_Intel_File_Hash), store->file_hash_count, &store->file_hash_index);
+    BroIntel_Save_Type(writer, BROINTEL_TYPE_URL, store->url, sizeof(_Sagan_BroIntel_Intel_URL), store->url_count, &store->url_index);
+    BroIntel_Save_Type(writer, BROINTEL_TYPE_SOFTWARE, store->software, sizeof(_Sagan_BroIntel_Intel_Software), store->software_count, &store->software_index);
+    BroIntel_Save_Type(writer, BROINTEL_TYPE_EMAIL, store->email, sizeof(_Sagan_BroIntel_Intel_Email), store->email_count, &store->email_index);
+    BroIntel_Save_Type(writer, BROINTEL_TYPE_USER_NAME, store->user_name, sizeof(_Sagan_BroIntel_Intel_User_Name), store->user_name_count, &store->user_name_index);
+    BroIntel_Save_Type(writer, BROINTEL_TYPE_FILE_NAME, store->file_name, sizeof(_Sagan_BroIntel_Intel_File_Name), store->file_name_count, &store->file_name_index);
+    BroIntel_Save_Type(writer, BROINTEL_TYPE_CERT_HASH, store->cert_hash, sizeof(_Sagan_BroIntel_Intel_Cert_Hash), store->cert_hash_count, &store->cert_hash_index);
+
+    BroIntel_Save_AC(writer, BROINTEL_TYPE_DOMAIN, &store->domain_ac);
+    BroIntel_Save_AC(writer, BROINTEL_TYPE_URL, &store->url_ac);
+
+}
+
+/*****************************************************************************
+ * BroIntel_Current - Returns the published store for this lookup and points
+ * the match callbacks at it.  NULL if nothing is loaded.
+ *****************************************************************************/
+
+static _Sagan_BroIntel_Store *BroIntel_Current(void)
+{
+
+    brointel_match_store = Sagan_RCU_Dereference(SaganBroIntelStore);
+
+    return(brointel_match_store);
+
+}
+
+/*****************************************************************************
+ * Match callbacks for Hash_Index_Find().  Stored values are lower case,
+ * keys may point into a (mixed case) log line and aren't NULL terminated.
+ *****************************************************************************/
+
+static sbool BroIntel_Match_String( const char *stored, const char *key, size_t len )
+{
+    return( !strncasecmp(stored, key, len) && stored[len] == '\0' );
+}
+
+static sbool BroIntel_Match_Addr( uint32_t i, const void *key, size_t len )
+{
+    return( !memcmp(brointel_match_store->addr[i].bits_ip, key, MAXIPBIT) );
+}
+
+static sbool BroIntel_Match_Domain( uint32_t i, const void *key, size_t len )
+{
+    return( BroIntel_Match_String(brointel_match_store->domain[i].domain, key, len) );
+}
+
+static sbool BroIntel_Match_File_Hash( uint32_t i, const void *key, size_t len )
+{
+    return( BroIntel_Match_String(brointel_match_store->file_hash[i].hash, key, len) );
+}
+
+static sbool BroIntel_Match_URL( uint32_t i, const void *key, size_t len )
+{
+    return( BroIntel_Match_String(brointel_match_store->url[i].url, key, len) );
+}
+
+static sbool BroIntel_Match_Software( uint32_t i, const void *key, size_t len )
+{
+    return( BroIntel_Match_String(brointel_match_store->software[i].software, key, len) );
+}
+
+static sbool BroIntel_Match_Email( uint32_t i, const void *key, size_t len )
+{
+    return( BroIntel_Match_String(brointel_match_store->email[i].email, key, len) );
+}
+
+static sbool BroIntel_Match_User_Name( uint32_t i, const void *key, size_t len )
+{
+    return( BroIntel_Match_String(brointel_match_store->user_name[i].username, key, len) );
+}
+
+static sbool BroIntel_Match_File_Name( uint32_t i, const void *key, size_t len )
+{
+    return( BroIntel_Match_String(brointel_match_store->file_name[i].file_name, key, len) );
+}
+
+static sbool BroIntel_Match_Cert_Hash( uint32_t i, const void *key, size_t len )
+{
+    return( BroIntel_Match_String(brointel_match_store->cert_hash[i].cert_hash, key, len) );
+}
+
+/*****************************************************************************
+ * BroIntel_Grow - Makes sure "array" has room for one more element.
+ * Arrays are grown geometrically so loading large feeds doesn't realloc()
+ * on every line.
+ *****************************************************************************/
+
+static void *BroIntel_Grow( void *array, int count, size_t element_size, _Sagan_BroIntel_Index *intel_index, const char *name )
+{
+
+    int new_size = 0;
+
+    if ( count < intel_index->size )
+        {
+            return(array);
+        }
+
+    new_size = intel_index->size == 0 ? 1024 : intel_index->size * 2;
+
+    array = realloc(array, new_size * element_size);
+
+    if ( array == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for %s. Abort!", __FILE__, __LINE__, name);
+        }
+
+    intel_index->size = new_size;
+
+    return(array);
+}
+
+/*****************************************************************************
+ * BroIntel_Add_String - Checks "value" for duplicates.  If it is new,  its
+ * hash is added to the index.  Returns false on duplicates.
+ *****************************************************************************/
+
+static sbool BroIntel_Add_String( _Sagan_BroIntel_Index *intel_index, Hash_Index_Match match, const char *value, size_t max_len, int count, const sbool *token_class )
+{
+
+    size_t len = strlen(value);
+    size_t i;
+    uint32_t hash;
+
+    /* Values are truncated to fit the array element */
+
+    if ( len > max_len )
+        {
+            len = max_len;
+        }
+
+    hash = Hash_FNV1a(value, len);
+
+    if ( Hash_Index_Find(&intel_index->index, hash, match, value, len) != -1 )
+        {
+            return(false);
+        }
+
+    Hash_Index_Add(&intel_index->index, hash, count);
+
+    /* Indicators with characters that end a token can never be seen by the
+     * tokenizer.  Those are searched with Sagan_stristr() */
+
+    if ( token_class != NULL )
+        {
+
+            for ( i = 0; i < len; i++ )
+                {
+
+                    if ( !token_class[(unsigned char)value[i]] )
+                        {
+
+                            intel_index->fallback = (int *) realloc(intel_index->fallback, (intel_index->fallback_count+1) * sizeof(int));
+
+                            if ( intel_index->fallback == NULL )
+                                {
+                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Bro Intel fallback list. Abort!", __FILE__, __LINE__);
+                                }
+
+                            intel_index->fallback[intel_index->fallback_count++] = count;
+                            break;
+                        }
+                }
+        }
+
+    return(true);
+}
+
+/*****************************************************************************
+ * BroIntel_Duplicate - Logs/counts a duplicate indicator
+ *****************************************************************************/
+
+static void BroIntel_Duplicate( const char *type, const char *value, const char *brointel_filename, int line_count )
+{
+
+    Sagan_Log(WARN, "[%s, line %d] Got duplicate %s '%s' in %s on line %d.", __FILE__, __LINE__, type, value, brointel_filename, line_count + 1);
+
+    pthread_mutex_lock(&CounterBroIntelGenericMutex);
+    counters->brointel_dups++;
+    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+
 }
 
 /*****************************************************************************
@@ -92,23 +710,44 @@ void Sagan_BroIntel_Load_File ( void )
     char *description;
 
     sbool found_flag;
-    sbool found_flag_array;
 
     char *tok = NULL; ;
     char *ptmp = NULL;
 
-    int line_count;
-    int i;
+    int line_count = 0;
 
     unsigned char bits_ip[MAXIPBIT] = {0};
 
     char *brointel_filename = NULL;
     char brointelbuf[MAX_BROINTEL_LINE_SIZE] = { 0 };
 
+    _Sagan_BroIntel_Store *store = NULL;
+
+    if ( config->brointel_db[0] != '\0' )
+        {
+            BroIntel_Load_DB();
+            return;
+        }
+
     pthread_mutex_lock(&CounterBroIntelGenericMutex);
     counters->brointel_dups = 0;
     pthread_mutex_unlock(&CounterBroIntelGenericMutex);
 
+    /* Build a new store off to the side.  Workers keep using the
+     * published one until we swap it in below */
+
+    store = calloc(1, sizeof(_Sagan_BroIntel_Store));
+
+    if ( store == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Bro Intel store. Abort!", __FILE__, __LINE__);
+        }
+
+    Aho_Corasick_Init(&store->domain_ac);
+    Aho_Corasick_Init(&store->url_ac);
+
+    brointel_match_store = store;
+
     brointel_filename = strtok_r(config->brointel_files, ",", &ptmp);
 
     while ( brointel_filename != NULL )
@@ -142,7 +781,9 @@ void Sagan_BroIntel_Load_File ( void )
 
                             if ( value == NULL || type == NULL || description == NULL )
                                 {
-                                    Sagan_Log(WARN, "[%s, line %d] Got invalid line at %d in %s", __FILE__, __LINE__, line_count, brointel_filename);
+                                    Sagan_Log(WARN, "[%s, line %d] Got invalid line at %d in %s", __FILE__, __LINE__, line_count + 1, brointel_filename);
+                                    line_count++;
+                                    continue;
                                 }
 
                             found_flag = 0;
@@ -151,41 +792,20 @@ void Sagan_BroIntel_Load_File ( void )
                                 {
 
                                     found_flag = 1; 			/* Used to short circuit other 'type' lookups */
-                                    found_flag_array = 0;		/* Used to short circuit/warn when dups are found.  This way we don't waste memory/CPU */
-
-                                    /* Check for duplicates. */
 
-                                    for (i=0; i < counters->brointel_addr_count; i++)
+                                    if ( Hash_Index_Find(&store->addr_index.index, Hash_FNV1a(bits_ip, MAXIPBIT), BroIntel_Match_Addr, bits_ip, MAXIPBIT) != -1 )
                                         {
-
-                                            if ( !memcmp(Sagan_BroIntel_Intel_Addr[i].bits_ip, bits_ip, MAXIPBIT) )
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::ADDR address %s in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-
-                                                    pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                                    counters->brointel_dups++;
-                                                    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
-
-                                                    found_flag_array = 1;
-                                                }
+                                            BroIntel_Duplicate("Intel::ADDR", value, brointel_filename, line_count);
                                         }
-
-                                    if ( found_flag_array == 0 )
+                                    else
                                         {
 
-                                            Sagan_BroIntel_Intel_Addr = (_Sagan_BroIntel_Intel_Addr *) realloc(Sagan_BroIntel_Intel_Addr, (counters->brointel_addr_count+1) * sizeof(_Sagan_BroIntel_Intel_Addr));
-
-                                            if ( Sagan_BroIntel_Intel_Addr == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Addr. Abort!", __FILE__, __LINE__);
-                                                }
+                                            store->addr = (_Sagan_BroIntel_Intel_Addr *) BroIntel_Grow(store->addr, store->addr_count, sizeof(_Sagan_BroIntel_Intel_Addr), &store->addr_index, "Intel::ADDR");
 
-                                            memset(&Sagan_BroIntel_Intel_Addr[counters->brointel_addr_count], 0, sizeof(_Sagan_BroIntel_Intel_Addr));
+                                            memcpy( store->addr[store->addr_count].bits_ip, bits_ip, sizeof(bits_ip) );
+                                            Hash_Index_Add(&store->addr_index.index, Hash_FNV1a(bits_ip, MAXIPBIT), store->addr_count);
 
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            memcpy( Sagan_BroIntel_Intel_Addr[counters->brointel_addr_count].bits_ip, bits_ip, sizeof(bits_ip) );
-                                            counters->brointel_addr_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                            store->addr_count++;
                                         }
 
                                 }
@@ -195,81 +815,42 @@ void Sagan_BroIntel_Load_File ( void )
                                     To_LowerC(value);
 
                                     found_flag = 1;
-                                    found_flag_array = 0;
 
+                                    store->domain = (_Sagan_BroIntel_Intel_Domain *) BroIntel_Grow(store->domain, store->domain_count, sizeof(_Sagan_BroIntel_Intel_Domain), &store->domain_index, "Intel::DOMAIN");
 
-                                    for (i=0; i < counters-> brointel_domain_count; i++)
+                                    if ( !BroIntel_Add_String(&store->domain_index, BroIntel_Match_Domain, value, sizeof(store->domain[0].domain) - 1, store->domain_count, NULL) )
                                         {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Domain[i].domain, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::DOMAIN '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-
-                                                    pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                                    counters->brointel_dups++;
-                                                    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
-
-                                                    found_flag_array = 1;
-                                                }
+                                            BroIntel_Duplicate("Intel::DOMAIN", value, brointel_filename, line_count);
                                         }
-
-                                    if ( found_flag_array == 0 )
+                                    else
                                         {
-                                            Sagan_BroIntel_Intel_Domain = (_Sagan_BroIntel_Intel_Domain *) realloc(Sagan_BroIntel_Intel_Domain, (counters->brointel_domain_count+1) * sizeof(_Sagan_BroIntel_Intel_Domain));
 
-                                            if ( Sagan_BroIntel_Intel_Domain == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Domain. Abort!", __FILE__, __LINE__);
-                                                }
+                                            strlcpy(store->domain[store->domain_count].domain, value, sizeof(store->domain[store->domain_count].domain));
+                                            Aho_Corasick_Add(&store->domain_ac, store->domain[store->domain_count].domain, store->domain_count);
 
-                                            memset(&Sagan_BroIntel_Intel_Domain[counters->brointel_domain_count], 0, sizeof(_Sagan_BroIntel_Intel_Domain));
-
-                                            strlcpy(Sagan_BroIntel_Intel_Domain[counters->brointel_domain_count].domain, value, sizeof(Sagan_BroIntel_Intel_Domain[counters->brointel_domain_count].domain));
-
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            counters->brointel_domain_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                            store->domain_count++;
                                         }
 
                                 }
 
                             if (!strcmp(type, "Intel::FILE_HASH") && found_flag == 0)
-                                {
-                                    To_LowerC(value);
-
-                                    found_flag = 1;
-                                    found_flag_array = 0;
-
-                                    for (i=0; i < counters->brointel_file_hash_count; i++)
-                                        {
-
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_File_Hash[i].hash, value))
-                                                {
+                                {
+                                    To_LowerC(value);
 
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::FILE_HASH '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+                                    found_flag = 1;
 
-                                                    pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                                    counters->brointel_dups++;
-                                                    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                    store->file_hash = (_Sagan_BroIntel_Intel_File_Hash *) BroIntel_Grow(store->file_hash, store->file_hash_count, sizeof(_Sagan_BroIntel_Intel_File_Hash), &store->file_hash_index, "Intel::FILE_HASH");
 
-                                                    found_flag_array = 1;
-                                                }
+                                    if ( !BroIntel_Add_String(&store->file_hash_index, BroIntel_Match_File_Hash, value, sizeof(store->file_hash[0].hash) - 1, store->file_hash_count, BroIntel_Class_Hash) )
+                                        {
+                                            BroIntel_Duplicate("Intel::FILE_HASH", value, brointel_filename, line_count);
                                         }
-
-                                    if ( found_flag_array == 0 )
+                                    else
                                         {
 
-                                            Sagan_BroIntel_Intel_File_Hash = (_Sagan_BroIntel_Intel_File_Hash *) realloc(Sagan_BroIntel_Intel_File_Hash, (counters->brointel_file_hash_count+1) * sizeof(_Sagan_BroIntel_Intel_File_Hash));
-
-                                            if ( Sagan_BroIntel_Intel_File_Hash == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_File_Hash. Abort!", __FILE__, __LINE__);
-                                                }
-
-                                            memset(&Sagan_BroIntel_Intel_File_Hash[counters->brointel_file_hash_count], 0, sizeof(_Sagan_BroIntel_Intel_File_Hash));
-
-                                            strlcpy(Sagan_BroIntel_Intel_File_Hash[counters->brointel_file_hash_count].hash, value, sizeof(Sagan_BroIntel_Intel_File_Hash[counters->brointel_file_hash_count].hash));
-                                            counters->brointel_file_hash_count++;
+                                            strlcpy(store->file_hash[store->file_hash_count].hash, value, sizeof(store->file_hash[store->file_hash_count].hash));
 
+                                            store->file_hash_count++;
                                         }
                                 }
 
@@ -280,40 +861,20 @@ void Sagan_BroIntel_Load_File ( void )
                                     To_LowerC(value);
 
                                     found_flag = 1;
-                                    found_flag_array = 0;
 
-                                    for (i=0; i < counters->brointel_url_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_URL[i].url, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::URL '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-
-                                                    pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                                    counters->brointel_dups++;
-                                                    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                    store->url = (_Sagan_BroIntel_Intel_URL *) BroIntel_Grow(store->url, store->url_count, sizeof(_Sagan_BroIntel_Intel_URL), &store->url_index, "Intel::URL");
 
-                                                    found_flag_array = 1;
-                                                }
+                                    if ( !BroIntel_Add_String(&store->url_index, BroIntel_Match_URL, value, sizeof(store->url[0].url) - 1, store->url_count, NULL) )
+                                        {
+                                            BroIntel_Duplicate("Intel::URL", value, brointel_filename, line_count);
                                         }
-
-
-                                    if ( found_flag_array == 0 )
+                                    else
                                         {
 
-                                            Sagan_BroIntel_Intel_URL = (_Sagan_BroIntel_Intel_URL *) realloc(Sagan_BroIntel_Intel_URL, (counters->brointel_url_count+1) * sizeof(_Sagan_BroIntel_Intel_URL));
-
-                                            if ( Sagan_BroIntel_Intel_URL == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_URL. Abort!", __FILE__, __LINE__);
-                                                }
-
-                                            memset(&Sagan_BroIntel_Intel_URL[counters->brointel_url_count], 0, sizeof(_Sagan_BroIntel_Intel_URL));
-
-                                            strlcpy(Sagan_BroIntel_Intel_URL[counters->brointel_url_count].url, value, sizeof(Sagan_BroIntel_Intel_URL[counters->brointel_url_count].url));
+                                            strlcpy(store->url[store->url_count].url, value, sizeof(store->url[store->url_count].url));
+                                            Aho_Corasick_Add(&store->url_ac, store->url[store->url_count].url, store->url_count);
 
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            counters->brointel_url_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                            store->url_count++;
 
                                         }
 
@@ -323,45 +884,22 @@ void Sagan_BroIntel_Load_File ( void )
                             if (!strcmp(type, "Intel::SOFTWARE") && found_flag == 0)
                                 {
 
-
                                     To_LowerC(value);
 
                                     found_flag = 1;
-                                    found_flag_array = 0;
-
-                                    for (i=0; i < counters->brointel_software_count++; i++)
-                                        {
-
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Software[i].software, value))
-                                                {
 
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::SOFTWARE '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+                                    store->software = (_Sagan_BroIntel_Intel_Software *) BroIntel_Grow(store->software, store->software_count, sizeof(_Sagan_BroIntel_Intel_Software), &store->software_index, "Intel::SOFTWARE");
 
-                                                    pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                                    counters->brointel_dups++;
-                                                    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
-
-                                                    found_flag_array = 1;
-                                                }
+                                    if ( !BroIntel_Add_String(&store->software_index, BroIntel_Match_Software, value, sizeof(store->software[0].software) - 1, store->software_count, NULL) )
+                                        {
+                                            BroIntel_Duplicate("Intel::SOFTWARE", value, brointel_filename, line_count);
                                         }
-
-                                    if ( found_flag_array == 0 )
+                                    else
                                         {
 
-                                            Sagan_BroIntel_Intel_Software = (_Sagan_BroIntel_Intel_Software *) realloc(Sagan_BroIntel_Intel_Software, (counters->brointel_software_count+1) * sizeof(_Sagan_BroIntel_Intel_Software));
-
-                                            if ( Sagan_BroIntel_Intel_Software == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Software. Abort!", __FILE__, __LINE__);
-                                                }
+                                            strlcpy(store->software[store->software_count].software, value, sizeof(store->software[store->software_count].software));
 
-                                            memset(&Sagan_BroIntel_Intel_Software[counters->brointel_software_count], 0, sizeof(_Sagan_BroIntel_Intel_Software));
-
-                                            strlcpy(Sagan_BroIntel_Intel_Software[counters->brointel_software_count].software, value, sizeof(Sagan_BroIntel_Intel_Software[counters->brointel_software_count].software));
-
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            counters->brointel_software_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                            store->software_count++;
 
                                         }
                                 }
@@ -371,42 +909,21 @@ void Sagan_BroIntel_Load_File ( void )
 
                                     To_LowerC(value);
 
-                                    found_flag_array = 0;
-
-                                    for (i=0; i < counters->brointel_email_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Email[i].email, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::EMAIL '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
-
-                                                    pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                                    counters->brointel_dups++;
-                                                    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                    found_flag = 1;
 
-                                                    found_flag_array = 1;
+                                    store->email = (_Sagan_BroIntel_Intel_Email *) BroIntel_Grow(store->email, store->email_count, sizeof(_Sagan_BroIntel_Intel_Email), &store->email_index, "Intel::EMAIL");
 
-                                                }
+                                    if ( !BroIntel_Add_String(&store->email_index, BroIntel_Match_Email, value, sizeof(store->email[0].email) - 1, store->email_count, BroIntel_Class_Email) )
+                                        {
+                                            BroIntel_Duplicate("Intel::EMAIL", value, brointel_filename, line_count);
                                         }
-
-                                    if ( found_flag_array == 0 )
+                                    else
                                         {
 
-                                            Sagan_BroIntel_Intel_Email = (_Sagan_BroIntel_Intel_Email *) realloc(Sagan_BroIntel_Intel_Email, (counters->brointel_email_count+1) * sizeof(_Sagan_BroIntel_Intel_Email));
+                                            strlcpy(store->email[store->email_count].email, value, sizeof(store->email[store->email_count].email));
 
-                                            if ( Sagan_BroIntel_Intel_Email == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Email. Abort!", __FILE__, __LINE__);
-                                                }
+                                            store->email_count++;
 
-                                            memset(&Sagan_BroIntel_Intel_Email[counters->brointel_email_count], 0, sizeof(_Sagan_BroIntel_Intel_Email));
-
-                                            strlcpy(Sagan_BroIntel_Intel_Email[counters->brointel_email_count].email, value, sizeof(Sagan_BroIntel_Intel_Email[counters->brointel_email_count].email));
-
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            counters->brointel_email_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
-
-                                            found_flag = 1;
                                         }
 
                                 }
@@ -417,40 +934,19 @@ void Sagan_BroIntel_Load_File ( void )
                                     To_LowerC(value);
 
                                     found_flag = 1;
-                                    found_flag_array = 0;
-
-                                    for (i=0; i < counters->brointel_user_name_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_User_Name[i].username, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::USER_NAME '%s' in %s on line %.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
 
-                                                    pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                                    counters->brointel_dups++;
-                                                    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                    store->user_name = (_Sagan_BroIntel_Intel_User_Name *) BroIntel_Grow(store->user_name, store->user_name_count, sizeof(_Sagan_BroIntel_Intel_User_Name), &store->user_name_index, "Intel::USER_NAME");
 
-                                                    found_flag_array = 1;
-                                                }
+                                    if ( !BroIntel_Add_String(&store->user_name_index, BroIntel_Match_User_Name, value, sizeof(store->user_name[0].username) - 1, store->user_name_count, BroIntel_Class_User_Name) )
+                                        {
+                                            BroIntel_Duplicate("Intel::USER_NAME", value, brointel_filename, line_count);
                                         }
-
-                                    if ( found_flag_array == 0 )
+                                    else
                                         {
 
+                                            strlcpy(store->user_name[store->user_name_count].username, value, sizeof(store->user_name[store->user_name_count].username));
 
-                                            Sagan_BroIntel_Intel_User_Name = (_Sagan_BroIntel_Intel_User_Name *) realloc(Sagan_BroIntel_Intel_User_Name, (counters->brointel_user_name_count+1) * sizeof(_Sagan_BroIntel_Intel_User_Name));
-
-                                            if ( Sagan_BroIntel_Intel_User_Name == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_User_Name. Abort!", __FILE__, __LINE__);
-                                                }
-
-                                            memset(&Sagan_BroIntel_Intel_User_Name[counters->brointel_user_name_count], 0, sizeof(_Sagan_BroIntel_Intel_User_Name));
-
-                                            strlcpy(Sagan_BroIntel_Intel_User_Name[counters->brointel_user_name_count].username, value, sizeof(Sagan_BroIntel_Intel_User_Name[counters->brointel_user_name_count].username));
-
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            counters->brointel_user_name_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                            store->user_name_count++;
                                         }
                                 }
 
@@ -460,42 +956,19 @@ void Sagan_BroIntel_Load_File ( void )
                                     To_LowerC(value);
 
                                     found_flag = 1;
-                                    found_flag_array = 0;
-
-                                    for (i=0; i < counters->brointel_file_name_count; i++)
-                                        {
-
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_File_Name[i].file_name, value))
-                                                {
 
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::FILE_NAME '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
+                                    store->file_name = (_Sagan_BroIntel_Intel_File_Name *) BroIntel_Grow(store->file_name, store->file_name_count, sizeof(_Sagan_BroIntel_Intel_File_Name), &store->file_name_index, "Intel::FILE_NAME");
 
-                                                    pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                                    counters->brointel_dups++;
-                                                    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
-
-                                                    found_flag_array = 1;
-                                                }
+                                    if ( !BroIntel_Add_String(&store->file_name_index, BroIntel_Match_File_Name, value, sizeof(store->file_name[0].file_name) - 1, store->file_name_count, BroIntel_Class_File_Name) )
+                                        {
+                                            BroIntel_Duplicate("Intel::FILE_NAME", value, brointel_filename, line_count);
                                         }
-
-
-                                    if ( found_flag_array == 0 )
+                                    else
                                         {
 
-                                            Sagan_BroIntel_Intel_File_Name = (_Sagan_BroIntel_Intel_File_Name *) realloc(Sagan_BroIntel_Intel_File_Name, (counters->brointel_file_name_count+1) * sizeof(_Sagan_BroIntel_Intel_File_Name));
-
-                                            if ( Sagan_BroIntel_Intel_File_Name == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_File_Name. Abort!", __FILE__, __LINE__);
-                                                }
-
-                                            memset(&Sagan_BroIntel_Intel_File_Name[counters->brointel_file_name_count], 0, sizeof(_Sagan_BroIntel_Intel_File_Name));
+                                            strlcpy(store->file_name[store->file_name_count].file_name, value, sizeof(store->file_name[store->file_name_count].file_name));
 
-                                            strlcpy(Sagan_BroIntel_Intel_File_Name[counters->brointel_file_name_count].file_name, value, sizeof(Sagan_BroIntel_Intel_File_Name[counters->brointel_file_name_count].file_name));
-
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            counters->brointel_file_name_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                            store->file_name_count++;
                                         }
 
                                 }
@@ -505,38 +978,19 @@ void Sagan_BroIntel_Load_File ( void )
                                     To_LowerC(value);
 
                                     found_flag = 1;
-                                    found_flag_array = 0;
-
-                                    for (i=0; i < counters->brointel_cert_hash_count; i++)
-                                        {
-                                            if (!strcasecmp(Sagan_BroIntel_Intel_Cert_Hash[i].cert_hash, value))
-                                                {
-                                                    Sagan_Log(WARN, "[%s, line %d] Got duplicate Intel::CERT_HASH '%s' in %s on line %d.", __FILE__, __LINE__, value, brointel_filename, line_count + 1);
 
-                                                    pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                                    counters->brointel_dups++;
-                                                    pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                    store->cert_hash = (_Sagan_BroIntel_Intel_Cert_Hash *) BroIntel_Grow(store->cert_hash, store->cert_hash_count, sizeof(_Sagan_BroIntel_Intel_Cert_Hash), &store->cert_hash_index, "Intel::CERT_HASH");
 
-                                                    found_flag_array = 1;
-                                                }
+                                    if ( !BroIntel_Add_String(&store->cert_hash_index, BroIntel_Match_Cert_Hash, value, sizeof(store->cert_hash[0].cert_hash) - 1, store->cert_hash_count, BroIntel_Class_Hash) )
+                                        {
+                                            BroIntel_Duplicate("Intel::CERT_HASH", value, brointel_filename, line_count);
                                         }
-
-                                    if ( found_flag_array == 0 )
+                                    else
                                         {
-                                            Sagan_BroIntel_Intel_Cert_Hash = (_Sagan_BroIntel_Intel_Cert_Hash *) realloc(Sagan_BroIntel_Intel_Cert_Hash, (counters->brointel_cert_hash_count+1) * sizeof(_Sagan_BroIntel_Intel_Cert_Hash));
-
-                                            if ( Sagan_BroIntel_Intel_Cert_Hash == NULL )
-                                                {
-                                                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Sagan_BroIntel_Intel_Cert_Hash. Abort!", __FILE__, __LINE__);
-                                                }
 
-                                            memset(&Sagan_BroIntel_Intel_Cert_Hash[counters->brointel_cert_hash_count], 0, sizeof(_Sagan_BroIntel_Intel_Cert_Hash));
+                                            strlcpy(store->cert_hash[store->cert_hash_count].cert_hash, value, sizeof(store->cert_hash[store->cert_hash_count].cert_hash));
 
-                                            strlcpy(Sagan_BroIntel_Intel_Cert_Hash[counters->brointel_cert_hash_count].cert_hash, value, sizeof(Sagan_BroIntel_Intel_Cert_Hash[counters->brointel_cert_hash_count].cert_hash));
-
-                                            pthread_mutex_lock(&CounterBroIntelGenericMutex);
-                                            counters->brointel_cert_hash_count++;
-                                            pthread_mutex_unlock(&CounterBroIntelGenericMutex);
+                                            store->cert_hash_count++;
                                         }
                                 }
 
@@ -551,6 +1005,112 @@ void Sagan_BroIntel_Load_File ( void )
             line_count = 0;
         }
 
+    Aho_Corasick_Compile(&store->domain_ac);
+    Aho_Corasick_Compile(&store->url_ac);
+
+    brointel_match_store = NULL;
+
+    BroIntel_Publish(store);
+
+}
+
+/*****************************************************************************
+ * BroIntel_Token_Search - Splits the syslog_message into tokens made of
+ * "token_class" characters and looks each one up in the index.  The
+ * message is only walked once,  so the cost doesn't depend on how many
+ * indicators are loaded.  Returns the array index of the first hit or -1.
+ *****************************************************************************/
+
+static int64_t BroIntel_Token_Search( const char *syslog_message, const sbool *token_class, _Sagan_BroIntel_Index *intel_index, Hash_Index_Match match, size_t max_len )
+{
+
+    const unsigned char *p = (const unsigned char *)syslog_message;
+    const unsigned char *start = NULL;
+
+    uint32_t hash = 0;
+    uint32_t trim_hash = 0;
+    size_t trim_len = 0;
+
+    int64_t found = -1;
+
+    if ( intel_index->index.count == 0 )
+        {
+            return(-1);
+        }
+
+    while ( *p != '\0' )
+        {
+
+            while ( *p != '\0' && !token_class[*p] )
+                {
+                    p++;
+                }
+
+            start = p;
+            hash = HASH_FNV_OFFSET;
+            trim_hash = HASH_FNV_OFFSET;
+            trim_len = 0;
+
+            while ( *p != '\0' && token_class[*p] )
+                {
+
+                    hash = Hash_FNV1a_Step(hash, tolower(*p));
+                    p++;
+
+                    /* Remember where the token last ended on a letter/number.
+                     * Trailing punctuation ("user@example.com.") is retried
+                     * without it */
+
+                    if ( isalnum(p[-1]) )
+                        {
+                            trim_hash = hash;
+                            trim_len = p - start;
+                        }
+                }
+
+            if ( p == start || (size_t)( p - start ) > max_len )
+                {
+                    continue;
+                }
+
+            found = Hash_Index_Find(&intel_index->index, hash, match, start, p - start);
+
+            if ( found == -1 && trim_len != 0 && trim_len != (size_t)( p - start ) )
+                {
+                    found = Hash_Index_Find(&intel_index->index, trim_hash, match, start, trim_len);
+                }
+
+            if ( found != -1 )
+                {
+                    return(found);
+                }
+
+        }
+
+    return(-1);
+}
+
+/*****************************************************************************
+ * BroIntel_Fallback_Search - Sagan_stristr() search of indicators that
+ * can't be found by BroIntel_Token_Search().  Returns the array index of
+ * the first hit or -1.
+ *****************************************************************************/
+
+static int BroIntel_Fallback_Search( char *syslog_message, _Sagan_BroIntel_Index *intel_index, const char *array, size_t element_size )
+{
+
+    int i;
+
+    for ( i = 0; i < intel_index->fallback_count; i++ )
+        {
+
+            if ( Sagan_stristr(syslog_message, array + ( intel_index->fallback[i] * element_size ), false) )
+                {
+                    return(intel_index->fallback[i]);
+                }
+        }
+
+    return(-1);
 }
 
 /*****************************************************************************
@@ -560,11 +1120,12 @@ void Sagan_BroIntel_Load_File ( void )
 sbool Sagan_BroIntel_IPADDR ( unsigned char *ip, char *ipaddr )
 {
 
-    int i = 0;
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
 
-    unsigned char ip_convert[MAXIPBIT] = { 0 };
-    memset(ip_convert, 0, MAXIPBIT);
-    memcpy(ip_convert, ip, MAXIPBIT);
+    if ( store == NULL )
+        {
+            return(false);
+        }
 
     /* If RFC1918 and friends,  we can short circuit here */
 
@@ -579,21 +1140,16 @@ sbool Sagan_BroIntel_IPADDR ( unsigned char *ip, char *ipaddr )
             return(false);
         }
 
-    /* Search array for for the IP address */
+    /* Search index for for the IP address */
 
-    for ( i = 0; i < counters->brointel_addr_count; i++)
+    if ( Hash_Index_Find(&store->addr_index.index, Hash_FNV1a(ip, MAXIPBIT), BroIntel_Match_Addr, ip, MAXIPBIT) != -1 )
         {
-
-            if ( !memcmp(ip_convert, Sagan_BroIntel_Intel_Addr[i].bits_ip, MAXIPBIT) )
+            if ( debug->debugbrointel )
                 {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found IP %u.", __FILE__, __LINE__, ip);
-                        }
-
-                    return(true);
+                    Sagan_Log(DEBUG, "[%s, line %d] Found IP %s.", __FILE__, __LINE__, ipaddr);
                 }
 
+            return(true);
         }
 
     return(false);
@@ -608,25 +1164,26 @@ sbool Sagan_BroIntel_IPADDR ( unsigned char *ip, char *ipaddr )
 sbool Sagan_BroIntel_IPADDR_All ( char *syslog_message, _Sagan_Lookup_Cache_Entry *lookup_cache, size_t cache_size)
 {
 
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
+
     int i;
-    int b;
 
-    for (i = 0; i < MAX_PARSE_IP; i++)
+    if ( store == NULL )
         {
+            return(false);
+        }
 
+    for (i = 0; i < cache_size; i++)
+        {
 
             if ( lookup_cache[i].status == 0 )
                 {
                     return(false);
                 }
 
-            for ( b = 0; b < counters->brointel_addr_count; b++ )
+            if ( Hash_Index_Find(&store->addr_index.index, Hash_FNV1a(lookup_cache[i].ip_bits, MAXIPBIT), BroIntel_Match_Addr, lookup_cache[i].ip_bits, MAXIPBIT) != -1 )
                 {
-
-                    if ( !memcmp(Sagan_BroIntel_Intel_Addr[b].bits_ip, lookup_cache[i].ip_bits, sizeof(Sagan_BroIntel_Intel_Addr[b].bits_ip)))
-                        {
-                            return(true);
-                        }
+                    return(true);
                 }
         }
 
@@ -634,27 +1191,59 @@ sbool Sagan_BroIntel_IPADDR_All ( char *syslog_message, _Sagan_Lookup_Cache_Entr
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_DOMAIN - Search DOMAIN array
+ * BroIntel_Domain_Boundary - Only accept domains that aren't part of a
+ * longer label.  "evil.com" matches "www.evil.com" but not "notevil.com"
+ * or "evil.community".  Used with "domain-boundary";  otherwise a DOMAIN
+ * matches anywhere in the message.
+ *****************************************************************************/
+
+static sbool BroIntel_Domain_Char( unsigned char c )
+{
+    return( isalnum(c) || c == '-' || c == '_' );
+}
+
+static sbool BroIntel_Domain_Boundary( const char *text, size_t start, size_t end )
+{
+
+    if ( start > 0 && BroIntel_Domain_Char(text[start-1]) && BroIntel_Domain_Char(text[start]) )
+        {
+            return(false);
+        }
+
+    if ( BroIntel_Domain_Char(text[end]) && BroIntel_Domain_Char(text[end-1]) )
+        {
+            return(false);
+        }
+
+    return(true);
+}
+
+/*****************************************************************************
+ * Sagan_BroIntel_DOMAIN - Search DOMAIN automaton
  *****************************************************************************/
 
 sbool Sagan_BroIntel_DOMAIN ( char *syslog_message )
 {
 
-    int i;
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
+
+    int64_t i;
 
-    for ( i = 0; i < counters->brointel_domain_count; i++)
+    if ( store == NULL )
         {
+            return(false);
+        }
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Domain[i].domain, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found domain %s.", __FILE__, __LINE__, Sagan_BroIntel_Intel_Domain[i].domain);
-                        }
+    i = Aho_Corasick_Search(&store->domain_ac, syslog_message, config->brointel_domain_boundary == true ? BroIntel_Domain_Boundary : NULL);
 
-                    return(true);
+    if ( i != -1 )
+        {
+            if ( debug->debugbrointel )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Found domain %s.", __FILE__, __LINE__, store->domain[i].domain);
                 }
 
+            return(true);
         }
 
     return(false);
@@ -662,27 +1251,36 @@ sbool Sagan_BroIntel_DOMAIN ( char *syslog_message )
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_FILE_HASH - Search FILE_HASH array
+ * Sagan_BroIntel_FILE_HASH - Search FILE_HASH index
  *****************************************************************************/
 
 sbool Sagan_BroIntel_FILE_HASH ( char *syslog_message )
 {
 
-    int i;
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
+
+    int64_t i;
 
-    for ( i = 0; i < counters->brointel_file_hash_count; i++)
+    if ( store == NULL )
         {
+            return(false);
+        }
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_File_Hash[i].hash, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found file hash %s.", __FILE__, __LINE__, Sagan_BroIntel_Intel_File_Hash[i].hash);
-                        }
+    i = BroIntel_Token_Search(syslog_message, BroIntel_Class_Hash, &store->file_hash_index, BroIntel_Match_File_Hash, sizeof(store->file_hash[0].hash) - 1);
 
-                    return(true);
+    if ( i == -1 )
+        {
+            i = BroIntel_Fallback_Search(syslog_message, &store->file_hash_index, (const char *)store->file_hash, sizeof(_Sagan_BroIntel_Intel_File_Hash));
+        }
+
+    if ( i != -1 )
+        {
+            if ( debug->debugbrointel )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Found file hash %s.", __FILE__, __LINE__, store->file_hash[i].hash);
                 }
 
+            return(true);
         }
 
     return(false);
@@ -690,27 +1288,31 @@ sbool Sagan_BroIntel_FILE_HASH ( char *syslog_message )
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_URL - Search URL array
+ * Sagan_BroIntel_URL - Search URL automaton
  *****************************************************************************/
 
 sbool Sagan_BroIntel_URL ( char *syslog_message )
 {
 
-    int i;
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
 
-    for ( i = 0; i < counters->brointel_url_count; i++)
+    int64_t i;
+
+    if ( store == NULL )
         {
+            return(false);
+        }
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_URL[i].url, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found URL \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_URL[i].url);
-                        }
+    i = Aho_Corasick_Search(&store->url_ac, syslog_message, NULL);
 
-                    return(true);
+    if ( i != -1 )
+        {
+            if ( debug->debugbrointel )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Found URL \"%s\".", __FILE__, __LINE__, store->url[i].url);
                 }
 
+            return(true);
         }
 
     return(false);
@@ -723,16 +1325,23 @@ sbool Sagan_BroIntel_URL ( char *syslog_message )
 sbool Sagan_BroIntel_SOFTWARE ( char *syslog_message )
 {
 
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
+
     int i;
 
-    for ( i = 0; i < counters->brointel_software_count; i++)
+    if ( store == NULL )
+        {
+            return(false);
+        }
+
+    for ( i = 0; i < store->software_count; i++)
         {
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Software[i].software, false) )
+            if ( Sagan_stristr(syslog_message, store->software[i].software, false) )
                 {
                     if ( debug->debugbrointel )
                         {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found software \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_Software[i].software);
+                            Sagan_Log(DEBUG, "[%s, line %d] Found software \"%s\".", __FILE__, __LINE__, store->software[i].software);
                         }
 
                     return(true);
@@ -744,108 +1353,144 @@ sbool Sagan_BroIntel_SOFTWARE ( char *syslog_message )
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_EMAIL - Search EMAIL array
+ * Sagan_BroIntel_EMAIL - Search EMAIL index
  *****************************************************************************/
 
 sbool Sagan_BroIntel_EMAIL ( char *syslog_message )
 {
 
-    int i;
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
+
+    int64_t i;
 
-    for ( i = 0; i < counters->brointel_email_count; i++)
+    if ( store == NULL )
         {
+            return(false);
+        }
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Email[i].email, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found e-mail address \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_Email[i].email);
-                        }
+    i = BroIntel_Token_Search(syslog_message, BroIntel_Class_Email, &store->email_index, BroIntel_Match_Email, sizeof(store->email[0].email) - 1);
 
-                    return(true);
+    if ( i == -1 )
+        {
+            i = BroIntel_Fallback_Search(syslog_message, &store->email_index, (const char *)store->email, sizeof(_Sagan_BroIntel_Intel_Email));
+        }
+
+    if ( i != -1 )
+        {
+            if ( debug->debugbrointel )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Found e-mail address \"%s\".", __FILE__, __LINE__, store->email[i].email);
                 }
 
+            return(true);
         }
 
     return(false);
 }
 
 /*****************************************************************************
- * Sagan_BroIntel_USER_NAME - Search USER_NAME array
+ * Sagan_BroIntel_USER_NAME - Search USER_NAME index
  ****************************************************************************/
 
 sbool Sagan_BroIntel_USER_NAME ( char *syslog_message )
 {
 
-    int i;
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
 
-    for ( i = 0; i < counters->brointel_user_name_count; i++)
+    int64_t i;
+
+    if ( store == NULL )
         {
+            return(false);
+        }
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_User_Name[i].username, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found the username \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_User_Name[i].username);
-                        }
+    i = BroIntel_Token_Search(syslog_message, BroIntel_Class_User_Name, &store->user_name_index, BroIntel_Match_User_Name, sizeof(store->user_name[0].username) - 1);
 
-                    return(true);
+    if ( i == -1 )
+        {
+            i = BroIntel_Fallback_Search(syslog_message, &store->user_name_index, (const char *)store->user_name, sizeof(_Sagan_BroIntel_Intel_User_Name));
+        }
+
+    if ( i != -1 )
+        {
+            if ( debug->debugbrointel )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Found the username \"%s\".", __FILE__, __LINE__, store->user_name[i].username);
                 }
 
+            return(true);
         }
 
     return(false);
 }
 
 /****************************************************************************
- * Sagan_BroIntel_FILE_NAME - Search FILE_NAME array
+ * Sagan_BroIntel_FILE_NAME - Search FILE_NAME index
  ****************************************************************************/
 
 sbool Sagan_BroIntel_FILE_NAME ( char *syslog_message )
 {
 
-    int i;
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
+
+    int64_t i;
 
-    for ( i = 0; i < counters->brointel_file_name_count; i++)
+    if ( store == NULL )
         {
+            return(false);
+        }
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_File_Name[i].file_name, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found the file name \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_File_Name[i].file_name);
-                        }
+    i = BroIntel_Token_Search(syslog_message, BroIntel_Class_File_Name, &store->file_name_index, BroIntel_Match_File_Name, sizeof(store->file_name[0].file_name) - 1);
 
-                    return(true);
+    if ( i == -1 )
+        {
+            i = BroIntel_Fallback_Search(syslog_message, &store->file_name_index, (const char *)store->file_name, sizeof(_Sagan_BroIntel_Intel_File_Name));
+        }
+
+    if ( i != -1 )
+        {
+            if ( debug->debugbrointel )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Found the file name \"%s\".", __FILE__, __LINE__, store->file_name[i].file_name);
                 }
 
+            return(true);
         }
 
     return(false);
 }
 
 /***************************************************************************
- * Sagan_BroIntel_CERT_HASH - Search CERT_HASH array
+ * Sagan_BroIntel_CERT_HASH - Search CERT_HASH index
  ***************************************************************************/
 
 sbool Sagan_BroIntel_CERT_HASH ( char *syslog_message )
 {
 
-    int i;
+    _Sagan_BroIntel_Store *store = BroIntel_Current();
 
-    for ( i = 0; i < counters->brointel_cert_hash_count; i++)
+    int64_t i;
+
+    if ( store == NULL )
         {
+            return(false);
+        }
 
-            if ( Sagan_stristr(syslog_message, Sagan_BroIntel_Intel_Cert_Hash[i].cert_hash, false) )
-                {
-                    if ( debug->debugbrointel )
-                        {
-                            Sagan_Log(DEBUG, "[%s, line %d] Found the CERT_HASH \"%s\".", __FILE__, __LINE__, Sagan_BroIntel_Intel_Cert_Hash[i].cert_hash);
-                        }
+    i = BroIntel_Token_Search(syslog_message, BroIntel_Class_Hash, &store->cert_hash_index, BroIntel_Match_Cert_Hash, sizeof(store->cert_hash[0].cert_hash) - 1);
 
-                    return(true);
+    if ( i == -1 )
+        {
+            i = BroIntel_Fallback_Search(syslog_message, &store->cert_hash_index, (const char *)store->cert_hash, sizeof(_Sagan_BroIntel_Intel_Cert_Hash));
+        }
+
+    if ( i != -1 )
+        {
+            if ( debug->debugbrointel )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Found the CERT_HASH \"%s\".", __FILE__, __LINE__, store->cert_hash[i].cert_hash);
                 }
 
+            return(true);
         }
 
     return(false);
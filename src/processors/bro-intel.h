@@ -96,7 +96,10 @@ struct _Sagan_BroIntel_Intel_Cert_Hash
 
 
 void Sagan_BroIntel_Init(void);
+void Sagan_BroIntel_Free(void);
 void Sagan_BroIntel_Load_File(void);
+struct _Sagan_Intel_DB_Writer;		/* intel-db.h */
+void Sagan_BroIntel_Save( struct _Sagan_Intel_DB_Writer * );
 
 sbool  Sagan_BroIntel_IPADDR ( unsigned char *, char *ipaddr );
 sbool  Sagan_BroIntel_IPADDR_All ( char *, _Sagan_Lookup_Cache_Entry *, size_t);
@@ -35,18 +35,27 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
+#include <stdbool.h>
+#include <errno.h>
 #include <sys/time.h>
+#include <sched.h>
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "rules.h"
 #include "sagan-config.h"
 #include "send-alert.h"
+#include "util-rcu.h"
+#include "util-time.h"
 
+#include "processors/engine.h"
 #include "processors/dynamic-rules.h"
 
 struct _SaganConfig *config;
-struct _Rule_Struct *rulestruct;
 struct _Rules_Loaded *rules_loaded;
 struct _SaganCounters *counters;
 
@@ -55,6 +64,157 @@ sbool reload_rules;
 pthread_mutex_t SaganRulesLoadedMutex;
 pthread_mutex_t CounterDynamicGenericMutex=PTHREAD_MUTEX_INITIALIZER;
 
+/* Sampled log lines waiting on the dynamic rule thread */
+
+pthread_mutex_t SaganDynamicQueueMutex=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t SaganDynamicQueueCond=PTHREAD_COND_INITIALIZER;
+
+struct _Sagan_Proc_Syslog *SaganDynamicQueue = NULL;
+int dynamic_queue_head = 0;
+int dynamic_queue_count = 0;
+sbool dynamic_thread_started = false;
+
+/***************************************************************************
+ * Sagan_Dynamic_Init - Starts the thread that evaluates dynamic rules.
+ * Safe to call again (after a reload turns "dynamic_load" on).
+ ***************************************************************************/
+
+void Sagan_Dynamic_Init ( void )
+{
+
+    pthread_t dynamic_thread;
+    pthread_attr_t dynamic_thread_attr;
+
+    int rc = 0;
+
+    if ( dynamic_thread_started == true )
+        {
+            return;
+        }
+
+    SaganDynamicQueue = malloc(sizeof(struct _Sagan_Proc_Syslog) * DYNAMIC_SAMPLE_QUEUE);
+
+    if ( SaganDynamicQueue == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganDynamicQueue. Abort!", __FILE__, __LINE__);
+        }
+
+    pthread_attr_init(&dynamic_thread_attr);
+    pthread_attr_setdetachstate(&dynamic_thread_attr,  PTHREAD_CREATE_DETACHED);
+
+    rc = pthread_create( &dynamic_thread, &dynamic_thread_attr, (void *)Sagan_Dynamic_Thread, NULL );
+
+    if ( rc != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Error creating dynamic rule thread [error: %d].", __FILE__, __LINE__, rc);
+        }
+
+    dynamic_thread_started = true;
+
+}
+
+/***************************************************************************
+ * Sagan_Dynamic_Sample - Called by the reader for every "sample-rate"-th
+ * log line.  The line is copied for the dynamic rule thread.  If that
+ * thread is behind,  the sample is dropped rather than making anyone wait.
+ ***************************************************************************/
+
+void Sagan_Dynamic_Sample ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
+{
+
+    pthread_mutex_lock(&SaganDynamicQueueMutex);
+
+    if ( SaganDynamicQueue == NULL || dynamic_queue_count >= DYNAMIC_SAMPLE_QUEUE )
+        {
+            counters->dynamic_sample_drop++;
+            pthread_mutex_unlock(&SaganDynamicQueueMutex);
+            return;
+        }
+
+    memcpy(&SaganDynamicQueue[(dynamic_queue_head + dynamic_queue_count) % DYNAMIC_SAMPLE_QUEUE], SaganProcSyslog_LOCAL, sizeof(_Sagan_Proc_Syslog));
+
+    dynamic_queue_count++;
+    counters->dynamic_sampled++;
+
+    pthread_cond_signal(&SaganDynamicQueueCond);
+    pthread_mutex_unlock(&SaganDynamicQueueMutex);
+
+}
+
+/***************************************************************************
+ * Sagan_Dynamic_Thread - Runs sampled log lines against the dynamic rules
+ * only.  The processor threads skip dynamic rules entirely,  so a load
+ * (or just evaluating them) never adds to their latency.  This thread
+ * runs at idle priority where the OS supports it,  so nothing a processor
+ * thread does may wait on it (see Rules_Reclaim()).
+ ***************************************************************************/
+
+void Sagan_Dynamic_Thread ( void )
+{
+
+    struct _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL = NULL;
+
+#ifdef SCHED_IDLE
+
+    struct sched_param param;
+
+#endif
+
+    (void)SetThreadName("SaganDynamic");
+
+#ifdef SCHED_IDLE
+
+    memset(&param, 0, sizeof(param));
+
+    if ( pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Couldn't lower the priority of the dynamic rule thread.", __FILE__, __LINE__);
+        }
+
+#endif
+
+    Sagan_RCU_Register();
+
+    SaganProcSyslog_LOCAL = malloc(sizeof(struct _Sagan_Proc_Syslog));
+
+    if ( SaganProcSyslog_LOCAL == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganProcSyslog_LOCAL. Abort!", __FILE__, __LINE__);
+        }
+
+    for (;;)
+        {
+
+            Sagan_RCU_Offline();
+
+            /* Free the rules replaced by our last load.  The processor
+             * threads never wait on us this way,  we only wait on them */
+
+            Rules_Reclaim();
+
+            pthread_mutex_lock(&SaganDynamicQueueMutex);
+
+            while ( dynamic_queue_count == 0 ) pthread_cond_wait(&SaganDynamicQueueCond, &SaganDynamicQueueMutex);
+
+            memcpy(SaganProcSyslog_LOCAL, &SaganDynamicQueue[dynamic_queue_head], sizeof(_Sagan_Proc_Syslog));
+
+            dynamic_queue_head = ( dynamic_queue_head + 1 ) % DYNAMIC_SAMPLE_QUEUE;
+            dynamic_queue_count--;
+
+            pthread_mutex_unlock(&SaganDynamicQueueMutex);
+
+            Sagan_RCU_Online();
+
+            Rules_Use(NULL);
+
+            (void)Sagan_Engine(SaganProcSyslog_LOCAL, true);
+
+            __atomic_add_fetch(&counters->dynamic_evaluated, 1, __ATOMIC_RELAXED);
+
+        }
+
+}
+
 int Sagan_Dynamic_Rules ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int rule_position, _Sagan_Processor_Info *processor_info_engine, char *ip_src, char *ip_dst )
 {
 
@@ -113,7 +273,7 @@ int Sagan_Dynamic_Rules ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int rule_po
 
             Sagan_Log(NORMAL, "Detected dynamic signature '%s'. Dynamically loading '%s'.", rulestruct[rule_position].s_msg, rulestruct[rule_position].dynamic_ruleset);
 
-            gettimeofday(&tp, 0);
+            Sagan_Clock_Timeval(&tp);
 
             /* Process the alert _before_ loading rule set! Otherwise, mem will mismatch */
             Send_Alert(SaganProcSyslog_LOCAL,
@@ -129,12 +289,13 @@ int Sagan_Dynamic_Rules ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int rule_po
                        config->sagan_port,
                        rule_position, tp );
 
-            /* Lock rules so other threads don't try to use it while we alter/load new rules */
+            /* The other workers keep using the current rules while the
+             * new version is built.  The mutex only keeps loads apart */
 
             pthread_mutex_lock(&SaganRulesLoadedMutex);
             reload_rules = 1;
 
-            Load_Rules(rulestruct[rule_position].dynamic_ruleset);
+            Rules_Load_Add(rulestruct[rule_position].dynamic_ruleset);
 
             reload_rules = 0;
             pthread_mutex_unlock(&SaganRulesLoadedMutex);
@@ -162,7 +323,7 @@ int Sagan_Dynamic_Rules ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, int rule_po
             Sagan_Log(NORMAL, "Detected dynamic signature '%s'. Sagan would automatically load '%s' but the 'dynamic_load' processor is set to 'alert'.", rulestruct[rule_position].s_msg, rulestruct[rule_position].dynamic_ruleset);
 
 
-            gettimeofday(&tp, 0);
+            Sagan_Clock_Timeval(&tp);
 
             Send_Alert(SaganProcSyslog_LOCAL,
                        NULL,
@@ -23,3 +23,6 @@
 #endif
 
 int Sagan_Dynamic_Rules ( _Sagan_Proc_Syslog *, int, _Sagan_Processor_Info *, char *, char * );
+void Sagan_Dynamic_Init ( void );
+void Sagan_Dynamic_Sample ( _Sagan_Proc_Syslog * );
+void Sagan_Dynamic_Thread ( void );
@@ -47,14 +47,18 @@
 #include "xbit-mmap.h"
 #include "rules.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "ipc.h"
 #include "flow.h"
 #include "after.h"
 #include "threshold.h"
+#include "util-hash.h"
 
 #include "parsers/parsers.h"
 
 #include "processors/engine.h"
+#include "json-handler.h"
+#include "output-plugins/eve.h"
 #include "processors/bro-intel.h"
 #include "processors/blacklist.h"
 #include "processors/dynamic-rules.h"
@@ -72,7 +76,6 @@
 #endif
 
 struct _SaganCounters *counters;
-struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
 
@@ -88,6 +91,58 @@ void Sagan_Engine_Init ( void )
     /* Nothing to do yet */
 }
 
+/****************************************************************************
+ * Sagan_Engine_Header_Match - Checks rule "b"'s program,  facility,
+ * priority,  level and tag against the log line.  Every field the rule
+ * uses must match one of its '|' separated values.  "value" and "hash"
+ * are the log line's fields,  hashed once for all rules.
+ ****************************************************************************/
+
+static sbool Sagan_Engine_Header_Match( int b, char **value, uint32_t *hash )
+{
+
+    _Rule_Header_Match *m = NULL;
+
+    sbool found = false;
+    int f = 0;
+    int i = 0;
+
+    for ( f = 0; f < RULE_HEADER_MAX; f++ )
+        {
+
+            if ( !( rulehdr.header_mask[b] & ( 1 << f ) ) )
+                {
+                    continue;
+                }
+
+            m = &rulehdr.header[f][b];
+            found = false;
+
+            for ( i = 0; i < m->count && found == false; i++ )
+                {
+
+                    /* Wildcard "program" patterns are stored with a hash of 0 */
+
+                    if ( f == RULE_HEADER_PROGRAM && m->hash[i] == 0 )
+                        {
+                            found = Wildcard(m->value[i], value[f]);
+                        }
+
+                    else if ( m->hash[i] == hash[f] && !strcmp(m->value[i], value[f]) )
+                        {
+                            found = true;
+                        }
+                }
+
+            if ( found == false )
+                {
+                    return(false);
+                }
+        }
+
+    return(true);
+}
+
 
 int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule_flag )
 {
@@ -140,8 +195,8 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
     sbool alert_time_trigger = false;
     sbool check_flow_return = true;  /* 1 = match, 0 = no match */
 
-    char *ptmp;
-    char *tok2;
+    char *header_value[RULE_HEADER_MAX];
+    uint32_t header_hash[RULE_HEADER_MAX];
 
     char *pnormalize_selector = NULL;
 
@@ -161,7 +216,6 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
     uint32_t ip_dstport_u32 = 0;
     unsigned char ip_dst_bits[MAXIPBIT] = { 0 };
 
-    char tmpbuf[128];
     char s_msg[1024];
     char alter_content[MAX_SYSLOGMSG];
     char meta_alter_content[MAX_SYSLOGMSG];
@@ -202,6 +256,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
     sbool bluedot_hash_flag = 0;
     sbool bluedot_url_flag = 0;
     sbool bluedot_filename_flag = 0;
+    sbool bluedot_pending = false;
 
 #endif
 
@@ -219,15 +274,39 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
 
     /* Get time we received the event */
 
-    gettimeofday(&tp, 0);       /* Store event time as soon as we get it */
+    Sagan_Clock_Timeval(&tp);       /* Store event time as soon as we get it */
 
     /* Search for matches */
 
     /* First we search for 'program' and such.   This way,  we don't waste CPU
-     * time with pcre/content.  */
+     * time with pcre/content.  The log line's fields are hashed once here and
+     * compared against the rule header table (see rules.h). */
+
+    header_value[RULE_HEADER_PROGRAM] = SaganProcSyslog_LOCAL->syslog_program;
+    header_value[RULE_HEADER_FACILITY] = SaganProcSyslog_LOCAL->syslog_facility;
+    header_value[RULE_HEADER_PRIORITY] = SaganProcSyslog_LOCAL->syslog_priority;
+    header_value[RULE_HEADER_LEVEL] = SaganProcSyslog_LOCAL->syslog_level;
+    header_value[RULE_HEADER_TAG] = SaganProcSyslog_LOCAL->syslog_tag;
 
-    for(b=0; b < counters->rulecount; b++)
+    for ( z = 0; z < RULE_HEADER_MAX; z++ )
         {
+            header_hash[z] = Hash_FNV1a(header_value[z], strlen(header_value[z]));
+        }
+
+    for(b=0; b < rules_active->count; b++)
+        {
+
+#ifdef WITH_BLUEDOT
+
+            /* A log line replayed after a Bluedot lookup only needs the
+             * rule that deferred it */
+
+            if ( SaganProcSyslog_LOCAL->bluedot_deferred_rule != 0 && b != SaganProcSyslog_LOCAL->bluedot_deferred_rule - 1 )
+                {
+                    continue;
+                }
+
+#endif
 
             ip_src_flag = false;
             ip_dst_flag = false;
@@ -251,92 +330,17 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
             memset(ip_src_bits, 0, sizeof(ip_src_bits));
             memset(ip_dst_bits, 0, sizeof(ip_dst_bits));
 
-            /* Process "normal" rules.  Skip dynamic rules if it's not time to process them */
+            /* The processor threads only run "normal" rules.  Dynamic rules are
+             * run by the dynamic rule thread on sampled log lines.  A Bluedot
+             * replay already picked its rule above */
 
-            if ( rulestruct[b].type == NORMAL_RULE || ( rulestruct[b].type == DYNAMIC_RULE && dynamic_rule_flag == true ) )
+            if ( rulehdr.type[b] == ( dynamic_rule_flag == true ? DYNAMIC_RULE : NORMAL_RULE ) || SaganProcSyslog_LOCAL->bluedot_deferred_rule != 0 )
                 {
 
-                    match = false;
-
-                    if ( strcmp(rulestruct[b].s_program, "" ))
-                        {
-                            strlcpy(tmpbuf, rulestruct[b].s_program, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-                            while ( ptmp != NULL )
-                                {
-                                    if ( Wildcard(ptmp, SaganProcSyslog_LOCAL->syslog_program) == 1 )
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( strcmp(rulestruct[b].s_facility, "" ))
-                        {
-                            strlcpy(tmpbuf, rulestruct[b].s_facility, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_facility))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( strcmp(rulestruct[b].s_syspri, "" ))
-                        {
-                            strlcpy(tmpbuf, rulestruct[b].s_syspri, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_priority))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( strcmp(rulestruct[b].s_level, "" ))
-                        {
-                            strlcpy(tmpbuf, rulestruct[b].s_level, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_level))
-                                        {
-                                            match = false;
-                                        }
+                    /* Only the rule header table has been read so far.  rulestruct[b]
+                     * is left alone unless the header fields match */
 
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
-
-                    if ( strcmp(rulestruct[b].s_tag, "" ))
-                        {
-                            strlcpy(tmpbuf, rulestruct[b].s_tag, sizeof(tmpbuf));
-                            ptmp = strtok_r(tmpbuf, "|", &tok2);
-                            match = true;
-                            while ( ptmp != NULL )
-                                {
-                                    if (!strcmp(ptmp, SaganProcSyslog_LOCAL->syslog_tag))
-                                        {
-                                            match = false;
-                                        }
-
-                                    ptmp = strtok_r(NULL, "|", &tok2);
-                                }
-                        }
+                    match = Sagan_Engine_Header_Match(b, header_value, header_hash) == false;
 
                     /* If there has been a match above,  or NULL on all,  then we continue with
                      * PCRE/content search */
@@ -346,10 +350,10 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                     if ( match == false )
                         {
 
-                            if ( rulestruct[b].content_count != 0 )
+                            if ( rulehdr.content_count[b] != 0 )
                                 {
 
-                                    for(z=0; z<rulestruct[b].content_count; z++)
+                                    for(z=0; z<rulehdr.content_count[b]; z++)
                                         {
 
 
@@ -456,10 +460,10 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                              * if there is a "content",  but that has failed,  there is no point in doing the
                              * pcre or meta_content. */
 
-                            if ( rulestruct[b].pcre_count != 0 && sagan_match == rulestruct[b].content_count )
+                            if ( rulehdr.pcre_count[b] != 0 && sagan_match == rulehdr.content_count[b] )
                                 {
 
-                                    for(z=0; z<rulestruct[b].pcre_count; z++)
+                                    for(z=0; z<rulehdr.pcre_count[b]; z++)
                                         {
 
                                             rc = pcre_exec( rulestruct[b].re_pcre[z], rulestruct[b].pcre_extra[z], SaganProcSyslog_LOCAL->syslog_message, (int)strlen(SaganProcSyslog_LOCAL->syslog_message), 0, 0, ovector, PCRE_OVECCOUNT);
@@ -474,10 +478,10 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
 
                             /* Search via meta_content */
 
-                            if ( rulestruct[b].meta_content_count != 0 && sagan_match == rulestruct[b].content_count + rulestruct[b].pcre_count )
+                            if ( rulehdr.meta_content_count[b] != 0 && sagan_match == rulehdr.content_count[b] + rulehdr.pcre_count[b] )
                                 {
 
-                                    for (z=0; z<rulestruct[b].meta_content_count; z++)
+                                    for (z=0; z<rulehdr.meta_content_count[b]; z++)
                                         {
 
                                             meta_alter_num = 0;
@@ -554,14 +558,14 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
 
                     /* if you got match */
 
-                    if ( sagan_match == rulestruct[b].pcre_count + rulestruct[b].content_count + rulestruct[b].meta_content_count )
+                    if ( sagan_match == rulehdr.pcre_count[b] + rulehdr.content_count[b] + rulehdr.meta_content_count[b] )
                         {
 
                             if ( match == false )
                                 {
 
 #ifdef HAVE_LIBLOGNORM
-                                    if ( liblognorm_status == 0 && rulestruct[b].normalize == 1 )
+                                    if ( liblognorm_status == 0 && ( rulehdr.flags[b] & RULE_FLAG_NORMALIZE ) )
                                         {
                                             /* Set that normalization has been tried work isn't repeated */
 
@@ -609,7 +613,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                 }
                                         }
 
-                                    if ( liblognorm_status == 1  && rulestruct[b].normalize == 1 )
+                                    if ( liblognorm_status == 1 && ( rulehdr.flags[b] & RULE_FLAG_NORMALIZE ) )
                                         {
                                             if ( SaganNormalizeLiblognorm.ip_src[0] != '0')
                                                 {
@@ -685,14 +689,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                     /* parse_src_ip: {position} - Parse_IP build a cache table for IPs, ports, etc.  This way,
                                     we only parse the syslog string one time regardless of the rule options! */
 
-                                    if ( rulestruct[b].s_find_src_ip == 1 ||
-                                            rulestruct[b].s_find_src_ip == 1 ||
-                                            rulestruct[b].blacklist_ipaddr_all == 1 ||
-                                            rulestruct[b].s_find_proto == 1 ||
-#ifdef WITH_BLUEDOT
-                                            rulestruct[b].bluedot_ipaddr_type == 4 ||
-#endif
-                                            rulestruct[b].brointel_ipaddr_all == 1 )
+                                    if ( rulehdr.flags[b] & RULE_FLAG_PARSE_IP )
                                         {
 
                                             lookup_cache_size = Parse_IP(SaganProcSyslog_LOCAL->syslog_message, lookup_cache );
@@ -840,7 +837,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                     /* Check for flow of rule - has_flow is set as rule loading.  It 1, then
                                     the rule has some sort of flow.  It 0,  rule is set any:any/any:any */
 
-                                    if ( rulestruct[b].has_flow == 1 )
+                                    if ( rulehdr.flags[b] & RULE_FLAG_FLOW )
                                         {
 
                                             check_flow_return = Check_Flow( b, proto, ip_src_bits, ip_srcport_u32, ip_dst_bits, ip_dstport_u32);
@@ -864,7 +861,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                      * Xbit - ISSET || ISNOTSET
                                      ****************************************************************************/
 
-                                    if ( rulestruct[b].xbit_flag )
+                                    if ( rulehdr.flags[b] & RULE_FLAG_XBIT )
                                         {
 
                                             if ( rulestruct[b].xbit_condition_count )
@@ -886,7 +883,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
 
 #ifdef HAVE_LIBMAXMINDDB
 
-                                    if ( rulestruct[b].geoip2_flag )
+                                    if ( rulehdr.flags[b] & RULE_FLAG_GEOIP2 )
                                         {
 
                                             if ( ip_src_flag == true && rulestruct[b].geoip2_src_or_dst == 1 )
@@ -951,7 +948,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                      * Time based alerting
                                      ****************************************************************************/
 
-                                    if ( rulestruct[b].alert_time_flag )
+                                    if ( rulehdr.flags[b] & RULE_FLAG_ALERT_TIME )
                                         {
 
                                             alert_time_trigger = false;
@@ -966,7 +963,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                      * Blacklist
                                      ****************************************************************************/
 
-                                    if ( rulestruct[b].blacklist_flag )
+                                    if ( rulehdr.flags[b] & RULE_FLAG_BLACKLIST )
                                         {
 
                                             blacklist_results = false;
@@ -999,6 +996,9 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
 
                                     if ( config->bluedot_flag )
                                         {
+
+                                            bluedot_pending = false;
+
                                             if ( rulestruct[b].bluedot_ipaddr_type )
                                                 {
 
@@ -1009,12 +1009,24 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                     if ( rulestruct[b].bluedot_ipaddr_type == 1 && ip_src_flag )
                                                         {
                                                             bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, ip_src_bits);
+
+                                                            if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                                                                {
+                                                                    bluedot_pending = true;
+                                                                }
+
                                                             bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                         }
 
                                                     if ( rulestruct[b].bluedot_ipaddr_type == 2 && ip_dst_flag )
                                                         {
                                                             bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, ip_dst_bits);
+
+                                                            if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                                                                {
+                                                                    bluedot_pending = true;
+                                                                }
+
                                                             bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                         }
 
@@ -1022,6 +1034,12 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                         {
 
                                                             bluedot_results = Sagan_Bluedot_Lookup(ip_src, BLUEDOT_LOOKUP_IP, b, ip_src_bits );
+
+                                                            if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                                                                {
+                                                                    bluedot_pending = true;
+                                                                }
+
                                                             bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
 
                                                             /* If the source isn't found,  then check the dst */
@@ -1029,6 +1047,12 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                             if ( bluedot_ip_flag != 0 )
                                                                 {
                                                                     bluedot_results = Sagan_Bluedot_Lookup(ip_dst, BLUEDOT_LOOKUP_IP, b, ip_dst_bits);
+
+                                                                    if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                                                                        {
+                                                                            bluedot_pending = true;
+                                                                        }
+
                                                                     bluedot_ip_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_IP);
                                                                 }
 
@@ -1037,7 +1061,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                     if ( lookup_cache_size > 0 && rulestruct[b].bluedot_ipaddr_type == 4 )
                                                         {
 
-                                                            bluedot_ip_flag = Sagan_Bluedot_IP_Lookup_All(SaganProcSyslog_LOCAL->syslog_message, b, lookup_cache, lookup_cache_size );
+                                                            bluedot_ip_flag = Sagan_Bluedot_IP_Lookup_All(SaganProcSyslog_LOCAL->syslog_message, b, lookup_cache, lookup_cache_size, &bluedot_pending );
 
                                                         }
 
@@ -1052,6 +1076,12 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                         {
 
                                                             bluedot_results = Sagan_Bluedot_Lookup( md5_hash, BLUEDOT_LOOKUP_HASH, b, NULL);
+
+                                                            if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                                                                {
+                                                                    bluedot_pending = true;
+                                                                }
+
                                                             bluedot_hash_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_HASH);
 
                                                         }
@@ -1060,6 +1090,12 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                         {
 
                                                             bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, NULL);
+
+                                                            if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                                                                {
+                                                                    bluedot_pending = true;
+                                                                }
+
                                                             bluedot_hash_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_HASH);
 
                                                         }
@@ -1068,6 +1104,12 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                         {
 
                                                             bluedot_results = Sagan_Bluedot_Lookup( sha256_hash, BLUEDOT_LOOKUP_HASH, b, NULL);
+
+                                                            if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                                                                {
+                                                                    bluedot_pending = true;
+                                                                }
+
                                                             bluedot_hash_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_HASH);
 
                                                         }
@@ -1078,6 +1120,12 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                 {
 
                                                     bluedot_results = Sagan_Bluedot_Lookup( normalize_http_uri, BLUEDOT_LOOKUP_URL, b, NULL);
+
+                                                    if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                                                        {
+                                                            bluedot_pending = true;
+                                                        }
+
                                                     bluedot_url_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_URL);
 
                                                 }
@@ -1086,6 +1134,12 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                 {
 
                                                     bluedot_results = Sagan_Bluedot_Lookup( normalize_filename, BLUEDOT_LOOKUP_FILENAME, b, NULL);
+
+                                                    if ( bluedot_results == BLUEDOT_LOOKUP_PENDING )
+                                                        {
+                                                            bluedot_pending = true;
+                                                        }
+
                                                     bluedot_filename_flag = Sagan_Bluedot_Cat_Compare( bluedot_results, b, BLUEDOT_LOOKUP_FILENAME);
 
                                                 }
@@ -1095,6 +1149,22 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
 
                                             Sagan_Bluedot_Check_Cache_Time();
 
+                                            /* With "pending-policy: defer" the log line is run against
+                                             * this rule again once the lookups are done.  Until then
+                                             * (and on the replay) pending intel counts as no intel */
+
+                                            if ( bluedot_pending == true && config->bluedot_pending_policy == BLUEDOT_PENDING_DEFER &&
+                                                    SaganProcSyslog_LOCAL->bluedot_deferred_rule == 0 )
+                                                {
+                                                    if ( Sagan_Bluedot_Defer(SaganProcSyslog_LOCAL, b) == true )
+                                                        {
+                                                            bluedot_ip_flag = false;
+                                                            bluedot_hash_flag = false;
+                                                            bluedot_url_flag = false;
+                                                            bluedot_filename_flag = false;
+                                                        }
+                                                }
+
 
                                         }
 #endif
@@ -1104,7 +1174,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                     * Bro Intel
                                     ****************************************************************************/
 
-                                    if ( rulestruct[b].brointel_flag )
+                                    if ( rulehdr.flags[b] & RULE_FLAG_BROINTEL )
                                         {
 
                                             brointel_results = false;
@@ -1333,6 +1403,7 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
                                                                                                                                     processor_info_engine->processor_priority      =       SaganProcSyslog_LOCAL->syslog_level;
                                                                                                                                     processor_info_engine->processor_pri           =       rulestruct[b].s_pri;
                                                                                                                                     processor_info_engine->processor_class         =       rulestruct[b].s_classtype;
+                                                                                                                                    processor_info_engine->processor_class_id      =       rulestruct[b].class_id;
                                                                                                                                     processor_info_engine->processor_tag           =       SaganProcSyslog_LOCAL->syslog_tag;
                                                                                                                                     processor_info_engine->processor_rev           =       rulestruct[b].s_rev;
                                                                                                                                     processor_info_engine_dst_port                 =       ip_dstport_u32;
@@ -1412,7 +1483,10 @@ int Sagan_Engine ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, sbool dynamic_rule
         } /* End for for loop */
 
 
-    if ( config->eve_flag && config->eve_logs )
+    /* Replayed log lines were already logged the first time through,  and
+     * lines sampled for the dynamic rule thread by a processor thread */
+
+    if ( config->eve_flag && config->eve_logs && SaganProcSyslog_LOCAL->bluedot_deferred_rule == 0 && dynamic_rule_flag == false )
         {
             Log_JSON(SaganProcSyslog_LOCAL, tp, json_normalize);
         }
@@ -45,9 +45,12 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "lockfile.h"
+#include "util-dns.h"
 
 #include "processors/perfmon.h"
+#include "processors/bluedot.h"
 
 struct _SaganConfig *config;
 struct _SaganCounters *counters;
@@ -67,13 +70,7 @@ void Sagan_Perfmonitor_Handler( void )
     unsigned long total=0;
     unsigned long seconds=0;
 
-    char curtime_utime[64] = { 0 };
-    time_t t;
-    struct tm *now;
-
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(curtime_utime, sizeof(curtime_utime), "%s",  now);
+    uint64_t curtime_utime = 0;
 
     uint64_t last_sagantotal = 0;
     uint64_t last_saganfound = 0;
@@ -91,12 +88,20 @@ void Sagan_Perfmonitor_Handler( void )
 
 #ifdef WITH_BLUEDOT
     uint64_t last_bluedot_ip_cache_hit = 0;
+    uint64_t last_bluedot_ip_cache_miss = 0;
+    uint64_t last_bluedot_ip_cache_evict = 0;
     uint64_t last_bluedot_ip_positive_hit = 0;
     uint64_t last_bluedot_hash_cache_hit = 0;
+    uint64_t last_bluedot_hash_cache_miss = 0;
+    uint64_t last_bluedot_hash_cache_evict = 0;
     uint64_t last_bluedot_hash_positive_hit = 0;
     uint64_t last_bluedot_url_cache_hit = 0;
+    uint64_t last_bluedot_url_cache_miss = 0;
+    uint64_t last_bluedot_url_cache_evict = 0;
     uint64_t last_bluedot_url_positive_hit = 0;
     uint64_t last_bluedot_filename_cache_hit = 0;
+    uint64_t last_bluedot_filename_cache_miss = 0;
+    uint64_t last_bluedot_filename_cache_evict = 0;
     uint64_t last_bluedot_filename_positive_hit = 0;
     uint64_t last_bluedot_error_count = 0;
 
@@ -121,16 +126,14 @@ void Sagan_Perfmonitor_Handler( void )
 
             sleep(config->perfmonitor_time);
 
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(curtime_utime, sizeof(curtime_utime), "%s",  now);
-            seconds = atol(curtime_utime) - atol(config->sagan_startutime);
+            curtime_utime = Sagan_Clock_Epoch();
+            seconds = curtime_utime - config->sagan_startutime;
 
 
             if ( config->perfmonitor_flag )
                 {
 
-                    fprintf(config->perfmonitor_file_stream, "%s,", curtime_utime),
+                    fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", curtime_utime),
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->sagantotal - last_sagantotal);
                     last_sagantotal = counters->sagantotal;
@@ -214,6 +217,11 @@ void Sagan_Perfmonitor_Handler( void )
                     fprintf(config->perfmonitor_file_stream, "0,0,");
 #endif
 
+                    if ( config->syslog_src_lookup )
+                        {
+                            Sagan_DNS_Cache_Stats();
+                        }
+
                     fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->dns_cache_count);
 
                     fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->dns_miss_count - last_dns_miss_count);
@@ -226,12 +234,20 @@ void Sagan_Perfmonitor_Handler( void )
                     if ( config->bluedot_flag )
                         {
 
+                            Sagan_Bluedot_Cache_Stats();
+
                             /* IP Reputation */
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_cache_count);
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_cache_hit - last_bluedot_ip_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_hit;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_cache_miss - last_bluedot_ip_cache_miss);
+                            last_bluedot_ip_cache_miss = counters->bluedot_ip_cache_miss;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_cache_evict - last_bluedot_ip_cache_evict);
+                            last_bluedot_ip_cache_evict = counters->bluedot_ip_cache_evict;
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_ip_positive_hit - last_bluedot_ip_positive_hit);
                             last_bluedot_ip_positive_hit = counters->bluedot_ip_positive_hit;
@@ -244,20 +260,32 @@ void Sagan_Perfmonitor_Handler( void )
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_cache_count);
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_cache_hit - last_bluedot_hash_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            last_bluedot_hash_cache_hit = counters->bluedot_hash_cache_hit;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_cache_miss - last_bluedot_hash_cache_miss);
+                            last_bluedot_hash_cache_miss = counters->bluedot_hash_cache_miss;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_cache_evict - last_bluedot_hash_cache_evict);
+                            last_bluedot_hash_cache_evict = counters->bluedot_hash_cache_evict;
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_hash_positive_hit - last_bluedot_hash_positive_hit);
                             last_bluedot_hash_positive_hit = counters->bluedot_hash_positive_hit;
 
                             bluedot_hash_total = counters->bluedot_hash_total / seconds;
-                            fprintf(config->perfmonitor_file_stream, "%lu,", total);
+                            fprintf(config->perfmonitor_file_stream, "%lu,", bluedot_hash_total);
 
                             /* URL */
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_cache_count);
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_cache_hit - last_bluedot_url_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            last_bluedot_url_cache_hit = counters->bluedot_url_cache_hit;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_cache_miss - last_bluedot_url_cache_miss);
+                            last_bluedot_url_cache_miss = counters->bluedot_url_cache_miss;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_cache_evict - last_bluedot_url_cache_evict);
+                            last_bluedot_url_cache_evict = counters->bluedot_url_cache_evict;
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_url_positive_hit - last_bluedot_url_positive_hit);
                             last_bluedot_url_positive_hit = counters->bluedot_url_positive_hit;
@@ -270,7 +298,13 @@ void Sagan_Perfmonitor_Handler( void )
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_cache_count);
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_cache_hit - last_bluedot_filename_cache_hit);
-                            last_bluedot_ip_cache_hit = counters->bluedot_ip_cache_count;
+                            last_bluedot_filename_cache_hit = counters->bluedot_filename_cache_hit;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_cache_miss - last_bluedot_filename_cache_miss);
+                            last_bluedot_filename_cache_miss = counters->bluedot_filename_cache_miss;
+
+                            fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_cache_evict - last_bluedot_filename_cache_evict);
+                            last_bluedot_filename_cache_evict = counters->bluedot_filename_cache_evict;
 
                             fprintf(config->perfmonitor_file_stream, "%" PRIu64 ",", counters->bluedot_filename_positive_hit - last_bluedot_filename_positive_hit);
                             last_bluedot_filename_positive_hit = counters->bluedot_filename_positive_hit;
@@ -290,14 +324,14 @@ void Sagan_Perfmonitor_Handler( void )
                     else
                         {
 
-                            fprintf(config->perfmonitor_file_stream, "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
+                            fprintf(config->perfmonitor_file_stream, "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
                         }
 
 #endif
 
 #ifndef WITH_BLUEDOT
 
-                    fprintf(config->perfmonitor_file_stream, "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
+                    fprintf(config->perfmonitor_file_stream, "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
 #endif
 
                     fprintf(config->perfmonitor_file_stream, "\n");
@@ -315,12 +349,10 @@ void Sagan_Perfmonitor_Close(void)
 
     char curtime[64] = { 0 };
 
-    time_t t;
-    struct tm *now;
+    struct tm now;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  now);
+    Sagan_Clock_LocalTime(&now);
+    strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  &now);
 
     fprintf(config->perfmonitor_file_stream, "################################ Perfmon end: pid=%d at=%s ###################################\n", getpid(), curtime);
 
@@ -337,12 +369,10 @@ void Sagan_Perfmonitor_Open(void)
 {
 
     char curtime[64] = { 0 };
-    time_t t;
-    struct tm *now;
+    struct tm now;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  now);
+    Sagan_Clock_LocalTime(&now);
+    strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  &now);
 
     if (( config->perfmonitor_file_stream = fopen(config->perfmonitor_file_name, "a" )) == NULL )
         {
@@ -351,7 +381,7 @@ void Sagan_Perfmonitor_Open(void)
         }
 
     fprintf(config->perfmonitor_file_stream, "################################ Perfmon start: pid=%d at=%s ###################################\n", getpid(), curtime);
-    fprintf(config->perfmonitor_file_stream, "# engine.utime,engine.total,engine.sig_match.total,engine.alerts.total,engine.after.total,engine.threshold.total, engine.drop.total,engine.ignored.total,engine.eps,geoip2.lookup.total,geoip2.hits,geoip2.misses,processor.drop.total,processor.blacklist.hits,processor.tracker.total,processor.tracker.down,output.drop.total,processor.esmtp.success,processor.esmtp.failed,dns.total,dns.miss,processor.bluedot_ip_cache_count,processor.bluedot_ip_cache_hit,processor.bluedot_ip_positive_hit,processor.bluedot_ip_qps,processor.bluedot_hash_cache_count,processor.bluedot_hash_cache_hit,processor.bluedot_hash_positive_hit,processor.bluedot_hash_qps,processor.bluedot_url_cache_count,processor.bluedot_url_cache_hit,processor.bluedot_url_positive_hit,processor.bluedot_url_qps,processor.bluedot_filename_cache_count,processor.bluedot_filename_cache_hit,processor.bluedot_filename_positive_hit,processor.bluedot_filename_qps,processor.bluedot_error_count,processor.bluedot_total_qps\n");
+    fprintf(config->perfmonitor_file_stream, "# engine.utime,engine.total,engine.sig_match.total,engine.alerts.total,engine.after.total,engine.threshold.total, engine.drop.total,engine.ignored.total,engine.eps,geoip2.lookup.total,geoip2.hits,geoip2.misses,processor.drop.total,processor.blacklist.hits,processor.tracker.total,processor.tracker.down,output.drop.total,processor.esmtp.success,processor.esmtp.failed,dns.total,dns.miss,processor.bluedot_ip_cache_count,processor.bluedot_ip_cache_hit,processor.bluedot_ip_cache_miss,processor.bluedot_ip_cache_evict,processor.bluedot_ip_positive_hit,processor.bluedot_ip_qps,processor.bluedot_hash_cache_count,processor.bluedot_hash_cache_hit,processor.bluedot_hash_cache_miss,processor.bluedot_hash_cache_evict,processor.bluedot_hash_positive_hit,processor.bluedot_hash_qps,processor.bluedot_url_cache_count,processor.bluedot_url_cache_hit,processor.bluedot_url_cache_miss,processor.bluedot_url_cache_evict,processor.bluedot_url_positive_hit,processor.bluedot_url_qps,processor.bluedot_filename_cache_count,processor.bluedot_filename_cache_hit,processor.bluedot_filename_cache_miss,processor.bluedot_filename_cache_evict,processor.bluedot_filename_positive_hit,processor.bluedot_filename_qps,processor.bluedot_error_count,processor.bluedot_total_qps\n");
     fflush(config->perfmonitor_file_stream);
 
 }
@@ -40,6 +40,7 @@
 #include <errno.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <pcre.h>
 
 #ifdef HAVE_SYS_PRCTL_H
 #include <sys/prctl.h>
@@ -50,6 +51,9 @@
 #include "sagan-config.h"
 #include "send-alert.h"
 #include "util-time.h"
+#include "classifications.h"
+#include "rules.h"
+#include "util-rcu.h"
 
 #include "processors/track-clients.h"
 
@@ -72,17 +76,11 @@ struct _SaganConfig *config;
 void Track_Clients ( char *host )
 {
 
-    char utime_tmp[20] = { 0 };
-    time_t t;
-    struct tm *now;
     int i;
     uint64_t utime_u64;
     unsigned char hostbits[MAXIPBIT] = { 0 };
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(utime_tmp, sizeof(utime_tmp), "%s",  now);
-    utime_u64 = atol(utime_tmp);
+    utime_u64 = Sagan_Clock_Epoch();
     int expired_time = config->pp_sagan_track_clients * 60;
 
     IP2Bit(host, hostbits);
@@ -164,6 +162,7 @@ void Track_Clients_Thread_Init ( void )
     processor_info_track_client->processor_priority     =       PROCESSOR_PRIORITY;
     processor_info_track_client->processor_pri          =       PROCESSOR_PRI;
     processor_info_track_client->processor_class        =       PROCESSOR_CLASS;
+    processor_info_track_client->processor_class_id     =       -1;		/* Per rule version,  see Track_Clients_Thread() */
     processor_info_track_client->processor_tag          =       PROCESSOR_TAG;
     processor_info_track_client->processor_rev          =       PROCESSOR_REV;
 
@@ -177,6 +176,8 @@ void Track_Clients_Thread_Init ( void )
 void Track_Clients_Thread ( void )
 {
 
+    Sagan_RCU_Register();
+
     for(;;)
         {
 
@@ -189,18 +190,11 @@ void Track_Clients_Thread ( void )
 
             const char *tmp_ip = NULL;
 
-            char utime_tmp[20] = { 0 };
-            time_t t;
-            struct tm *now;
-
             uint64_t utime_u32;
 
             struct timeval tp;
 
-            t = time(NULL);
-            now=localtime(&t);
-            strftime(utime_tmp, sizeof(utime_tmp), "%s",  now);
-            utime_u32 = atol(utime_tmp);
+            utime_u32 = Sagan_Clock_Epoch();
 
             int expired_time = config->pp_sagan_track_clients * 60;
 
@@ -213,6 +207,14 @@ void Track_Clients_Thread ( void )
                     Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for SaganProcSyslog_LOCAL. Abort!", __FILE__, __LINE__);
                 }
 
+            /* Alerts use the published rule version's classifications
+             * and gen-msg map.  It can be replaced between passes */
+
+            Sagan_RCU_Online();
+            Rules_Use(NULL);
+
+            processor_info_track_client->processor_class_id = Classtype_Find(PROCESSOR_CLASS);
+
             /*********************************/
             /* Look through "known" system   */
             /*********************************/
@@ -270,7 +272,7 @@ void Track_Clients_Thread ( void )
 
                                     alertid=101;		/* See gen-msg.map */
 
-                                    gettimeofday(&tp, 0);
+                                    Sagan_Clock_Timeval(&tp);
 
                                     /* Send alert to output plugins */
 
@@ -336,7 +338,7 @@ void Track_Clients_Thread ( void )
 
                                     alertid=100;	/* See gen-msg.map  */
 
-                                    gettimeofday(&tp, 0);
+                                    Sagan_Clock_Timeval(&tp);
 
 
                                     /* Send alert to output plugins */
@@ -360,6 +362,8 @@ void Track_Clients_Thread ( void )
 
                 }  /* End for 'for' loop */
             free(SaganProcSyslog_LOCAL);
+
+            Sagan_RCU_Offline();
             sleep(60);
 
         } /* End Ifinite Loop */
@@ -46,7 +46,6 @@ struct _SaganDebug *debug;
 struct _SaganConfig *config;
 
 struct _Ref_Struct *refstruct;
-struct _Rule_Struct *rulestruct;
 
 void Load_Reference( const char *ruleset )
 {
@@ -129,20 +128,15 @@ void Load_Reference( const char *ruleset )
 }
 
 
-/****************************************************************************/
-/* This simple looks up references and returns a string with them formatted */
-/* properly.  It gets passed the location of the rule in memory (based on   */
-/* the rulecount.  This is used for sagan-alert.c and sagan-esmtp.c         */
-/****************************************************************************/
+/****************************************************************************
+ * Reference_Render - Formats a rule's references once,  when the rule is
+ * loaded,  in both the "alert" ([Xref => url]) and the "parsable"
+ * (Reference:url) forms.  A malformed reference leaves both empty.
+ ****************************************************************************/
 
-// 0 == alert
-// 1 == parsable.
-
-void Reference_Lookup( int rulemem, int type, char *str, size_t size )
+void Reference_Render( int rulemem )
 {
 
-    char reftmp[256] = { 0 };
-
     int i=0;
     int b=0;
 
@@ -155,9 +149,22 @@ void Reference_Lookup( int rulemem, int type, char *str, size_t size )
     char refinfo[512];
     char refinfo2[512];
 
+    char *alert = rulestruct[rulemem].s_reference_alert;
+    char *parsable = rulestruct[rulemem].s_reference_parsable;
+
+    alert[0] = '\0';
+    parsable[0] = '\0';
+
     for (i=0; i < rulestruct[rulemem].ref_count + 1 ; i++ )
         {
 
+            /* Rules without a reference */
+
+            if ( rulestruct[rulemem].s_reference[i] == NULL )
+                {
+                    break;
+                }
+
             strlcpy(refinfo, rulestruct[rulemem].s_reference[i], sizeof(refinfo));
 
             tmp = strtok_r(refinfo, ",", &tmptok);
@@ -168,7 +175,8 @@ void Reference_Lookup( int rulemem, int type, char *str, size_t size )
                 }
             else
                 {
-                    strlcpy(str, "", 1);
+                    alert[0] = '\0';
+                    parsable[0] = '\0';
                     return;
                 }
 
@@ -180,7 +188,8 @@ void Reference_Lookup( int rulemem, int type, char *str, size_t size )
                 }
             else
                 {
-                    strlcpy(str, "", 1);
+                    alert[0] = '\0';
+                    parsable[0] = '\0';
                     return;
                 }
 
@@ -190,20 +199,33 @@ void Reference_Lookup( int rulemem, int type, char *str, size_t size )
 
                     if (!strcmp(refstruct[b].s_refid,  reftype))
                         {
-                            if ( type == 0 )
-                                {
-                                    snprintf(refinfo2, sizeof(refinfo2)-1, "[Xref => %s%s]",  refstruct[b].s_refurl, url);
-                                }
 
-                            if ( type == 1 )
-                                {
-                                    snprintf(refinfo2, sizeof(refinfo2)-1, "Reference:%s%s\n", refstruct[b].s_refurl, url);
-                                }
+                            snprintf(refinfo2, sizeof(refinfo2)-1, "[Xref => %s%s]",  refstruct[b].s_refurl, url);
+                            strlcat(alert,  refinfo2,  sizeof(rulestruct[rulemem].s_reference_alert));
 
-                            strlcat(reftmp,  refinfo2,  sizeof(reftmp));
+                            snprintf(refinfo2, sizeof(refinfo2)-1, "Reference:%s%s\n", refstruct[b].s_refurl, url);
+                            strlcat(parsable,  refinfo2,  sizeof(rulestruct[rulemem].s_reference_parsable));
                         }
                 }
         }
 
-    snprintf(str, size, "%s", reftmp);
+}
+
+/****************************************************************************
+ * Reference_Lookup - Returns a rule's references as formatted by
+ * Reference_Render().  This is used for alert, external and esmtp output.
+ ****************************************************************************/
+
+// 0 == alert
+// 1 == parsable.
+
+const char *Reference_Lookup( int rulemem, int type )
+{
+
+    if ( type == 1 )
+        {
+            return(rulestruct[rulemem].s_reference_parsable);
+        }
+
+    return(rulestruct[rulemem].s_reference_alert);
 }
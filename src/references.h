@@ -33,4 +33,5 @@ struct _Ref_Struct
 
 
 void Load_Reference ( const char * );
-void Reference_Lookup( int, int, char *str, size_t size );
+void Reference_Render( int );
+const char *Reference_Lookup( int, int );
@@ -0,0 +1,733 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* rules-cache.c
+ *
+ * Once a rule file has been parsed,  its rules are written to the
+ * "rule-cache" directory as one image:  a header,  the _Rule_Struct's,
+ * then everything they point to.  Pointers are stored as offsets into
+ * that data.  The image is keyed by a hash of the rule file and of what
+ * the parser reads from the configuration (vars,  classifications,
+ * references,  etc).  When the key matches on the next load,  the image is
+ * mapped,  checked and copied in rather than parsing the file again.
+ *
+ * Compiled PCREs follow the data,  each stored as its length and the
+ * pcre_compile() output (PCRE_INFO_SIZE bytes).  The key includes
+ * pcre_version(),  so a library upgrade rebuilds the cache.  Study/JIT
+ * results can't be saved;  Load_Rules() redoes those on the PCRE compile
+ * threads.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pcre.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "classifications.h"
+#include "references.h"
+#include "rules.h"
+#include "rules-cache.h"
+#include "util-hash.h"
+#include "util-rcu.h"
+
+#ifdef WITH_BLUEDOT
+#include "processors/bluedot.h"
+#endif
+
+struct _SaganCounters *counters;
+struct _SaganDebug *debug;
+struct _SaganConfig *config;
+
+struct _Ref_Struct *refstruct;
+struct _SaganVar *var;
+
+#ifdef WITH_BLUEDOT
+struct _Sagan_Bluedot_Cat_Store *SaganBluedotCatStore;
+#endif
+
+typedef struct _Rules_Cache_Header _Rules_Cache_Header;
+struct _Rules_Cache_Header
+{
+    char magic[8];			/* RULES_CACHE_MAGIC */
+    uint32_t version;
+    uint32_t rule_size;			/* sizeof(_Rule_Struct) */
+    uint32_t pointer_size;
+    uint32_t rules;
+    uint64_t key;			/* Rules_Cache_Key() */
+    uint64_t data_size;
+    uint64_t pcre_size;			/* Compiled PCREs,  after the data */
+    uint64_t checksum;			/* Hash_FNV1a_64() of the rules,  data and PCREs */
+    int32_t xbit_counters;
+    int32_t dynamic_rules;
+};
+
+/* The data section while it is being built */
+
+typedef struct _Rules_Cache_Data _Rules_Cache_Data;
+struct _Rules_Cache_Data
+{
+    char *data;
+    size_t size;
+    size_t used;
+};
+
+/****************************************************************************
+ * Rules_Cache_Path - Cache file for "ruleset".  The name keeps the rule
+ * file's name for people listing the directory.
+ ****************************************************************************/
+
+static void Rules_Cache_Path( const char *ruleset, char *str, size_t size )
+{
+
+    const char *name = strrchr(ruleset, '/');
+
+    name = name == NULL ? ruleset : name + 1;
+
+    snprintf(str, size, "%s/%s.%016" PRIx64 ".cache", config->rule_cache_dir, name, Hash_FNV1a_64(HASH_FNV64_OFFSET, ruleset, strlen(ruleset)));
+
+}
+
+/****************************************************************************
+ * Rules_Cache_Append - Copies "len" bytes to the data section.  Returns
+ * what is stored in place of the pointer:  the offset plus one,  so NULL
+ * stays NULL.
+ ****************************************************************************/
+
+static void *Rules_Cache_Append( _Rules_Cache_Data *d, const void *src, size_t len )
+{
+
+    size_t offset = ( d->used + SAGAN_ARENA_ALIGN - 1 ) & ~( (size_t)SAGAN_ARENA_ALIGN - 1 );
+
+    if ( src == NULL )
+        {
+            return(NULL);
+        }
+
+    while ( offset + len > d->size )
+        {
+
+            d->size = d->size == 0 ? 65536 : d->size * 2;
+            d->data = realloc(d->data, d->size);
+
+            if ( d->data == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the rule cache. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    memset(d->data + d->used, 0, offset - d->used);
+    memcpy(d->data + offset, src, len);
+
+    d->used = offset + len;
+
+    return( (void *)(uintptr_t)( offset + 1 ) );
+}
+
+/****************************************************************************
+ * Rules_Cache_Append_PCRE - Copies a compiled PCRE,  preceded by its
+ * length,  to "d".  Returns what is stored in place of the pointer.  A
+ * PCRE we can't size is left out;  it is compiled from its source again
+ * on load.
+ ****************************************************************************/
+
+static void *Rules_Cache_Append_PCRE( _Rules_Cache_Data *d, pcre *re )
+{
+
+    char *record = NULL;
+    void *offset = NULL;
+    size_t size = 0;
+    uint64_t len = 0;
+
+    if ( pcre_fullinfo(re, NULL, PCRE_INFO_SIZE, &size) != 0 || size == 0 )
+        {
+            return(NULL);
+        }
+
+    record = malloc(sizeof(uint64_t) + size);
+
+    if ( record == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the rule cache. Abort!", __FILE__, __LINE__);
+        }
+
+    len = size;
+
+    memcpy(record, &len, sizeof(uint64_t));
+    memcpy(record + sizeof(uint64_t), re, size);
+
+    offset = Rules_Cache_Append(d, record, sizeof(uint64_t) + size);
+
+    free(record);
+
+    return(offset);
+}
+
+/****************************************************************************
+ * Rules_Cache_Restore_PCRE - Rebuilds the compiled PCREs of the "count"
+ * cached rules in "rules".  Each goes in its own pcre_malloc() block,  so
+ * it is freed like any other compiled PCRE.  Returns count * MAX_PCRE
+ * PCREs,  or NULL if one doesn't check out with this PCRE library.
+ ****************************************************************************/
+
+static pcre **Rules_Cache_Restore_PCRE( const _Rule_Struct *rules, int count, const char *patterns, uint64_t patterns_size )
+{
+
+    pcre **re = NULL;
+
+    uintptr_t offset = 0;
+    uint64_t len = 0;
+    size_t size = 0;
+    int b = 0;
+    int i = 0;
+
+    re = calloc((size_t)count * MAX_PCRE + 1, sizeof(pcre *));
+
+    if ( re == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the rule cache. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( b = 0; b < count; b++ )
+        {
+
+            for ( i = 0; i < MAX_PCRE; i++ )
+                {
+
+                    if ( rules[b].re_pcre[i] == NULL )
+                        {
+                            continue;
+                        }
+
+                    offset = (uintptr_t)rules[b].re_pcre[i] - 1;
+
+                    if ( offset > patterns_size || patterns_size - offset < sizeof(uint64_t) )
+                        {
+                            goto bad;
+                        }
+
+                    memcpy(&len, patterns + offset, sizeof(uint64_t));
+
+                    if ( len == 0 || len > patterns_size - offset - sizeof(uint64_t) )
+                        {
+                            goto bad;
+                        }
+
+                    re[ b * MAX_PCRE + i ] = pcre_malloc(len);
+
+                    if ( re[ b * MAX_PCRE + i ] == NULL )
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the rule cache. Abort!", __FILE__, __LINE__);
+                        }
+
+                    memcpy(re[ b * MAX_PCRE + i ], patterns + offset + sizeof(uint64_t), len);
+
+                    /* Also catches a pattern from a different PCRE build
+                     * (byte order,  link size) that got past the key */
+
+                    if ( pcre_fullinfo(re[ b * MAX_PCRE + i ], NULL, PCRE_INFO_SIZE, &size) != 0 || size != len )
+                        {
+                            goto bad;
+                        }
+                }
+        }
+
+    return(re);
+
+bad:
+
+    for ( i = 0; i < count * MAX_PCRE; i++ )
+        {
+            if ( re[i] != NULL )
+                {
+                    pcre_free(re[i]);
+                }
+        }
+
+    free(re);
+
+    return(NULL);
+}
+
+/****************************************************************************
+ * Rules_Cache_Relocate - Turns a stored offset back into a pointer within
+ * "data"
+ ****************************************************************************/
+
+static void *Rules_Cache_Relocate( void *offset, char *data )
+{
+
+    if ( offset == NULL )
+        {
+            return(NULL);
+        }
+
+    return( data + ( (uintptr_t)offset - 1 ) );
+}
+
+/****************************************************************************
+ * Rules_Cache_Key - Hash of everything that decides what parsing
+ * "ruleset" would produce
+ ****************************************************************************/
+
+uint64_t Rules_Cache_Key( const char *ruleset )
+{
+
+    FILE *fp = NULL;
+
+    char buf[65536];
+    size_t len = 0;
+
+    uint64_t hash = HASH_FNV64_OFFSET;
+    uint32_t layout[3] = { RULES_CACHE_VERSION, sizeof(_Rule_Struct), sizeof(void *) };
+    int options[6] = { 0 };
+    int i = 0;
+
+#ifdef WITH_BLUEDOT
+    _Sagan_Bluedot_Cat_Store *store = Sagan_RCU_Dereference(SaganBluedotCatStore);
+#endif
+
+    hash = Hash_FNV1a_64(hash, layout, sizeof(layout));
+    hash = Hash_FNV1a_64(hash, ruleset, strlen(ruleset) + 1);
+
+    /* Compiled PCREs are only good for the library that compiled them */
+
+    hash = Hash_FNV1a_64(hash, pcre_version(), strlen(pcre_version()) + 1);
+
+    if (( fp = fopen(ruleset, "r")) != NULL )
+        {
+
+            while (( len = fread(buf, 1, sizeof(buf), fp)) > 0 )
+                {
+                    hash = Hash_FNV1a_64(hash, buf, len);
+                }
+
+            fclose(fp);
+        }
+
+    for ( i = 0; i < counters->var_count; i++ )
+        {
+            hash = Hash_FNV1a_64(hash, var[i].var_name, strlen(var[i].var_name) + 1);
+            hash = Hash_FNV1a_64(hash, var[i].var_value, strlen(var[i].var_value) + 1);
+        }
+
+    for ( i = 0; i < rules_active->class_count; i++ )
+        {
+            hash = Hash_FNV1a_64(hash, rules_active->classes[i].s_shortname, strlen(rules_active->classes[i].s_shortname) + 1);
+            hash = Hash_FNV1a_64(hash, &rules_active->classes[i].s_priority, sizeof(rules_active->classes[i].s_priority));
+        }
+
+    for ( i = 0; i < counters->refcount; i++ )
+        {
+            hash = Hash_FNV1a_64(hash, refstruct[i].s_refid, strlen(refstruct[i].s_refid) + 1);
+            hash = Hash_FNV1a_64(hash, refstruct[i].s_refurl, strlen(refstruct[i].s_refurl) + 1);
+        }
+
+    /* Configuration that rules are checked against or take defaults from */
+
+    options[0] = config->sagan_proto;
+    options[1] = config->sagan_port;
+    options[2] = config->dynamic_load_sample_rate != 0;
+
+#ifdef HAVE_LIBMAXMINDDB
+    options[3] = config->have_geoip2;
+#endif
+
+#ifdef HAVE_LIBESMTP
+    options[4] = config->sagan_esmtp_server[0] != '\0';
+#endif
+
+#ifdef WITH_BLUEDOT
+
+    options[5] = config->bluedot_flag;
+
+    for ( i = 0; store != NULL && i < store->count; i++ )
+        {
+            hash = Hash_FNV1a_64(hash, store->cats[i].cat, strlen(store->cats[i].cat) + 1);
+            hash = Hash_FNV1a_64(hash, &store->cats[i].cat_number, sizeof(store->cats[i].cat_number));
+        }
+
+#endif
+
+    hash = Hash_FNV1a_64(hash, options, sizeof(options));
+
+    return(hash);
+}
+
+/****************************************************************************
+ * Rules_Cache_Restore - Loads "ruleset" from its cache file if the file
+ * is there,  intact and matches "key".  The rules are added to the end
+ * of rulestruct.  Returns false if the rule file needs to be parsed.
+ ****************************************************************************/
+
+sbool Rules_Cache_Restore( const char *ruleset, uint64_t key, _Rules_Set *set )
+{
+
+    struct stat st;
+
+    _Rules_Cache_Header *header = NULL;
+    _Rule_Struct *rule = NULL;
+    meta_content_conversion *meta = NULL;
+    pcre **re = NULL;
+
+    char path[MAXPATH];
+    char *map = NULL;
+    char *data = NULL;
+
+    size_t rules_size = 0;
+    uint64_t checksum = 0;
+    int fd = -1;
+    int b = 0;
+    int i = 0;
+    int j = 0;
+
+    Rules_Cache_Path(ruleset, path, sizeof(path));
+
+    if (( fd = open(path, O_RDONLY)) == -1 )
+        {
+
+            if ( debug->debugload )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] No rule cache for %s (%s)", __FILE__, __LINE__, ruleset, strerror(errno));
+                }
+
+            return(false);
+        }
+
+    if ( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(_Rules_Cache_Header) )
+        {
+            close(fd);
+            Sagan_Log(WARN, "[%s, line %d] Rule cache %s is truncated,  parsing %s.", __FILE__, __LINE__, path, ruleset);
+            return(false);
+        }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if ( map == MAP_FAILED )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot mmap() rule cache %s (%s),  parsing %s.", __FILE__, __LINE__, path, strerror(errno), ruleset);
+            return(false);
+        }
+
+    header = (_Rules_Cache_Header *)map;
+    rules_size = (size_t)header->rules * sizeof(_Rule_Struct);
+
+    if ( memcmp(header->magic, RULES_CACHE_MAGIC, sizeof(RULES_CACHE_MAGIC)) ||
+            header->version != RULES_CACHE_VERSION ||
+            header->rule_size != sizeof(_Rule_Struct) ||
+            header->pointer_size != sizeof(void *) ||
+            header->key != key )
+        {
+            munmap(map, st.st_size);
+
+            if ( debug->debugload )
+                {
+                    Sagan_Log(DEBUG, "[%s, line %d] Rule cache %s is out of date", __FILE__, __LINE__, path);
+                }
+
+            return(false);
+        }
+
+    if ( header->data_size > (uint64_t)st.st_size || header->pcre_size > (uint64_t)st.st_size ||
+            sizeof(_Rules_Cache_Header) + rules_size + header->data_size + header->pcre_size != (uint64_t)st.st_size )
+        {
+            munmap(map, st.st_size);
+            Sagan_Log(WARN, "[%s, line %d] Rule cache %s has the wrong size,  parsing %s.", __FILE__, __LINE__, path, ruleset);
+            return(false);
+        }
+
+    checksum = Hash_FNV1a_64(HASH_FNV64_OFFSET, map + sizeof(_Rules_Cache_Header), rules_size + header->data_size + header->pcre_size);
+
+    if ( checksum != header->checksum )
+        {
+            munmap(map, st.st_size);
+            Sagan_Log(WARN, "[%s, line %d] Rule cache %s is corrupt,  parsing %s.", __FILE__, __LINE__, path, ruleset);
+            return(false);
+        }
+
+    re = Rules_Cache_Restore_PCRE( (const _Rule_Struct *)( map + sizeof(_Rules_Cache_Header) ), header->rules,
+                                   map + sizeof(_Rules_Cache_Header) + rules_size + header->data_size, header->pcre_size );
+
+    if ( re == NULL )
+        {
+            munmap(map, st.st_size);
+            Sagan_Log(WARN, "[%s, line %d] Rule cache %s has PCREs this PCRE library can't use,  parsing %s.", __FILE__, __LINE__, path, ruleset);
+            return(false);
+        }
+
+    /* The image is good.  Rule data goes in the set's arena,  so it is
+     * freed like that of a parsed file */
+
+    if ( header->data_size > 0 )
+        {
+            data = Sagan_Arena_Memdup(&set->arena, map + sizeof(_Rules_Cache_Header) + rules_size, header->data_size);
+        }
+
+    Rules_Reserve(header->rules);
+
+    memcpy(&rulestruct[counters->rulecount], map + sizeof(_Rules_Cache_Header), rules_size);
+
+    for ( b = counters->rulecount; b < counters->rulecount + (int)header->rules; b++ )
+        {
+
+            rule = &rulestruct[b];
+
+            /* Studied (and JIT'ed) by Load_Rules() */
+
+            for ( i = 0; i < MAX_PCRE; i++ )
+                {
+                    rule->s_pcre[i] = Rules_Cache_Relocate(rule->s_pcre[i], data);
+                    rule->re_pcre[i] = re[ ( b - counters->rulecount ) * MAX_PCRE + i ];
+                    rule->pcre_extra[i] = NULL;
+                }
+
+            for ( i = 0; i < MAX_CONTENT; i++ )
+                {
+                    rule->s_content[i] = Rules_Cache_Relocate(rule->s_content[i], data);
+                }
+
+            for ( i = 0; i < MAX_REFERENCE; i++ )
+                {
+                    rule->s_reference[i] = Rules_Cache_Relocate(rule->s_reference[i], data);
+                }
+
+            rule->flow_1 = Rules_Cache_Relocate(rule->flow_1, data);
+            rule->flow_2 = Rules_Cache_Relocate(rule->flow_2, data);
+            rule->port_1 = Rules_Cache_Relocate(rule->port_1, data);
+            rule->port_2 = Rules_Cache_Relocate(rule->port_2, data);
+
+            for ( i = 0; i < rule->meta_content_count; i++ )
+                {
+
+                    meta = &rule->meta_content_containers[i];
+                    meta->meta_content_converted = Rules_Cache_Relocate(meta->meta_content_converted, data);
+
+                    for ( j = 0; j < meta->meta_counter; j++ )
+                        {
+                            meta->meta_content_converted[j] = Rules_Cache_Relocate(meta->meta_content_converted[j], data);
+                        }
+                }
+
+#ifdef HAVE_LIBESMTP
+
+            /* Normally set by the parser when it sees "email:" */
+
+            if ( rule->email_flag )
+                {
+                    config->sagan_esmtp_flag = true;
+                }
+
+#endif
+
+        }
+
+    set->rules = header->rules;
+    set->xbit_counters = header->xbit_counters;
+    set->dynamic_rules = header->dynamic_rules;
+
+    counters->rulecount += header->rules;
+    counters->xbit_total_counter += header->xbit_counters;
+    counters->dynamic_rule_count += header->dynamic_rules;
+
+    free(re);
+    munmap(map, st.st_size);
+
+    return(true);
+}
+
+/****************************************************************************
+ * Rules_Cache_Save - Writes the "set->rules" rules starting at
+ * rulestruct[first] to the cache file for "ruleset".  Failing to write the
+ * cache isn't fatal;  the file is just parsed again next time.
+ ****************************************************************************/
+
+void Rules_Cache_Save( const char *ruleset, uint64_t key, _Rules_Set *set, int first )
+{
+
+    _Rules_Cache_Header header;
+    _Rules_Cache_Data data;
+    _Rules_Cache_Data patterns;
+
+    _Rule_Struct *rules = NULL;
+    _Rule_Struct *rule = NULL;
+    meta_content_conversion *meta = NULL;
+
+    char *converted[MAX_META_CONTENT_ITEMS];
+
+    char path[MAXPATH];
+    char tmp_path[MAXPATH];
+
+    FILE *fp = NULL;
+    sbool written = false;
+
+    size_t rules_size = (size_t)set->rules * sizeof(_Rule_Struct);
+    int b = 0;
+    int i = 0;
+    int j = 0;
+
+    memset(&data, 0, sizeof(data));
+    memset(&patterns, 0, sizeof(patterns));
+
+    rules = malloc(rules_size + 1);
+
+    if ( rules == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the rule cache. Abort!", __FILE__, __LINE__);
+        }
+
+    memcpy(rules, &rulestruct[first], rules_size);
+
+    for ( b = 0; b < set->rules; b++ )
+        {
+
+            rule = &rules[b];
+
+            for ( i = 0; i < MAX_PCRE; i++ )
+                {
+                    rule->pcre_extra[i] = NULL;
+
+                    if ( rule->re_pcre[i] != NULL )
+                        {
+                            rule->re_pcre[i] = Rules_Cache_Append_PCRE(&patterns, rule->re_pcre[i]);
+                        }
+
+                    if ( rule->s_pcre[i] != NULL )
+                        {
+                            rule->s_pcre[i] = Rules_Cache_Append(&data, rule->s_pcre[i], strlen(rule->s_pcre[i]) + 1);
+                        }
+                }
+
+            for ( i = 0; i < MAX_CONTENT; i++ )
+                {
+                    if ( rule->s_content[i] != NULL )
+                        {
+                            rule->s_content[i] = Rules_Cache_Append(&data, rule->s_content[i], strlen(rule->s_content[i]) + 1);
+                        }
+                }
+
+            for ( i = 0; i < MAX_REFERENCE; i++ )
+                {
+                    if ( rule->s_reference[i] != NULL )
+                        {
+                            rule->s_reference[i] = Rules_Cache_Append(&data, rule->s_reference[i], strlen(rule->s_reference[i]) + 1);
+                        }
+                }
+
+            rule->flow_1 = Rules_Cache_Append(&data, rule->flow_1, rule->flow_1_counter * sizeof(struct arr_flow_1));
+            rule->flow_2 = Rules_Cache_Append(&data, rule->flow_2, rule->flow_2_counter * sizeof(struct arr_flow_2));
+            rule->port_1 = Rules_Cache_Append(&data, rule->port_1, rule->port_1_counter * sizeof(struct arr_port_1));
+            rule->port_2 = Rules_Cache_Append(&data, rule->port_2, rule->port_2_counter * sizeof(struct arr_port_2));
+
+            for ( i = 0; i < rule->meta_content_count; i++ )
+                {
+
+                    meta = &rule->meta_content_containers[i];
+
+                    for ( j = 0; j < meta->meta_counter; j++ )
+                        {
+                            converted[j] = Rules_Cache_Append(&data, meta->meta_content_converted[j], strlen(meta->meta_content_converted[j]) + 1);
+                        }
+
+                    meta->meta_content_converted = Rules_Cache_Append(&data, converted, meta->meta_counter * sizeof(char *));
+                }
+        }
+
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, RULES_CACHE_MAGIC, sizeof(RULES_CACHE_MAGIC));
+    header.version = RULES_CACHE_VERSION;
+    header.rule_size = sizeof(_Rule_Struct);
+    header.pointer_size = sizeof(void *);
+    header.rules = set->rules;
+    header.key = key;
+    header.data_size = data.used;
+    header.pcre_size = patterns.used;
+    header.xbit_counters = set->xbit_counters;
+    header.dynamic_rules = set->dynamic_rules;
+
+    header.checksum = Hash_FNV1a_64(HASH_FNV64_OFFSET, rules, rules_size);
+    header.checksum = Hash_FNV1a_64(header.checksum, data.data, data.used);
+    header.checksum = Hash_FNV1a_64(header.checksum, patterns.data, patterns.used);
+
+    /* Written under another name,  then renamed,  so a crash or a second
+     * Sagan never leaves a half written cache behind */
+
+    Rules_Cache_Path(ruleset, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+
+    (void)mkdir(config->rule_cache_dir, 0750);		/* Already there is fine */
+
+    if (( fp = fopen(tmp_path, "w")) != NULL )
+        {
+
+            written = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                      ( rules_size == 0 || fwrite(rules, rules_size, 1, fp) == 1 ) &&
+                      ( data.used == 0 || fwrite(data.data, data.used, 1, fp) == 1 ) &&
+                      ( patterns.used == 0 || fwrite(patterns.data, patterns.used, 1, fp) == 1 );
+
+            if ( fclose(fp) != 0 )
+                {
+                    written = false;
+                }
+
+            if ( written == false )
+                {
+                    unlink(tmp_path);
+                }
+        }
+
+    if ( written == false )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot write rule cache %s (%s).", __FILE__, __LINE__, tmp_path, strerror(errno));
+        }
+
+    else if ( rename(tmp_path, path) != 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot rename rule cache %s to %s (%s).", __FILE__, __LINE__, tmp_path, path, strerror(errno));
+            unlink(tmp_path);
+        }
+
+    else if ( debug->debugload )
+        {
+            Sagan_Log(DEBUG, "[%s, line %d] Wrote rule cache %s (%d rules, %lu bytes of data, %lu bytes of PCRE)", __FILE__, __LINE__, path, set->rules, (unsigned long)data.used, (unsigned long)patterns.used);
+        }
+
+    free(patterns.data);
+    free(data.data);
+    free(rules);
+
+}
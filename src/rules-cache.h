@@ -0,0 +1,33 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* rules-cache.h
+ *
+ * Parsed rule files saved to disk,  so an unchanged rule file doesn't have
+ * to be parsed again.  See rules-cache.c
+ *
+ */
+
+#define RULES_CACHE_MAGIC	"SAGANRC"
+#define RULES_CACHE_VERSION	2
+
+uint64_t Rules_Cache_Key( const char * );
+sbool Rules_Cache_Restore( const char *, uint64_t, _Rules_Set * );
+void Rules_Cache_Save( const char *, uint64_t, _Rules_Set *, int );
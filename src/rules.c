@@ -52,45 +52,979 @@
 #include "xbit-mmap.h"
 #include "lockfile.h"
 #include "classifications.h"
+#include "references.h"
+#include "gen-msg.h"
+#include "ignore-list.h"
 #include "rules.h"
+#include "rules-cache.h"
+#include "util-rcu.h"
+#include "util-hash.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "parsers/parsers.h"
 
 #ifdef WITH_BLUEDOT
 #include "processors/bluedot.h"
 #endif
 
+#ifdef HAVE_LIBMAXMINDDB
+#include "geoip2.h"
+#endif
+
 struct _SaganCounters *counters;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
 
-#ifdef WITH_BLUEDOT
+#ifdef WITH_BLUEDOT
+
+char *bluedot_time = NULL;
+char *bluedot_type = NULL;
+
+uint64_t bluedot_time_u32 = 0;
+
+#endif
+
+#ifdef HAVE_LIBLOGNORM
+#include "liblognormalize.h"
+struct liblognorm_struct *liblognormstruct;
+struct liblognorm_toload_struct *liblognormtoloadstruct;
+int liblognorm_count;
+#endif
+
+/* For pre-8.20 PCRE compatibility */
+#ifndef PCRE_STUDY_JIT_COMPILE
+#define PCRE_STUDY_JIT_COMPILE 0
+#endif
+
+/* Loaded by Load_YAML_Config() and Load_Ignore_List(),  and taken over by
+ * the next Rules_Load_All() */
+
+struct _Class_Struct *classstruct = NULL;
+struct _Sagan_Processor_Generator *generator;
+struct _Sagan_Ignorelist *SaganIgnorelist;
+
+struct _Rules_Loaded *rules_loaded;
+
+__thread _Rules_Version *rules_active = NULL;
+
+static _Rules_Version *rules_current = NULL;	/* Published,  see Rules_Publish() */
+static _Rules_Version *rules_build = NULL;	/* Being loaded */
+static _Rules_Version *rules_build_caller = NULL;	/* The loader's rules_active before the build */
+
+static uint64_t rules_generation = 0;
+static int rules_reclaim = 0;			/* Versions were retired since Rules_Reclaim() */
+
+/* One "pcre:" waiting to be compiled.  Load_Rules() queues these while it
+ * parses a file,  then Rules_PCRE_Compile() compiles them all at once.  A
+ * rule from the rule cache arrives already compiled ("re" is set) and is
+ * only studied */
+
+typedef struct _Rules_PCRE_Job _Rules_PCRE_Job;
+struct _Rules_PCRE_Job
+{
+    int rule;				/* rulestruct[] index */
+    int slot;				/* re_pcre[] / pcre_extra[] index */
+    int linecount;
+    int options;
+    const char *pattern;		/* In the rule set's arena */
+
+    pcre *re;
+    pcre_extra *extra;
+    const char *error;
+    int erroffset;
+    int jit;
+
+    uint64_t compile_usec;
+    uint64_t study_usec;
+};
+
+typedef struct _Rules_PCRE_Queue _Rules_PCRE_Queue;
+struct _Rules_PCRE_Queue
+{
+    _Rules_PCRE_Job *jobs;
+    int count;
+    int size;
+    int next;				/* Next job for a compile thread to take */
+};
+
+static uint64_t rules_var_usec = 0;	/* Rules_Var_To_Value() time for the current file */
+
+/****************************************************************************
+ * Rules_Realloc - realloc() that aborts on failure
+ ****************************************************************************/
+
+static void *Rules_Realloc( void *ptr, size_t size )
+{
+
+    ptr = realloc(ptr, size);
+
+    if ( ptr == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for rules. Abort!", __FILE__, __LINE__);
+        }
+
+    return(ptr);
+}
+
+/****************************************************************************
+ * Rules_Grow - Doubles the rule table and rule header table of the version
+ * being built
+ ****************************************************************************/
+
+static void Rules_Grow( void )
+{
+
+    _Rules_Version *version = rules_build;
+    int i = 0;
+
+    version->size = version->size == 0 ? RULES_ALLOC_MIN : version->size * 2;
+
+    version->rules = Rules_Realloc(version->rules, version->size * sizeof(_Rule_Struct));
+
+    version->hdr.type = Rules_Realloc(version->hdr.type, version->size * sizeof(unsigned char));
+    version->hdr.flags = Rules_Realloc(version->hdr.flags, version->size * sizeof(uint16_t));
+    version->hdr.header_mask = Rules_Realloc(version->hdr.header_mask, version->size * sizeof(unsigned char));
+    version->hdr.content_count = Rules_Realloc(version->hdr.content_count, version->size * sizeof(unsigned char));
+    version->hdr.pcre_count = Rules_Realloc(version->hdr.pcre_count, version->size * sizeof(unsigned char));
+    version->hdr.meta_content_count = Rules_Realloc(version->hdr.meta_content_count, version->size * sizeof(unsigned char));
+
+    for ( i = 0; i < RULE_HEADER_MAX; i++ )
+        {
+            version->hdr.header[i] = Rules_Realloc(version->hdr.header[i], version->size * sizeof(_Rule_Header_Match));
+        }
+
+}
+
+/****************************************************************************
+ * Rules_Reserve - Makes room in the version being built for "count" more
+ * rules
+ ****************************************************************************/
+
+void Rules_Reserve( int count )
+{
+
+    while ( counters->rulecount + count > rules_build->size )
+        {
+            Rules_Grow();
+        }
+
+}
+
+/****************************************************************************
+ * Rules_Header_Build - Fills in the rule header table for rule "b" once
+ * it has been parsed
+ ****************************************************************************/
+
+static void Rules_Header_Build( int b, _Rules_Set *set )
+{
+
+    _Rule_Struct *rule = &rulestruct[b];
+    _Rule_Header_Match *m = NULL;
+
+    const char *fields[RULE_HEADER_MAX] = { rule->s_program, rule->s_facility, rule->s_syspri, rule->s_level, rule->s_tag };
+
+    char tmp[256];
+    char *ptmp = NULL;
+    char *tok = NULL;
+
+    uint16_t flags = 0;
+    int count = 0;
+    int i = 0;
+
+    rulehdr.type[b] = rule->type;
+    rulehdr.content_count[b] = rule->content_count;
+    rulehdr.pcre_count[b] = rule->pcre_count;
+    rulehdr.meta_content_count[b] = rule->meta_content_count;
+    rulehdr.header_mask[b] = 0;
+
+    for ( i = 0; i < RULE_HEADER_MAX; i++ )
+        {
+
+            m = &rulehdr.header[i][b];
+            memset(m, 0, sizeof(_Rule_Header_Match));
+
+            if ( fields[i][0] == '\0' )
+                {
+                    continue;
+                }
+
+            rulehdr.header_mask[b] |= 1 << i;
+
+            count = 1;
+
+            for ( ptmp = (char *)fields[i]; *ptmp != '\0'; ptmp++ )
+                {
+                    if ( *ptmp == '|' )
+                        {
+                            count++;
+                        }
+                }
+
+            m->hash = Sagan_Arena_Alloc(&set->arena, count * sizeof(uint32_t));
+            m->value = Sagan_Arena_Alloc(&set->arena, count * sizeof(char *));
+
+            strlcpy(tmp, fields[i], sizeof(tmp));
+
+            for ( ptmp = strtok_r(tmp, "|", &tok); ptmp != NULL; ptmp = strtok_r(NULL, "|", &tok) )
+                {
+
+                    m->value[m->count] = Sagan_Arena_Strdup(&set->arena, ptmp);
+
+                    if ( i == RULE_HEADER_PROGRAM && strpbrk(ptmp, "*?") != NULL )
+                        {
+                            m->hash[m->count] = 0;
+                        }
+                    else
+                        {
+                            m->hash[m->count] = Hash_FNV1a(ptmp, strlen(ptmp));
+                        }
+
+                    m->count++;
+                }
+        }
+
+    if ( rule->s_find_src_ip || rule->s_find_dst_ip || rule->s_find_proto ||
+            rule->blacklist_ipaddr_all || rule->brointel_ipaddr_all
+#ifdef WITH_BLUEDOT
+            || rule->bluedot_ipaddr_type == 4
+#endif
+       )
+        {
+            flags |= RULE_FLAG_PARSE_IP;
+        }
+
+    flags |= rule->has_flow ? RULE_FLAG_FLOW : 0;
+    flags |= rule->xbit_flag ? RULE_FLAG_XBIT : 0;
+    flags |= rule->normalize ? RULE_FLAG_NORMALIZE : 0;
+    flags |= rule->alert_time_flag ? RULE_FLAG_ALERT_TIME : 0;
+    flags |= rule->blacklist_flag ? RULE_FLAG_BLACKLIST : 0;
+    flags |= rule->brointel_flag ? RULE_FLAG_BROINTEL : 0;
+
+#ifdef HAVE_LIBMAXMINDDB
+    flags |= rule->geoip2_flag ? RULE_FLAG_GEOIP2 : 0;
+#endif
+
+    rulehdr.flags[b] = flags;
+
+}
+
+/****************************************************************************
+ * Rules_Header_Copy - Copies rule "src"'s header table entry to "dst"
+ ****************************************************************************/
+
+static void Rules_Header_Copy( int dst, int src )
+{
+
+    int i = 0;
+
+    rulehdr.type[dst] = rulehdr.type[src];
+    rulehdr.flags[dst] = rulehdr.flags[src];
+    rulehdr.header_mask[dst] = rulehdr.header_mask[src];
+    rulehdr.content_count[dst] = rulehdr.content_count[src];
+    rulehdr.pcre_count[dst] = rulehdr.pcre_count[src];
+    rulehdr.meta_content_count[dst] = rulehdr.meta_content_count[src];
+
+    for ( i = 0; i < RULE_HEADER_MAX; i++ )
+        {
+            rulehdr.header[i][dst] = rulehdr.header[i][src];
+        }
+
+}
+
+/****************************************************************************
+ * Rules_PCRE_Size - Memory used by a compiled and studied PCRE
+ ****************************************************************************/
+
+static size_t Rules_PCRE_Size( pcre *re, pcre_extra *extra )
+{
+
+    size_t size = 0;
+    size_t study_size = 0;
+
+    if ( re == NULL )
+        {
+            return(0);
+        }
+
+    pcre_fullinfo(re, NULL, PCRE_INFO_SIZE, &size);
+
+    if ( extra != NULL )
+        {
+            pcre_fullinfo(re, extra, PCRE_INFO_STUDYSIZE, &study_size);
+        }
+
+    return(size + study_size);
+}
+
+/****************************************************************************
+ * Rules_PCRE_Release - Frees a compiled and studied PCRE
+ ****************************************************************************/
+
+static void Rules_PCRE_Release( pcre *re, pcre_extra *extra )
+{
+
+    if ( extra != NULL )
+        {
+#if defined(PCRE_MAJOR) && ( PCRE_MAJOR > 8 || ( PCRE_MAJOR == 8 && PCRE_MINOR >= 20 ) )
+            pcre_free_study(extra);
+#else
+            pcre_free(extra);
+#endif
+        }
+
+    if ( re != NULL )
+        {
+            pcre_free(re);
+        }
+
+}
+
+/****************************************************************************
+ * Rules_Var_To_Value - Var_To_Value() that keeps track of the time spent
+ * expanding variables
+ ****************************************************************************/
+
+static void Rules_Var_To_Value( char *in_str, char *str, size_t size )
+{
+
+    uint64_t start = Sagan_Clock_Mono_NS() / 1000;
+
+    Var_To_Value(in_str, str, size);
+
+    rules_var_usec += Sagan_Clock_Mono_NS() / 1000 - start;
+
+}
+
+/****************************************************************************
+ * Rules_Read_Line - fgets() that keeps track of the time spent reading
+ ****************************************************************************/
+
+static char *Rules_Read_Line( char *buf, int size, FILE *fp, uint64_t *usec )
+{
+
+    uint64_t start = Sagan_Clock_Mono_NS() / 1000;
+    char *ret = fgets(buf, size, fp);
+
+    *usec += Sagan_Clock_Mono_NS() / 1000 - start;
+
+    return(ret);
+}
+
+/****************************************************************************
+ * Rules_Time_Report - Logs where the time loading "count" rule sets went.
+ * Reading,  parsing and var expansion happen on the loading thread.  Only
+ * the PCRE compile and study/JIT run on "rule-compile-threads" threads,
+ * so those two are CPU time summed over the threads.
+ ****************************************************************************/
+
+static void Rules_Time_Report( const char *name, _Rules_Set **sets, int count )
+{
+
+    uint64_t read_usec = 0;
+    uint64_t parse_usec = 0;
+    uint64_t var_usec = 0;
+    uint64_t compile_usec = 0;
+    uint64_t study_usec = 0;
+    uint64_t pcre_wall_usec = 0;
+    int pcre_count = 0;
+    int pcre_threads = 0;
+    int i = 0;
+
+    for ( i = 0; i < count; i++ )
+        {
+            read_usec += sets[i]->read_usec;
+            parse_usec += sets[i]->parse_usec;
+            var_usec += sets[i]->var_usec;
+            compile_usec += sets[i]->compile_usec;
+            study_usec += sets[i]->study_usec;
+            pcre_wall_usec += sets[i]->pcre_wall_usec;
+            pcre_count += sets[i]->pcre_count;
+
+            if ( sets[i]->pcre_threads > pcre_threads )
+                {
+                    pcre_threads = sets[i]->pcre_threads;
+                }
+        }
+
+    Sagan_Log(NORMAL, "Load times for %s: read %.1f ms, parse %.1f ms, var expansion %.1f ms (single thread). PCRE: %d regexes on up to %d thread(s) in %.1f ms elapsed (compile %.1f ms, study/JIT %.1f ms, CPU time over all threads).",
+              name, read_usec / 1000.0, parse_usec / 1000.0, var_usec / 1000.0,
+              pcre_count, pcre_threads, pcre_wall_usec / 1000.0, compile_usec / 1000.0, study_usec / 1000.0);
+
+}
+
+/****************************************************************************
+ * Rules_PCRE_Queue - Adds a "pcre:" to the list to compile (or,  if it came
+ * compiled from the rule cache,  to study) once the rule file has been
+ * parsed
+ ****************************************************************************/
+
+static void Rules_PCRE_Queue( _Rules_PCRE_Queue *queue, int rule, int slot )
+{
+
+    _Rules_PCRE_Job *job = NULL;
+
+    if ( queue->count >= queue->size )
+        {
+            queue->size = queue->size == 0 ? RULES_ALLOC_MIN : queue->size * 2;
+            queue->jobs = Rules_Realloc(queue->jobs, queue->size * sizeof(_Rules_PCRE_Job));
+        }
+
+    job = &queue->jobs[queue->count++];
+
+    memset(job, 0, sizeof(_Rules_PCRE_Job));
+
+    job->rule = rule;
+    job->slot = slot;
+    job->linecount = rulestruct[rule].s_linecount;
+    job->options = rulestruct[rule].pcre_options[slot];
+    job->pattern = rulestruct[rule].s_pcre[slot];
+    job->re = rulestruct[rule].re_pcre[slot];
+
+}
+
+/****************************************************************************
+ * Rules_PCRE_Thread - Compiles and studies queued PCREs until none are
+ * left.  Nothing is logged here;  Rules_PCRE_Compile() reports the results
+ * in rule file order.
+ ****************************************************************************/
+
+static void *Rules_PCRE_Thread( void *arg )
+{
+
+    _Rules_PCRE_Queue *queue = arg;
+    _Rules_PCRE_Job *job = NULL;
+
+    uint64_t start = 0;
+    int study_options = 0;
+    int i = 0;
+
+#ifdef PCRE_HAVE_JIT
+
+    if ( config->pcre_jit == 1 )
+        {
+            study_options |= PCRE_STUDY_JIT_COMPILE;
+        }
+
+#endif
+
+    while ( ( i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED) ) < queue->count )
+        {
+
+            job = &queue->jobs[i];
+
+            if ( job->re == NULL )
+                {
+
+                    start = Sagan_Clock_Mono_NS() / 1000;
+                    job->re = pcre_compile( job->pattern, job->options, &job->error, &job->erroffset, NULL );
+                    job->compile_usec = Sagan_Clock_Mono_NS() / 1000 - start;
+
+                    if ( job->re == NULL )
+                        {
+                            continue;
+                        }
+                }
+
+            start = Sagan_Clock_Mono_NS() / 1000;
+            job->extra = pcre_study( job->re, study_options, &job->error );
+            job->study_usec = Sagan_Clock_Mono_NS() / 1000 - start;
+
+#ifdef PCRE_HAVE_JIT
+
+            if ( config->pcre_jit == 1 && pcre_fullinfo(job->re, job->extra, PCRE_INFO_JIT, &job->jit) != 0 )
+                {
+                    job->jit = 0;
+                }
+
+#endif
+
+        }
+
+    return(NULL);
+}
+
+/****************************************************************************
+ * Rules_PCRE_Compile - Compiles the PCREs queued while parsing the rules
+ * of "set" (rulestruct[first] onward).  The work is spread over
+ * "rule-compile-threads" threads.  Results are then stored and reported in
+ * rule file order,  and rules with a PCRE that won't compile are dropped.
+ ****************************************************************************/
+
+static void Rules_PCRE_Compile( _Rules_PCRE_Queue *queue, _Rules_Set *set, int first, const char *ruleset_fullname )
+{
+
+    pthread_t threads[RULES_COMPILE_THREADS_MAX];
+    _Rules_PCRE_Job *job = NULL;
+
+    sbool *dropped = NULL;
+
+    uint64_t start = Sagan_Clock_Mono_NS() / 1000;
+    int thread_count = config->rule_compile_threads;
+    int started = 0;
+    int rc = 0;
+    int i = 0;
+    int b = 0;
+    int d = 0;
+
+    if ( queue->count == 0 )
+        {
+            return;
+        }
+
+    if ( thread_count == 0 )
+        {
+            thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+
+    if ( thread_count > RULES_COMPILE_THREADS_MAX )
+        {
+            thread_count = RULES_COMPILE_THREADS_MAX;
+        }
+
+    if ( thread_count > queue->count )
+        {
+            thread_count = queue->count;
+        }
+
+    /* The calling thread compiles as well,  so only start the extras */
+
+    for ( started = 0; started < thread_count - 1; started++ )
+        {
+
+            rc = pthread_create( &threads[started], NULL, Rules_PCRE_Thread, queue );
+
+            if ( rc != 0 )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Could not pthread_create() a PCRE compile thread [error: %d]. Continuing with %d thread(s).", __FILE__, __LINE__, rc, started + 1);
+                    break;
+                }
+        }
+
+    Rules_PCRE_Thread(queue);
+
+    for ( i = 0; i < started; i++ )
+        {
+            pthread_join(threads[i], NULL);
+        }
+
+    set->pcre_wall_usec = Sagan_Clock_Mono_NS() / 1000 - start;
+    set->pcre_threads = started + 1;
+    set->pcre_count = queue->count;
+
+    dropped = calloc(set->rules, sizeof(sbool));
+    set->re_pcre = calloc(queue->count + 1, sizeof(pcre *));
+    set->pcre_extra = calloc(queue->count + 1, sizeof(pcre_extra *));
+
+    if ( dropped == NULL || set->re_pcre == NULL || set->pcre_extra == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for PCRE results. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < queue->count; i++ )
+        {
+
+            job = &queue->jobs[i];
+
+            set->compile_usec += job->compile_usec;
+            set->study_usec += job->study_usec;
+
+            rulestruct[job->rule].re_pcre[job->slot] = job->re;
+            rulestruct[job->rule].pcre_extra[job->slot] = job->extra;
+
+            if ( job->re == NULL )
+                {
+                    dropped[job->rule - first] = true;
+                    Remove_Lock_File();
+                    Sagan_Log(WARN, "[%s, line %d] PCRE failure at %d: %s in %s at line %d, skipping rule", __FILE__, __LINE__, job->erroffset, job->error, ruleset_fullname, job->linecount);
+                }
+
+#ifdef PCRE_HAVE_JIT
+
+            else if ( config->pcre_jit == 1 && job->jit != 1 )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] PCRE JIT does not support regexp in %s at line %d (pcre: \"%s\"). Continuing without PCRE JIT enabled for this rule.", __FILE__, __LINE__, ruleset_fullname, job->linecount, job->pattern);
+                }
+
+#endif
+        }
+
+    /* Close the gaps left by dropped rules.  Only this file's rules can
+     * move,  so the sid order is unchanged */
+
+    for ( b = first, d = first; b < first + set->rules; b++ )
+        {
+
+            if ( dropped[b - first] == true )
+                {
+
+                    for ( i = 0; i < rulestruct[b].pcre_count; i++ )
+                        {
+                            Rules_PCRE_Release(rulestruct[b].re_pcre[i], rulestruct[b].pcre_extra[i]);
+                        }
+
+                    continue;
+                }
+
+            for ( i = 0; i < rulestruct[b].pcre_count; i++ )
+                {
+                    set->pcre_size += Rules_PCRE_Size(rulestruct[b].re_pcre[i], rulestruct[b].pcre_extra[i]);
+                    set->re_pcre[set->pcre_loaded] = rulestruct[b].re_pcre[i];
+                    set->pcre_extra[set->pcre_loaded] = rulestruct[b].pcre_extra[i];
+                    set->pcre_loaded++;
+                }
+
+            if ( d != b )
+                {
+                    memcpy(&rulestruct[d], &rulestruct[b], sizeof(_Rule_Struct));
+                    Rules_Header_Copy(d, b);
+                }
+
+            d++;
+        }
+
+    set->rules = d - first;
+    counters->rulecount = d;
+
+    free(dropped);
+    free(queue->jobs);
+
+}
+
+/****************************************************************************
+ * Rules_Load_Finish - Last steps of Load_Rules(),  for parsed and cached
+ * rule files alike.  Compiles the PCREs,  refreshes the rule cache and
+ * logs what was loaded.
+ ****************************************************************************/
+
+static void Rules_Load_Finish( _Rules_PCRE_Queue *queue, _Rules_Set *set, int first, const char *ruleset_fullname, uint64_t cache_key )
+{
+
+    Rules_PCRE_Compile(queue, set, first, ruleset_fullname);
+
+    if ( set->cached == false && config->rule_cache_dir[0] != '\0' )
+        {
+            Rules_Cache_Save(ruleset_fullname, cache_key, set, first);
+        }
+
+    Sagan_Log(NORMAL, "Loaded %d rules from %s%s (%lu KB rule table, %lu KB rule data, %lu KB PCRE).", set->rules, ruleset_fullname,
+              set->cached ? " [rule cache]" : "",
+              (unsigned long)( set->rules * sizeof(_Rule_Struct) / 1024 ), (unsigned long)( set->arena.allocated / 1024 ), (unsigned long)( set->pcre_size / 1024 ));
+
+    Rules_Time_Report(ruleset_fullname, &set, 1);
+
+}
+
+/****************************************************************************
+ * Rules_Set_Release - Drops a version's reference to a rule set.  The
+ * last one frees the set's PCREs and rule data.
+ ****************************************************************************/
+
+static void Rules_Set_Release( _Rules_Set *set )
+{
+
+    int i = 0;
+
+    if ( __atomic_sub_fetch(&set->refs, 1, __ATOMIC_ACQ_REL) != 0 )
+        {
+            return;
+        }
+
+    for ( i = 0; i < set->pcre_loaded; i++ )
+        {
+            Rules_PCRE_Release(set->re_pcre[i], set->pcre_extra[i]);
+        }
+
+    Sagan_Arena_Free(&set->arena);
+
+    free(set->re_pcre);
+    free(set->pcre_extra);
+    free(set);
+
+}
+
+/****************************************************************************
+ * Rules_Release - Drops a reference to a rule version,  freeing it with
+ * the last one
+ ****************************************************************************/
+
+void Rules_Release( _Rules_Version *version )
+{
+
+    int i = 0;
+
+    if ( __atomic_sub_fetch(&version->refs, 1, __ATOMIC_ACQ_REL) != 0 )
+        {
+            return;
+        }
+
+    for ( i = 0; i < version->set_count; i++ )
+        {
+            Rules_Set_Release(version->sets[i]);
+        }
+
+    for ( i = 0; i < RULE_HEADER_MAX; i++ )
+        {
+            free(version->hdr.header[i]);
+        }
+
+    free(version->hdr.type);
+    free(version->hdr.flags);
+    free(version->hdr.header_mask);
+    free(version->hdr.content_count);
+    free(version->hdr.pcre_count);
+    free(version->hdr.meta_content_count);
+
+    free(version->classes);
+    free(version->generators);
+    free(version->ignore);
+
+    free(version->rules);
+    free(version->sets);
+    free(version);
+
+}
+
+/****************************************************************************
+ * Rules_Retired - Called by Sagan_RCU_Reclaim() once no worker can still
+ * be using a replaced version.  Queued alerts may still hold it.
+ ****************************************************************************/
+
+static void Rules_Retired( void *ptr )
+{
+    Rules_Release(ptr);
+}
+
+/****************************************************************************
+ * Rules_Hold - Takes a reference to the calling thread's rule version,  for
+ * alerts that are written out after the thread moves on
+ ****************************************************************************/
+
+_Rules_Version *Rules_Hold( void )
+{
+
+    __atomic_add_fetch(&rules_active->refs, 1, __ATOMIC_RELAXED);
+
+    return(rules_active);
+}
+
+/****************************************************************************
+ * Rules_Use - Sets the calling thread's rule version.  NULL means the
+ * published one,  which a worker may only use while RCU online.
+ ****************************************************************************/
 
-struct _Sagan_Bluedot_Cat_List *SaganBluedotCatList;
+void Rules_Use( _Rules_Version *version )
+{
 
-char *bluedot_time = NULL;
-char *bluedot_type = NULL;
+    if ( version == NULL )
+        {
+            version = Sagan_RCU_Dereference(rules_current);
+        }
 
-uint64_t bluedot_time_u32 = 0;
+    rules_active = version;
 
-#endif
+}
 
-#ifdef HAVE_LIBLOGNORM
-#include "liblognormalize.h"
-struct liblognorm_struct *liblognormstruct;
-struct liblognorm_toload_struct *liblognormtoloadstruct;
-int liblognorm_count;
-#endif
+/****************************************************************************
+ * Rules_Reclaim - Frees replaced versions once the workers are past them.
+ * This waits on every online reader,  so it is never called by a worker;
+ * the dynamic rule thread (between log lines) and the reload do it.
+ ****************************************************************************/
 
-/* For pre-8.20 PCRE compatibility */
-#ifndef PCRE_STUDY_JIT_COMPILE
-#define PCRE_STUDY_JIT_COMPILE 0
-#endif
+void Rules_Reclaim( void )
+{
 
-struct _Rule_Struct *rulestruct = NULL;
-struct _Class_Struct *classstruct = NULL;
+    if ( __atomic_exchange_n(&rules_reclaim, 0, __ATOMIC_ACQ_REL) != 0 )
+        {
+            Sagan_RCU_Reclaim();
+        }
+
+}
+
+/****************************************************************************
+ * Rules_Copy_Table - Copies one of the configuration tables of a version
+ ****************************************************************************/
+
+static void *Rules_Copy_Table( const void *table, int count, size_t size )
+{
+
+    void *copy = NULL;
+
+    if ( count == 0 )
+        {
+            return(NULL);
+        }
+
+    copy = Rules_Realloc(NULL, count * size);
+    memcpy(copy, table, count * size);
+
+    return(copy);
+}
+
+/****************************************************************************
+ * Rules_Build_Begin - Starts a new,  unpublished version.  With "copy" it
+ * starts out with every rule of the published version.  Until
+ * Rules_Publish(),  "rulestruct" in the calling thread is the new version.
+ * Callers hold SaganRulesLoadedMutex.
+ ****************************************************************************/
+
+static void Rules_Build_Begin( sbool copy )
+{
+
+    _Rules_Version *current = rules_current;
+    _Rules_Version *version = NULL;
+
+    int i = 0;
+
+    version = calloc(1, sizeof(_Rules_Version));
+
+    if ( version == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rules. Abort!", __FILE__, __LINE__);
+        }
+
+    version->refs = 1;				/* Dropped when it is replaced */
+
+    rules_build = version;
+    rules_build_caller = rules_active;
+    rules_active = version;
+
+    counters->rulecount = 0;
+
+    Rules_Grow();
+
+    if ( copy == false || current == NULL )
+        {
+
+            /* The tables the configuration just loaded become ours */
+
+            version->classes = classstruct;
+            version->class_count = counters->classcount;
+            version->generators = generator;
+            version->generator_count = counters->genmapcount;
+            version->ignore = SaganIgnorelist;
+            version->ignore_count = counters->droplist_count;
+
+            classstruct = NULL;
+            generator = NULL;
+            SaganIgnorelist = NULL;
+
+            counters->xbit_total_counter = 0;
+            counters->dynamic_rule_count = 0;
+            return;
+        }
+
+    version->classes = Rules_Copy_Table(current->classes, current->class_count, sizeof(_Class_Struct));
+    version->class_count = current->class_count;
+    version->generators = Rules_Copy_Table(current->generators, current->generator_count, sizeof(_Sagan_Processor_Generator));
+    version->generator_count = current->generator_count;
+    version->ignore = Rules_Copy_Table(current->ignore, current->ignore_count, sizeof(_Sagan_Ignorelist));
+    version->ignore_count = current->ignore_count;
+
+    Rules_Reserve(current->count);
+
+    memcpy(version->rules, current->rules, current->count * sizeof(_Rule_Struct));
+
+    memcpy(version->hdr.type, current->hdr.type, current->count * sizeof(unsigned char));
+    memcpy(version->hdr.flags, current->hdr.flags, current->count * sizeof(uint16_t));
+    memcpy(version->hdr.header_mask, current->hdr.header_mask, current->count * sizeof(unsigned char));
+    memcpy(version->hdr.content_count, current->hdr.content_count, current->count * sizeof(unsigned char));
+    memcpy(version->hdr.pcre_count, current->hdr.pcre_count, current->count * sizeof(unsigned char));
+    memcpy(version->hdr.meta_content_count, current->hdr.meta_content_count, current->count * sizeof(unsigned char));
+
+    for ( i = 0; i < RULE_HEADER_MAX; i++ )
+        {
+            memcpy(version->hdr.header[i], current->hdr.header[i], current->count * sizeof(_Rule_Header_Match));
+        }
+
+    version->sets = Rules_Realloc(NULL, ( current->set_count + 1 ) * sizeof(_Rules_Set *));
 
-void Load_Rules( const char *ruleset )
+    for ( i = 0; i < current->set_count; i++ )
+        {
+            version->sets[i] = current->sets[i];
+            __atomic_add_fetch(&version->sets[i]->refs, 1, __ATOMIC_RELAXED);
+        }
+
+    version->set_count = current->set_count;
+    counters->rulecount = current->count;
+
+}
+
+/****************************************************************************
+ * Rules_Publish - Swaps the version being built in for the workers and
+ * retires the one it replaces
+ ****************************************************************************/
+
+static void Rules_Publish( void )
+{
+
+    _Rules_Version *old = rules_current;
+    _Rules_Version *version = rules_build;
+
+    version->count = counters->rulecount;
+    version->generation = ++rules_generation;
+
+    Sagan_RCU_Assign(rules_current, version);
+
+    rules_active = rules_build_caller;
+    rules_build = NULL;
+    rules_build_caller = NULL;
+
+    if ( old != NULL )
+        {
+            Sagan_RCU_Retire(old, Rules_Retired);
+            __atomic_store_n(&rules_reclaim, 1, __ATOMIC_RELEASE);
+        }
+
+}
+
+/****************************************************************************
+ * Rules_Memory_Report - Logs the memory used by the published rules.
+ * Callers hold SaganRulesLoadedMutex so the version can't be replaced.
+ ****************************************************************************/
+
+void Rules_Memory_Report( void )
+{
+
+    _Rules_Version *version = rules_current;
+
+    size_t table = 0;
+    size_t header = 0;
+    size_t data = 0;
+    size_t pcre_size = 0;
+    int i = 0;
+
+    if ( version == NULL )
+        {
+            return;
+        }
+
+    table = version->size * sizeof(_Rule_Struct);
+    header = version->size * ( 5 * sizeof(unsigned char) + sizeof(uint16_t) + RULE_HEADER_MAX * sizeof(_Rule_Header_Match) );
+
+    for ( i = 0; i < version->set_count; i++ )
+        {
+            data += version->sets[i]->arena.allocated;
+            pcre_size += version->sets[i]->pcre_size;
+        }
+
+    Sagan_Log(NORMAL, "Rules use %lu KB: %lu KB rule table (%d of %d entries of %lu bytes), %lu KB header table, %lu KB rule data, %lu KB PCRE in %d rule file(s).",
+              (unsigned long)( ( table + header + data + pcre_size ) / 1024 ),
+              (unsigned long)( table / 1024 ), version->count, version->size, (unsigned long)sizeof(_Rule_Struct),
+              (unsigned long)( header / 1024 ), (unsigned long)( data / 1024 ), (unsigned long)( pcre_size / 1024 ), version->set_count);
+
+    Rules_Time_Report("all rule files", version->sets, version->set_count);
+
+}
+
+/****************************************************************************
+ * Load_Rules - Parses one rule file into the version being built.  The
+ * file is read and parsed serially on the calling thread,  since the parser
+ * appends to rulestruct and updates shared counters,  Bluedot and var
+ * state.  Only the PCREs it queues are compiled on other threads (see
+ * Rules_PCRE_Compile()).
+ ****************************************************************************/
+
+static void Load_Rules( const char *ruleset )
 {
 
     struct stat filecheck;
@@ -98,9 +1032,6 @@ void Load_Rules( const char *ruleset )
     sbool found = 0;
     sbool bad_rule = 0;
 
-    const char *error;
-    int erroffset;
-
     FILE *rulesfile;
     char ruleset_fullname[MAXPATH];
 
@@ -109,8 +1040,6 @@ void Load_Rules( const char *ruleset )
 
     char nettmp[64];
 
-    char tolower_tmp[512];
-
     char *tokenrule;
     char *tokennet;
     char *rulesplit;
@@ -186,6 +1115,28 @@ void Load_Rules( const char *ruleset )
 
     int is_masked = 0;
 
+    /* Flows are parsed here,  then copied to the arena at their real size */
+
+    struct arr_flow_1 flow_1[MAX_CHECK_FLOWS];
+    struct arr_flow_2 flow_2[MAX_CHECK_FLOWS];
+    struct arr_port_1 port_1[MAX_CHECK_FLOWS];
+    struct arr_port_2 port_2[MAX_CHECK_FLOWS];
+
+    char *meta_converted[MAX_META_CONTENT_ITEMS];
+    char meta_content_help[CONFBUF];
+
+    _Rules_Set *set = NULL;
+    _Rules_PCRE_Queue pcre_queue;
+
+    uint64_t load_start = Sagan_Clock_Mono_NS() / 1000;
+    uint64_t cache_key = 0;
+    int first = counters->rulecount;
+    int xbit_start = counters->xbit_total_counter;
+    int dynamic_start = counters->dynamic_rule_count;
+
+    memset(&pcre_queue, 0, sizeof(pcre_queue));
+    rules_var_usec = 0;
+
     /* Store rule set names/path in memory for later usage dynamic loading, etc */
 
     strlcpy(ruleset_fullname, ruleset, sizeof(ruleset_fullname));
@@ -197,7 +1148,53 @@ void Load_Rules( const char *ruleset )
 
     Sagan_Log(NORMAL, "Loading %s rule file.", ruleset_fullname);
 
-    while ( fgets(rulebuf, sizeof(rulebuf), rulesfile) != NULL )
+    set = calloc(1, sizeof(_Rules_Set));
+
+    if ( set == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for rule set. Abort!", __FILE__, __LINE__);
+        }
+
+    rules_build->sets = Rules_Realloc(rules_build->sets, ( rules_build->set_count + 1 ) * sizeof(_Rules_Set *));
+    rules_build->sets[rules_build->set_count++] = set;
+
+    set->refs = 1;
+    strlcpy(set->ruleset, ruleset_fullname, sizeof(set->ruleset));
+
+    /* An unchanged rule file comes straight from the rule cache */
+
+    if ( config->rule_cache_dir[0] != '\0' )
+        {
+
+            cache_key = Rules_Cache_Key(ruleset_fullname);
+
+            if ( config->rule_cache_rebuild == false && Rules_Cache_Restore(ruleset_fullname, cache_key, set) == true )
+                {
+
+                    fclose(rulesfile);
+
+                    set->cached = true;
+                    set->read_usec = Sagan_Clock_Mono_NS() / 1000 - load_start;
+
+                    for ( d = first; d < counters->rulecount; d++ )
+                        {
+
+                            Rules_Header_Build(d, set);
+
+                            for ( i = 0; i < rulestruct[d].pcre_count; i++ )
+                                {
+                                    Rules_PCRE_Queue(&pcre_queue, d, i);
+                                }
+                        }
+
+                    set->parse_usec = Sagan_Clock_Mono_NS() / 1000 - load_start - set->read_usec;
+
+                    Rules_Load_Finish(&pcre_queue, set, first, ruleset_fullname, cache_key);
+                    return;
+                }
+        }
+
+    while ( Rules_Read_Line(rulebuf, sizeof(rulebuf), rulesfile, &set->read_usec) != NULL )
         {
             /* Reset for next rule */
 
@@ -217,10 +1214,10 @@ void Load_Rules( const char *ruleset )
             memset(netstr, 0, sizeof(netstr));
             memset(rulestr, 0, sizeof(rulestr));
 
-            int f1=0; /* Need for flow_direction, must reset every rule, not every group */
-            int f2=0; /* Need for flow_direction, must reset every rule, not every group */
-            int g1=0; /* Need for port_direction, must reset every rule, not every group */
-            int g2=0; /* Need for port_direction, must reset every rule, not every group */
+            memset(flow_1, 0, sizeof(flow_1));
+            memset(flow_2, 0, sizeof(flow_2));
+            memset(port_1, 0, sizeof(port_1));
+            memset(port_2, 0, sizeof(port_2));
 
             linecount++;
 
@@ -233,15 +1230,17 @@ void Load_Rules( const char *ruleset )
             else
                 {
 
-                    /* Allocate memory for rules, but not comments */
+                    /* Allocate memory for rules, but not comments.  The table
+                       doubles,  so loading n rules is O(log n) realloc()'s */
 
-                    rulestruct = (_Rule_Struct *) realloc(rulestruct, (counters->rulecount+1) * sizeof(_Rule_Struct));
-                    if ( rulestruct == NULL )
+                    if ( counters->rulecount >= rules_build->size )
                         {
-                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for rulestruct. Abort!", __FILE__, __LINE__);
+                            Rules_Grow();
                         }
 
                     memset(&rulestruct[counters->rulecount], 0, sizeof(struct _Rule_Struct));
+                    rulestruct[counters->rulecount].class_id = -1;
+                    rulestruct[counters->rulecount].s_linecount = linecount;
 
                 }
 
@@ -447,7 +1446,7 @@ void Load_Rules( const char *ruleset )
                         {
 
 
-                            Var_To_Value(tokennet, flow_a, sizeof(flow_a));
+                            Rules_Var_To_Value(tokennet, flow_a, sizeof(flow_a));
 
                             Remove_Spaces(flow_a);
 
@@ -493,9 +1492,14 @@ void Load_Rules( const char *ruleset )
                                                     Sagan_Log(WARN,"[%s, line %d] Value is not a valid IPv4/IPv6 '%s'", __FILE__, __LINE__, tok_help);
                                                 }
 
-                                            f1++;
+                                            if ( flow_1_count >= MAX_CHECK_FLOWS )
+                                                {
+                                                    bad_rule = true;
+                                                    Sagan_Log(WARN,"[%s, line %d] You have exceeded the amount of IP's for flow_1 '%d', skipping rule.", __FILE__, __LINE__, MAX_CHECK_FLOWS);
+                                                    break;
+                                                }
 
-                                            is_masked = Netaddr_To_Range(tmptoken, (unsigned char *)&rulestruct[counters->rulecount].flow_1[flow_1_count].range);
+                                            is_masked = Netaddr_To_Range(tmptoken, (unsigned char *)&flow_1[flow_1_count].range);
 
                                             if(strchr(tmptoken, '/'))
                                                 {
@@ -503,37 +1507,30 @@ void Load_Rules( const char *ruleset )
                                                     if( !strncmp(tmptoken, "!", 1) || !strncmp("not", tmptoken, 3))
                                                         {
 
-                                                            rulestruct[counters->rulecount].flow_1_type[f1] = is_masked ? 0 : 2; /* 0 = not in group, 2 == IP not range */
+                                                            flow_1[flow_1_count].type = is_masked ? 0 : 2; /* 0 = not in group, 2 == IP not range */
                                                         }
                                                     else
                                                         {
 
-                                                            rulestruct[counters->rulecount].flow_1_type[f1] = is_masked ? 1 : 3; /* 1 = in group, 3 == IP not range */
+                                                            flow_1[flow_1_count].type = is_masked ? 1 : 3; /* 1 = in group, 3 == IP not range */
                                                         }
                                                 }
                                             else if( !strncmp(tmptoken, "!", 1) || !strncmp("not", tmptoken, 3))
                                                 {
 
-                                                    rulestruct[counters->rulecount].flow_1_type[f1] = 2; /* 2 = not match ip */
+                                                    flow_1[flow_1_count].type = 2; /* 2 = not match ip */
                                                 }
                                             else
                                                 {
 
-                                                    rulestruct[counters->rulecount].flow_1_type[f1] = 3; /* 3 = match ip */
+                                                    flow_1[flow_1_count].type = 3; /* 3 = match ip */
                                                 }
 
                                             flow_1_count++;
-
-                                            if( flow_1_count > MAX_CHECK_FLOWS )
-                                                {
-                                                    bad_rule = true;
-                                                    Sagan_Log(WARN,"[%s, line %d] You have exceeded the amount of IP's for flow_1 '50', skipping rule.", __FILE__, __LINE__);
-                                                    continue;
-                                                }
-                                            printf("%d\n", flow_1_count);
                                         }
                                     rulestruct[counters->rulecount].flow_1_var = 1;   /* 1 = var */
                                     rulestruct[counters->rulecount].flow_1_counter = flow_1_count;
+                                    rulestruct[counters->rulecount].flow_1 = Sagan_Arena_Memdup(&set->arena, flow_1, flow_1_count * sizeof(struct arr_flow_1));
                                 }
                         }
 
@@ -551,11 +1548,17 @@ void Load_Rules( const char *ruleset )
                                     strlcpy(tmp4, nettmp, sizeof(tmp4));
                                     for (tmptoken = strtok_r(tmp4, ",", &saveptrport); tmptoken; tmptoken = strtok_r(NULL, ",", &saveptrport))
                                         {
+                                            if ( port_1_count >= MAX_CHECK_FLOWS )
+                                                {
+                                                    bad_rule = true;
+                                                    Sagan_Log(WARN,"[%s, line %d] You have exceeded the amount of Ports for port_1 '%d', skipping rule.", __FILE__, __LINE__, MAX_CHECK_FLOWS);
+                                                    break;
+                                                }
+
                                             Strip_Chars(tmptoken, "not!", tok_help2);
-                                            g1++;
                                             if (Is_Numeric(nettmp))
                                                 {
-                                                    rulestruct[counters->rulecount].port_1[port_1_count].lo = atoi(nettmp);          /* If it's a number (see Var_To_Value),  then set to that */
+                                                    port_1[port_1_count].lo = atoi(nettmp);          /* If it's a number (see Var_To_Value),  then set to that */
                                                 }
 
                                             if (!strncmp(tmptoken,"!", 1) || !strncmp("not", tmptoken, 3))
@@ -563,16 +1566,16 @@ void Load_Rules( const char *ruleset )
                                                     if(strchr(tok_help2,':'))
                                                         {
 
-                                                            rulestruct[counters->rulecount].port_1[port_1_count].lo = atoi(strtok_r(tok_help2, ":", &saveptrportrange));
-                                                            rulestruct[counters->rulecount].port_1[port_1_count].hi = atoi(strtok_r(NULL, ":", &saveptrportrange));
-                                                            rulestruct[counters->rulecount].port_1_type[g1] = 0; /* 0 = not in group */
+                                                            port_1[port_1_count].lo = atoi(strtok_r(tok_help2, ":", &saveptrportrange));
+                                                            port_1[port_1_count].hi = atoi(strtok_r(NULL, ":", &saveptrportrange));
+                                                            port_1[port_1_count].type = 0; /* 0 = not in group */
 
                                                         }
                                                     else
                                                         {
 
-                                                            rulestruct[counters->rulecount].port_1[port_1_count].lo = atoi(tok_help2);
-                                                            rulestruct[counters->rulecount].port_1_type[g1] = 2; /* This was a single port, not a range */
+                                                            port_1[port_1_count].lo = atoi(tok_help2);
+                                                            port_1[port_1_count].type = 2; /* This was a single port, not a range */
 
                                                         }
                                                 }
@@ -581,31 +1584,25 @@ void Load_Rules( const char *ruleset )
                                                     if(strchr(tok_help2, ':'))
                                                         {
 
-                                                            rulestruct[counters->rulecount].port_1[port_1_count].lo = atoi(strtok_r(tok_help2, ":", &saveptrportrange));
-                                                            rulestruct[counters->rulecount].port_1[port_1_count].hi = atoi(strtok_r(NULL, ":", &saveptrportrange));
-                                                            rulestruct[counters->rulecount].port_1_type[g1] = 1; /* 1 = in group */
+                                                            port_1[port_1_count].lo = atoi(strtok_r(tok_help2, ":", &saveptrportrange));
+                                                            port_1[port_1_count].hi = atoi(strtok_r(NULL, ":", &saveptrportrange));
+                                                            port_1[port_1_count].type = 1; /* 1 = in group */
 
                                                         }
                                                     else
                                                         {
 
-                                                            rulestruct[counters->rulecount].port_1[port_1_count].lo = atoi(tok_help2);
-                                                            rulestruct[counters->rulecount].port_1_type[g1] = 3; /* This was a single port, not a range */
+                                                            port_1[port_1_count].lo = atoi(tok_help2);
+                                                            port_1[port_1_count].type = 3; /* This was a single port, not a range */
 
                                                         }
 
                                                 }
                                             port_1_count++;
 
-                                            if( port_1_count > MAX_CHECK_FLOWS )
-                                                {
-                                                    Sagan_Log(WARN,"[%s, line %d] You have exceeded the amount of Ports for port_1 '%d', skipping rule.", __FILE__, __LINE__, MAX_CHECK_FLOWS);
-                                                    bad_rule = true;
-                                                    continue;
-                                                }
-
                                         }
                                     rulestruct[counters->rulecount].port_1_counter = port_1_count;
+                                    rulestruct[counters->rulecount].port_1 = Sagan_Arena_Memdup(&set->arena, port_1, port_1_count * sizeof(struct arr_port_1));
                                 }
 
                         }
@@ -640,7 +1637,7 @@ void Load_Rules( const char *ruleset )
                     if ( netcount == 5 )
                         {
 
-                            Var_To_Value(tokennet, flow_b, sizeof(flow_b));
+                            Rules_Var_To_Value(tokennet, flow_b, sizeof(flow_b));
 
                             Remove_Spaces(flow_b);
 
@@ -685,38 +1682,40 @@ void Load_Rules( const char *ruleset )
                                                     Sagan_Log(WARN,"[%s, line %d] Value is not a valid IPv4/IPv6 '%s'", __FILE__, __LINE__, tok_help);
                                                 }
 
-                                            f2++;
+                                            if ( flow_2_count >= MAX_CHECK_FLOWS )
+                                                {
+                                                    bad_rule = true;
+                                                    Sagan_Log(WARN,"[%s, line %d] You have exceeded the amount of entries for follow_flow_2 '%d', skipping.", __FILE__, __LINE__, MAX_CHECK_FLOWS);
+                                                    break;
+                                                }
 
-                                            is_masked = Netaddr_To_Range(tmptoken, (unsigned char *)&rulestruct[counters->rulecount].flow_2[flow_2_count].range);
+                                            is_masked = Netaddr_To_Range(tmptoken, (unsigned char *)&flow_2[flow_2_count].range);
 
                                             if(strchr(tmptoken, '/'))
                                                 {
                                                     if( !strncmp(tmptoken, "!", 1) || !strncmp("not", tmptoken, 3))
                                                         {
-                                                            rulestruct[counters->rulecount].flow_2_type[f2] = is_masked ? 0 : 2; /* 0 = not in group, 2 == IP not range */
+                                                            flow_2[flow_2_count].type = is_masked ? 0 : 2; /* 0 = not in group, 2 == IP not range */
                                                         }
                                                     else
                                                         {
-                                                            rulestruct[counters->rulecount].flow_2_type[f2] = is_masked ? 1 : 3; /* 1 = in group, 3 == IP not range */
+                                                            flow_2[flow_2_count].type = is_masked ? 1 : 3; /* 1 = in group, 3 == IP not range */
                                                         }
                                                 }
                                             else if( !strncmp(tmptoken, "!", 1) || !strncmp("not", tmptoken, 3))
                                                 {
-                                                    rulestruct[counters->rulecount].flow_2_type[f2] = 2; /* 2 = not match ip */
+                                                    flow_2[flow_2_count].type = 2; /* 2 = not match ip */
                                                 }
                                             else
                                                 {
-                                                    rulestruct[counters->rulecount].flow_2_type[f2] = 3; /* 3 = match ip */
-                                                }
-                                            if( flow_2_count > MAX_CHECK_FLOWS )
-                                                {
-                                                    bad_rule = true;
-                                                    Sagan_Log(WARN,"[%s, line %d] You have exceeded the amount of entries for follow_flow_2 '50', skipping.", __FILE__, __LINE__);
-                                                    continue;
+                                                    flow_2[flow_2_count].type = 3; /* 3 = match ip */
                                                 }
+
+                                            flow_2_count++;
                                         }
                                     rulestruct[counters->rulecount].flow_2_var = 1;   /* 1 = var */
                                     rulestruct[counters->rulecount].flow_2_counter = flow_2_count;
+                                    rulestruct[counters->rulecount].flow_2 = Sagan_Arena_Memdup(&set->arena, flow_2, flow_2_count * sizeof(struct arr_flow_2));
                                 }
                         }
 
@@ -734,11 +1733,17 @@ void Load_Rules( const char *ruleset )
                                     strlcpy(tmp4, nettmp, sizeof(tmp4));
                                     for (tmptoken = strtok_r(tmp4, ",", &saveptrport); tmptoken; tmptoken = strtok_r(NULL, ",", &saveptrport))
                                         {
+                                            if ( port_2_count >= MAX_CHECK_FLOWS )
+                                                {
+                                                    bad_rule = true;
+                                                    Sagan_Log(WARN,"[%s, line %d] You have exceeded the amount of Ports for port_2 '%d', skipping rule.", __FILE__, __LINE__, MAX_CHECK_FLOWS);
+                                                    break;
+                                                }
+
                                             Strip_Chars(tmptoken, "not!", tok_help2);
-                                            g2++;
                                             if (Is_Numeric(nettmp))
                                                 {
-                                                    rulestruct[counters->rulecount].port_2[port_2_count].lo = atoi(nettmp);          /* If it's a number (see Var_To_Value),  then set to that */
+                                                    port_2[port_2_count].lo = atoi(nettmp);          /* If it's a number (see Var_To_Value),  then set to that */
                                                 }
 
                                             if (!strncmp(tmptoken,"!", 1) || !strncmp("not", tmptoken, 3))
@@ -746,16 +1751,16 @@ void Load_Rules( const char *ruleset )
                                                     if(strchr(tok_help2,':'))
                                                         {
 
-                                                            rulestruct[counters->rulecount].port_2[port_2_count].lo = atoi(strtok_r(tok_help2, ":", &saveptrportrange));
-                                                            rulestruct[counters->rulecount].port_2[port_2_count].hi = atoi(strtok_r(NULL, ":", &saveptrportrange));
-                                                            rulestruct[counters->rulecount].port_2_type[g2] = 0; /* 0 = not in group */
+                                                            port_2[port_2_count].lo = atoi(strtok_r(tok_help2, ":", &saveptrportrange));
+                                                            port_2[port_2_count].hi = atoi(strtok_r(NULL, ":", &saveptrportrange));
+                                                            port_2[port_2_count].type = 0; /* 0 = not in group */
 
                                                         }
                                                     else
                                                         {
 
-                                                            rulestruct[counters->rulecount].port_2[port_2_count].lo = atoi(tok_help2);
-                                                            rulestruct[counters->rulecount].port_2_type[g2] = 2; /* This was a single port, not a range */
+                                                            port_2[port_2_count].lo = atoi(tok_help2);
+                                                            port_2[port_2_count].type = 2; /* This was a single port, not a range */
 
                                                         }
                                                 }
@@ -764,31 +1769,25 @@ void Load_Rules( const char *ruleset )
                                                     if(strchr(tok_help2, ':'))
                                                         {
 
-                                                            rulestruct[counters->rulecount].port_2[port_2_count].lo = atoi(strtok_r(tok_help2, ":", &saveptrportrange));
-                                                            rulestruct[counters->rulecount].port_2[port_2_count].hi = atoi(strtok_r(NULL, ":", &saveptrportrange));
-                                                            rulestruct[counters->rulecount].port_2_type[g2] = 1; /* 1 = in group */
+                                                            port_2[port_2_count].lo = atoi(strtok_r(tok_help2, ":", &saveptrportrange));
+                                                            port_2[port_2_count].hi = atoi(strtok_r(NULL, ":", &saveptrportrange));
+                                                            port_2[port_2_count].type = 1; /* 1 = in group */
 
                                                         }
                                                     else
                                                         {
 
-                                                            rulestruct[counters->rulecount].port_2[port_2_count].lo = atoi(tok_help2);
-                                                            rulestruct[counters->rulecount].port_2_type[g2] = 3; /* This was a single port, not a range */
+                                                            port_2[port_2_count].lo = atoi(tok_help2);
+                                                            port_2[port_2_count].type = 3; /* This was a single port, not a range */
 
                                                         }
 
                                                 }
                                             port_2_count++;
 
-                                            if( port_2_count > MAX_CHECK_FLOWS )
-                                                {
-                                                    bad_rule = true;
-                                                    Sagan_Log(WARN,"[%s, line %d] You have exceeded the amount of Ports for port_2 '%d', skipping.", __FILE__, __LINE__, MAX_CHECK_FLOWS);
-                                                    continue;
-                                                }
-
                                         }
                                     rulestruct[counters->rulecount].port_2_counter = port_2_count;
+                                    rulestruct[counters->rulecount].port_2 = Sagan_Arena_Memdup(&set->arena, port_2, port_2_count * sizeof(struct arr_port_2));
                                 }
 
                         }
@@ -802,7 +1801,7 @@ void Load_Rules( const char *ruleset )
                         }
 
                     tokennet = strtok_r(NULL, " ", &saveptrnet);
-                    Var_To_Value(tokennet, nettmp, sizeof(nettmp));
+                    Rules_Var_To_Value(tokennet, nettmp, sizeof(nettmp));
                     Remove_Spaces(nettmp);
 
                     netcount++;
@@ -863,7 +1862,7 @@ void Load_Rules( const char *ruleset )
                                     continue;
                                 }
 
-                            Var_To_Value(arg, tmp1, sizeof(tmp1));
+                            Rules_Var_To_Value(arg, tmp1, sizeof(tmp1));
                             Remove_Spaces(tmp1);
 
                             if (!strcmp(tmp1, "icmp") || !strcmp(tmp1, "1"))
@@ -895,7 +1894,7 @@ void Load_Rules( const char *ruleset )
                                     continue;
                                 }
 
-                            Var_To_Value(arg, tmp1, sizeof(tmp1));
+                            Rules_Var_To_Value(arg, tmp1, sizeof(tmp1));
                             Remove_Spaces(tmp1);
 
                             rulestruct[counters->rulecount].default_src_port = atoi(tmp1);
@@ -914,7 +1913,7 @@ void Load_Rules( const char *ruleset )
                                     continue;
                                 }
 
-                            Var_To_Value(arg, tmp1, sizeof(tmp1));
+                            Rules_Var_To_Value(arg, tmp1, sizeof(tmp1));
                             Remove_Spaces(tmp1);
 
 
@@ -1446,7 +2445,7 @@ void Load_Rules( const char *ruleset )
                                     continue;
                                 }
 
-                            Var_To_Value(arg, tmp1, sizeof(tmp1));
+                            Rules_Var_To_Value(arg, tmp1, sizeof(tmp1));
                             Remove_Spaces(tmp1);
 
                             strlcpy(rulestruct[counters->rulecount].dynamic_ruleset, tmp1, sizeof(rulestruct[counters->rulecount].dynamic_ruleset));
@@ -1537,11 +2536,16 @@ void Load_Rules( const char *ruleset )
 
                             tmptoken = strtok_r(NULL, ";", &saveptrrule2);           /* Grab country codes */
 
-                            Var_To_Value(tmptoken, tmp1, sizeof(tmp1));
+                            Rules_Var_To_Value(tmptoken, tmp1, sizeof(tmp1));
                             Remove_Spaces(tmp1);
 
                             strlcpy(rulestruct[counters->rulecount].geoip2_country_codes, tmp1, sizeof(rulestruct[counters->rulecount].geoip2_country_codes));
 
+                            if ( GeoIP2_Country_Set( rulestruct[counters->rulecount].geoip2_country_set, tmp1 ) == false )
+                                {
+                                    Sagan_Log(WARN, "[%s, line %d] 'country_code' option at line %d in %s has codes that are not two letter ISO codes.  They will never match.", __FILE__, __LINE__, linecount, ruleset_fullname);
+                                }
+
                             rulestruct[counters->rulecount].geoip2_flag = 1;
                         }
 #endif
@@ -1557,7 +2561,7 @@ void Load_Rules( const char *ruleset )
                     if (!strcmp(rulesplit, "meta_content"))
                         {
 
-                            if ( meta_content_count > MAX_META_CONTENT )
+                            if ( meta_content_count >= MAX_META_CONTENT )
                                 {
                                     bad_rule = true;
                                     Sagan_Log(WARN, "[%s, line %d] There is to many \"meta_content\" types in the rule at line %d in %s, skipping rule", __FILE__, __LINE__, linecount, ruleset_fullname);
@@ -1584,7 +2588,7 @@ void Load_Rules( const char *ruleset )
 
                             Content_Pipe(tmp2, linecount, ruleset_fullname, rule_tmp, sizeof(rule_tmp));
 
-                            strlcpy(rulestruct[counters->rulecount].meta_content_help[meta_content_count], rule_tmp, sizeof(rulestruct[counters->rulecount].meta_content_help[meta_content_count]));
+                            strlcpy(meta_content_help, rule_tmp, sizeof(meta_content_help));
 
                             tmptoken = strtok_r(NULL, ";", &saveptrrule2);           /* Grab Search data */
 
@@ -1595,7 +2599,7 @@ void Load_Rules( const char *ruleset )
                                     continue;
                                 }
 
-                            Var_To_Value(tmptoken, tmp1, sizeof(tmp1));
+                            Rules_Var_To_Value(tmptoken, tmp1, sizeof(tmp1));
                             Content_Pipe(tmp1, linecount, ruleset_fullname, rule_tmp, sizeof(rule_tmp));
                             Remove_Spaces(rule_tmp);
 
@@ -1607,21 +2611,22 @@ void Load_Rules( const char *ruleset )
                             while (ptmp != NULL)
                                 {
 
-                                    Replace_Sagan(rulestruct[counters->rulecount].meta_content_help[meta_content_count], ptmp, tmp_help, sizeof(tmp_help));
-                                    strlcpy(rulestruct[counters->rulecount].meta_content_containers[meta_content_count].meta_content_converted[meta_content_converted_count], tmp_help, sizeof(rulestruct[counters->rulecount].meta_content_containers[meta_content_count].meta_content_converted[meta_content_converted_count]));
-
-                                    meta_content_converted_count++;
-
-                                    if ( meta_content_converted_count > MAX_META_ITEM_SIZE )
+                                    if ( meta_content_converted_count >= MAX_META_CONTENT_ITEMS )
                                         {
 
-                                            Sagan_Log(ERROR, "[%s, line %d] To many meta_content string values at %d in %s.  Max is %d", __FILE__, __LINE__, linecount, ruleset_fullname, MAX_META_ITEM_SIZE);
+                                            Sagan_Log(ERROR, "[%s, line %d] To many meta_content string values at %d in %s.  Max is %d", __FILE__, __LINE__, linecount, ruleset_fullname, MAX_META_CONTENT_ITEMS);
 
                                         }
 
+                                    Replace_Sagan(meta_content_help, ptmp, tmp_help, sizeof(tmp_help));
+                                    meta_converted[meta_content_converted_count] = Sagan_Arena_Strdup(&set->arena, tmp_help);
+
+                                    meta_content_converted_count++;
+
                                     ptmp = strtok_r(NULL, ",", &tok);
                                 }
 
+                            rulestruct[counters->rulecount].meta_content_containers[meta_content_count].meta_content_converted = Sagan_Arena_Memdup(&set->arena, meta_converted, meta_content_converted_count * sizeof(char *));
                             rulestruct[counters->rulecount].meta_content_containers[meta_content_count].meta_counter = meta_content_converted_count;
 
                             rulestruct[counters->rulecount].meta_content_flag = true;
@@ -1639,9 +2644,11 @@ void Load_Rules( const char *ruleset )
                         {
                             strtok_r(NULL, ":", &saveptrrule2);
                             rulestruct[counters->rulecount].meta_content_case[meta_content_count-1] = 1;
-                            To_LowerC(rulestruct[counters->rulecount].meta_content[meta_content_count-1]);
-                            strlcpy(tolower_tmp, rulestruct[counters->rulecount].meta_content[meta_content_count-1], sizeof(tolower_tmp));
-                            strlcpy(rulestruct[counters->rulecount].meta_content[meta_content_count-1], tolower_tmp, sizeof(rulestruct[counters->rulecount].meta_content[meta_content_count-1]));
+
+                            for ( i = 0; i < rulestruct[counters->rulecount].meta_content_containers[meta_content_count-1].meta_counter; i++ )
+                                {
+                                    To_LowerC(rulestruct[counters->rulecount].meta_content_containers[meta_content_count-1].meta_content_converted[i]);
+                                }
                         }
 
 
@@ -1674,18 +2681,13 @@ void Load_Rules( const char *ruleset )
                             Remove_Spaces(arg);
                             strlcpy(rulestruct[counters->rulecount].s_classtype, arg, sizeof(rulestruct[counters->rulecount].s_classtype));
 
-                            found = 0;
+                            rulestruct[counters->rulecount].class_id = Classtype_Find(rulestruct[counters->rulecount].s_classtype);
 
-                            for(i=0; i < counters->classcount; i++)
+                            if ( rulestruct[counters->rulecount].class_id != -1 )
                                 {
-                                    if (!strcmp(classstruct[i].s_shortname, rulestruct[counters->rulecount].s_classtype))
-                                        {
-                                            rulestruct[counters->rulecount].s_pri = classstruct[i].s_priority;
-                                            found = 1;
-                                        }
+                                    rulestruct[counters->rulecount].s_pri = rules_active->classes[rulestruct[counters->rulecount].class_id].s_priority;
                                 }
-
-                            if ( found == 0 )
+                            else
                                 {
                                     bad_rule = true;
                                     Sagan_Log(WARN, "[%s, line %d] The classtype \"%s\" was not found on line %d in %s! "
@@ -1706,7 +2708,7 @@ void Load_Rules( const char *ruleset )
                                     continue;
                                 }
 
-                            Var_To_Value(arg, tmp1, sizeof(tmp1));
+                            Rules_Var_To_Value(arg, tmp1, sizeof(tmp1));
                             Remove_Spaces(tmp1);
 
                             strlcpy(rulestruct[counters->rulecount].s_program, tmp1, sizeof(rulestruct[counters->rulecount].s_program));
@@ -1724,8 +2726,15 @@ void Load_Rules( const char *ruleset )
                                     continue;
                                 }
 
+                            if ( ref_count >= MAX_REFERENCE )
+                                {
+                                    bad_rule = true;
+                                    Sagan_Log(WARN, "[%s, line %d] There is to many \"reference\" types in the rule at line %d in %s, skipping rule", __FILE__, __LINE__, linecount, ruleset_fullname);
+                                    continue;
+                                }
+
                             Remove_Spaces(arg);
-                            strlcpy(rulestruct[counters->rulecount].s_reference[ref_count], arg, sizeof(rulestruct[counters->rulecount].s_reference[ref_count]));
+                            rulestruct[counters->rulecount].s_reference[ref_count] = Sagan_Arena_Strdup(&set->arena, arg);
                             rulestruct[counters->rulecount].ref_count=ref_count;
                             ref_count++;
                         }
@@ -1879,7 +2888,7 @@ void Load_Rules( const char *ruleset )
 
                     if (!strcmp(rulesplit, "content" ))
                         {
-                            if ( content_count > MAX_CONTENT )
+                            if ( content_count >= MAX_CONTENT )
                                 {
                                     bad_rule = true;
                                     Sagan_Log(WARN, "[%s, line %d] There is to many \"content\" types in the rule at line %d in %s, skipping rule", __FILE__, __LINE__, linecount, ruleset_fullname);
@@ -1909,7 +2918,7 @@ void Load_Rules( const char *ruleset )
                             Content_Pipe(tmp2, linecount, ruleset_fullname, rule_tmp, sizeof(rule_tmp));
                             strlcpy(final_content, rule_tmp, sizeof(final_content));
 
-                            strlcpy(rulestruct[counters->rulecount].s_content[content_count], final_content, sizeof(rulestruct[counters->rulecount].s_content[content_count]));
+                            rulestruct[counters->rulecount].s_content[content_count] = Sagan_Arena_Strdup(&set->arena, final_content);
                             final_content[0] = '\0';
                             content_count++;
                             rulestruct[counters->rulecount].content_count=content_count;
@@ -1922,8 +2931,6 @@ void Load_Rules( const char *ruleset )
                             strtok_r(NULL, ":", &saveptrrule2);
                             rulestruct[counters->rulecount].s_nocase[content_count - 1] = 1;
                             To_LowerC(rulestruct[counters->rulecount].s_content[content_count - 1]);
-                            strlcpy(tolower_tmp, rulestruct[counters->rulecount].s_content[content_count - 1], sizeof(tolower_tmp));
-                            strlcpy(rulestruct[counters->rulecount].s_content[content_count-1], tolower_tmp, sizeof(rulestruct[counters->rulecount].s_content[content_count-1]));
 
                         }
 
@@ -2047,7 +3054,7 @@ void Load_Rules( const char *ruleset )
                     if (!strcmp(rulesplit, "pcre" ))
                         {
 
-                            if ( pcre_count > MAX_PCRE )
+                            if ( pcre_count >= MAX_PCRE )
                                 {
                                     bad_rule = true;
                                     Sagan_Log(WARN, "[%s, line %d] There is to many \"pcre\" types in the rule at line %d in %s, skipping rule", __FILE__, __LINE__, linecount, ruleset_fullname);
@@ -2064,6 +3071,7 @@ void Load_Rules( const char *ruleset )
                                 }
 
                             pcreflag=0;
+                            pcreoptions=0;
                             memset(pcrerule, 0, sizeof(pcrerule));
 
                             for ( i = 1; i < strlen(tmp2); i++)
@@ -2145,42 +3153,14 @@ void Load_Rules( const char *ruleset )
 
                             /* We store the compiled/study results.  This saves us some CPU time during searching - Champ Clark III - 02/01/2011 */
 
-                            rulestruct[counters->rulecount].re_pcre[pcre_count] =  pcre_compile( pcrerule, pcreoptions, &error, &erroffset, NULL );
-
-#ifdef PCRE_HAVE_JIT
-
-                            if ( config->pcre_jit == 1 )
-                                {
-                                    pcreoptions |= PCRE_STUDY_JIT_COMPILE;
-                                }
-#endif
-
-                            rulestruct[counters->rulecount].pcre_extra[pcre_count] = pcre_study( rulestruct[counters->rulecount].re_pcre[pcre_count], pcreoptions, &error);
-
-#ifdef PCRE_HAVE_JIT
-
-                            if ( config->pcre_jit == 1 )
-                                {
-                                    int jit = 0;
-                                    rc = 0;
-
-                                    rc = pcre_fullinfo(rulestruct[counters->rulecount].re_pcre[pcre_count], rulestruct[counters->rulecount].pcre_extra[pcre_count], PCRE_INFO_JIT, &jit);
+                            /* Compiling is left to Rules_PCRE_Compile() once the whole file
+                             * has been parsed.  Only the regexes are compiled in parallel,
+                             * the parse itself is serial */
 
-                                    if (rc != 0 || jit != 1)
-                                        {
-                                            Sagan_Log(WARN, "[%s, line %d] PCRE JIT does not support regexp in %s at line %d (pcre: \"%s\"). Continuing without PCRE JIT enabled for this rule.", __FILE__, __LINE__, ruleset_fullname, linecount, pcrerule);
-                                        }
-                                }
-
-#endif
+                            rulestruct[counters->rulecount].s_pcre[pcre_count] = Sagan_Arena_Strdup(&set->arena, pcrerule);
+                            rulestruct[counters->rulecount].pcre_options[pcre_count] = pcreoptions;
 
-                            if (  rulestruct[counters->rulecount].re_pcre[pcre_count]  == NULL )
-                                {
-                                    bad_rule = true;
-                                    Remove_Lock_File();
-                                    Sagan_Log(WARN, "[%s, line %d] PCRE failure at %d: %s, skipping rule", __FILE__, __LINE__, erroffset, error);
-                                    continue;
-                                }
+                            Rules_PCRE_Queue(&pcre_queue, counters->rulecount, pcre_count);
 
                             pcre_count++;
                             rulestruct[counters->rulecount].pcre_count=pcre_count;
@@ -2233,7 +3213,7 @@ void Load_Rules( const char *ruleset )
                             rulestruct[counters->rulecount].alert_time_flag = 1;
 
                             tok_tmp = strtok_r(NULL, ":", &saveptrrule2);
-                            Var_To_Value(tok_tmp, tmp1, sizeof(tmp1));
+                            Rules_Var_To_Value(tok_tmp, tmp1, sizeof(tmp1));
 
                             tmptoken = strtok_r(tmp1, ",", &saveptrrule2);
 
@@ -2872,7 +3852,7 @@ void Load_Rules( const char *ruleset )
                                                     continue;
                                                 }
 
-                                            Var_To_Value(tmptok_tmp, tmp1, sizeof(tmp1));
+                                            Rules_Var_To_Value(tmptok_tmp, tmp1, sizeof(tmp1));
 
                                             Sagan_Verify_Categories( tmp1, counters->rulecount, ruleset_fullname, linecount, BLUEDOT_LOOKUP_HASH);
                                         }
@@ -2891,7 +3871,7 @@ void Load_Rules( const char *ruleset )
                                                     continue;
                                                 }
 
-                                            Var_To_Value(tmptok_tmp, tmp1, sizeof(tmp1));
+                                            Rules_Var_To_Value(tmptok_tmp, tmp1, sizeof(tmp1));
 
                                             Sagan_Verify_Categories( tmp1, counters->rulecount, ruleset_fullname, linecount, BLUEDOT_LOOKUP_URL);
                                         }
@@ -2910,7 +3890,7 @@ void Load_Rules( const char *ruleset )
                                                     continue;
                                                 }
 
-                                            Var_To_Value(tmptok_tmp, tmp1, sizeof(tmp1));
+                                            Rules_Var_To_Value(tmptok_tmp, tmp1, sizeof(tmp1));
 
                                             Sagan_Verify_Categories( tmp1, counters->rulecount, ruleset_fullname, linecount, BLUEDOT_LOOKUP_FILENAME);
                                         }
@@ -2942,6 +3922,14 @@ void Load_Rules( const char *ruleset )
                     continue;
                 }
 
+            /* Format the references now,  so alerts don't have to */
+
+            Reference_Render(counters->rulecount);
+
+            Rules_Header_Build(counters->rulecount, set);
+
+            set->rules++;
+
             /* Some new stuff (normalization) stuff needs to be added */
 
             if ( debug->debugload )
@@ -2984,4 +3972,74 @@ void Load_Rules( const char *ruleset )
         } /* end of while loop */
 
     fclose(rulesfile);
+
+    set->var_usec = rules_var_usec;
+    set->parse_usec = Sagan_Clock_Mono_NS() / 1000 - load_start - set->read_usec - set->var_usec;
+
+    set->xbit_counters = counters->xbit_total_counter - xbit_start;
+    set->dynamic_rules = counters->dynamic_rule_count - dynamic_start;
+
+    Rules_Load_Finish(&pcre_queue, set, first, ruleset_fullname, cache_key);
+}
+
+/****************************************************************************
+ * Rules_Check_Sids - Rules can't share a sid
+ ****************************************************************************/
+
+static void Rules_Check_Sids( void )
+{
+
+    int a = 0;
+    int check = 0;
+
+    for (a = 0; a < counters->rulecount; a++)
+        {
+
+            for ( check = a+1; check < counters->rulecount; check++)
+                {
+
+                    if (!strcmp (rulestruct[check].s_sid, rulestruct[a].s_sid ))
+                        {
+                            Sagan_Log(ERROR, "[%s, line %d] Detected duplicate signature id [sid] number %s.  Please correct this.", __FILE__, __LINE__, rulestruct[check].s_sid);
+                        }
+                }
+        }
+
+}
+
+/****************************************************************************
+ * Rules_Load_All - Loads every rule file in "rules_loaded" into a new
+ * version and publishes it.  Workers keep running on the old rules while
+ * this runs.  Callers hold SaganRulesLoadedMutex.
+ ****************************************************************************/
+
+void Rules_Load_All( void )
+{
+
+    int i = 0;
+
+    Rules_Build_Begin(false);
+
+    for ( i = 0; i < counters->rules_loaded_count; i++ )
+        {
+            Load_Rules(rules_loaded[i].ruleset);
+        }
+
+    Rules_Check_Sids();
+    Rules_Publish();
+
+}
+
+/****************************************************************************
+ * Rules_Load_Add - Publishes the current rules plus "ruleset".  Used for
+ * dynamic rules.  Callers hold SaganRulesLoadedMutex.
+ ****************************************************************************/
+
+void Rules_Load_Add( const char *ruleset )
+{
+
+    Rules_Build_Begin(true);
+    Load_Rules(ruleset);
+    Rules_Publish();
+
 }
@@ -26,12 +26,56 @@
 #define BLUEDOT_MAX_CAT        10
 #endif
 
+#include "util-arena.h"
+
 typedef struct _Rules_Loaded _Rules_Loaded;
 struct _Rules_Loaded
 {
     char ruleset[MAXPATH];
 };
 
+/* Memory used by the rules of one rule file.  Everything a rule points to
+ * (content,  flows,  meta_content,  etc) comes out of "arena".  A set is
+ * shared by every rule version that contains the file,  and freed with the
+ * last of them */
+
+typedef struct _Rules_Set _Rules_Set;
+struct _Rules_Set
+{
+    char ruleset[MAXPATH];
+    int rules;
+    size_t pcre_size;			/* Compiled and studied,  from pcre_fullinfo() */
+    _Sagan_Arena arena;
+
+    pcre **re_pcre;			/* The set's compiled PCREs,  to free them */
+    pcre_extra **pcre_extra;
+    int pcre_loaded;
+
+    int refs;				/* Rule versions using the set */
+
+    /* Load times in microseconds.  "compile" and "study" are summed over
+     * the PCRE compile threads,  "pcre_wall" is the elapsed time */
+
+    uint64_t read_usec;
+    uint64_t parse_usec;
+    uint64_t var_usec;
+    uint64_t compile_usec;
+    uint64_t study_usec;
+    uint64_t pcre_wall_usec;
+    int pcre_count;
+    int pcre_threads;
+
+    /* What loading the file added to counters->xbit_total_counter and
+     * counters->dynamic_rule_count.  Kept in the rule cache,  since the
+     * cache skips the parser that counts them */
+
+    int xbit_counters;
+    int dynamic_rules;
+    sbool cached;			/* Loaded from the rule cache */
+};
+
+/* "type" - 0 == not in group,  1 == in group,  2 == not match ip,  3 == match ip */
+
 typedef struct arr_flow_1 arr_flow_1;
 struct arr_flow_1
 {
@@ -40,6 +84,7 @@ struct arr_flow_1
         unsigned char ipbits[MAXIPBIT];
         unsigned char maskbits[MAXIPBIT];
     } range;
+    unsigned char type;
 };
 
 typedef struct arr_flow_2 arr_flow_2;
@@ -50,13 +95,17 @@ struct arr_flow_2
         unsigned char ipbits[MAXIPBIT];
         unsigned char maskbits[MAXIPBIT];
     } range;
+    unsigned char type;
 };
 
+/* "type" - 0 == not in range,  1 == in range,  2 == not port,  3 == port */
+
 typedef struct arr_port_1 arr_port_1;
 struct arr_port_1
 {
     int lo;
     int hi;
+    unsigned char type;
 };
 
 typedef struct arr_port_2 arr_port_2;
@@ -64,12 +113,13 @@ struct arr_port_2
 {
     int lo;
     int hi;
+    unsigned char type;
 };
 
 typedef struct meta_content_conversion meta_content_conversion;
 struct meta_content_conversion
 {
-    char meta_content_converted[MAX_META_CONTENT_ITEMS][256];
+    char **meta_content_converted;		/* "meta_counter" strings */
     int  meta_counter;
 };
 
@@ -81,10 +131,16 @@ struct _Rule_Struct
 
     pcre *re_pcre[MAX_PCRE];
     pcre_extra *pcre_extra[MAX_PCRE];
+    char *s_pcre[MAX_PCRE];			/* Source pattern and options,  for the rule cache */
+    int pcre_options[MAX_PCRE];
 
-    char s_content[MAX_CONTENT][256];
-    char s_reference[MAX_REFERENCE][256];
+    char *s_content[MAX_CONTENT];
+    char *s_reference[MAX_REFERENCE];
+    char s_reference_alert[MAX_REFERENCE_TEXT];		/* Formatted at load,  see Reference_Render() */
+    char s_reference_parsable[MAX_REFERENCE_TEXT];
     char s_classtype[32];
+    int  class_id;				/* classstruct[] index,  -1 if none */
+    int  s_linecount;				/* Line within the rule file */
     char s_sid[32];
     char s_rev[5];
     int  s_pri;
@@ -100,12 +156,12 @@ struct _Rule_Struct
     sbool type;				/* 0 == normal,  1 == dynamic */
     char  dynamic_ruleset[MAXPATH];
 
-    /* Check Flow */
-    struct arr_flow_1 flow_1[MAX_CHECK_FLOWS];
-    struct arr_flow_2 flow_2[MAX_CHECK_FLOWS];
+    /* Check Flow.  "*_counter" entries each */
+    struct arr_flow_1 *flow_1;
+    struct arr_flow_2 *flow_2;
 
-    struct arr_port_1 port_1[MAX_CHECK_FLOWS];
-    struct arr_port_2 port_2[MAX_CHECK_FLOWS];
+    struct arr_port_1 *port_1;
+    struct arr_port_2 *port_2;
 
     struct meta_content_conversion meta_content_containers[MAX_META_CONTENT];
 
@@ -118,13 +174,9 @@ struct _Rule_Struct
 
     sbool has_flow;
 
-    int flow_1_type[MAX_CHECK_FLOWS];
-    int flow_2_type[MAX_CHECK_FLOWS];
     int flow_1_counter;
     int flow_2_counter;
 
-    int port_1_type[MAX_CHECK_FLOWS];
-    int port_2_type[MAX_CHECK_FLOWS];
     int port_1_counter;
     int port_2_counter;
 
@@ -206,9 +258,6 @@ struct _Rule_Struct
     sbool meta_content_case[MAX_META_CONTENT];
     sbool meta_content_not[MAX_META_CONTENT];
 
-    char meta_content[MAX_META_CONTENT][CONFBUF];
-    char meta_content_help[MAX_META_CONTENT][CONFBUF];
-
     sbool alert_time_flag;
     unsigned char alert_days;
     sbool aetas_next_day;
@@ -280,10 +329,106 @@ struct _Rule_Struct
     sbool geoip2_flag;
     unsigned char geoip2_type;           /* 1 == isnot, 2 == is */
     char  geoip2_country_codes[256];
+    uint64_t geoip2_country_set[GEOIP2_COUNTRY_WORDS];	/* Compiled from geoip2_country_codes */
     unsigned char geoip2_src_or_dst;             /* 1 == src, 2 == dst */
 
 #endif
 
 };
 
-void Load_Rules ( const char * );
+/* The rule header table.  This is what the engine reads for every rule
+ * and every log line,  kept as parallel arrays indexed like rulestruct so
+ * the loop walks a few small dense arrays.  Everything else (messages,
+ * content,  references,  intel options) stays in _Rule_Struct and is only
+ * read once a rule passes these checks. */
+
+#define RULE_HEADER_PROGRAM	0
+#define RULE_HEADER_FACILITY	1
+#define RULE_HEADER_PRIORITY	2
+#define RULE_HEADER_LEVEL	3
+#define RULE_HEADER_TAG		4
+#define RULE_HEADER_MAX		5
+
+#define RULE_FLAG_PARSE_IP	0x0001		/* Needs Parse_IP() */
+#define RULE_FLAG_FLOW		0x0002
+#define RULE_FLAG_XBIT		0x0004
+#define RULE_FLAG_NORMALIZE	0x0008
+#define RULE_FLAG_ALERT_TIME	0x0010
+#define RULE_FLAG_GEOIP2	0x0020
+#define RULE_FLAG_BLACKLIST	0x0040
+#define RULE_FLAG_BROINTEL	0x0080
+
+/* One header field of one rule,  split on '|' at load.  For "program",  a
+ * hash of 0 means the value is a wildcard pattern */
+
+typedef struct _Rule_Header_Match _Rule_Header_Match;
+struct _Rule_Header_Match
+{
+    int count;
+    uint32_t *hash;			/* Hash_FNV1a() of each value */
+    char **value;
+};
+
+typedef struct _Rule_Header_Table _Rule_Header_Table;
+struct _Rule_Header_Table
+{
+    unsigned char *type;		/* NORMAL_RULE or DYNAMIC_RULE */
+    uint16_t *flags;			/* RULE_FLAG_* */
+    unsigned char *header_mask;		/* Bit per RULE_HEADER_* the rule checks */
+    unsigned char *content_count;
+    unsigned char *pcre_count;
+    unsigned char *meta_content_count;
+    _Rule_Header_Match *header[RULE_HEADER_MAX];
+};
+
+/* One complete set of loaded rules.  Published versions are never
+ * changed;  a reload or a dynamic rule builds a new version off to the side
+ * and swaps it in with one pointer store.  Workers pick up the new version
+ * at their next log line.  The old one is freed once no worker can still be
+ * on it (util-rcu.c) and no queued alert refers to it ("refs"). */
+
+typedef struct _Rules_Version _Rules_Version;
+struct _Rules_Version
+{
+    _Rule_Struct *rules;
+    _Rule_Header_Table hdr;
+    int count;				/* Loaded */
+    int size;				/* Allocated */
+
+    _Rules_Set **sets;
+    int set_count;
+
+    /* Tables loaded with the configuration.  They are swapped with the
+     * rules so a version always resolves class_id against its own
+     * classifications */
+
+    struct _Class_Struct *classes;
+    int class_count;
+
+    struct _Sagan_Processor_Generator *generators;
+    int generator_count;
+
+    struct _Sagan_Ignorelist *ignore;
+    int ignore_count;
+
+    uint64_t generation;
+    int refs;
+};
+
+/* The version the calling thread works with.  Workers set it per log line,
+ * output threads per alert,  and loaders to the version being built.
+ * "rulestruct" and "rulehdr" always refer to it. */
+
+extern __thread _Rules_Version *rules_active;
+
+#define rulestruct	(rules_active->rules)
+#define rulehdr		(rules_active->hdr)
+
+void Rules_Load_All( void );
+void Rules_Load_Add( const char * );
+void Rules_Use( _Rules_Version * );
+_Rules_Version *Rules_Hold( void );
+void Rules_Release( _Rules_Version * );
+void Rules_Reclaim( void );
+void Rules_Memory_Report( void );
+void Rules_Reserve( int );
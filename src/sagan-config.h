@@ -56,6 +56,12 @@ struct _SaganConfig
     int		    eve_fd;
     sbool		eve_alerts;
     sbool		eve_logs;
+    uint64_t		eve_buffer_size;
+    int			eve_flush_interval;
+    sbool		eve_sync;
+    unsigned char	eve_compress;
+    uint64_t		eve_rotate_size;
+    int			eve_rotate_interval;
 
 
     char         sagan_alert_filepath[MAXPATH];
@@ -66,6 +72,12 @@ struct _SaganConfig
     int          sagan_alert_fd;
     FILE	     *sagan_fast_stream;
     int	         sagan_fast_fd;
+    unsigned char alert_compress;
+    uint64_t     alert_rotate_size;
+    int          alert_rotate_interval;
+    unsigned char fast_compress;
+    uint64_t     fast_rotate_size;
+    int          fast_rotate_interval;
     char         sagan_log_filepath[MAXPATH];
     FILE         *sagan_log_stream;
     int          sagan_log_fd;
@@ -75,7 +87,7 @@ struct _SaganConfig
     char         sagan_log_path[MAXPATH];
     char         sagan_rule_path[MAXPATH];
     char         sagan_host[MAXHOST];
-    char         sagan_startutime[20];                  /* Records utime at startup */
+    uint64_t     sagan_startutime;                      /* Records utime at startup */
     char         home_net[MAXPATH];
     char         external_net[MAXPATH];
     char	 xbit_storage;				/* 0 == mmap, 1 == redis */
@@ -89,14 +101,34 @@ struct _SaganConfig
 
     sbool        sagan_external_output_flag;            /* For calling external commands */
     char         sagan_external_command[MAXPATH];
+    unsigned char external_mode;
+    unsigned char external_format;
+    int          external_processes;
+    int          external_timeout;
 
     int          sagan_port;
     sbool        disable_dns_warnings;
     sbool        syslog_src_lookup;
+    uint64_t     dns_cache_size;
+    int          dns_ttl;
+    int          dns_negative_ttl;
+    int          dns_resolvers;
+    int          dns_pending_policy;
+    int          dns_hold_time;
+    int          dns_queue_size;
+
+    uint64_t     output_queue_size;
+    int          output_overflow;
+    int          aggregate_by;			/* AGGREGATE_BY_* mask,  0 is off */
+    int          aggregate_window;		/* Seconds */
+    uint64_t     aggregate_memory;		/* Bytes */
     int          sagan_proto;
     char 	 *sagan_proto_string;
 
     sbool	 pcre_jit; 				/* For PCRE JIT support testing */
+    int          rule_compile_threads;		/* 0 == one per CPU */
+    char         rule_cache_dir[MAXPATH];	/* Empty == no rule cache */
+    sbool        rule_cache_rebuild;		/* --rebuild-rule-cache */
 
     sbool        endian;
 
@@ -113,6 +145,7 @@ struct _SaganConfig
 
     sbool       blacklist_flag;
     char        blacklist_files[2048];
+    char        blacklist_db[MAXPATH];		/* Precompiled intel image (saganintel) */
 
     sbool	perfmonitor_flag;
     int		perfmonitor_time;
@@ -122,6 +155,7 @@ struct _SaganConfig
 
     sbool        sagan_fwsam_flag;
     char         sagan_fwsam_info[1024];
+    int          fwsam_queue_size;
 
     /* Dynamic rule loading and reporting */
 
@@ -203,6 +237,9 @@ struct _SaganConfig
     char        sagan_esmtp_server[255];
     sbool       sagan_esmtp_flag;
     char        sagan_email_subject[64];
+    int         esmtp_spool_size;
+    int         esmtp_digest_interval;
+    int         esmtp_digest_max;
 #endif
 
     /* libdnet - Used for unified2 support */
@@ -243,6 +280,12 @@ struct _SaganConfig
     int		 bluedot_url_queue;
     int		 bluedot_filename_queue;
 
+    int		 bluedot_request_timeout;		/* Seconds */
+    int		 bluedot_negative_ttl;			/* Seconds */
+    int		 bluedot_max_connections;
+    int		 bluedot_max_deferred;
+    unsigned char bluedot_pending_policy;
+
 #endif
 
 
@@ -250,12 +293,14 @@ struct _SaganConfig
 
     sbool	 brointel_flag;
     char	 brointel_files[2048];
+    char	 brointel_db[MAXPATH];		/* Precompiled intel image (saganintel) */
+    sbool	 brointel_domain_boundary;	/* DOMAIN only matches whole labels */
 
     /* For Maxmind GeoIP2 address lookup */
 
 #ifdef HAVE_LIBMAXMINDDB
 
-    MMDB_s 	geoip2;
+    MMDB_s 	*geoip2;		/* Published with Sagan_RCU_Assign() */
     char        geoip2_country_file[MAXPATH];
     sbool 	have_geoip2;
 
@@ -84,7 +84,10 @@ typedef void json_object;
 #define MAX_CHECK_FLOWS		100		/* Max amount of IP addresses to be checked in a flow */
 
 #define MAX_REFERENCE		10		/* Max references within a rule */
+#define MAX_REFERENCE_TEXT	256		/* A rule's references,  formatted for output */
 #define MAX_PARSE_IP		10		/* Max IP to collect form log line via parse.c */
+#define RULES_ALLOC_MIN		64		/* First rulestruct allocation,  doubles after */
+#define RULES_COMPILE_THREADS_MAX	32		/* Cap on "rule-compile-threads" */
 
 /* TODO: These need to be labeled better! These directly affect
    functions like is_notroutable(). Think before you alter */
@@ -92,6 +95,14 @@ typedef void json_object;
 #define MAXIP			64		/* Max IP length */
 #define MAXIPBIT	     	16		/* Max IP length in bytes */
 
+/* GeoIP2 country sets are bitmaps over every two letter ISO code */
+
+#define GEOIP2_COUNTRY_COUNT		( 26 * 26 )
+#define GEOIP2_COUNTRY_WORDS		( ( GEOIP2_COUNTRY_COUNT + 63 ) / 64 )
+
+#define GEOIP2_CACHE_SIZE		1024		/* Per thread ip -> country LRU */
+#define GEOIP2_CACHE_BUCKETS		2048		/* Must be a power of 2 */
+
 
 #define MAXSELECTOR		64		/* Max tracking selector length */
 
@@ -128,6 +139,71 @@ typedef void json_object;
 
 #define MAX_PROCESSOR_THREADS   100
 
+/* "source-lookup" DNS cache */
+
+#define DNS_CACHE_SIZE_DEFAULT	10000
+#define DNS_TTL_DEFAULT		3600		/* Seconds */
+#define DNS_NEGATIVE_TTL_DEFAULT	300		/* Seconds */
+#define DNS_RESOLVERS_DEFAULT	4
+#define DNS_HOLD_TIME_DEFAULT	250		/* Milliseconds */
+#define DNS_QUEUE_SIZE_DEFAULT	1024		/* Hostnames queued or being resolved */
+#define DNS_REQUEST_TIMEOUT	30		/* Seconds before a pending lookup is retried */
+
+#define DNS_PENDING_PASS	0
+#define DNS_PENDING_HOLD	1
+
+/* Output queues */
+
+#define OUTPUT_QUEUE_SIZE_DEFAULT	256		/* Alerts per worker,  per plugin */
+#define OUTPUT_DRAIN_TIMEOUT		5		/* Seconds to wait for the queues on SIGHUP */
+
+#define OUTPUT_OVERFLOW_BLOCK		0
+#define OUTPUT_OVERFLOW_DROP		1
+
+/* Alert aggregation */
+
+#define AGGREGATE_WINDOW_DEFAULT	60		/* Seconds */
+#define AGGREGATE_MEMORY_DEFAULT	16		/* MB */
+
+/* EVE writer */
+
+#define EVE_BUFFER_SIZE_DEFAULT		65536		/* Bytes */
+#define EVE_FLUSH_INTERVAL_DEFAULT	1000		/* Milliseconds */
+#define EVE_BACKLOG_FACTOR		4		/* "buffer-size" multiples a thread may queue for the flusher */
+
+/* External output */
+
+#define EXTERNAL_MODE_EXEC		0		/* fork()/exec() per alert */
+#define EXTERNAL_MODE_PERSISTENT	1		/* Long lived children fed over stdin */
+
+#define EXTERNAL_FORMAT_TEXT		0
+#define EXTERNAL_FORMAT_JSON		1
+
+#define EXTERNAL_PROCESSES_DEFAULT	2
+#define EXTERNAL_TIMEOUT_DEFAULT	1000		/* Milliseconds */
+#define EXTERNAL_QUICK_EXIT		5000		/* Milliseconds.  A child that dies sooner "failed to start" */
+#define EXTERNAL_BACKOFF_MIN		250		/* Milliseconds before restarting after one quick exit,  doubles after */
+#define EXTERNAL_BACKOFF_MAX		60000		/* Milliseconds */
+#define EXTERNAL_MAX_QUICK_EXITS	5		/* Quick exits in a row before a pool is given up on */
+
+/* SMTP output */
+
+#define ESMTP_SPOOL_SIZE_DEFAULT	1000		/* Alerts waiting to be mailed */
+#define ESMTP_DIGEST_MAX_DEFAULT	100		/* Alerts per digest mail */
+#define ESMTP_BATCH_MAX			50		/* Mails sent per SMTP connection */
+
+/* Snortsam output */
+
+#define FWSAM_QUEUE_SIZE_DEFAULT	1000		/* Blocks waiting to be sent */
+
+/* Compressed/rotated output files */
+
+#define STREAM_COMPRESS_NONE		0
+#define STREAM_COMPRESS_GZIP		1
+
+#define STREAM_BUFFER_SIZE		65536		/* Bytes */
+#define STREAM_SYNC_INTERVAL		1		/* Seconds between zlib sync flushes */
+
 #define SUNDAY			1
 #define MONDAY			2
 #define TUESDAY			4
@@ -210,11 +286,17 @@ typedef void json_object;
 #define NORMAL_RULE			0
 #define DYNAMIC_RULE			1
 
+#define DYNAMIC_SAMPLE_QUEUE		64	/* Sampled log lines waiting on the dynamic rule thread */
+
 #define XBIT_STORAGE_MMAP		0
 #define XBIT_STORAGE_REDIS		1
 
 #define	THREAD_NAME_LEN			16
 
+#define SAGAN_LOG_QUEUE			256	/* Messages waiting on the log thread */
+#define SAGAN_LOG_MSG_SIZE		5128
+#define SAGAN_LOG_BURST			10	/* WARN/DEBUG messages per call site,  per second */
+
 #ifdef WITH_BLUEDOT
 
 #define BLUEDOT_IP_DEFAULT		500000
@@ -227,4 +309,12 @@ typedef void json_object;
 #define BLUEDOT_URL_QUEUE_DEFAULT	1000
 #define BLUEDOT_FILENAME_QUEUE_DEFAULT	1000
 
+#define BLUEDOT_REQUEST_TIMEOUT_DEFAULT	5
+#define BLUEDOT_NEGATIVE_TTL_DEFAULT	60
+#define BLUEDOT_MAX_CONNECTIONS_DEFAULT	32
+#define BLUEDOT_MAX_DEFERRED_DEFAULT	1000
+
+#define BLUEDOT_PENDING_EVALUATE	0
+#define BLUEDOT_PENDING_DEFER		1
+
 #endif
@@ -60,7 +60,9 @@
 #include "xbit-mmap.h"
 #include "processor.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "config-yaml.h"
+#include "rules.h"
 #include "ignore-list.h"
 #include "key.h"
 #include "lockfile.h"
@@ -69,6 +71,11 @@
 #include "stats.h"
 #include "ipc.h"
 #include "parsers/parsers.h"
+#include "util-dns.h"
+#include "output.h"
+#include "aggregate.h"
+#include "json-handler.h"
+#include "output-plugins/eve.h"
 
 #ifdef HAVE_SYS_PRCTL_H
 #include <sys/prctl.h>
@@ -83,6 +90,7 @@
 #include "processors/track-clients.h"
 #include "processors/perfmon.h"
 #include "processors/bro-intel.h"
+#include "processors/dynamic-rules.h"
 
 #ifdef HAVE_LIBLOGNORM
 #include "liblognormalize.h"
@@ -92,14 +100,20 @@
 #include "output-plugins/unified2.h"
 #endif
 
+#ifdef HAVE_LIBESMTP
+#include "output-plugins/esmtp.h"
+#endif
+
+#ifdef WITH_SNORTSAM
+#include "output-plugins/snortsam.h"
+#endif
+
 #define OVECCOUNT 30
 
 struct _SaganCounters *counters = NULL;
 struct _SaganConfig *config = NULL;
 struct _SaganDebug *debug = NULL;
 
-struct _Rule_Struct *rulestruct;
-
 #ifdef WITH_BLUEDOT
 #include <curl/curl.h>
 #include "processors/bluedot.h"
@@ -115,7 +129,6 @@ struct _Sagan_Proc_Syslog *SaganProcSyslog = NULL;
 int proc_msgslot = 0;
 int proc_running = 0;
 
-unsigned char dynamic_rule_flag = 0;
 sbool reload_rules = false;
 
 pthread_cond_t SaganProcDoWork=PTHREAD_COND_INITIALIZER;
@@ -123,7 +136,6 @@ pthread_cond_t SaganProcDoWork=PTHREAD_COND_INITIALIZER;
 pthread_mutex_t SaganProcWorkMutex=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t SaganMalformedCounter=PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t SaganRulesLoadedMutex=PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t SaganDynamicFlag=PTHREAD_MUTEX_INITIALIZER;
 
 /* ########################################################################
  * Start of main() thread
@@ -146,6 +158,7 @@ int main(int argc, char **argv)
         { "log",          required_argument,    NULL,   'l' },
         { "file",	  required_argument,    NULL,   'F' },
         { "quiet", 	  no_argument, 		NULL, 	'Q' },
+        { "rebuild-rule-cache", no_argument,	NULL,	'R' },		/* Long option only */
         {0, 0, 0, 0}
     };
 
@@ -208,9 +221,19 @@ int main(int argc, char **argv)
     pthread_attr_init(&ct_report_thread_attr);
     pthread_attr_setdetachstate(&ct_report_thread_attr,  PTHREAD_CREATE_DETACHED);
 
-    char src_dns_lookup[20] = { 0 };
+#ifdef WITH_BLUEDOT
+
+    /* Bluedot lookup thread */
+
+    pthread_t bluedot_thread;
+    pthread_attr_t bluedot_thread_attr;
+    pthread_attr_init(&bluedot_thread_attr);
+    pthread_attr_setdetachstate(&bluedot_thread_attr,  PTHREAD_CREATE_DETACHED);
+
+#endif
+
+    char src_dns_lookup[MAXIP] = { 0 };
 
-    sbool dns_flag = false;
     sbool fifoerr = false;
 
     char *syslog_host=NULL;
@@ -233,9 +256,6 @@ int main(int argc, char **argv)
 
     int dynamic_line_count = 0;
 
-    time_t t;
-    struct tm *run;
-
     sbool debugflag = false;
 
     /* Allocate memory for global struct _SaganDebug */
@@ -260,16 +280,6 @@ int main(int argc, char **argv)
 
     memset(config, 0, sizeof(_SaganConfig));
 
-    struct _SaganDNSCache *dnscache;
-    dnscache = malloc(sizeof(_SaganDNSCache));
-
-    if ( dnscache == NULL )
-        {
-            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for dnscache. Abort!", __FILE__, __LINE__);
-        }
-
-    memset(dnscache, 0, sizeof(_SaganDNSCache));
-
     counters = malloc(sizeof(_SaganCounters));
 
     if ( counters == NULL )
@@ -279,9 +289,7 @@ int main(int argc, char **argv)
 
     memset(counters, 0, sizeof(_SaganCounters));
 
-    t = time(NULL);
-    run=localtime(&t);
-    strftime(config->sagan_startutime, sizeof(config->sagan_startutime), "%s",  run);
+    config->sagan_startutime = Sagan_Clock_Epoch();
 
     strlcpy(config->sagan_config, CONFIG_FILE_PATH, sizeof(config->sagan_config));
 
@@ -329,6 +337,10 @@ int main(int argc, char **argv)
                     config->quiet = true;
                     break;
 
+                case 'R':
+                    config->rule_cache_rebuild = true;
+                    break;
+
                 case 'C':
                     Credits();
                     exit(0);
@@ -597,6 +609,11 @@ int main(int argc, char **argv)
         }
 
 
+    /* Log messages are written by their own thread from here on.  Like
+     * the signal thread,  this has to be after the fork() */
+
+    Sagan_Log_Init();
+
     /* Create the signal handlers thread _after_ the fork() so it can properly
      * handly signals - Champ Clark III - 06/13/2011 */
 
@@ -626,9 +643,22 @@ int main(int argc, char **argv)
 #endif
 
     pthread_mutex_lock(&SaganRulesLoadedMutex);
-    (void)Load_YAML_Config(config->sagan_config);
+    (void)Load_YAML_Config(config, config->sagan_config);
+
+    /* The ignore list is published with the rules */
+
+    if ( config->sagan_droplist_flag )
+        {
+            Load_Ignore_List();
+        }
+
+    Rules_Load_All();
     pthread_mutex_unlock(&SaganRulesLoadedMutex);
 
+    /* The rule cache has been rewritten;  reloads can use it again */
+
+    config->rule_cache_rebuild = false;
+
     (void)Sagan_Engine_Init();
 
     SaganProcSyslog = malloc(config->max_processor_threads * sizeof(struct _Sagan_Proc_Syslog));
@@ -660,6 +690,10 @@ int main(int argc, char **argv)
     Sagan_Log(NORMAL, "Out of %d rules, %d xbit(s) are in use.", counters->rulecount, counters->xbit_total_counter);
     Sagan_Log(NORMAL, "Out of %d rules, %d dynamic rule(s) are loaded.", counters->rulecount, counters->dynamic_rule_count);
 
+    pthread_mutex_lock(&SaganRulesLoadedMutex);
+    Rules_Memory_Report();
+    pthread_mutex_unlock(&SaganRulesLoadedMutex);
+
 #ifdef PCRE_HAVE_JIT
 
     if ( config->pcre_jit )
@@ -723,6 +757,11 @@ int main(int argc, char **argv)
 
     Open_Log_File(OPEN, ALERT_LOG);
 
+    if ( config->eve_flag )
+        {
+            Eve_Init();
+        }
+
     /****************************************************************************
      * Display processor information as we load
      ****************************************************************************/
@@ -752,6 +791,13 @@ int main(int argc, char **argv)
 
         }
 
+    /* DNS cache for "source-lookup" ********************************************/
+
+    if ( config->syslog_src_lookup )
+        {
+            Sagan_DNS_Init();
+        }
+
     /* Sagan Blacklist IP processor *********************************************/
 
     if ( config->blacklist_flag )
@@ -774,7 +820,7 @@ int main(int argc, char **argv)
 
             /* Record epoch so we can determine TTL */
 
-            config->bluedot_dns_last_lookup = atol(config->sagan_startutime);
+            config->bluedot_dns_last_lookup = config->sagan_startutime;
 
             if ( rc != 0 )
                 {
@@ -793,6 +839,20 @@ int main(int argc, char **argv)
             Sagan_Log(NORMAL, "Bluedot Hash Cache Size: %" PRIu64 "", config->bluedot_hash_max_cache);
             Sagan_Log(NORMAL, "Bluedot URL Cache Size: %" PRIu64 "", config->bluedot_url_max_cache);
             Sagan_Log(NORMAL, "Bluedot Filename Cache Size: %" PRIu64 "", config->bluedot_filename_max_cache);
+            Sagan_Log(NORMAL, "Bluedot Request Timeout: %d seconds.", config->bluedot_request_timeout);
+            Sagan_Log(NORMAL, "Bluedot Negative Cache Timeout: %d seconds.", config->bluedot_negative_ttl);
+            Sagan_Log(NORMAL, "Bluedot Max Connections: %d", config->bluedot_max_connections);
+            Sagan_Log(NORMAL, "Bluedot Pending Policy: %s", config->bluedot_pending_policy == BLUEDOT_PENDING_DEFER ? "defer" : "evaluate");
+
+            /* Lookups are done by their own thread so the engine never waits on Bluedot */
+
+            rc = pthread_create( &bluedot_thread, &bluedot_thread_attr, (void *)Sagan_Bluedot_Thread, NULL );
+
+            if ( rc != 0 )
+                {
+                    Remove_Lock_File();
+                    Sagan_Log(ERROR, "[%s, line %d] Error creating Bluedot thread [error: %d].", __FILE__, __LINE__, rc);
+                }
 
         }
 
@@ -835,6 +895,13 @@ int main(int argc, char **argv)
 
             Sagan_Log(NORMAL, "E-Mail will be sent from: %s", config->sagan_esmtp_from);
             Sagan_Log(NORMAL, "SMTP server is set to: %s", config->sagan_esmtp_server);
+
+            if ( config->esmtp_digest_interval != 0 )
+                {
+                    Sagan_Log(NORMAL, "E-Mail digests every %d seconds (max %d alerts per mail)", config->esmtp_digest_interval, config->esmtp_digest_max);
+                }
+
+            ESMTP_Init();
         }
 
 #endif
@@ -846,6 +913,9 @@ int main(int argc, char **argv)
 
             Sagan_Log(NORMAL, "");
             Sagan_Log(NORMAL, "Snortsam output plug in enabled.");
+            Sagan_Log(NORMAL, "Snortsam queue size: %d", config->fwsam_queue_size);
+
+            FWSam_Init();
 
         }
 
@@ -857,6 +927,11 @@ int main(int argc, char **argv)
             Sagan_Log(NORMAL, "");
             Sagan_Log(NORMAL, "External program to be called: %s", config->sagan_external_command);
 
+            if ( config->external_mode == EXTERNAL_MODE_PERSISTENT )
+                {
+                    Sagan_Log(NORMAL, "External program mode: persistent (%d processes, %s format)", config->external_processes, config->external_format == EXTERNAL_FORMAT_JSON ? "json" : "text");
+                }
+
         }
 
     /* Unified2 ****************************************************************/
@@ -885,7 +960,6 @@ int main(int argc, char **argv)
     if ( config->sagan_droplist_flag )
         {
 
-            Load_Ignore_List();
             Sagan_Log(NORMAL, "");
             Sagan_Log(NORMAL, "Loaded %d ignore/drop list item(s).", counters->droplist_count);
 
@@ -975,6 +1049,21 @@ int main(int argc, char **argv)
 
 #endif
 
+    /* Output threads must be running before the workers can alert */
+
+    Output_Init();
+
+    if ( config->aggregate_by != 0 )
+        {
+            Aggregate_Init();
+        }
+
+    if ( config->dynamic_load_flag == true )
+        {
+            Sagan_Log(NORMAL, "Spawning dynamic rule thread (sample rate: 1 in %d).", config->dynamic_load_sample_rate);
+            Sagan_Dynamic_Init();
+        }
+
     Sagan_Log(NORMAL, "Spawning %d Processor Threads.", config->max_processor_threads);
 
     for (i = 0; i < config->max_processor_threads; i++)
@@ -1119,65 +1208,23 @@ int main(int argc, char **argv)
 
                             syslog_host = psyslogstring != NULL ? strsep(&psyslogstring, "|") : NULL;
 
-                            /* If we're using DNS (and we shouldn't be!),  we start DNS checks and lookups
-                             * here.  We cache both good and bad lookups to not over load our DNS server(s).
-                             * The only way DNS cache can be cleared is to restart Sagan */
+                            /* If we're using DNS (and we shouldn't be!),  hostnames are looked up
+                             * through the DNS cache.  Misses are resolved by the resolver threads so
+                             * a slow DNS server doesn't stall the reader.  Failed lookups get the
+                             * config->sagan_host value */
 
                             if (config->syslog_src_lookup )
                                 {
 
-                                    if ( !Is_IP(syslog_host) )   	/* Is inbound a valid IP? */
+                                    if ( syslog_host == NULL )
                                         {
-                                            dns_flag = false;
-
-                                            for(i=0; i <= counters->dns_cache_count ; i++)  			/* Check cache first */
-                                                {
-                                                    if (!strcmp( dnscache[i].hostname, syslog_host))
-                                                        {
-                                                            syslog_host = dnscache[i].src_ip;
-                                                            dns_flag = true;
-                                                        }
-                                                }
-
-                                            /* If entry was not found in cache,  look it up */
-
-                                            if ( dns_flag == false )
-                                                {
-
-                                                    /* Do a DNS lookup */
-
-                                                    rc = DNS_Lookup(syslog_host, src_dns_lookup, sizeof(src_dns_lookup));
-
-                                                    /* Invalid lookups get the config->sagan_host value */
-
-                                                    if ( rc == -1 )
-                                                        {
-
-                                                            strlcpy(src_dns_lookup, config->sagan_host, sizeof(src_dns_lookup));
-                                                            counters->dns_miss_count++;
-
-                                                        }
-
-
-                                                    /* Add entry to DNS Cache */
-
-                                                    dnscache = (_SaganDNSCache *) realloc(dnscache, (counters->dns_cache_count+1) * sizeof(_SaganDNSCache));
-
-                                                    if ( dnscache == NULL )
-                                                        {
-
-                                                            Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for dnscache. Abort!", __FILE__, __LINE__);
-
-                                                        }
-
-                                                    memset(&dnscache[counters->dns_cache_count], 0, sizeof(_SaganDNSCache));
-
-                                                    strlcpy(dnscache[counters->dns_cache_count].hostname, syslog_host, sizeof(dnscache[counters->dns_cache_count].hostname));
-                                                    strlcpy(dnscache[counters->dns_cache_count].src_ip, src_dns_lookup, sizeof(dnscache[counters->dns_cache_count].src_ip));
-                                                    counters->dns_cache_count++;
-                                                    syslog_host = src_dns_lookup;
+                                            syslog_host = config->sagan_host;
+                                        }
 
-                                                }
+                                    else if ( !Is_IP(syslog_host) )   	/* Is inbound a valid IP? */
+                                        {
+                                            Sagan_DNS_Lookup(syslog_host, src_dns_lookup, sizeof(src_dns_lookup));
+                                            syslog_host = src_dns_lookup;
                                         }
 
                                 }
@@ -1362,26 +1409,16 @@ int main(int argc, char **argv)
                                     strlcpy(SaganProcSyslog[proc_msgslot].syslog_program, syslog_program, sizeof(SaganProcSyslog[proc_msgslot].syslog_program));
                                     strlcpy(SaganProcSyslog[proc_msgslot].syslog_message, syslog_msg, sizeof(SaganProcSyslog[proc_msgslot].syslog_message));
 
-                                    if ( config->dynamic_load_flag == true && ( dynamic_line_count >= config->dynamic_load_sample_rate ) )
-                                        {
-
-                                            pthread_mutex_lock(&SaganDynamicFlag);
-                                            dynamic_rule_flag = DYNAMIC_RULE;
-                                            pthread_mutex_unlock(&SaganDynamicFlag);
-
-                                            dynamic_line_count = 0;
-                                        }
-
+                                    SaganProcSyslog[proc_msgslot].bluedot_deferred_rule = 0;
+                                    SaganProcSyslog[proc_msgslot].bluedot_deferred_rules = NULL;
 
-                                    /* Thread holds here if rule load is in progress */
+                                    /* A copy goes to the dynamic rule thread.  The
+                                     * processor threads never run dynamic rules */
 
-                                    if ( config->dynamic_load_flag == true )
+                                    if ( config->dynamic_load_flag == true && ( dynamic_line_count >= config->dynamic_load_sample_rate ) )
                                         {
-
-                                            pthread_mutex_lock(&SaganRulesLoadedMutex);
-                                            reload_rules = true;
-                                            pthread_mutex_unlock(&SaganRulesLoadedMutex);
-
+                                            Sagan_Dynamic_Sample(&SaganProcSyslog[proc_msgslot]);
+                                            dynamic_line_count = 0;
                                         }
 
                                     proc_msgslot++;
@@ -97,6 +97,26 @@ typedef char sbool;	/* From rsyslog. 'bool' causes compatiablity problems on OSX
 			   "(small bool) I intentionally use char, to keep it slim so
 		           that many fit into the CPU cache!".  */
 
+/* Every Sagan_Log() call site gets one of these,  for rate limiting (see
+ * util.c).  The macro keeps call sites unchanged */
+
+typedef struct _Sagan_Log_Site _Sagan_Log_Site;
+struct _Sagan_Log_Site
+{
+    const char *file;
+    int line;
+    uint64_t window;			/* Second "count" is for */
+    int count;				/* Messages logged in "window" */
+    uint64_t suppressed;		/* Messages not logged since the last summary */
+    sbool listed;			/* On the log thread's list of sites to summarize */
+    struct _Sagan_Log_Site *next;
+};
+
+#define Sagan_Log(type, ...) do { \
+    static _Sagan_Log_Site sagan_log_site = { __FILE__, __LINE__ }; \
+    Sagan_Log_Site(&sagan_log_site, type, __VA_ARGS__); \
+} while (0)
+
 sbool     Is_Numeric (char *);
 void      To_UpperC(char* const );
 void      To_LowerC(char* const );
@@ -104,13 +124,15 @@ sbool	  Check_Endian( void );
 void      Usage( void );
 void      Chroot( const char * );
 void	  Remove_Return(char *);
-int       Classtype_Lookup( const char *, char *, size_t size );
 void      Remove_Spaces(char *);
 void      Between_Quotes( char *, char *str, size_t size );
 double    CalcPct(uint64_t, uint64_t);
 void      Replace_String(char *, char *, char *, char *str, size_t size);
 uint64_t Value_To_Seconds (char *, uint64_t);
-void      Sagan_Log( int, const char *, ... );
+void      Sagan_Log_Site( struct _Sagan_Log_Site *, int, const char *, ... );
+void      Sagan_Log_Init( void );
+void      Sagan_Log_Sync( void );
+void      Sagan_Log_Close( void );
 void      Droppriv( void );
 int       DNS_Lookup( char *, char *str, size_t size );
 void      Var_To_Value(char *, char *str, size_t size);
@@ -159,14 +181,6 @@ int       PageSupportsRWX(void);
 #endif
 
 
-typedef struct _SaganDNSCache _SaganDNSCache;
-struct _SaganDNSCache
-{
-
-    char hostname[64];
-    char src_ip[20];
-};
-
 typedef struct _Sagan_IPC_Counters _Sagan_IPC_Counters;
 struct _Sagan_IPC_Counters
 {
@@ -202,7 +216,19 @@ struct _SaganCounters
     uint64_t sagan_log_drop;
     uint64_t dns_cache_count;
     uint64_t dns_miss_count;
+    uint64_t dns_cache_hit;
+    uint64_t dns_pending_count;
+    uint64_t dns_queue_drop;
+    uint64_t external_count_success;
+    uint64_t external_count_failed;
+    uint64_t external_restart_count;
     uint64_t fwsam_count;
+    uint64_t fwsam_count_failed;
+    uint64_t fwsam_count_suppressed;		/* Duplicate of a block still in effect */
+    uint64_t fwsam_count_dropped;			/* Queue full */
+    uint64_t fwsam_queue_depth;
+    uint64_t fwsam_latency_total;			/* Microseconds,  queued to sent */
+    uint64_t fwsam_latency_max;
     uint64_t ignore_count;
     uint64_t blacklist_count;
 
@@ -232,6 +258,10 @@ struct _SaganCounters
 
     int	     dynamic_rule_count;
 
+    uint64_t dynamic_sampled;			/* Log lines sent to the dynamic rule thread */
+    uint64_t dynamic_sample_drop;		/* Samples dropped,  that thread was behind */
+    uint64_t dynamic_evaluated;			/* Samples run against the dynamic rules */
+
     int	     classcount;
     int      rulecount;
     int	     refcount;
@@ -269,6 +299,8 @@ struct _SaganCounters
 #ifdef WITH_BLUEDOT
     uint64_t bluedot_ip_cache_count;                      /* Bluedot cache processor */
     uint64_t bluedot_ip_cache_hit;                        /* Bluedot hit's from Cache */
+    uint64_t bluedot_ip_cache_miss;
+    uint64_t bluedot_ip_cache_evict;
     uint64_t bluedot_ip_positive_hit;
     uint64_t bluedot_ip_total;
 
@@ -282,19 +314,27 @@ struct _SaganCounters
     uint64_t bluedot_mdate_cache;                                 /* Hits from cache , but where over a modification date */
     uint64_t bluedot_cdate_cache;      			   /* Hits from cache , but where over a create date */
     uint64_t bluedot_error_count;
+    uint64_t bluedot_deferred;				   /* Log lines held for a pending lookup */
+    uint64_t bluedot_deferred_drop;			   /* Deferred list full,  evaluated without intel */
 
     uint64_t bluedot_hash_cache_count;
     uint64_t bluedot_hash_cache_hit;
+    uint64_t bluedot_hash_cache_miss;
+    uint64_t bluedot_hash_cache_evict;
     uint64_t bluedot_hash_positive_hit;
     uint64_t bluedot_hash_total;
 
     uint64_t bluedot_url_cache_count;
     uint64_t bluedot_url_cache_hit;
+    uint64_t bluedot_url_cache_miss;
+    uint64_t bluedot_url_cache_evict;
     uint64_t bluedot_url_positive_hit;
     uint64_t bluedot_url_total;
 
     uint64_t bluedot_filename_cache_count;
     uint64_t bluedot_filename_cache_hit;
+    uint64_t bluedot_filename_cache_miss;
+    uint64_t bluedot_filename_cache_evict;
     uint64_t bluedot_filename_positive_hit;
     uint64_t bluedot_filename_total;
 
@@ -306,6 +346,7 @@ struct _SaganCounters
 #ifdef HAVE_LIBESMTP
     uint64_t esmtp_count_success;
     uint64_t esmtp_count_failed;
+    uint64_t esmtp_count_dropped;
 #endif
 
 #ifdef HAVE_LIBHIREDIS
@@ -381,6 +422,9 @@ struct _Sagan_Proc_Syslog
     char syslog_program[50];
     char syslog_message[MAX_SYSLOGMSG];
 
+    int bluedot_deferred_rule;		/* Rule position + 1 when replayed by Bluedot,  0 otherwise */
+    struct _Rules_Version *bluedot_deferred_rules;	/* Held rules "bluedot_deferred_rule" is from */
+
 };
 
 typedef struct _Sagan_Event _Sagan_Event;
@@ -421,6 +465,8 @@ struct _Sagan_Event
     char *sid;
     char *rev;
     char *class;
+    int class_id;			/* See Classtype_Lookup() */
+    uint64_t aggregate_count;		/* Set on aggregation summaries */
     int pri;
     int ip_proto;
 
@@ -601,6 +647,7 @@ struct _Sagan_Processor_Info
     char *processor_priority;		/* Syslog priority */
     int   processor_pri;		/* Sagan priority */
     char *processor_class;
+    int   processor_class_id;		/* Classtype_Find() of processor_class */
     char *processor_tag;
     char *processor_rev;
     int   processor_generator_id;
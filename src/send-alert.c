@@ -43,6 +43,7 @@ void Send_Alert ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, json_object *json_n
 {
 
     char tmp[64] = { 0 };
+    const char *msg = NULL;
 
     struct _Sagan_Event *SaganProcessorEvent = NULL;
     SaganProcessorEvent = malloc(sizeof(struct _Sagan_Event));
@@ -57,8 +58,8 @@ void Send_Alert ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, json_object *json_n
     if ( processor_info->processor_generator_id != SAGAN_PROCESSOR_GENERATOR_ID )
         {
 
-            Generator_Lookup(processor_info->processor_generator_id, alertid, tmp, sizeof(tmp));
-            SaganProcessorEvent->f_msg           =       tmp;
+            msg = Generator_Lookup(processor_info->processor_generator_id, alertid);
+            SaganProcessorEvent->f_msg           =       msg != NULL ? (char *)msg : processor_info->processor_name;
 
         }
     else
@@ -73,6 +74,7 @@ void Send_Alert ( _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL, json_object *json_n
     SaganProcessorEvent->priority        =       processor_info->processor_priority;	/* Syslog priority */
     SaganProcessorEvent->pri             =       processor_info->processor_pri;		/* Sagan priority */
     SaganProcessorEvent->class           =       processor_info->processor_class;
+    SaganProcessorEvent->class_id        =       processor_info->processor_class_id;
     SaganProcessorEvent->tag             =       processor_info->processor_tag;
     SaganProcessorEvent->rev             =       processor_info->processor_rev;
 
@@ -60,10 +60,17 @@
 #include "rules.h"
 #include "ignore-list.h"
 #include "flow.h"
+#include "util-rcu.h"
 
 #include "processors/blacklist.h"
 #include "processors/track-clients.h"
 #include "processors/bro-intel.h"
+#include "processors/dynamic-rules.h"
+#include "util-dns.h"
+#include "output.h"
+#include "aggregate.h"
+#include "json-handler.h"
+#include "output-plugins/eve.h"
 
 #ifdef HAVE_LIBLOGNORM
 #include "liblognormalize.h"
@@ -76,6 +83,18 @@ int liblognorm_count;
 sbool sagan_unified2_flag;
 #endif
 
+#ifdef HAVE_LIBESMTP
+#include "output-plugins/esmtp.h"
+#endif
+
+#ifdef WITH_SNORTSAM
+#include "output-plugins/snortsam.h"
+#endif
+
+#ifdef WITH_BLUEDOT
+#include "processors/bluedot.h"
+#endif
+
 #ifdef HAVE_LIBMAXMINDDB
 #include <maxminddb.h>
 #include "geoip2.h"
@@ -84,30 +103,99 @@ sbool sagan_unified2_flag;
 struct _SaganCounters *counters;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
-struct _Rule_Struct *rulestruct;
 struct _Rules_Loaded *rules_loaded;
-struct _Class_Struct *classstruct;
-struct _Sagan_Processor_Generator *generator;
-struct _Sagan_Blacklist *SaganBlacklist;
-struct _Sagan_Track_Clients *SaganTrackClients;
 struct _SaganVar *var;
 
-struct _Sagan_Ignorelist *SaganIgnorelist;
+pthread_mutex_t SaganRulesLoadedMutex;
+
+/* Only one intel reload runs at a time.  A SIGHUP that arrives while one
+ * is running waits for it */
 
-struct _Sagan_BroIntel_Intel_Addr *Sagan_BroIntel_Intel_Addr;
-struct _Sagan_BroIntel_Intel_Domain *Sagan_BroIntel_Intel_Domain;
-struct _Sagan_BroIntel_Intel_File_Hash *Sagan_BroIntel_Intel_File_Hash;
-struct _Sagan_BroIntel_Intel_URL *Sagan_BroIntel_Intel_URL;
-struct _Sagan_BroIntel_Intel_Software *Sagan_BroIntel_Intel_Software;
-struct _Sagan_BroIntel_Intel_Email *Sagan_BroIntel_Intel_Email;
-struct _Sagan_BroIntel_Intel_User_Name *Sagan_BroIntel_Intel_User_Name;
-struct _Sagan_BroIntel_Intel_File_Name *Sagan_BroIntel_Intel_File_Name;
-struct _Sagan_BroIntel_Intel_Cert_Hash *Sagan_BroIntel_Intel_Cert_Hash;
+pthread_mutex_t SaganIntelLoaderMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t SaganIntelLoaderCond = PTHREAD_COND_INITIALIZER;
+sbool intel_loader_running = false;
 
-pthread_mutex_t SaganReloadMutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t SaganReloadCond = PTHREAD_COND_INITIALIZER;
+#ifdef WITH_BLUEDOT
+sbool bluedot_load;
+#endif
 
-pthread_mutex_t SaganRulesLoadedMutex;
+/* The configuration replaced by the last reload.  Threads outside of the
+ * rule versions read "config" without a lock,  so it is kept until the
+ * next reload instead of being freed right away */
+
+static struct _SaganConfig *config_retired = NULL;
+
+/****************************************************************************
+ * Config_Publish - Makes a configuration loaded by a reload the live one.
+ ****************************************************************************/
+
+static void Config_Publish( struct _SaganConfig *staging )
+{
+
+    struct _SaganConfig *old = config;
+
+    __atomic_store_n(&config, staging, __ATOMIC_RELEASE);
+
+    free(config_retired);
+    config_retired = old;
+
+}
+
+/****************************************************************************
+ * Sagan_Intel_Loader_Done - Lets the next SIGHUP start a loader.
+ ****************************************************************************/
+
+static void Sagan_Intel_Loader_Done( void )
+{
+
+    pthread_mutex_lock(&SaganIntelLoaderMutex);
+    intel_loader_running = false;
+    pthread_cond_broadcast(&SaganIntelLoaderCond);
+    pthread_mutex_unlock(&SaganIntelLoaderMutex);
+
+}
+
+/****************************************************************************
+ * Sagan_Intel_Loader - Rebuilds the intel stores (blacklist,  Bro Intel and
+ * GeoIP2) after a reload.  This runs once the workers are processing again.
+ * They keep using the old copies until each new one is swapped in,  and the
+ * old copies are released once every worker is done with them.
+ ****************************************************************************/
+
+static void Sagan_Intel_Loader( void )
+{
+
+    (void)SetThreadName("SaganIntel");
+
+    if ( config->blacklist_flag )
+        {
+            Sagan_Blacklist_Init();
+            Sagan_Blacklist_Load();
+        }
+
+    if ( config->brointel_flag )
+        {
+            Sagan_BroIntel_Init();
+            Sagan_BroIntel_Load_File();
+        }
+
+#ifdef HAVE_LIBMAXMINDDB
+
+    if ( config->have_geoip2 )
+        {
+            Sagan_Log(NORMAL, "Reloading GeoIP2 data.");
+            Open_GeoIP2_Database();
+        }
+
+#endif
+
+    Sagan_RCU_Reclaim();
+
+    Sagan_Log(NORMAL, "Intel data reloaded.");
+
+    Sagan_Intel_Loader_Done();
+
+}
 
 void Sig_Handler( void )
 {
@@ -116,7 +204,16 @@ void Sig_Handler( void )
 
     sigset_t signal_set;
     int sig;
+    int rc = 0;
     sbool orig_perfmon_value = 0;
+    sbool perfmon_open = false;
+
+    struct _SaganConfig *staging = NULL;
+
+    pthread_t intel_loader_thread;
+    pthread_attr_t intel_loader_thread_attr;
+    pthread_attr_init(&intel_loader_thread_attr);
+    pthread_attr_setdetachstate(&intel_loader_thread_attr,  PTHREAD_CREATE_DETACHED);
 
 #ifdef HAVE_LIBPCAP
     sbool orig_plog_value = 0;
@@ -150,15 +247,17 @@ void Sig_Handler( void )
 
 #ifdef HAVE_LIBMAXMINDDB
 
-                    MMDB_close(&config->geoip2);
+                    if ( config->geoip2 != NULL )
+                        {
+                            MMDB_close(config->geoip2);
+                        }
 
 #endif
 
                     if ( config->eve_flag == true )
                         {
 
-                            fflush(config->eve_stream);
-                            fclose(config->eve_stream);
+                            Eve_Close();
 
                         }
 
@@ -179,8 +278,21 @@ void Sig_Handler( void )
 
                         }
 
-                    fflush(config->sagan_log_stream);               /* Close the sagan.log */
-                    fclose(config->sagan_log_stream);
+#ifdef HAVE_LIBESMTP
+                    if ( config->sagan_esmtp_flag )
+                        {
+                            ESMTP_Close();				/* Pending digests */
+                        }
+#endif
+
+#ifdef WITH_SNORTSAM
+                    if ( config->sagan_fwsam_flag )
+                        {
+                            FWSam_Close();				/* Queued blocks,  check out */
+                        }
+#endif
+
+                    Sagan_Log_Close();				/* Write what is queued and close the sagan.log */
 
                     /* IPC Shared Memory */
 
@@ -265,9 +377,26 @@ void Sig_Handler( void )
 
                 case SIGHUP:
 
-                    config->sagan_reload = 1;				/* Only this thread can alter this */
+                    /* Wait for the last intel reload to finish */
+
+                    pthread_mutex_lock(&SaganIntelLoaderMutex);
+
+                    while ( intel_loader_running == true ) pthread_cond_wait(&SaganIntelLoaderCond, &SaganIntelLoaderMutex);
+
+                    intel_loader_running = true;
+                    pthread_mutex_unlock(&SaganIntelLoaderMutex);
+
+                    /* Workers keep running while the configuration is
+                     * rewritten.  What they read per log line (rules,  the
+                     * ignore list,  classifications and the gen-msg map) is
+                     * loaded into a new rule version and swapped in whole */
+
+                    __atomic_store_n(&config->sagan_reload, 1, __ATOMIC_RELEASE);	/* Only this thread can alter this */
 
-                    pthread_mutex_lock(&SaganReloadMutex);
+                    /* Queued alerts are written to the current log files */
+
+                    Aggregate_Flush();
+                    Output_Pause();
 
                     Sagan_Log(NORMAL, "[Reloading Sagan version %s.]-------", VERSION);
 
@@ -276,25 +405,12 @@ void Sig_Handler( void )
                     * 04/14/2015 - Champ Clark III (cclark@quadrantsec.com)
                     */
 
-                    Open_Log_File(REOPEN, ALL_LOGS);
-
-                    /******************/
-                    /* Reset counters */
-                    /******************/
-
-                    counters->refcount=0;
-                    counters->classcount=0;
-                    counters->rulecount=0;
-                    counters->ruletotal=0;
-                    counters->genmapcount=0;
-                    counters->rules_loaded_count=0;
-                    counters->var_count=0;
+                    if ( config->eve_flag == true )
+                        {
+                            Eve_Close();
+                        }
 
-                    memset(rules_loaded, 0, sizeof(_Rules_Loaded));
-                    memset(rulestruct, 0, sizeof(_Rule_Struct));
-                    memset(classstruct, 0, sizeof(_Class_Struct));
-                    memset(generator, 0, sizeof(_Sagan_Processor_Generator));
-                    memset(var, 0, sizeof(_SaganVar));
+                    Open_Log_File(REOPEN, ALL_LOGS);
 
                     /**********************************/
                     /* Disabled and reset processors. */
@@ -306,148 +422,178 @@ void Sig_Handler( void )
 
                     /* Single Threaded processors */
 
-                    if ( config->perfmonitor_flag == 1 && orig_perfmon_value == 0 )
+                    /* The perfmon thread stops writing before its file is
+                     * closed.  It is re-opened after the new configuration
+                     * is published */
+
+                    if ( config->perfmonitor_flag == 1 )
                         {
+                            __atomic_store_n(&config->perfmonitor_flag, 0, __ATOMIC_RELEASE);
                             Sagan_Perfmonitor_Close();
                             orig_perfmon_value = 1;
                         }
 
-                    config->perfmonitor_flag = 0;
-
 #ifdef HAVE_LIBPCAP
 
                     if ( config->plog_flag )
                         {
                             orig_plog_value = 1;
                         }
-
-                    config->plog_flag = 0;
 #endif
 
-                    /* Multi Threaded processors */
+                    /* The new configuration is parsed into a copy.  Workers
+                     * keep reading the current one (output flags and all)
+                     * until the copy is complete and published */
 
-                    config->blacklist_flag = 0;
+                    staging = malloc(sizeof(_SaganConfig));
 
-                    if ( config->blacklist_flag )
+                    if ( staging == NULL )
                         {
-                            free(SaganBlacklist);
+                            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for the new configuration. Abort!", __FILE__, __LINE__);
                         }
 
-                    config->blacklist_flag = 0;
+                    memcpy(staging, config, sizeof(_SaganConfig));
 
-                    if ( config->brointel_flag )
-                        {
-                            free(Sagan_BroIntel_Intel_Addr);
-                            free(Sagan_BroIntel_Intel_Domain);
-                            free(Sagan_BroIntel_Intel_File_Hash);
-                            free(Sagan_BroIntel_Intel_URL);
-                            free(Sagan_BroIntel_Intel_Software);
-                            free(Sagan_BroIntel_Intel_Email);
-                            free(Sagan_BroIntel_Intel_User_Name);
-                            free(Sagan_BroIntel_Intel_File_Name);
-                            free(Sagan_BroIntel_Intel_Cert_Hash);
+                    staging->perfmonitor_flag = 0;
 
-                            counters->brointel_addr_count = 0;
-                            counters->brointel_domain_count = 0;
-                            counters->brointel_file_hash_count = 0;
-                            counters->brointel_url_count = 0;
-                            counters->brointel_software_count = 0;
-                            counters->brointel_email_count = 0;
-                            counters->brointel_user_name_count = 0;
-                            counters->brointel_file_name_count = 0;
-                            counters->brointel_cert_hash_count = 0;
-                            counters->brointel_dups = 0;
-                        }
+#ifdef HAVE_LIBPCAP
+                    staging->plog_flag = 0;
+#endif
 
-                    config->brointel_flag = 0;
+                    /* Multi Threaded processors.  The blacklist and Bro Intel
+                     * data stay published until Sagan_Intel_Loader() swaps
+                     * in the new copies */
 
-                    if ( config->sagan_track_clients_flag )
-                        {
+                    staging->blacklist_flag = 0;
+                    staging->brointel_flag = 0;
 
-                            free(SaganTrackClients);
+                    staging->blacklist_db[0] = '\0';
+                    staging->brointel_db[0] = '\0';
 
-                        }
+#ifdef WITH_BLUEDOT
+
+                    /* Re-read the categories.  The new list replaces the old one */
+
+                    bluedot_load = false;
+#endif
 
                     /* Output formats */
 
-                    config->sagan_external_output_flag = 0;
+                    staging->sagan_external_output_flag = 0;
 
 #ifdef WITH_SYSLOG
-                    config->sagan_syslog_flag = 0;
+                    staging->sagan_syslog_flag = 0;
 #endif
 
 
 #ifdef HAVE_LIBESMTP
-                    config->sagan_esmtp_flag = 0;
+                    staging->sagan_esmtp_flag = 0;
 #endif
 
 #ifdef WITH_SNORTSAM
-                    config->sagan_fwsam_flag = 0;
+                    staging->sagan_fwsam_flag = 0;
 #endif
 
-                    /* Non-output / Processors */
+                    /* Non-output / Processors.  The published ignore list
+                     * stays in use until the new rules replace it */
 
-                    if ( config->sagan_droplist_flag )
-                        {
-                            config->sagan_droplist_flag = 0;
-                            free(SaganIgnorelist);
-                        }
+                    staging->sagan_droplist_flag = 0;
 
                     /************************************************************/
                     /* Re-load primary configuration (rules/classifictions/etc) */
                     /************************************************************/
 
+                    /* Variables,  references and the tables loaded with the
+                     * configuration are only read while loading rules.  The
+                     * dynamic rule thread loads under SaganRulesLoadedMutex */
+
                     pthread_mutex_lock(&SaganRulesLoadedMutex);
-                    Load_YAML_Config(config->sagan_config);	/* <- RELOAD */
+
+                    /******************/
+                    /* Reset counters */
+                    /******************/
+
+                    /* The rule counters are reset by Rules_Load_All() */
+
+                    counters->refcount=0;
+                    counters->classcount=0;
+                    counters->ruletotal=0;
+                    counters->genmapcount=0;
+                    counters->var_count=0;
+
+                    memset(var, 0, sizeof(_SaganVar));
+
+                    counters->rules_loaded_count=0;
+                    memset(rules_loaded, 0, sizeof(_Rules_Loaded));
+
+                    Load_YAML_Config(staging, staging->sagan_config);	/* <- RELOAD */
                     pthread_mutex_unlock(&SaganRulesLoadedMutex);
 
-                    /************************************************************/
-                    /* Re-load primary configuration (rules/classifictions/etc) */
-                    /************************************************************/
+                    /* perfmon is switched on once its file is open again */
 
-                    if ( config->perfmonitor_flag == 1 )
+                    perfmon_open = false;
+
+                    if ( staging->perfmonitor_flag == 1 )
                         {
                             if ( orig_perfmon_value == 1 )
                                 {
-                                    Sagan_Perfmonitor_Open();
+                                    perfmon_open = true;
                                 }
                             else
                                 {
                                     Sagan_Log(WARN, "** 'perfmonitor' must be loaded at runtime! NOT loading 'perfmonitor'!");
-                                    config->perfmonitor_flag = 0;
                                 }
+
+                            staging->perfmonitor_flag = 0;
                         }
 
 
 #ifdef HAVE_LIBPCAP
 
-                    if ( config->plog_flag == 1 )
+                    if ( staging->plog_flag == 1 && orig_plog_value == 0 )
                         {
-                            if ( orig_plog_value == 1 )
-                                {
-                                    config->plog_flag = 1;
-                                }
-                            else
-                                {
-                                    Sagan_Log(WARN, "** 'plog' must be loaded at runtime! NOT loading 'plog'!");
-                                    config->plog_flag = 0;
-                                }
+                            Sagan_Log(WARN, "** 'plog' must be loaded at runtime! NOT loading 'plog'!");
+                            staging->plog_flag = 0;
+                        }
+#endif
+
+                    /* The workers see the new configuration at their next
+                     * read.  Until Rules_Load_All() below finishes they run
+                     * it with the old rules */
+
+                    Config_Publish(staging);
+
+                    if ( perfmon_open == true )
+                        {
+                            Sagan_Perfmonitor_Open();
+                            config->perfmonitor_flag = 1;
+                        }
+
+#ifdef WITH_BLUEDOT
+
+                    /* Held back by Load_YAML_Config() during a reload.  Both
+                     * read the global configuration */
+
+                    if ( config->bluedot_flag == true && bluedot_load == false )
+                        {
+                            Sagan_Bluedot_Init();
+                            Sagan_Bluedot_Load_Cat();
+
+                            bluedot_load = true;
                         }
 #endif
 
-                    /* Load Blacklist data */
+                    /* Processors that are no longer enabled give up their data.
+                     * Enabled ones are reloaded by Sagan_Intel_Loader() */
 
-                    if ( config->blacklist_flag )
+                    if ( !config->blacklist_flag )
                         {
-                            counters->blacklist_count=0;
-                            Sagan_Blacklist_Init();
-                            Sagan_Blacklist_Load();
+                            Sagan_Blacklist_Free();
                         }
 
-                    if ( config->brointel_flag )
+                    if ( !config->brointel_flag )
                         {
-                            Sagan_BroIntel_Init();
-                            Sagan_BroIntel_Load_File();
+                            Sagan_BroIntel_Free();
                         }
 
                     if ( config->sagan_track_clients_flag )
@@ -456,25 +602,80 @@ void Sig_Handler( void )
                         }
 
 
+                    /* "source-lookup" can be turned on by a reload.  The cache
+                     * size and resolver count are fixed once it is running */
+
+                    if ( config->syslog_src_lookup )
+                        {
+                            Sagan_DNS_Init();
+                        }
+
+#ifdef WITH_SNORTSAM
+                    if ( config->sagan_fwsam_flag )
+                        {
+                            FWSam_Init();
+                        }
+#endif
+
+                    if ( config->aggregate_by != 0 )
+                        {
+                            Aggregate_Init();
+                        }
+
+                    Output_Resume();
+
+                    /* Parse and compile the rules with the workers running on
+                     * the old ones.  They switch over at their next log line */
+
+                    pthread_mutex_lock(&SaganRulesLoadedMutex);
+
                     /* Non output / processors */
 
+                    counters->droplist_count = 0;
+
                     if ( config->sagan_droplist_flag )
                         {
                             Load_Ignore_List();
                             Sagan_Log(NORMAL, "Loaded %d ignore/drop list item(s).", counters->droplist_count);
                         }
 
-#ifdef HAVE_LIBMAXMINDDB
-                    Sagan_Log(NORMAL, "Reloading GeoIP2 data.");
-                    Open_GeoIP2_Database();
+                    Rules_Load_All();
+                    Rules_Memory_Report();
+                    pthread_mutex_unlock(&SaganRulesLoadedMutex);
+
+                    __atomic_store_n(&config->sagan_reload, 0, __ATOMIC_RELEASE);
+
+                    Rules_Reclaim();
+
+#ifdef HAVE_LIBESMTP
+
+                    /* A rule's "email" option can turn e-mail on */
+
+                    if ( config->sagan_esmtp_flag )
+                        {
+                            ESMTP_Init();
+                        }
 #endif
 
-                    pthread_cond_signal(&SaganReloadCond);
-                    pthread_mutex_unlock(&SaganReloadMutex);
+                    /* Does nothing if the thread is already running */
 
-                    config->sagan_reload = 0;
+                    if ( config->dynamic_load_flag == true )
+                        {
+                            Sagan_Dynamic_Init();
+                        }
 
                     Sagan_Log(NORMAL, "Configuration reloaded.");
+
+                    /* Intel data is rebuilt while the workers run */
+
+                    rc = pthread_create( &intel_loader_thread, &intel_loader_thread_attr, (void *)Sagan_Intel_Loader, NULL );
+
+                    if ( rc != 0 )
+                        {
+                            Sagan_Log(WARN, "[%s, line %d] Error creating intel loader thread [error: %d]. Intel data not reloaded.", __FILE__, __LINE__, rc);
+                            Sagan_Intel_Loader_Done();
+                        }
+
                     break;
 
                 /* Signals to ignore */
@@ -39,6 +39,14 @@
 #include "sagan-defs.h"
 #include "stats.h"
 #include "sagan-config.h"
+#include "util-time.h"
+#include "util-dns.h"
+#include "output.h"
+#include "aggregate.h"
+
+#ifdef WITH_BLUEDOT
+#include "processors/bluedot.h"
+#endif
 
 struct _SaganCounters *counters;
 struct _Sagan_IPC_Counters *counters_ipc;
@@ -48,13 +56,13 @@ struct _SaganConfig *config;
 void Statistics( void )
 {
 
-    char timet[20];
-
-    time_t t;
-    struct tm *now;
     int seconds = 0;
     unsigned long total=0;
 
+    _Sagan_Output_Stats output_stats;
+    _Sagan_Aggregate_Stats aggregate_stats;
+    int i = 0;
+
     int uptime_days;
     int uptime_abovedays;
     int uptime_hours;
@@ -73,10 +81,7 @@ void Statistics( void )
     /* This is used to calulate the events per/second */
     /* Champ Clark III - 11/17/2011 */
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-    seconds = atol(timet) - atol(config->sagan_startutime);
+    seconds = Sagan_Clock_Epoch() - config->sagan_startutime;
 
     /* if statement prevents floating point exception */
 
@@ -171,30 +176,77 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "           Tracking/Down            : %" PRIu64 " / %"PRIu64 " [%d minutes]" , counters_ipc->track_clients_client_count, counters_ipc->track_clients_down, config->pp_sagan_track_clients);
                 }
 
+            /* How close the dynamic rule thread is to the configured sample
+             * rate.  Drops mean it couldn't keep up */
 
-            if (config->output_thread_flag)
+            if (config->dynamic_load_flag)
                 {
-                    Sagan_Log(NORMAL, "");
-                    Sagan_Log(NORMAL, "          -[ Sagan Output Plugin Statistics ]-");
-                    Sagan_Log(NORMAL, "");
-                    Sagan_Log(NORMAL,"           Dropped                  : %" PRIu64 " (%.3f%%)", counters->sagan_output_drop, CalcPct(counters->sagan_output_drop, counters->sagantotal) );
+                    Sagan_Log(NORMAL, "           Dynamic Samples          : %" PRIu64 " of %" PRIu64 " expected (%.3f%%)", counters->dynamic_sampled, counters->sagantotal / config->dynamic_load_sample_rate, CalcPct(counters->dynamic_sampled, counters->sagantotal / config->dynamic_load_sample_rate) );
+                    Sagan_Log(NORMAL, "           Dynamic Samples Dropped  : %" PRIu64 " (%.3f%%)", counters->dynamic_sample_drop, CalcPct(counters->dynamic_sample_drop, counters->dynamic_sampled + counters->dynamic_sample_drop) );
+                    Sagan_Log(NORMAL, "           Dynamic Samples Run      : %" PRIu64 "", counters->dynamic_evaluated);
+                }
+
+
+            Sagan_Log(NORMAL, "");
+            Sagan_Log(NORMAL, "          -[ Sagan Output Plugin Statistics ]-");
+            Sagan_Log(NORMAL, "");
+            Sagan_Log(NORMAL,"           Dropped                  : %" PRIu64 " (%.3f%%)", counters->sagan_output_drop, CalcPct(counters->sagan_output_drop, counters->sagantotal) );
+
+            for ( i = 0; i < SAGAN_OUTPUT_MAX; i++ )
+                {
+
+                    Output_Plugin_Stats(i, &output_stats);
+
+                    if ( output_stats.written == 0 && output_stats.dropped == 0 && output_stats.depth == 0 )
+                        {
+                            continue;
+                        }
+
+                    Sagan_Log(NORMAL, "           %-24s : %" PRIu64 " written, %" PRIu64 " queued, %" PRIu64 " dropped, latency %" PRIu64 "/%" PRIu64 " us (avg/max)",
+                              output_stats.name, output_stats.written, output_stats.depth, output_stats.dropped, output_stats.latency_avg, output_stats.latency_max);
+                }
+
+            if ( config->aggregate_by != 0 )
+                {
+                    Aggregate_Stats(&aggregate_stats);
+
+                    Sagan_Log(NORMAL, "           Aggregation              : %" PRIu64 " groups (%" PRIu64 " bytes), %" PRIu64 " suppressed, %" PRIu64 " summaries, %" PRIu64 " overflow", aggregate_stats.groups, aggregate_stats.memory, aggregate_stats.suppressed, aggregate_stats.summaries, aggregate_stats.overflow);
                 }
 
 #ifdef HAVE_LIBESMTP
             if ( config->sagan_esmtp_flag )
                 {
-                    Sagan_Log(NORMAL, "           Email Success/Failed     : %" PRIu64 " / %" PRIu64 "" , counters->esmtp_count_success, counters->esmtp_count_failed);
+                    Sagan_Log(NORMAL, "           Email Success/Failed     : %" PRIu64 " / %" PRIu64 " (%" PRIu64 " alerts dropped, spool full)" , counters->esmtp_count_success, counters->esmtp_count_failed, counters->esmtp_count_dropped);
+                }
+#endif
+
+#ifdef WITH_SNORTSAM
+            if ( config->sagan_fwsam_flag )
+                {
+                    Sagan_Log(NORMAL, "           Snortsam Sent/Failed     : %" PRIu64 " / %" PRIu64 " (%" PRIu64 " duplicates suppressed, %" PRIu64 " dropped, queue full)", counters->fwsam_count, counters->fwsam_count_failed, counters->fwsam_count_suppressed, counters->fwsam_count_dropped);
+                    Sagan_Log(NORMAL, "           Snortsam Queue/Latency   : %" PRIu64 " queued, latency %" PRIu64 "/%" PRIu64 " us (avg/max)", counters->fwsam_queue_depth,
+                              counters->fwsam_count + counters->fwsam_count_failed ? counters->fwsam_latency_total / ( counters->fwsam_count + counters->fwsam_count_failed ) : 0, counters->fwsam_latency_max);
                 }
 #endif
 
+            if ( config->external_mode == EXTERNAL_MODE_PERSISTENT )
+                {
+                    Sagan_Log(NORMAL, "           External Sent/Failed     : %" PRIu64 " / %" PRIu64 " (%" PRIu64 " restarts)", counters->external_count_success, counters->external_count_failed, counters->external_restart_count);
+                }
+
 
             if (config->syslog_src_lookup)
                 {
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          -[ Sagan DNS Cache Statistics ]-");
                     Sagan_Log(NORMAL, "");
+                    Sagan_DNS_Cache_Stats();
+
                     Sagan_Log(NORMAL, "           Cached                   : %" PRIu64 "", counters->dns_cache_count);
+                    Sagan_Log(NORMAL, "           Hits                     : %" PRIu64 "", counters->dns_cache_hit);
                     Sagan_Log(NORMAL, "           Missed                   : %" PRIu64 " (%.3f%%)", counters->dns_miss_count, CalcPct(counters->dns_miss_count, counters->dns_cache_count));
+                    Sagan_Log(NORMAL, "           Pending (default host)   : %" PRIu64 "", counters->dns_pending_count);
+                    Sagan_Log(NORMAL, "           Dropped (queue full)     : %" PRIu64 "", counters->dns_queue_drop);
                 }
 
             Sagan_Log(NORMAL, "");
@@ -207,6 +259,9 @@ void Statistics( void )
 
             if (config->bluedot_flag)
                 {
+
+                    Sagan_Bluedot_Cache_Stats();
+
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          -[ Sagan Bluedot Processor ]-");
                     Sagan_Log(NORMAL, "");
@@ -214,6 +269,8 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          IP addresses in cache         : %" PRIu64 " (%.3f%%)", counters->bluedot_ip_cache_count, CalcPct(counters->bluedot_ip_cache_count, config->bluedot_ip_max_cache));
                     Sagan_Log(NORMAL, "          IP hits from cache            : %" PRIu64 " (%.3f%%)", counters->bluedot_ip_cache_hit, CalcPct(counters->bluedot_ip_cache_hit, counters->bluedot_ip_cache_count));
+                    Sagan_Log(NORMAL, "          IP misses from cache          : %" PRIu64 "", counters->bluedot_ip_cache_miss);
+                    Sagan_Log(NORMAL, "          IP cache evictions            : %" PRIu64 "", counters->bluedot_ip_cache_evict);
                     Sagan_Log(NORMAL, "          IP/Bluedot hits in logs       : %" PRIu64 "", counters->bluedot_ip_positive_hit);
                     Sagan_Log(NORMAL, "          IP with date > mdate          : %" PRIu64 "", counters->bluedot_mdate);
                     Sagan_Log(NORMAL, "          IP with date > cdate          : %" PRIu64 "", counters->bluedot_cdate);
@@ -226,6 +283,8 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          Hashes in cache               : %" PRIu64 " (%.3f%%)", counters->bluedot_hash_cache_count, CalcPct(counters->bluedot_hash_cache_count, config->bluedot_hash_max_cache));
                     Sagan_Log(NORMAL, "          Hash hits from cache          : %" PRIu64 " (%.3f%%)", counters->bluedot_hash_cache_hit, CalcPct(counters->bluedot_hash_cache_hit, counters->bluedot_hash_cache_count));
+                    Sagan_Log(NORMAL, "          Hash misses from cache        : %" PRIu64 "", counters->bluedot_hash_cache_miss);
+                    Sagan_Log(NORMAL, "          Hash cache evictions          : %" PRIu64 "", counters->bluedot_hash_cache_evict);
                     Sagan_Log(NORMAL, "          Hash/Bluedot hits in logs     : %" PRIu64 "", counters->bluedot_hash_positive_hit);
                     Sagan_Log(NORMAL, "          Hash queries per/second       : %lu (%" PRIu64 "/%" PRIu64 ")", bluedot_hash_total, counters->bluedot_hash_queue_current, config->bluedot_hash_queue);
 
@@ -234,6 +293,8 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          URLs in cache                 : %" PRIu64 " (%.3f%%)", counters->bluedot_url_cache_count, CalcPct(counters->bluedot_url_cache_count, config->bluedot_url_max_cache));
                     Sagan_Log(NORMAL, "          URL hits from cache           : %" PRIu64 " (%.3f%%)", counters->bluedot_url_cache_hit, CalcPct(counters->bluedot_url_cache_hit, counters->bluedot_url_cache_count));
+                    Sagan_Log(NORMAL, "          URL misses from cache         : %" PRIu64 "", counters->bluedot_url_cache_miss);
+                    Sagan_Log(NORMAL, "          URL cache evictions           : %" PRIu64 "", counters->bluedot_url_cache_evict);
                     Sagan_Log(NORMAL, "          URL/Bluedot hits in logs      : %" PRIu64 "", counters->bluedot_url_positive_hit);
                     Sagan_Log(NORMAL, "          URL queries per/second        : %lu (%" PRIu64 "/%" PRIu64 ")", bluedot_url_total, counters->bluedot_url_queue_current, config->bluedot_url_queue);
 
@@ -242,6 +303,8 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          Filenames in cache            : %" PRIu64 " (%.3f%%)", counters->bluedot_filename_cache_count, CalcPct(counters->bluedot_filename_cache_count, config->bluedot_filename_max_cache));
                     Sagan_Log(NORMAL, "          Filename hits from cache      : %" PRIu64 " (%.3f%%)", counters->bluedot_filename_cache_hit, CalcPct(counters->bluedot_filename_cache_hit, counters->bluedot_filename_cache_count));
+                    Sagan_Log(NORMAL, "          Filename misses from cache    : %" PRIu64 "", counters->bluedot_filename_cache_miss);
+                    Sagan_Log(NORMAL, "          Filename cache evictions      : %" PRIu64 "", counters->bluedot_filename_cache_evict);
                     Sagan_Log(NORMAL, "          Filename/Bluedot hits in logs : %" PRIu64 "", counters->bluedot_filename_positive_hit);
                     Sagan_Log(NORMAL, "          URL queries per/second        : %lu (%" PRIu64 "/%" PRIu64 ")", bluedot_filename_total, counters->bluedot_filename_queue_current, config->bluedot_filename_queue);
 
@@ -249,6 +312,8 @@ void Statistics( void )
                     Sagan_Log(NORMAL, "          * Bluedot Combined Statistics *");
                     Sagan_Log(NORMAL, "");
                     Sagan_Log(NORMAL, "          Lookup error count            : %" PRIu64 "", counters->bluedot_error_count);
+                    Sagan_Log(NORMAL, "          Deferred log lines            : %" PRIu64 "", counters->bluedot_deferred);
+                    Sagan_Log(NORMAL, "          Deferred list full            : %" PRIu64 "", counters->bluedot_deferred_drop);
                     Sagan_Log(NORMAL, "          Total query rate/per second   : %lu", bluedot_ip_total + bluedot_hash_total + bluedot_url_total + bluedot_filename_total);
 
 
@@ -37,6 +37,7 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "rules.h"
 #include "threshold.h"
 #include "ipc.h"
@@ -56,7 +57,6 @@ struct thresh_by_username_ipc *threshbyusername_ipc;
 struct _Sagan_IPC_Counters *counters_ipc;
 
 struct _SaganCounters *counters;
-struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
 
@@ -67,9 +67,7 @@ struct _SaganConfig *config;
 sbool Thresh_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bits, char *selector, char *syslog_message )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     sbool thresh_log_flag = false;
 
@@ -77,9 +75,7 @@ sbool Thresh_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bit
 
     int i;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     /* Check array for matching src / sid */
 
@@ -103,9 +99,9 @@ sbool Thresh_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bit
                     pthread_mutex_lock(&Thresh_By_Src_Mutex);
 
                     threshbysrc_ipc[i].count++;
-                    thresh_oldtime = atol(timet) - threshbysrc_ipc[i].utime;
+                    thresh_oldtime = epoch_time - threshbysrc_ipc[i].utime;
 
-                    threshbysrc_ipc[i].utime = atol(timet);
+                    threshbysrc_ipc[i].utime = epoch_time;
 
                     strlcpy(threshbysrc_ipc[i].syslog_message, syslog_message, sizeof(threshbysrc_ipc[i].syslog_message));
                     strlcpy(threshbysrc_ipc[i].signature_msg, rulestruct[rule_position].s_msg, sizeof(threshbysrc_ipc[i].signature_msg));
@@ -113,7 +109,7 @@ sbool Thresh_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bit
                     if ( thresh_oldtime > rulestruct[rule_position].threshold_seconds )
                         {
                             threshbysrc_ipc[i].count=1;
-                            threshbysrc_ipc[i].utime = atol(timet);
+                            threshbysrc_ipc[i].utime = epoch_time;
                             thresh_log_flag = false;
                         }
 
@@ -151,7 +147,7 @@ sbool Thresh_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bit
             selector == NULL ? threshbysrc_ipc[counters_ipc->thresh_count_by_src].selector[0] = '\0' : strlcpy(threshbysrc_ipc[counters_ipc->thresh_count_by_src].selector, selector, MAXSELECTOR);
 
             threshbysrc_ipc[counters_ipc->thresh_count_by_src].count = 1;
-            threshbysrc_ipc[counters_ipc->thresh_count_by_src].utime = atol(timet);
+            threshbysrc_ipc[counters_ipc->thresh_count_by_src].utime = epoch_time;
             threshbysrc_ipc[counters_ipc->thresh_count_by_src].expire = rulestruct[rule_position].threshold_seconds;
 
             strlcpy(threshbysrc_ipc[counters_ipc->thresh_count_by_src].syslog_message, syslog_message, sizeof(threshbysrc_ipc[counters_ipc->thresh_count_by_src].syslog_message));
@@ -173,9 +169,7 @@ sbool Thresh_By_Src ( int rule_position, char *ip_src, unsigned char *ip_src_bit
 sbool Thresh_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bits, char *selector, char *syslog_message )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     sbool thresh_log_flag = false;
 
@@ -183,9 +177,7 @@ sbool Thresh_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bit
 
     int i;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     /* Check array for matching dst / sid */
 
@@ -209,9 +201,9 @@ sbool Thresh_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bit
                     pthread_mutex_lock(&Thresh_By_Dst_Mutex);
 
                     threshbydst_ipc[i].count++;
-                    thresh_oldtime = atol(timet) - threshbydst_ipc[i].utime;
+                    thresh_oldtime = epoch_time - threshbydst_ipc[i].utime;
 
-                    threshbydst_ipc[i].utime = atol(timet);
+                    threshbydst_ipc[i].utime = epoch_time;
 
                     strlcpy(threshbydst_ipc[i].syslog_message, syslog_message, sizeof(threshbydst_ipc[i].syslog_message));
                     strlcpy(threshbydst_ipc[i].signature_msg, rulestruct[rule_position].s_msg, sizeof(threshbydst_ipc[i].signature_msg));
@@ -220,7 +212,7 @@ sbool Thresh_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bit
                         {
 
                             threshbydst_ipc[i].count=1;
-                            threshbydst_ipc[i].utime = atol(timet);
+                            threshbydst_ipc[i].utime = epoch_time;
                             thresh_log_flag = false;
 
                         }
@@ -257,7 +249,7 @@ sbool Thresh_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bit
             strlcpy(threshbydst_ipc[counters_ipc->thresh_count_by_dst].sid, rulestruct[rule_position].s_sid, sizeof(threshbydst_ipc[counters_ipc->thresh_count_by_dst].sid));
             selector == NULL ? threshbydst_ipc[counters_ipc->thresh_count_by_dst].selector[0] = '\0' : strlcpy(threshbydst_ipc[counters_ipc->thresh_count_by_dst].selector, selector, MAXSELECTOR);
             threshbydst_ipc[counters_ipc->thresh_count_by_dst].count = 1;
-            threshbydst_ipc[counters_ipc->thresh_count_by_dst].utime = atol(timet);
+            threshbydst_ipc[counters_ipc->thresh_count_by_dst].utime = epoch_time;
             threshbydst_ipc[counters_ipc->thresh_count_by_dst].expire = rulestruct[rule_position].threshold_seconds;
 
             strlcpy(threshbydst_ipc[counters_ipc->thresh_count_by_dst].syslog_message, syslog_message, sizeof(threshbydst_ipc[counters_ipc->thresh_count_by_dst].syslog_message));
@@ -279,9 +271,7 @@ sbool Thresh_By_Dst ( int rule_position, char *ip_dst, unsigned char *ip_dst_bit
 sbool Thresh_By_Username( int rule_position, char *normalize_username, char *selector, char *syslog_message )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     sbool thresh_log_flag = false;
 
@@ -289,9 +279,7 @@ sbool Thresh_By_Username( int rule_position, char *normalize_username, char *sel
 
     int i;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     /* Check array fror matching username / sid */
 
@@ -315,8 +303,8 @@ sbool Thresh_By_Username( int rule_position, char *normalize_username, char *sel
                     pthread_mutex_lock(&Thresh_By_Username_Mutex);
 
                     threshbyusername_ipc[rule_position].count++;
-                    thresh_oldtime = atol(timet) - threshbyusername_ipc[rule_position].utime;
-                    threshbyusername_ipc[rule_position].utime = atol(timet);
+                    thresh_oldtime = epoch_time - threshbyusername_ipc[rule_position].utime;
+                    threshbyusername_ipc[rule_position].utime = epoch_time;
 
                     strlcpy(threshbyusername_ipc[i].syslog_message, syslog_message, sizeof(threshbyusername_ipc[i].syslog_message));
                     strlcpy(threshbyusername_ipc[i].signature_msg, rulestruct[rule_position].s_msg, sizeof(threshbyusername_ipc[i].signature_msg));
@@ -325,7 +313,7 @@ sbool Thresh_By_Username( int rule_position, char *normalize_username, char *sel
                     if ( thresh_oldtime > rulestruct[rule_position].threshold_seconds )
                         {
                             threshbyusername_ipc[rule_position].count=1;
-                            threshbyusername_ipc[rule_position].utime = atol(timet);
+                            threshbyusername_ipc[rule_position].utime = epoch_time;
                             thresh_log_flag = false;
                         }
 
@@ -362,7 +350,7 @@ sbool Thresh_By_Username( int rule_position, char *normalize_username, char *sel
             strlcpy(threshbyusername_ipc[counters_ipc->thresh_count_by_username].sid, rulestruct[rule_position].s_sid, sizeof(threshbyusername_ipc[counters_ipc->thresh_count_by_username].sid));
             selector == NULL ? threshbyusername_ipc[counters_ipc->thresh_count_by_username].selector[0] = '\0' : strlcpy(threshbyusername_ipc[counters_ipc->thresh_count_by_username].selector, selector, MAXSELECTOR);
             threshbyusername_ipc[counters_ipc->thresh_count_by_username].count = 1;
-            threshbyusername_ipc[counters_ipc->thresh_count_by_username].utime = atol(timet);
+            threshbyusername_ipc[counters_ipc->thresh_count_by_username].utime = epoch_time;
             threshbyusername_ipc[counters_ipc->thresh_count_by_username].expire = rulestruct[rule_position].threshold_seconds;
 
             strlcpy(threshbyusername_ipc[counters_ipc->thresh_count_by_username].syslog_message, syslog_message, sizeof(threshbyusername_ipc[counters_ipc->thresh_count_by_username].syslog_message));
@@ -385,9 +373,7 @@ sbool Thresh_By_Username( int rule_position, char *normalize_username, char *sel
 sbool Thresh_By_DstPort( int rule_position, uint32_t ip_dstport_u32, char *selector )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     sbool thresh_log_flag = false;
 
@@ -395,9 +381,7 @@ sbool Thresh_By_DstPort( int rule_position, uint32_t ip_dstport_u32, char *selec
 
     int i;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     /* Check array for matching dst port / sid */
 
@@ -421,14 +405,14 @@ sbool Thresh_By_DstPort( int rule_position, uint32_t ip_dstport_u32, char *selec
                     pthread_mutex_lock(&Thresh_By_Dst_Port_Mutex);
 
                     threshbydstport_ipc[rule_position].count++;
-                    thresh_oldtime = atol(timet) - threshbydstport_ipc[rule_position].utime;
-                    threshbydstport_ipc[rule_position].utime = atol(timet);
+                    thresh_oldtime = epoch_time - threshbydstport_ipc[rule_position].utime;
+                    threshbydstport_ipc[rule_position].utime = epoch_time;
 
                     if ( thresh_oldtime > rulestruct[rule_position].threshold_seconds )
                         {
 
                             threshbydstport_ipc[rule_position].count=1;
-                            threshbydstport_ipc[rule_position].utime = atol(timet);
+                            threshbydstport_ipc[rule_position].utime = epoch_time;
                             thresh_log_flag = false;
                         }
 
@@ -465,7 +449,7 @@ sbool Thresh_By_DstPort( int rule_position, uint32_t ip_dstport_u32, char *selec
             strlcpy(threshbydstport_ipc[counters_ipc->thresh_count_by_dstport].sid, rulestruct[rule_position].s_sid, sizeof(threshbydstport_ipc[counters_ipc->thresh_count_by_dstport].sid));
             selector == NULL ? threshbydstport_ipc[counters_ipc->thresh_count_by_dstport].selector[0] = '\0' : strlcpy(threshbydstport_ipc[counters_ipc->thresh_count_by_dstport].selector, selector, MAXSELECTOR);
             threshbydstport_ipc[counters_ipc->thresh_count_by_dstport].count = 1;
-            threshbydstport_ipc[counters_ipc->thresh_count_by_dstport].utime = atol(timet);
+            threshbydstport_ipc[counters_ipc->thresh_count_by_dstport].utime = epoch_time;
             threshbydstport_ipc[counters_ipc->thresh_count_by_dstport].expire = rulestruct[rule_position].threshold_seconds;
 
             counters_ipc->thresh_count_by_dstport++;
@@ -484,9 +468,7 @@ sbool Thresh_By_DstPort( int rule_position, uint32_t ip_dstport_u32, char *selec
 sbool Thresh_By_SrcPort( int rule_position, uint32_t ip_srcport_u32, char *selector )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     sbool thresh_log_flag = false;
 
@@ -494,9 +476,7 @@ sbool Thresh_By_SrcPort( int rule_position, uint32_t ip_srcport_u32, char *selec
 
     int i;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     /* Check array for matching src port / sid */
 
@@ -520,14 +500,14 @@ sbool Thresh_By_SrcPort( int rule_position, uint32_t ip_srcport_u32, char *selec
                     pthread_mutex_lock(&Thresh_By_Src_Port_Mutex);
 
                     threshbysrcport_ipc[rule_position].count++;
-                    thresh_oldtime = atol(timet) - threshbysrcport_ipc[rule_position].utime;
-                    threshbysrcport_ipc[rule_position].utime = atol(timet);
+                    thresh_oldtime = epoch_time - threshbysrcport_ipc[rule_position].utime;
+                    threshbysrcport_ipc[rule_position].utime = epoch_time;
 
                     if ( thresh_oldtime > rulestruct[rule_position].threshold_seconds )
                         {
 
                             threshbysrcport_ipc[rule_position].count=1;
-                            threshbysrcport_ipc[rule_position].utime = atol(timet);
+                            threshbysrcport_ipc[rule_position].utime = epoch_time;
                             thresh_log_flag = false;
                         }
 
@@ -564,7 +544,7 @@ sbool Thresh_By_SrcPort( int rule_position, uint32_t ip_srcport_u32, char *selec
             strlcpy(threshbysrcport_ipc[counters_ipc->thresh_count_by_srcport].sid, rulestruct[rule_position].s_sid, sizeof(threshbysrcport_ipc[counters_ipc->thresh_count_by_srcport].sid));
             selector == NULL ? threshbysrcport_ipc[counters_ipc->thresh_count_by_srcport].selector[0] = '\0' : strlcpy(threshbysrcport_ipc[counters_ipc->thresh_count_by_srcport].selector, selector, MAXSELECTOR);
             threshbysrcport_ipc[counters_ipc->thresh_count_by_srcport].count = 1;
-            threshbysrcport_ipc[counters_ipc->thresh_count_by_srcport].utime = atol(timet);
+            threshbysrcport_ipc[counters_ipc->thresh_count_by_srcport].utime = epoch_time;
             threshbysrcport_ipc[counters_ipc->thresh_count_by_srcport].expire = rulestruct[rule_position].threshold_seconds;
 
             counters_ipc->thresh_count_by_srcport++;
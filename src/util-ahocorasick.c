@@ -0,0 +1,375 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-ahocorasick.c
+ *
+ * Case insensitive Aho-Corasick automaton.  Patterns are added to a trie,
+ * then Aho_Corasick_Compile() lays out each node's transitions as a sorted
+ * edge list and computes the failure links.  A search walks the text once
+ * no matter how many patterns are loaded.
+ *
+ * Transitions out of the root are kept in a 256 entry table since most
+ * characters in a log line don't start a pattern.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sagan.h"
+#include "util-ahocorasick.h"
+
+/****************************************************************************
+ * Aho_Corasick_New_Node - Returns the index of a new,  empty node
+ ****************************************************************************/
+
+static uint32_t Aho_Corasick_New_Node( _Sagan_Aho_Corasick *ac, unsigned char c, uint32_t depth )
+{
+
+    _Sagan_AC_Node *node = NULL;
+
+    if ( ac->node_count == ac->node_size )
+        {
+
+            ac->node_size = ac->node_size == 0 ? 1024 : ac->node_size * 2;
+            ac->nodes = (_Sagan_AC_Node *) realloc(ac->nodes, ac->node_size * sizeof(_Sagan_AC_Node));
+
+            if ( ac->nodes == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to reallocate memory for Aho-Corasick nodes. Abort!", __FILE__, __LINE__);
+                }
+        }
+
+    node = &ac->nodes[ac->node_count];
+    memset(node, 0, sizeof(_Sagan_AC_Node));
+
+    node->c = c;
+    node->depth = depth;
+    node->pattern = -1;
+
+    return(ac->node_count++);
+}
+
+/****************************************************************************
+ * Aho_Corasick_Init - Sets up an empty automaton (just the root)
+ ****************************************************************************/
+
+void Aho_Corasick_Init( _Sagan_Aho_Corasick *ac )
+{
+
+    memset(ac, 0, sizeof(_Sagan_Aho_Corasick));
+    Aho_Corasick_New_Node(ac, 0, 0);
+
+}
+
+/****************************************************************************
+ * Aho_Corasick_Free - Releases an automaton
+ ****************************************************************************/
+
+void Aho_Corasick_Free( _Sagan_Aho_Corasick *ac )
+{
+
+    free(ac->nodes);
+    free(ac->edges);
+
+    memset(ac, 0, sizeof(_Sagan_Aho_Corasick));
+
+}
+
+/****************************************************************************
+ * Aho_Corasick_Add - Adds "pattern" with the ID "id".  Patterns are case
+ * insensitive.  If the pattern was already added,  the first ID is kept.
+ ****************************************************************************/
+
+void Aho_Corasick_Add( _Sagan_Aho_Corasick *ac, const char *pattern, int64_t id )
+{
+
+    const unsigned char *p = (const unsigned char *)pattern;
+
+    uint32_t node = 0;
+    uint32_t child = 0;
+    uint32_t new_node = 0;
+
+    unsigned char c;
+
+    if ( ac->compiled == true )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Patterns can't be added to a compiled Aho-Corasick automaton. Abort!", __FILE__, __LINE__);
+        }
+
+    if ( *p == '\0' )
+        {
+            return;
+        }
+
+    for ( ; *p != '\0'; p++ )
+        {
+
+            c = tolower(*p);
+
+            for ( child = ac->nodes[node].first_child; child != 0; child = ac->nodes[child].next_sibling )
+                {
+
+                    if ( ac->nodes[child].c == c )
+                        {
+                            break;
+                        }
+                }
+
+            if ( child == 0 )
+                {
+
+                    /* ac->nodes may move on realloc(),  so no pointers are
+                     * held across Aho_Corasick_New_Node() */
+
+                    new_node = Aho_Corasick_New_Node(ac, c, ac->nodes[node].depth + 1);
+
+                    ac->nodes[new_node].next_sibling = ac->nodes[node].first_child;
+                    ac->nodes[node].first_child = new_node;
+
+                    child = new_node;
+                }
+
+            node = child;
+        }
+
+    if ( ac->nodes[node].pattern == -1 )
+        {
+            ac->nodes[node].pattern = id;
+            ac->pattern_count++;
+        }
+
+}
+
+/****************************************************************************
+ * Aho_Corasick_Goto - Returns the node reached from "node" on "c",  or 0
+ * if there is no such transition.
+ ****************************************************************************/
+
+static inline uint32_t Aho_Corasick_Goto( _Sagan_Aho_Corasick *ac, uint32_t node, unsigned char c )
+{
+
+    _Sagan_AC_Edge *edges = NULL;
+
+    uint32_t low = 0;
+    uint32_t high = 0;
+    uint32_t mid = 0;
+
+    if ( node == 0 )
+        {
+            return(ac->root_next[c]);
+        }
+
+    edges = &ac->edges[ac->nodes[node].edge_start];
+    high = ac->nodes[node].edge_count;
+
+    while ( low < high )
+        {
+
+            mid = ( low + high ) / 2;
+
+            if ( edges[mid].c == c )
+                {
+                    return(edges[mid].node);
+                }
+
+            if ( edges[mid].c < c )
+                {
+                    low = mid + 1;
+                }
+            else
+                {
+                    high = mid;
+                }
+        }
+
+    return(0);
+}
+
+/****************************************************************************
+ * Aho_Corasick_Compile - Builds edge lists and failure links.  Must be
+ * called after the last Aho_Corasick_Add() and before searching.
+ ****************************************************************************/
+
+void Aho_Corasick_Compile( _Sagan_Aho_Corasick *ac )
+{
+
+    uint32_t *queue = NULL;
+    uint32_t head = 0;
+    uint32_t tail = 0;
+
+    uint32_t edge_count = 0;
+    uint32_t node = 0;
+    uint32_t child = 0;
+    uint32_t fail = 0;
+    uint32_t next = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    _Sagan_AC_Edge edge;
+
+    queue = malloc(ac->node_count * sizeof(uint32_t));
+    ac->edges = malloc(ac->node_count * sizeof(_Sagan_AC_Edge));
+
+    if ( queue == NULL || ac->edges == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for Aho-Corasick automaton. Abort!", __FILE__, __LINE__);
+        }
+
+    /* Breadth first,  so a node's fail target (which is always shallower)
+     * has its edges and links in place before they are needed */
+
+    queue[tail++] = 0;
+
+    while ( head < tail )
+        {
+
+            node = queue[head++];
+
+            /* Lay out this node's children as a sorted edge list */
+
+            ac->nodes[node].edge_start = edge_count;
+
+            for ( child = ac->nodes[node].first_child; child != 0; child = ac->nodes[child].next_sibling )
+                {
+
+                    edge.c = ac->nodes[child].c;
+                    edge.node = child;
+
+                    for ( j = edge_count; j > ac->nodes[node].edge_start && ac->edges[j-1].c > edge.c; j-- )
+                        {
+                            ac->edges[j] = ac->edges[j-1];
+                        }
+
+                    ac->edges[j] = edge;
+                    edge_count++;
+                }
+
+            ac->nodes[node].edge_count = edge_count - ac->nodes[node].edge_start;
+
+            if ( node == 0 )
+                {
+
+                    for ( i = 0; i < ac->nodes[0].edge_count; i++ )
+                        {
+                            ac->root_next[ac->edges[i].c] = ac->edges[i].node;
+                        }
+                }
+
+            /* Failure and dictionary links for the children */
+
+            for ( i = ac->nodes[node].edge_start; i < edge_count; i++ )
+                {
+
+                    child = ac->edges[i].node;
+                    queue[tail++] = child;
+
+                    if ( node == 0 )
+                        {
+                            ac->nodes[child].fail = 0;
+                        }
+                    else
+                        {
+
+                            fail = ac->nodes[node].fail;
+
+                            while ( fail != 0 && Aho_Corasick_Goto(ac, fail, ac->nodes[child].c) == 0 )
+                                {
+                                    fail = ac->nodes[fail].fail;
+                                }
+
+                            next = Aho_Corasick_Goto(ac, fail, ac->nodes[child].c);
+                            ac->nodes[child].fail = next;
+                        }
+
+                    fail = ac->nodes[child].fail;
+                    ac->nodes[child].dict = ac->nodes[fail].pattern != -1 ? fail : ac->nodes[fail].dict;
+                }
+
+        }
+
+    free(queue);
+
+    ac->compiled = true;
+
+}
+
+/****************************************************************************
+ * Aho_Corasick_Search - Scans "text" once.  Returns the ID of the first
+ * pattern found (and accepted by "accept",  if not NULL),  or -1.
+ ****************************************************************************/
+
+int64_t Aho_Corasick_Search( _Sagan_Aho_Corasick *ac, const char *text, Aho_Corasick_Accept accept )
+{
+
+    const unsigned char *p = (const unsigned char *)text;
+
+    uint32_t node = 0;
+    uint32_t next = 0;
+    uint32_t match = 0;
+
+    unsigned char c;
+
+    if ( ac->compiled == false || ac->pattern_count == 0 )
+        {
+            return(-1);
+        }
+
+    for ( ; *p != '\0'; p++ )
+        {
+
+            c = tolower(*p);
+
+            while ( ( next = Aho_Corasick_Goto(ac, node, c) ) == 0 && node != 0 )
+                {
+                    node = ac->nodes[node].fail;
+                }
+
+            node = next;
+
+            if ( node == 0 )
+                {
+                    continue;
+                }
+
+            match = ac->nodes[node].pattern != -1 ? node : ac->nodes[node].dict;
+
+            while ( match != 0 )
+                {
+
+                    if ( accept == NULL || accept(text, ( p + 1 - (const unsigned char *)text ) - ac->nodes[match].depth, p + 1 - (const unsigned char *)text) )
+                        {
+                            return(ac->nodes[match].pattern);
+                        }
+
+                    match = ac->nodes[match].dict;
+                }
+        }
+
+    return(-1);
+}
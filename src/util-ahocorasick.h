@@ -0,0 +1,70 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Case insensitive multi-pattern (Aho-Corasick) matching */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct _Sagan_AC_Edge _Sagan_AC_Edge;
+struct _Sagan_AC_Edge
+{
+    unsigned char c;
+    uint32_t node;
+};
+
+typedef struct _Sagan_AC_Node _Sagan_AC_Node;
+struct _Sagan_AC_Node
+{
+    uint32_t first_child;	/* Only used while building */
+    uint32_t next_sibling;	/* Only used while building */
+    uint32_t edge_start;
+    uint16_t edge_count;
+    unsigned char c;
+    uint32_t fail;
+    uint32_t dict;		/* Closest node on the fail chain that ends a pattern */
+    uint32_t depth;
+    int64_t  pattern;		/* Pattern ID that ends here,  -1 if none */
+};
+
+typedef struct _Sagan_Aho_Corasick _Sagan_Aho_Corasick;
+struct _Sagan_Aho_Corasick
+{
+    _Sagan_AC_Node *nodes;
+    uint32_t node_count;
+    uint32_t node_size;
+
+    _Sagan_AC_Edge *edges;
+    uint32_t root_next[256];
+
+    uint32_t pattern_count;
+    sbool compiled;
+};
+
+/* Optional filter for matches.  "start" and "end" are offsets of the match
+ * within "text".  Return true to accept the match. */
+
+typedef sbool (*Aho_Corasick_Accept)( const char *text, size_t start, size_t end );
+
+void    Aho_Corasick_Init( _Sagan_Aho_Corasick * );
+void    Aho_Corasick_Free( _Sagan_Aho_Corasick * );
+void    Aho_Corasick_Add( _Sagan_Aho_Corasick *, const char *, int64_t );
+void    Aho_Corasick_Compile( _Sagan_Aho_Corasick * );
+int64_t Aho_Corasick_Search( _Sagan_Aho_Corasick *, const char *, Aho_Corasick_Accept );
@@ -0,0 +1,149 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-arena.c
+ *
+ * Allocations come out of large chunks and are never freed one at a time.
+ * Sagan_Arena_Free() releases the whole arena.  Each new chunk is twice
+ * the size of the last (up to SAGAN_ARENA_CHUNK_MAX),  so the number of
+ * malloc() calls grows with the log of the data size.  Requests bigger
+ * than a chunk get a chunk of their own.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "sagan.h"
+#include "util-arena.h"
+
+/****************************************************************************
+ * Sagan_Arena_Alloc - Returns "size" bytes of zeroed memory,  aligned to
+ * SAGAN_ARENA_ALIGN
+ ****************************************************************************/
+
+void *Sagan_Arena_Alloc( _Sagan_Arena *arena, size_t size )
+{
+
+    _Sagan_Arena_Chunk *chunk = arena->chunks;
+    size_t chunk_size = 0;
+    void *p = NULL;
+
+    size = ( size + SAGAN_ARENA_ALIGN - 1 ) & ~( (size_t)SAGAN_ARENA_ALIGN - 1 );
+
+    if ( chunk == NULL || chunk->size - chunk->used < size )
+        {
+
+            chunk_size = chunk == NULL ? SAGAN_ARENA_CHUNK_MIN : chunk->size * 2;
+
+            if ( chunk_size > SAGAN_ARENA_CHUNK_MAX )
+                {
+                    chunk_size = SAGAN_ARENA_CHUNK_MAX;
+                }
+
+            if ( chunk_size < size )
+                {
+                    chunk_size = size;
+                }
+
+            chunk = calloc(1, sizeof(_Sagan_Arena_Chunk) + chunk_size);
+
+            if ( chunk == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for arena. Abort!", __FILE__, __LINE__);
+                }
+
+            chunk->size = chunk_size;
+
+            /* An oversized request fills its chunk;  keep allocating from
+             * the previous one */
+
+            if ( arena->chunks != NULL && chunk_size == size )
+                {
+                    chunk->next = arena->chunks->next;
+                    arena->chunks->next = chunk;
+                }
+            else
+                {
+                    chunk->next = arena->chunks;
+                    arena->chunks = chunk;
+                }
+
+            arena->allocated += sizeof(_Sagan_Arena_Chunk) + chunk_size;
+        }
+
+    p = chunk->data + chunk->used;
+
+    chunk->used += size;
+    arena->used += size;
+
+    return(p);
+}
+
+/****************************************************************************
+ * Sagan_Arena_Memdup - Copies "size" bytes of "src" into the arena
+ ****************************************************************************/
+
+void *Sagan_Arena_Memdup( _Sagan_Arena *arena, const void *src, size_t size )
+{
+
+    void *p = Sagan_Arena_Alloc(arena, size);
+
+    memcpy(p, src, size);
+
+    return(p);
+}
+
+/****************************************************************************
+ * Sagan_Arena_Strdup - Copies "s" into the arena
+ ****************************************************************************/
+
+char *Sagan_Arena_Strdup( _Sagan_Arena *arena, const char *s )
+{
+    return(Sagan_Arena_Memdup(arena, s, strlen(s) + 1));
+}
+
+/****************************************************************************
+ * Sagan_Arena_Free - Releases everything allocated from "arena" and leaves
+ * it empty
+ ****************************************************************************/
+
+void Sagan_Arena_Free( _Sagan_Arena *arena )
+{
+
+    _Sagan_Arena_Chunk *chunk = arena->chunks;
+    _Sagan_Arena_Chunk *next = NULL;
+
+    while ( chunk != NULL )
+        {
+            next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+
+    memset(arena, 0, sizeof(_Sagan_Arena));
+
+}
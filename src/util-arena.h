@@ -0,0 +1,56 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-arena.h
+ *
+ * Bump allocator for data that is built once and freed all at once (ie -
+ * the strings and tables of a rule set).  See util-arena.c
+ *
+ */
+
+#include <stddef.h>
+
+#define SAGAN_ARENA_CHUNK_MIN	16384		/* First chunk,  bytes */
+#define SAGAN_ARENA_CHUNK_MAX	1048576		/* Chunks double up to this size */
+#define SAGAN_ARENA_ALIGN	16
+
+typedef struct _Sagan_Arena_Chunk _Sagan_Arena_Chunk;
+struct _Sagan_Arena_Chunk
+{
+    _Sagan_Arena_Chunk *next;
+    size_t size;
+    size_t used;
+    char data[] __attribute__((aligned(SAGAN_ARENA_ALIGN)));
+};
+
+/* A zeroed _Sagan_Arena is empty and ready to use */
+
+typedef struct _Sagan_Arena _Sagan_Arena;
+struct _Sagan_Arena
+{
+    _Sagan_Arena_Chunk *chunks;		/* Newest first */
+    size_t allocated;			/* Bytes malloc()'ed,  including headers */
+    size_t used;			/* Bytes handed out,  including padding */
+};
+
+void *Sagan_Arena_Alloc( _Sagan_Arena *, size_t );
+void *Sagan_Arena_Memdup( _Sagan_Arena *, const void *, size_t );
+char *Sagan_Arena_Strdup( _Sagan_Arena *, const char * );
+void  Sagan_Arena_Free( _Sagan_Arena * );
@@ -0,0 +1,511 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-cache.c
+ *
+ * A bounded,  thread safe key/value cache.  The table is split into
+ * "stripes",  each with its own lock,  buckets and entry slab,  so threads
+ * looking up different keys rarely wait on each other.
+ *
+ * Every entry carries its own expire time.  Stale entries are treated as
+ * misses and are reclaimed either by Sagan_Cache_Expire() or when their
+ * slot is needed.  When a stripe is full,  a CLOCK sweep picks the entry to
+ * evict: entries that were used since the last sweep get a second chance.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "sagan.h"
+#include "util-hash.h"
+#include "util-cache.h"
+
+/****************************************************************************
+ * Sagan_Cache_Init - Allocates a cache that holds at most "max_entries"
+ * values of "value_size" bytes.
+ ****************************************************************************/
+
+void Sagan_Cache_Init( _Sagan_Cache *cache, uint64_t max_entries, size_t value_size, sbool nocase )
+{
+
+    _Sagan_Cache_Stripe *stripe = NULL;
+
+    uint32_t buckets = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    if ( max_entries == 0 )
+        {
+            max_entries = 1;
+        }
+
+    memset(cache, 0, sizeof(_Sagan_Cache));
+
+    cache->value_size = value_size;
+    cache->nocase = nocase;
+
+    /* Small caches don't need (or get) many stripes */
+
+    cache->stripe_count = 1;
+
+    while ( cache->stripe_count < SAGAN_CACHE_MAX_STRIPES && cache->stripe_count * 2 <= max_entries )
+        {
+            cache->stripe_count *= 2;
+        }
+
+    cache->stripes = calloc(cache->stripe_count, sizeof(_Sagan_Cache_Stripe));
+
+    if ( cache->stripes == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for cache. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < cache->stripe_count; i++ )
+        {
+
+            stripe = &cache->stripes[i];
+
+            pthread_mutex_init(&stripe->lock, NULL);
+
+            stripe->capacity = ( max_entries + cache->stripe_count - 1 ) / cache->stripe_count;
+
+            buckets = 16;
+
+            while ( buckets < stripe->capacity )
+                {
+                    buckets <<= 1;
+                }
+
+            stripe->bucket_mask = buckets - 1;
+
+            stripe->entries = calloc(stripe->capacity, sizeof(_Sagan_Cache_Entry));
+            stripe->values = calloc(stripe->capacity, value_size);
+            stripe->buckets = calloc(buckets, sizeof(uint32_t));
+
+            if ( stripe->entries == NULL || stripe->values == NULL || stripe->buckets == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for cache. Abort!", __FILE__, __LINE__);
+                }
+
+            /* Every slot starts on the free list */
+
+            for ( j = 0; j < stripe->capacity; j++ )
+                {
+                    stripe->entries[j].next = j + 2 <= stripe->capacity ? j + 2 : 0;
+                }
+
+            stripe->free_head = 1;
+        }
+
+}
+
+/****************************************************************************
+ * Sagan_Cache_Free - Releases a cache and every key in it
+ ****************************************************************************/
+
+void Sagan_Cache_Free( _Sagan_Cache *cache )
+{
+
+    _Sagan_Cache_Stripe *stripe = NULL;
+
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    for ( i = 0; i < cache->stripe_count; i++ )
+        {
+
+            stripe = &cache->stripes[i];
+
+            for ( j = 0; j < stripe->capacity; j++ )
+                {
+                    free(stripe->entries[j].key);
+                }
+
+            free(stripe->entries);
+            free(stripe->values);
+            free(stripe->buckets);
+
+            pthread_mutex_destroy(&stripe->lock);
+        }
+
+    free(cache->stripes);
+
+    memset(cache, 0, sizeof(_Sagan_Cache));
+
+}
+
+/****************************************************************************
+ * Sagan_Cache_Hash - Hash used for both stripe and bucket selection.  The
+ * low bits pick the bucket,  the high bits the stripe.
+ ****************************************************************************/
+
+static inline uint32_t Sagan_Cache_Hash( _Sagan_Cache *cache, const void *key, size_t len )
+{
+    return( cache->nocase ? Hash_FNV1a_Lower(key, len) : Hash_FNV1a(key, len) );
+}
+
+static inline _Sagan_Cache_Stripe *Sagan_Cache_Stripe_Of( _Sagan_Cache *cache, uint32_t hash )
+{
+    return( &cache->stripes[ ( hash >> 24 ) & ( cache->stripe_count - 1 ) ] );
+}
+
+/****************************************************************************
+ * Sagan_Cache_Find - Returns the index of "key" in the stripe or -1.
+ * Caller holds the stripe lock.
+ ****************************************************************************/
+
+static int64_t Sagan_Cache_Find( _Sagan_Cache *cache, _Sagan_Cache_Stripe *stripe, uint32_t hash, const void *key, size_t len )
+{
+
+    _Sagan_Cache_Entry *entry = NULL;
+    uint32_t pos = stripe->buckets[ hash & stripe->bucket_mask ];
+
+    while ( pos != 0 )
+        {
+
+            entry = &stripe->entries[pos - 1];
+
+            if ( entry->hash == hash && entry->key_len == len &&
+                    ( cache->nocase ? !strncasecmp((const char *)entry->key, key, len) : !memcmp(entry->key, key, len) ) )
+                {
+                    return(pos - 1);
+                }
+
+            pos = entry->next;
+        }
+
+    return(-1);
+}
+
+/****************************************************************************
+ * Sagan_Cache_Remove - Unlinks entry "index" from its bucket and puts it
+ * on the free list.  Caller holds the stripe lock.
+ ****************************************************************************/
+
+static void Sagan_Cache_Remove( _Sagan_Cache_Stripe *stripe, uint32_t index )
+{
+
+    _Sagan_Cache_Entry *entry = &stripe->entries[index];
+    uint32_t *link = &stripe->buckets[ entry->hash & stripe->bucket_mask ];
+
+    while ( *link != 0 && *link != index + 1 )
+        {
+            link = &stripe->entries[*link - 1].next;
+        }
+
+    if ( *link == index + 1 )
+        {
+            *link = entry->next;
+        }
+
+    free(entry->key);
+
+    entry->key = NULL;
+    entry->key_len = 0;
+    entry->used = false;
+    entry->referenced = false;
+
+    entry->next = stripe->free_head;
+    stripe->free_head = index + 1;
+
+    stripe->count--;
+
+}
+
+/****************************************************************************
+ * Sagan_Cache_Lookup - Copies the value for "key" to "value" (if not NULL)
+ * and returns true.  Stale entries are removed and count as a miss.
+ ****************************************************************************/
+
+sbool Sagan_Cache_Lookup( _Sagan_Cache *cache, const void *key, size_t len, void *value, uint64_t now )
+{
+
+    uint32_t hash = Sagan_Cache_Hash(cache, key, len);
+    _Sagan_Cache_Stripe *stripe = Sagan_Cache_Stripe_Of(cache, hash);
+
+    int64_t index = 0;
+
+    pthread_mutex_lock(&stripe->lock);
+
+    index = Sagan_Cache_Find(cache, stripe, hash, key, len);
+
+    if ( index != -1 && now > stripe->entries[index].expire )
+        {
+            Sagan_Cache_Remove(stripe, index);
+            stripe->expired++;
+            index = -1;
+        }
+
+    if ( index == -1 )
+        {
+            stripe->misses++;
+            pthread_mutex_unlock(&stripe->lock);
+            return(false);
+        }
+
+    stripe->entries[index].referenced = true;
+    stripe->hits++;
+
+    if ( value != NULL )
+        {
+            memcpy(value, stripe->values + ( index * cache->value_size ), cache->value_size);
+        }
+
+    pthread_mutex_unlock(&stripe->lock);
+
+    return(true);
+}
+
+/****************************************************************************
+ * Sagan_Cache_Claim - Returns a free slot,  evicting one if the stripe is
+ * full.  Caller holds the stripe lock.
+ ****************************************************************************/
+
+static uint32_t Sagan_Cache_Claim( _Sagan_Cache_Stripe *stripe, uint64_t now )
+{
+
+    _Sagan_Cache_Entry *entry = NULL;
+    uint32_t index = 0;
+
+    while ( stripe->free_head == 0 )
+        {
+
+            index = stripe->hand;
+            entry = &stripe->entries[index];
+
+            stripe->hand = ( stripe->hand + 1 ) % stripe->capacity;
+
+            if ( now > entry->expire )
+                {
+                    Sagan_Cache_Remove(stripe, index);
+                    stripe->expired++;
+                }
+
+            else if ( entry->referenced == true )
+                {
+                    entry->referenced = false;
+                }
+
+            else
+                {
+                    Sagan_Cache_Remove(stripe, index);
+                    stripe->evictions++;
+                }
+        }
+
+    index = stripe->free_head - 1;
+    stripe->free_head = stripe->entries[index].next;
+
+    return(index);
+}
+
+/****************************************************************************
+ * Sagan_Cache_Store - Stores "value" under "key" until "now + ttl".  Caller
+ * holds the stripe lock.
+ ****************************************************************************/
+
+static void Sagan_Cache_Store( _Sagan_Cache *cache, _Sagan_Cache_Stripe *stripe, uint32_t hash, const void *key, size_t len, const void *value, uint64_t now, uint64_t ttl )
+{
+
+    _Sagan_Cache_Entry *entry = NULL;
+    unsigned char *key_copy = NULL;
+
+    int64_t index = 0;
+    uint32_t bucket = 0;
+
+    index = Sagan_Cache_Find(cache, stripe, hash, key, len);
+
+    if ( index == -1 )
+        {
+
+            key_copy = malloc(len + 1);
+
+            if ( key_copy == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for cache key. Abort!", __FILE__, __LINE__);
+                }
+
+            memcpy(key_copy, key, len);
+            key_copy[len] = '\0';
+
+            index = Sagan_Cache_Claim(stripe, now);
+            entry = &stripe->entries[index];
+
+            bucket = hash & stripe->bucket_mask;
+
+            entry->hash = hash;
+            entry->key = key_copy;
+            entry->key_len = len;
+            entry->used = true;
+            entry->referenced = false;
+            entry->next = stripe->buckets[bucket];
+
+            stripe->buckets[bucket] = index + 1;
+            stripe->count++;
+        }
+
+    entry = &stripe->entries[index];
+    entry->expire = now + ttl;
+
+    memcpy(stripe->values + ( index * cache->value_size ), value, cache->value_size);
+
+}
+
+/****************************************************************************
+ * Sagan_Cache_Insert - Stores "value" under "key" until "now + ttl".  An
+ * existing entry for "key" is replaced.
+ ****************************************************************************/
+
+void Sagan_Cache_Insert( _Sagan_Cache *cache, const void *key, size_t len, const void *value, uint64_t now, uint64_t ttl )
+{
+
+    uint32_t hash = Sagan_Cache_Hash(cache, key, len);
+    _Sagan_Cache_Stripe *stripe = Sagan_Cache_Stripe_Of(cache, hash);
+
+    pthread_mutex_lock(&stripe->lock);
+    Sagan_Cache_Store(cache, stripe, hash, key, len, value, now, ttl);
+    pthread_mutex_unlock(&stripe->lock);
+
+}
+
+/****************************************************************************
+ * Sagan_Cache_Lookup_Or_Insert - Like Sagan_Cache_Lookup(),  but on a miss
+ * "placeholder" is stored under "key" before the stripe lock is dropped.
+ * Only one caller can miss on a key,  so it alone goes on to resolve it.
+ ****************************************************************************/
+
+sbool Sagan_Cache_Lookup_Or_Insert( _Sagan_Cache *cache, const void *key, size_t len, void *value, const void *placeholder, uint64_t now, uint64_t ttl )
+{
+
+    uint32_t hash = Sagan_Cache_Hash(cache, key, len);
+    _Sagan_Cache_Stripe *stripe = Sagan_Cache_Stripe_Of(cache, hash);
+
+    int64_t index = 0;
+
+    pthread_mutex_lock(&stripe->lock);
+
+    index = Sagan_Cache_Find(cache, stripe, hash, key, len);
+
+    if ( index != -1 && now > stripe->entries[index].expire )
+        {
+            Sagan_Cache_Remove(stripe, index);
+            stripe->expired++;
+            index = -1;
+        }
+
+    if ( index == -1 )
+        {
+            stripe->misses++;
+            Sagan_Cache_Store(cache, stripe, hash, key, len, placeholder, now, ttl);
+            pthread_mutex_unlock(&stripe->lock);
+            return(false);
+        }
+
+    stripe->entries[index].referenced = true;
+    stripe->hits++;
+
+    if ( value != NULL )
+        {
+            memcpy(value, stripe->values + ( index * cache->value_size ), cache->value_size);
+        }
+
+    pthread_mutex_unlock(&stripe->lock);
+
+    return(true);
+}
+
+/****************************************************************************
+ * Sagan_Cache_Expire - Removes every stale entry.  Stripes are locked one
+ * at a time so lookups can continue while this runs.  Returns the number of
+ * entries removed.
+ ****************************************************************************/
+
+uint64_t Sagan_Cache_Expire( _Sagan_Cache *cache, uint64_t now )
+{
+
+    _Sagan_Cache_Stripe *stripe = NULL;
+
+    uint64_t removed = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    for ( i = 0; i < cache->stripe_count; i++ )
+        {
+
+            stripe = &cache->stripes[i];
+
+            pthread_mutex_lock(&stripe->lock);
+
+            for ( j = 0; j < stripe->capacity; j++ )
+                {
+
+                    if ( stripe->entries[j].used == true && now > stripe->entries[j].expire )
+                        {
+                            Sagan_Cache_Remove(stripe, j);
+                            stripe->expired++;
+                            removed++;
+                        }
+                }
+
+            pthread_mutex_unlock(&stripe->lock);
+        }
+
+    return(removed);
+}
+
+/****************************************************************************
+ * Sagan_Cache_Stats - Totals the per-stripe counters
+ ****************************************************************************/
+
+void Sagan_Cache_Stats( _Sagan_Cache *cache, _Sagan_Cache_Stats *stats )
+{
+
+    _Sagan_Cache_Stripe *stripe = NULL;
+    uint32_t i = 0;
+
+    memset(stats, 0, sizeof(_Sagan_Cache_Stats));
+
+    for ( i = 0; i < cache->stripe_count; i++ )
+        {
+
+            stripe = &cache->stripes[i];
+
+            pthread_mutex_lock(&stripe->lock);
+
+            stats->count += stripe->count;
+            stats->hits += stripe->hits;
+            stats->misses += stripe->misses;
+            stats->evictions += stripe->evictions;
+            stats->expired += stripe->expired;
+
+            pthread_mutex_unlock(&stripe->lock);
+        }
+
+}
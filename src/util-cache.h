@@ -0,0 +1,87 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Lock striped hash table cache with per-entry TTL and CLOCK eviction */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define SAGAN_CACHE_MAX_STRIPES	16
+
+typedef struct _Sagan_Cache_Entry _Sagan_Cache_Entry;
+struct _Sagan_Cache_Entry
+{
+    uint32_t hash;
+    uint32_t next;		/* Next entry in bucket or free list (index + 1) */
+    uint64_t expire;		/* Epoch time the entry goes stale */
+    unsigned char *key;
+    uint32_t key_len;
+    sbool used;
+    sbool referenced;		/* CLOCK "second chance" bit */
+};
+
+typedef struct _Sagan_Cache_Stripe _Sagan_Cache_Stripe;
+struct _Sagan_Cache_Stripe
+{
+    pthread_mutex_t lock;
+
+    _Sagan_Cache_Entry *entries;
+    unsigned char *values;
+    uint32_t *buckets;		/* Entry index + 1,  0 == empty */
+    uint32_t bucket_mask;
+
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t free_head;		/* Entry index + 1,  0 == full */
+    uint32_t hand;		/* CLOCK hand */
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t expired;
+};
+
+typedef struct _Sagan_Cache _Sagan_Cache;
+struct _Sagan_Cache
+{
+    _Sagan_Cache_Stripe *stripes;
+    uint32_t stripe_count;	/* Always a power of 2 */
+    size_t value_size;
+    sbool nocase;		/* Keys are case insensitive strings */
+};
+
+typedef struct _Sagan_Cache_Stats _Sagan_Cache_Stats;
+struct _Sagan_Cache_Stats
+{
+    uint64_t count;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t expired;
+};
+
+void     Sagan_Cache_Init( _Sagan_Cache *, uint64_t, size_t, sbool );
+void     Sagan_Cache_Free( _Sagan_Cache * );
+sbool    Sagan_Cache_Lookup( _Sagan_Cache *, const void *, size_t, void *, uint64_t );
+void     Sagan_Cache_Insert( _Sagan_Cache *, const void *, size_t, const void *, uint64_t, uint64_t );
+sbool    Sagan_Cache_Lookup_Or_Insert( _Sagan_Cache *, const void *, size_t, void *, const void *, uint64_t, uint64_t );
+uint64_t Sagan_Cache_Expire( _Sagan_Cache *, uint64_t );
+void     Sagan_Cache_Stats( _Sagan_Cache *, _Sagan_Cache_Stats * );
@@ -0,0 +1,391 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-dns.c
+ *
+ * DNS cache used by "source-lookup".  Entries are kept in a lock striped
+ * util-cache table with a positive and a negative TTL.  A lookup that
+ * misses leaves a "pending" placeholder in the cache and queues the
+ * hostname for the resolver threads,  so the thread that asked never waits
+ * on the network.  Depending on "dns-pending-policy" the caller either
+ * carries on with "sagan_host" or waits up to "dns-hold-time" milliseconds
+ * for the answer.  At most "dns-queue-size" hostnames are queued or being
+ * resolved at once; a miss beyond that is dropped and retried once its
+ * placeholder expires.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "util-time.h"
+#include "util-cache.h"
+#include "util-dns.h"
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+
+static _Sagan_Cache SaganDNSCache;
+
+/* Hostnames waiting on a resolver thread */
+
+static pthread_mutex_t SaganDNSQueueMutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t SaganDNSQueueCond=PTHREAD_COND_INITIALIZER;
+
+static _Sagan_DNS_Request *SaganDNSQueueHead = NULL;
+static _Sagan_DNS_Request *SaganDNSQueueTail = NULL;
+static _Sagan_DNS_Request *SaganDNSResolving = NULL;	/* Taken by a resolver thread */
+static int SaganDNSQueueCount = 0;			/* Both of the above */
+
+/* Broadcast every time a resolver thread stores an answer */
+
+static pthread_mutex_t SaganDNSResolvedMutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t SaganDNSResolvedCond=PTHREAD_COND_INITIALIZER;
+
+static pthread_mutex_t CounterDNSMutex=PTHREAD_MUTEX_INITIALIZER;
+
+static void Sagan_DNS_Resolver( void );
+
+/****************************************************************************
+ * Sagan_DNS_Init - Allocates the DNS cache and starts the resolver threads.
+ * Only the first call does anything.
+ ****************************************************************************/
+
+static sbool dns_init = false;
+
+void Sagan_DNS_Init( void )
+{
+
+    pthread_t resolver_thread;
+    pthread_attr_t resolver_thread_attr;
+
+    int i = 0;
+    int rc = 0;
+
+    if ( dns_init == true )
+        {
+            return;
+        }
+
+    dns_init = true;
+
+    Sagan_Cache_Init(&SaganDNSCache, config->dns_cache_size, sizeof(_Sagan_DNS_Cache_Entry), true);
+
+    pthread_attr_init(&resolver_thread_attr);
+    pthread_attr_setdetachstate(&resolver_thread_attr,  PTHREAD_CREATE_DETACHED);
+
+    for ( i = 0; i < config->dns_resolvers; i++ )
+        {
+
+            rc = pthread_create( &resolver_thread, &resolver_thread_attr, (void *)Sagan_DNS_Resolver, NULL );
+
+            if ( rc != 0 )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Error creating DNS resolver thread [error: %d].", __FILE__, __LINE__, rc);
+                }
+        }
+
+    pthread_attr_destroy(&resolver_thread_attr);
+
+    Sagan_Log(NORMAL, "DNS cache initialized (Size: %" PRIu64 ", TTL: %d/%d, Resolvers: %d, Pending policy: %s).",
+              config->dns_cache_size, config->dns_ttl, config->dns_negative_ttl, config->dns_resolvers,
+              config->dns_pending_policy == DNS_PENDING_HOLD ? "hold" : "pass");
+
+}
+
+/****************************************************************************
+ * Sagan_DNS_Queued - Returns true if "host" is queued or being resolved.
+ * Called with SaganDNSQueueMutex held.
+ ****************************************************************************/
+
+static sbool Sagan_DNS_Queued( const char *host )
+{
+
+    _Sagan_DNS_Request *request = NULL;
+
+    for ( request = SaganDNSQueueHead; request != NULL; request = request->next )
+        {
+            if ( !strcmp(request->hostname, host) )
+                {
+                    return(true);
+                }
+        }
+
+    for ( request = SaganDNSResolving; request != NULL; request = request->next )
+        {
+            if ( !strcmp(request->hostname, host) )
+                {
+                    return(true);
+                }
+        }
+
+    return(false);
+}
+
+/****************************************************************************
+ * Sagan_DNS_Queue - Hands a hostname to the resolver threads.  A hostname
+ * that is already waiting (its placeholder expired first) isn't queued
+ * twice,  and nothing is queued while the queue is full.
+ ****************************************************************************/
+
+static void Sagan_DNS_Queue( const char *host )
+{
+
+    _Sagan_DNS_Request *request = NULL;
+
+    pthread_mutex_lock(&SaganDNSQueueMutex);
+
+    if ( Sagan_DNS_Queued(host) == true )
+        {
+            pthread_mutex_unlock(&SaganDNSQueueMutex);
+            return;
+        }
+
+    if ( SaganDNSQueueCount >= config->dns_queue_size )
+        {
+            pthread_mutex_unlock(&SaganDNSQueueMutex);
+            __atomic_add_fetch(&counters->dns_queue_drop, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+    request = malloc(sizeof(_Sagan_DNS_Request));
+
+    if ( request == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for DNS request. Abort!", __FILE__, __LINE__);
+        }
+
+    strlcpy(request->hostname, host, sizeof(request->hostname));
+    request->next = NULL;
+
+    if ( SaganDNSQueueTail == NULL )
+        {
+            SaganDNSQueueHead = request;
+        }
+    else
+        {
+            SaganDNSQueueTail->next = request;
+        }
+
+    SaganDNSQueueTail = request;
+    SaganDNSQueueCount++;
+
+    pthread_cond_signal(&SaganDNSQueueCond);
+    pthread_mutex_unlock(&SaganDNSQueueMutex);
+
+}
+
+/****************************************************************************
+ * Sagan_DNS_Hold - Waits up to "dns-hold-time" milliseconds for a resolver
+ * thread to replace the "pending" placeholder for "host".  Returns true
+ * and fills in "entry" if an answer arrived in time.
+ ****************************************************************************/
+
+static sbool Sagan_DNS_Hold( const char *host, _Sagan_DNS_Cache_Entry *entry )
+{
+
+    struct timespec deadline;
+    sbool found = false;
+    int rc = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    deadline.tv_sec += config->dns_hold_time / 1000;
+    deadline.tv_nsec += ( config->dns_hold_time % 1000 ) * 1000000L;
+
+    if ( deadline.tv_nsec >= 1000000000L )
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+    /* The resolver stores its answer before it takes SaganDNSResolvedMutex,
+     * so checking the cache while holding the mutex can't miss a wakeup */
+
+    pthread_mutex_lock(&SaganDNSResolvedMutex);
+
+    while ( rc != ETIMEDOUT )
+        {
+
+            if ( Sagan_Cache_Lookup(&SaganDNSCache, host, strlen(host), entry, Sagan_Clock_Epoch()) == true &&
+                    entry->pending == false )
+                {
+                    found = true;
+                    break;
+                }
+
+            rc = pthread_cond_timedwait(&SaganDNSResolvedCond, &SaganDNSResolvedMutex, &deadline);
+        }
+
+    pthread_mutex_unlock(&SaganDNSResolvedMutex);
+
+    return(found);
+}
+
+/****************************************************************************
+ * Sagan_DNS_Lookup - Looks "host" up in the DNS cache.  Returns 0 and
+ * copies the address to "str" on a positive answer.  Negative answers and
+ * lookups still pending return -1 and copy "sagan_host" to "str".
+ ****************************************************************************/
+
+int Sagan_DNS_Lookup( const char *host, char *str, size_t size )
+{
+
+    _Sagan_DNS_Cache_Entry entry;
+    _Sagan_DNS_Cache_Entry placeholder;
+
+    memset(&placeholder, 0, sizeof(placeholder));
+    placeholder.pending = true;
+
+    /* A miss stores the placeholder so only one thread queues "host".  If a
+     * resolver thread doesn't answer in time,  the placeholder expires and
+     * the next lookup queues "host" again,  unless it is still waiting */
+
+    if ( Sagan_Cache_Lookup_Or_Insert(&SaganDNSCache, host, strlen(host), &entry, &placeholder, Sagan_Clock_Epoch(), DNS_REQUEST_TIMEOUT) == false )
+        {
+            memcpy(&entry, &placeholder, sizeof(entry));
+            Sagan_DNS_Queue(host);
+        }
+
+    if ( entry.pending == true && config->dns_pending_policy == DNS_PENDING_HOLD )
+        {
+            Sagan_DNS_Hold(host, &entry);
+        }
+
+    if ( entry.pending == true )
+        {
+            pthread_mutex_lock(&CounterDNSMutex);
+            counters->dns_pending_count++;
+            pthread_mutex_unlock(&CounterDNSMutex);
+        }
+
+    if ( entry.pending == false && entry.found == true )
+        {
+            strlcpy(str, entry.ip, size);
+            return(0);
+        }
+
+    strlcpy(str, config->sagan_host, size);
+    return(-1);
+}
+
+/****************************************************************************
+ * Sagan_DNS_Resolver - Resolver thread.  Takes hostnames off the queue,
+ * resolves them and stores the answer with the positive or negative TTL.
+ ****************************************************************************/
+
+static void Sagan_DNS_Resolver( void )
+{
+
+    _Sagan_DNS_Request *request = NULL;
+    _Sagan_DNS_Request **p = NULL;
+    _Sagan_DNS_Cache_Entry entry;
+
+    for (;;)
+        {
+
+            pthread_mutex_lock(&SaganDNSQueueMutex);
+
+            while ( SaganDNSQueueHead == NULL )
+                {
+                    pthread_cond_wait(&SaganDNSQueueCond, &SaganDNSQueueMutex);
+                }
+
+            request = SaganDNSQueueHead;
+            SaganDNSQueueHead = request->next;
+
+            if ( SaganDNSQueueHead == NULL )
+                {
+                    SaganDNSQueueTail = NULL;
+                }
+
+            request->next = SaganDNSResolving;
+            SaganDNSResolving = request;
+
+            pthread_mutex_unlock(&SaganDNSQueueMutex);
+
+            memset(&entry, 0, sizeof(entry));
+
+            if ( DNS_Lookup(request->hostname, entry.ip, sizeof(entry.ip)) == 0 )
+                {
+                    entry.found = true;
+                    Sagan_Cache_Insert(&SaganDNSCache, request->hostname, strlen(request->hostname), &entry, Sagan_Clock_Epoch(), config->dns_ttl);
+                }
+            else
+                {
+
+                    Sagan_Cache_Insert(&SaganDNSCache, request->hostname, strlen(request->hostname), &entry, Sagan_Clock_Epoch(), config->dns_negative_ttl);
+
+                    pthread_mutex_lock(&CounterDNSMutex);
+                    counters->dns_miss_count++;
+                    pthread_mutex_unlock(&CounterDNSMutex);
+                }
+
+            /* The answer is in the cache,  so the hostname can be queued again */
+
+            pthread_mutex_lock(&SaganDNSQueueMutex);
+
+            for ( p = &SaganDNSResolving; *p != request; p = &(*p)->next );
+
+            *p = request->next;
+            SaganDNSQueueCount--;
+
+            pthread_mutex_unlock(&SaganDNSQueueMutex);
+
+            free(request);
+
+            pthread_mutex_lock(&SaganDNSResolvedMutex);
+            pthread_cond_broadcast(&SaganDNSResolvedCond);
+            pthread_mutex_unlock(&SaganDNSResolvedMutex);
+
+        }
+
+}
+
+/****************************************************************************
+ * Sagan_DNS_Cache_Stats - Copies the cache size and hit counts into
+ * "counters" for perfmon and stats.
+ ****************************************************************************/
+
+void Sagan_DNS_Cache_Stats( void )
+{
+
+    _Sagan_Cache_Stats stats;
+
+    Sagan_Cache_Stats(&SaganDNSCache, &stats);
+
+    counters->dns_cache_count = stats.count;
+    counters->dns_cache_hit = stats.hits;
+
+}
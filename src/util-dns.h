@@ -0,0 +1,42 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+
+/* Hashed,  TTL bound DNS cache for "source-lookup".  Misses are resolved
+ * by a small pool of resolver threads */
+
+typedef struct _Sagan_DNS_Cache_Entry _Sagan_DNS_Cache_Entry;
+struct _Sagan_DNS_Cache_Entry
+{
+    char ip[MAXIP];
+    sbool pending;		/* Waiting on a resolver thread */
+    sbool found;		/* false == negative entry */
+};
+
+typedef struct _Sagan_DNS_Request _Sagan_DNS_Request;
+struct _Sagan_DNS_Request
+{
+    char hostname[MAXHOST];
+    struct _Sagan_DNS_Request *next;
+};
+
+void Sagan_DNS_Init( void );
+int  Sagan_DNS_Lookup( const char *, char *, size_t );
+void Sagan_DNS_Cache_Stats( void );
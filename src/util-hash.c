@@ -0,0 +1,239 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-hash.c
+ *
+ * FNV-1a hashing and a small open addressing (linear probing) index.  The
+ * index only stores the hash and an array index,  the keys themselves stay
+ * in the caller's array.  This lets large,  read mostly data sets (Bro intel,
+ * etc) be searched in O(1) without keeping a second copy of every key.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "sagan.h"
+#include "util-hash.h"
+
+/****************************************************************************
+ * Hash_FNV1a - 32 bit FNV-1a hash of "len" bytes
+ ****************************************************************************/
+
+uint32_t Hash_FNV1a( const void *data, size_t len )
+{
+
+    const unsigned char *p = data;
+    uint32_t hash = HASH_FNV_OFFSET;
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+        {
+            hash = Hash_FNV1a_Step(hash, p[i]);
+        }
+
+    return(hash);
+}
+
+/****************************************************************************
+ * Hash_FNV1a_Lower - Same as Hash_FNV1a() but case insensitive
+ ****************************************************************************/
+
+uint32_t Hash_FNV1a_Lower( const char *data, size_t len )
+{
+
+    uint32_t hash = HASH_FNV_OFFSET;
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+        {
+            hash = Hash_FNV1a_Step(hash, tolower((unsigned char)data[i]));
+        }
+
+    return(hash);
+}
+
+/****************************************************************************
+ * Hash_FNV1a_64 - 64 bit FNV-1a hash of "len" bytes.  Pass
+ * HASH_FNV64_OFFSET to start,  or a previous result to continue hashing
+ * across several buffers.
+ ****************************************************************************/
+
+uint64_t Hash_FNV1a_64( uint64_t hash, const void *data, size_t len )
+{
+
+    const unsigned char *p = data;
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+        {
+            hash = ( hash ^ p[i] ) * HASH_FNV64_PRIME;
+        }
+
+    return(hash);
+}
+
+/****************************************************************************
+ * Hash_Index_Init - Sets up an empty index sized for about "expected"
+ * entries.  The index grows on its own,  so this is only a hint.
+ ****************************************************************************/
+
+void Hash_Index_Init( _Sagan_Hash_Index *index, uint32_t expected )
+{
+
+    uint32_t size = 64;
+
+    while ( size < expected * 2 )
+        {
+            size <<= 1;
+        }
+
+    index->slots = calloc(size, sizeof(_Sagan_Hash_Slot));
+
+    if ( index->slots == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for hash index. Abort!", __FILE__, __LINE__);
+        }
+
+    index->size = size;
+    index->count = 0;
+
+}
+
+/****************************************************************************
+ * Hash_Index_Free - Releases the index (not the array it points into)
+ ****************************************************************************/
+
+void Hash_Index_Free( _Sagan_Hash_Index *index )
+{
+
+    free(index->slots);
+
+    index->slots = NULL;
+    index->size = 0;
+    index->count = 0;
+
+}
+
+/****************************************************************************
+ * Hash_Index_Insert - Places a hash/index pair.  Caller makes sure there
+ * is room.
+ ****************************************************************************/
+
+static void Hash_Index_Insert( _Sagan_Hash_Slot *slots, uint32_t size, uint32_t hash, uint32_t array_index )
+{
+
+    uint32_t pos = hash & ( size - 1 );
+
+    while ( slots[pos].index != 0 )
+        {
+            pos = ( pos + 1 ) & ( size - 1 );
+        }
+
+    slots[pos].hash = hash;
+    slots[pos].index = array_index + 1;
+
+}
+
+/****************************************************************************
+ * Hash_Index_Add - Adds "array_index" under "hash".  The index is doubled
+ * once it is half full so probe chains stay short.
+ ****************************************************************************/
+
+void Hash_Index_Add( _Sagan_Hash_Index *index, uint32_t hash, uint32_t array_index )
+{
+
+    _Sagan_Hash_Slot *new_slots = NULL;
+    uint32_t new_size = 0;
+    uint32_t i;
+
+    if ( index->slots == NULL )
+        {
+            Hash_Index_Init(index, 0);
+        }
+
+    if ( ( index->count + 1 ) * 2 > index->size )
+        {
+
+            new_size = index->size * 2;
+            new_slots = calloc(new_size, sizeof(_Sagan_Hash_Slot));
+
+            if ( new_slots == NULL )
+                {
+                    Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for hash index. Abort!", __FILE__, __LINE__);
+                }
+
+            for ( i = 0; i < index->size; i++ )
+                {
+
+                    if ( index->slots[i].index != 0 )
+                        {
+                            Hash_Index_Insert(new_slots, new_size, index->slots[i].hash, index->slots[i].index - 1);
+                        }
+                }
+
+            free(index->slots);
+
+            index->slots = new_slots;
+            index->size = new_size;
+        }
+
+    Hash_Index_Insert(index->slots, index->size, hash, array_index);
+    index->count++;
+
+}
+
+/****************************************************************************
+ * Hash_Index_Find - Returns the array index of "key",  or -1 if it isn't
+ * in the index.
+ ****************************************************************************/
+
+int64_t Hash_Index_Find( _Sagan_Hash_Index *index, uint32_t hash, Hash_Index_Match match, const void *key, size_t len )
+{
+
+    uint32_t pos = 0;
+
+    if ( index->slots == NULL )
+        {
+            return(-1);
+        }
+
+    pos = hash & ( index->size - 1 );
+
+    while ( index->slots[pos].index != 0 )
+        {
+
+            if ( index->slots[pos].hash == hash && match( index->slots[pos].index - 1, key, len ) )
+                {
+                    return( (int64_t)index->slots[pos].index - 1 );
+                }
+
+            pos = ( pos + 1 ) & ( index->size - 1 );
+        }
+
+    return(-1);
+}
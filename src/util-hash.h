@@ -0,0 +1,64 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* Hash functions and a open addressing index over caller owned arrays */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HASH_FNV_OFFSET		2166136261U
+#define HASH_FNV_PRIME		16777619U
+
+#define HASH_FNV64_OFFSET	14695981039346656037ULL
+#define HASH_FNV64_PRIME	1099511628211ULL
+
+/* Step the FNV-1a hash by one byte.  Used when a key is hashed while it is
+ * being scanned (ie - tokens within a log line) */
+
+#define Hash_FNV1a_Step(hash, c)	( ( (hash) ^ (unsigned char)(c) ) * HASH_FNV_PRIME )
+
+uint32_t Hash_FNV1a( const void *, size_t );
+uint32_t Hash_FNV1a_Lower( const char *, size_t );
+uint64_t Hash_FNV1a_64( uint64_t, const void *, size_t );
+
+typedef struct _Sagan_Hash_Slot _Sagan_Hash_Slot;
+struct _Sagan_Hash_Slot
+{
+    uint32_t hash;
+    uint32_t index;		/* Array index + 1.  0 == empty slot */
+};
+
+typedef struct _Sagan_Hash_Index _Sagan_Hash_Index;
+struct _Sagan_Hash_Index
+{
+    _Sagan_Hash_Slot *slots;
+    uint32_t size;		/* Always a power of 2 */
+    uint32_t count;
+};
+
+/* Called for every slot whose hash matches.  Returns true if array element
+ * "index" is equal to "key" */
+
+typedef sbool (*Hash_Index_Match)( uint32_t index, const void *key, size_t len );
+
+void     Hash_Index_Init( _Sagan_Hash_Index *, uint32_t );
+void     Hash_Index_Free( _Sagan_Hash_Index * );
+void     Hash_Index_Add( _Sagan_Hash_Index *, uint32_t, uint32_t );
+int64_t  Hash_Index_Find( _Sagan_Hash_Index *, uint32_t, Hash_Index_Match, const void *, size_t );
@@ -0,0 +1,242 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+
+/* util-rcu.c
+ *
+ * Lets worker threads read intel stores (blacklist,  Bro Intel,  GeoIP2,
+ * etc) without locks while a loader replaces them.  A loader builds the
+ * new copy off to the side,  publishes it with Sagan_RCU_Assign(),  calls
+ * Sagan_RCU_Synchronize() and then frees the old copy.
+ *
+ * Workers go offline between events (a "quiescent" point where they hold
+ * no references into a store) and back online with the current epoch
+ * when they pick up the next one.  Sagan_RCU_Synchronize() bumps the
+ * global epoch and waits until every registered thread has either come
+ * online in the new epoch or is offline.  Readers never block.
+ *
+ * Code that can't wait (ie - it holds a lock a worker might be waiting
+ * on) hands the old copy to Sagan_RCU_Retire() instead.  It is free()'ed
+ * by the next Sagan_RCU_Reclaim().
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sagan.h"
+#include "util-rcu.h"
+
+static uint64_t rcu_epoch = 1;
+
+static _Sagan_RCU_Thread *rcu_threads = NULL;
+static pthread_mutex_t SaganRCUMutex=PTHREAD_MUTEX_INITIALIZER;
+
+static _Sagan_RCU_Retired *rcu_retired = NULL;
+static pthread_mutex_t SaganRCURetireMutex=PTHREAD_MUTEX_INITIALIZER;
+
+static __thread _Sagan_RCU_Thread *rcu_self = NULL;
+
+/****************************************************************************
+ * Sagan_RCU_Register - Adds the calling thread to the list of readers.  The
+ * thread starts out online.  Threads are never removed since workers live
+ * for the life of the process.
+ ****************************************************************************/
+
+void Sagan_RCU_Register( void )
+{
+
+    if ( rcu_self != NULL )
+        {
+            return;
+        }
+
+    rcu_self = calloc(1, sizeof(_Sagan_RCU_Thread));
+
+    if ( rcu_self == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for RCU thread. Abort!", __FILE__, __LINE__);
+        }
+
+    Sagan_RCU_Online();
+
+    pthread_mutex_lock(&SaganRCUMutex);
+    rcu_self->next = rcu_threads;
+    rcu_threads = rcu_self;
+    pthread_mutex_unlock(&SaganRCUMutex);
+
+}
+
+/****************************************************************************
+ * Sagan_RCU_Online - Called before the thread reads any published pointer.
+ * The fence keeps those reads from moving ahead of the epoch store.  Threads
+ * that never registered (ie - the main thread at start up) are ignored.
+ ****************************************************************************/
+
+void Sagan_RCU_Online( void )
+{
+
+    if ( rcu_self == NULL )
+        {
+            return;
+        }
+
+    __atomic_store_n(&rcu_self->epoch, __atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+}
+
+/****************************************************************************
+ * Sagan_RCU_Offline - Called before a thread blocks.  Offline threads hold
+ * no references and are skipped by Sagan_RCU_Synchronize().
+ ****************************************************************************/
+
+void Sagan_RCU_Offline( void )
+{
+
+    if ( rcu_self == NULL )
+        {
+            return;
+        }
+
+    __atomic_store_n(&rcu_self->epoch, 0, __ATOMIC_RELEASE);
+
+}
+
+/****************************************************************************
+ * Sagan_RCU_Synchronize - Waits until no reader can still hold a pointer
+ * that was unpublished before the call.  Only loaders call this,  so a
+ * short sleep while polling is fine.
+ ****************************************************************************/
+
+void Sagan_RCU_Synchronize( void )
+{
+
+    _Sagan_RCU_Thread *thread = NULL;
+    uint64_t target = 0;
+    uint64_t seen = 0;
+
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = 1000000;	/* 1 ms */
+
+    target = __atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&SaganRCUMutex);
+
+    for ( thread = rcu_threads; thread != NULL; thread = thread->next )
+        {
+
+            if ( thread == rcu_self )
+                {
+                    continue;
+                }
+
+            for (;;)
+                {
+
+                    seen = __atomic_load_n(&thread->epoch, __ATOMIC_ACQUIRE);
+
+                    if ( seen == 0 || seen >= target )
+                        {
+                            break;
+                        }
+
+                    nanosleep(&ts, NULL);
+                }
+        }
+
+    pthread_mutex_unlock(&SaganRCUMutex);
+
+}
+
+/****************************************************************************
+ * Sagan_RCU_Retire - Queues an unpublished pointer to be released with
+ * "free_func" after a grace period.
+ ****************************************************************************/
+
+void Sagan_RCU_Retire( void *ptr, void (*free_func)( void * ) )
+{
+
+    _Sagan_RCU_Retired *retired = NULL;
+
+    if ( ptr == NULL )
+        {
+            return;
+        }
+
+    retired = malloc(sizeof(_Sagan_RCU_Retired));
+
+    if ( retired == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for RCU retire list. Abort!", __FILE__, __LINE__);
+        }
+
+    retired->ptr = ptr;
+    retired->free_func = free_func;
+
+    pthread_mutex_lock(&SaganRCURetireMutex);
+    retired->next = rcu_retired;
+    rcu_retired = retired;
+    pthread_mutex_unlock(&SaganRCURetireMutex);
+
+}
+
+/****************************************************************************
+ * Sagan_RCU_Reclaim - Waits for a grace period and releases everything
+ * retired before the call.  Must not be called while holding a lock a
+ * worker could be waiting on.
+ ****************************************************************************/
+
+void Sagan_RCU_Reclaim( void )
+{
+
+    _Sagan_RCU_Retired *list = NULL;
+    _Sagan_RCU_Retired *next = NULL;
+
+    pthread_mutex_lock(&SaganRCURetireMutex);
+    list = rcu_retired;
+    rcu_retired = NULL;
+    pthread_mutex_unlock(&SaganRCURetireMutex);
+
+    if ( list == NULL )
+        {
+            return;
+        }
+
+    Sagan_RCU_Synchronize();
+
+    for ( ; list != NULL; list = next )
+        {
+            next = list->next;
+            list->free_func(list->ptr);
+            free(list);
+        }
+
+}
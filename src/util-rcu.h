@@ -0,0 +1,53 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+
+/* Quiescent state based reclamation for data that is read by the worker
+ * threads and replaced by a loader */
+
+#include <stdint.h>
+
+typedef struct _Sagan_RCU_Thread _Sagan_RCU_Thread;
+struct _Sagan_RCU_Thread
+{
+    uint64_t epoch;		/* Last epoch seen while online,  0 == offline */
+    _Sagan_RCU_Thread *next;
+};
+
+/* Something unpublished that is waiting for a grace period */
+
+typedef struct _Sagan_RCU_Retired _Sagan_RCU_Retired;
+struct _Sagan_RCU_Retired
+{
+    void *ptr;
+    void (*free_func)( void * );
+    _Sagan_RCU_Retired *next;
+};
+
+#define Sagan_RCU_Dereference(p)	__atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define Sagan_RCU_Assign(p, v)		__atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+void Sagan_RCU_Register( void );
+void Sagan_RCU_Online( void );
+void Sagan_RCU_Offline( void );
+void Sagan_RCU_Synchronize( void );
+void Sagan_RCU_Retire( void *, void (*)( void * ) );
+void Sagan_RCU_Reclaim( void );
+
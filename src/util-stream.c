@@ -0,0 +1,569 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* util-stream.c
+ *
+ * Output files that are gzip compressed and/or rotated by size or age.
+ * The caller gets an ordinary FILE * (fopencookie()),  so the alert,  fast
+ * and EVE writers keep using fprintf()/fwrite().  Compression happens in
+ * whichever thread writes the stream,  which is the output thread for
+ * those three.
+ *
+ * Rotation is never done from inside a write.  The writer calls
+ * Sagan_Stream_Maintain() after it flushes a batch,  i.e. on a record
+ * boundary.  The current file is finished (gzip trailer written,
+ * fdatasync()ed) and renamed to "<filename>.<YYYYmmddHHMMSS>[.gz]",  then
+ * a new file is started under the same FILE *.  Every rotated file is a
+ * complete gzip member,  so a shipper can read anything that has been
+ * renamed without worrying about a half written frame.  For the same
+ * reason a compressed file left over from the last run (which may end in
+ * an unfinished member if we crashed) is moved aside the same way rather
+ * than appended to.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "sagan.h"
+#include "sagan-defs.h"
+#include "sagan-config.h"
+#include "util-time.h"
+#include "util-stream.h"
+
+struct _SaganConfig *config;
+
+typedef struct _Sagan_Stream _Sagan_Stream;
+struct _Sagan_Stream
+{
+    char path[MAXPATH];
+    FILE *stream;
+    int fd;
+
+    unsigned char compress;
+    uint64_t rotate_size;		/* Bytes on disk,  0 == never */
+    int rotate_interval;		/* Seconds,  0 == never */
+
+    unsigned long pw_uid;
+    unsigned long pw_gid;
+
+    uint64_t size;			/* Current file size */
+    time_t opened;			/* When the current file was started */
+    time_t last_sync;
+    sbool dirty;			/* Written to since it was started */
+    sbool pending;			/* Data sitting in zlib since the last sync flush */
+
+#ifdef HAVE_LIBZ
+    z_stream z;
+    unsigned char out[STREAM_BUFFER_SIZE];
+#endif
+
+    struct _Sagan_Stream *next;
+};
+
+/* Open streams,  so Sagan_Stream_Maintain() can find the stream behind a
+ * FILE * */
+
+static pthread_mutex_t SaganStreamListMutex=PTHREAD_MUTEX_INITIALIZER;
+static _Sagan_Stream *SaganStreamList = NULL;
+
+#ifdef HAVE_FOPENCOOKIE
+
+/****************************************************************************
+ * Stream_Write_Raw - write()s "len" bytes to the current file
+ ****************************************************************************/
+
+static int Stream_Write_Raw( _Sagan_Stream *s, const void *buf, size_t len )
+{
+
+    const char *p = buf;
+    ssize_t written = 0;
+
+    while ( len > 0 )
+        {
+
+            written = write(s->fd, p, len);
+
+            if ( written < 0 )
+                {
+
+                    if ( errno == EINTR )
+                        {
+                            continue;
+                        }
+
+                    return(-1);
+                }
+
+            p += written;
+            len -= written;
+            s->size += written;
+        }
+
+    return(0);
+}
+
+/****************************************************************************
+ * Stream_Deflate - Runs zlib over whatever is in z.next_in and writes the
+ * output.  "flush" is passed straight to deflate().
+ ****************************************************************************/
+
+#ifdef HAVE_LIBZ
+
+static int Stream_Deflate( _Sagan_Stream *s, int flush )
+{
+
+    int rc = 0;
+
+    do
+        {
+
+            s->z.next_out = s->out;
+            s->z.avail_out = sizeof(s->out);
+
+            rc = deflate(&s->z, flush);
+
+            if ( rc == Z_STREAM_ERROR )
+                {
+                    errno = EIO;
+                    return(-1);
+                }
+
+            if ( Stream_Write_Raw(s, s->out, sizeof(s->out) - s->z.avail_out) < 0 )
+                {
+                    return(-1);
+                }
+
+        }
+    while ( s->z.avail_out == 0 || ( flush == Z_FINISH && rc != Z_STREAM_END ) );
+
+    return(0);
+}
+
+#endif
+
+/****************************************************************************
+ * Stream_Archive - Renames the file at "path" to
+ * "<filename>.<YYYYmmddHHMMSS>[.gz]"
+ ****************************************************************************/
+
+static void Stream_Archive( _Sagan_Stream *s )
+{
+
+    char archive[MAXPATH+32] = { 0 };
+    char stamp[20] = { 0 };
+    const char *suffix = "";
+
+    struct tm tm;
+    time_t now = (time_t)Sagan_Clock_Epoch();
+    size_t len = strlen(s->path);
+
+    int i = 0;
+
+    if ( s->compress == STREAM_COMPRESS_GZIP && ( len < 3 || strcmp(s->path + len - 3, ".gz") ) )
+        {
+            suffix = ".gz";
+        }
+
+    localtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d%H%M%S", &tm);
+
+    snprintf(archive, sizeof(archive), "%s.%s%s", s->path, stamp, suffix);
+
+    /* More than one rotation in a second */
+
+    while ( access(archive, F_OK) == 0 )
+        {
+            snprintf(archive, sizeof(archive), "%s.%s_%d%s", s->path, stamp, ++i, suffix);
+        }
+
+    if ( rename(s->path, archive) < 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot rotate %s to %s: %s", __FILE__, __LINE__, s->path, archive, strerror(errno));
+        }
+
+}
+
+/****************************************************************************
+ * Stream_Start - Opens (or creates) the file at "path" and starts a new
+ * gzip member.  A compressed file that is already there is moved aside
+ * first;  appending to one that ends in a partial member would leave a
+ * file zcat can't read past that point.
+ ****************************************************************************/
+
+static int Stream_Start( _Sagan_Stream *s )
+{
+
+    struct stat st;
+
+    if ( s->compress == STREAM_COMPRESS_GZIP && stat(s->path, &st) == 0 && st.st_size > 0 )
+        {
+            Stream_Archive(s);
+        }
+
+    s->fd = open(s->path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+
+    if ( s->fd < 0 )
+        {
+            return(-1);
+        }
+
+    /* We'll already be the runas user after a rotation */
+
+    if ( geteuid() == 0 && fchown(s->fd, s->pw_uid, s->pw_gid) < 0 )
+        {
+            close(s->fd);
+            s->fd = -1;
+            return(-1);
+        }
+
+    s->size = fstat(s->fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+    s->opened = (time_t)Sagan_Clock_Epoch();
+    s->last_sync = s->opened;
+    s->dirty = false;
+    s->pending = false;
+
+#ifdef HAVE_LIBZ
+
+    if ( s->compress == STREAM_COMPRESS_GZIP )
+        {
+            deflateReset(&s->z);
+        }
+
+#endif
+
+    return(0);
+}
+
+/****************************************************************************
+ * Stream_Finish - Ends the gzip member,  gets it on disk and closes the
+ * current file.
+ ****************************************************************************/
+
+static int Stream_Finish( _Sagan_Stream *s )
+{
+
+    int rc = 0;
+
+    if ( s->fd < 0 )
+        {
+            return(0);
+        }
+
+#ifdef HAVE_LIBZ
+
+    if ( s->compress == STREAM_COMPRESS_GZIP && s->dirty == true )
+        {
+            s->z.next_in = NULL;
+            s->z.avail_in = 0;
+            rc = Stream_Deflate(s, Z_FINISH);
+        }
+
+#endif
+
+    fdatasync(s->fd);
+    close(s->fd);
+    s->fd = -1;
+
+    return(rc);
+}
+
+/****************************************************************************
+ * Stream_Rotate - Finishes the current file,  moves it out of the way and
+ * starts a new one.
+ ****************************************************************************/
+
+static void Stream_Rotate( _Sagan_Stream *s )
+{
+
+    if ( Stream_Finish(s) < 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Error finishing %s: %s", __FILE__, __LINE__, s->path, strerror(errno));
+        }
+
+    Stream_Archive(s);
+
+    if ( Stream_Start(s) < 0 )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Cannot open %s after rotation: %s", __FILE__, __LINE__, s->path, strerror(errno));
+        }
+
+}
+
+/****************************************************************************
+ * Stream_Cookie_Write - fopencookie() write hook.  Called by stdio when
+ * its buffer fills or is flushed.
+ ****************************************************************************/
+
+static ssize_t Stream_Cookie_Write( void *cookie, const char *buf, size_t size )
+{
+
+    _Sagan_Stream *s = cookie;
+
+    /* A failed open during rotation gets retried here */
+
+    if ( s->fd < 0 && Stream_Start(s) < 0 )
+        {
+            return(-1);
+        }
+
+    s->dirty = true;
+
+#ifdef HAVE_LIBZ
+
+    if ( s->compress == STREAM_COMPRESS_GZIP )
+        {
+
+            s->z.next_in = (unsigned char *)buf;
+            s->z.avail_in = size;
+            s->pending = true;
+
+            if ( Stream_Deflate(s, Z_NO_FLUSH) < 0 )
+                {
+                    return(-1);
+                }
+
+            return(size);
+        }
+
+#endif
+
+    if ( Stream_Write_Raw(s, buf, size) < 0 )
+        {
+            return(-1);
+        }
+
+    return(size);
+}
+
+/****************************************************************************
+ * Stream_Cookie_Close - fopencookie() close hook.  fclose() of the stream
+ * finishes the current file.
+ ****************************************************************************/
+
+static int Stream_Cookie_Close( void *cookie )
+{
+
+    _Sagan_Stream *s = cookie;
+    _Sagan_Stream **p = NULL;
+
+    int rc = Stream_Finish(s);
+
+#ifdef HAVE_LIBZ
+
+    if ( s->compress == STREAM_COMPRESS_GZIP )
+        {
+            deflateEnd(&s->z);
+        }
+
+#endif
+
+    pthread_mutex_lock(&SaganStreamListMutex);
+
+    for ( p = &SaganStreamList; *p != NULL; p = &(*p)->next )
+        {
+            if ( *p == s )
+                {
+                    *p = s->next;
+                    break;
+                }
+        }
+
+    pthread_mutex_unlock(&SaganStreamListMutex);
+
+    free(s);
+
+    return(rc);
+}
+
+#endif /* HAVE_FOPENCOOKIE */
+
+/****************************************************************************
+ * Sagan_Stream_Open - Like OpenStream(),  for a file that's compressed
+ * and/or rotated.  Returns NULL and sets errno on failure.
+ ****************************************************************************/
+
+FILE *Sagan_Stream_Open( const char *path, unsigned char compress, uint64_t rotate_size, int rotate_interval, unsigned long pw_uid, unsigned long pw_gid )
+{
+
+#ifdef HAVE_FOPENCOOKIE
+
+    cookie_io_functions_t io = { NULL, Stream_Cookie_Write, NULL, Stream_Cookie_Close };
+    _Sagan_Stream *s = NULL;
+
+    int err = 0;
+
+    s = calloc(1, sizeof(_Sagan_Stream));
+
+    if ( s == NULL )
+        {
+            return(NULL);
+        }
+
+    strlcpy(s->path, path, sizeof(s->path));
+    s->compress = compress;
+    s->rotate_size = rotate_size;
+    s->rotate_interval = rotate_interval;
+    s->pw_uid = pw_uid;
+    s->pw_gid = pw_gid;
+    s->fd = -1;
+
+#ifdef HAVE_LIBZ
+
+    /* windowBits + 16 == gzip header and trailer rather than zlib */
+
+    if ( compress == STREAM_COMPRESS_GZIP &&
+            deflateInit2(&s->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+        {
+            free(s);
+            errno = ENOMEM;
+            return(NULL);
+        }
+
+#endif
+
+    if ( Stream_Start(s) < 0 )
+        {
+            err = errno;
+#ifdef HAVE_LIBZ
+            if ( compress == STREAM_COMPRESS_GZIP )
+                {
+                    deflateEnd(&s->z);
+                }
+#endif
+            free(s);
+            errno = err;
+            return(NULL);
+        }
+
+    s->stream = fopencookie(s, "a", io);
+
+    if ( s->stream == NULL )
+        {
+            err = errno;
+            Stream_Cookie_Close(s);
+            errno = err;
+            return(NULL);
+        }
+
+    setvbuf(s->stream, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+
+    pthread_mutex_lock(&SaganStreamListMutex);
+    s->next = SaganStreamList;
+    SaganStreamList = s;
+    pthread_mutex_unlock(&SaganStreamListMutex);
+
+    return(s->stream);
+
+#else
+
+    errno = ENOSYS;
+    return(NULL);
+
+#endif
+
+}
+
+/****************************************************************************
+ * Sagan_Stream_Maintain - Called by a writer after it has flushed a batch.
+ * Rotates the file if it's due,  otherwise does a zlib sync flush every
+ * STREAM_SYNC_INTERVAL seconds so a crash loses little.  Does nothing for
+ * a stream that didn't come from Sagan_Stream_Open().
+ ****************************************************************************/
+
+void Sagan_Stream_Maintain( FILE *stream )
+{
+
+#ifdef HAVE_FOPENCOOKIE
+
+    _Sagan_Stream *s = NULL;
+    time_t now = 0;
+
+    if ( stream == NULL )
+        {
+            return;
+        }
+
+    pthread_mutex_lock(&SaganStreamListMutex);
+
+    for ( s = SaganStreamList; s != NULL && s->stream != stream; s = s->next );
+
+    pthread_mutex_unlock(&SaganStreamListMutex);
+
+    if ( s == NULL )
+        {
+            return;
+        }
+
+    flockfile(stream);
+
+    fflush(stream);
+
+    now = (time_t)Sagan_Clock_Epoch();
+
+    if ( s->dirty == true &&
+            ( ( s->rotate_size != 0 && s->size >= s->rotate_size ) ||
+              ( s->rotate_interval != 0 && now - s->opened >= s->rotate_interval ) ) )
+        {
+            Stream_Rotate(s);
+        }
+
+#ifdef HAVE_LIBZ
+
+    else if ( s->pending == true && s->fd >= 0 && now - s->last_sync >= STREAM_SYNC_INTERVAL )
+        {
+
+            s->z.next_in = NULL;
+            s->z.avail_in = 0;
+
+            if ( Stream_Deflate(s, Z_SYNC_FLUSH) < 0 )
+                {
+                    Sagan_Log(WARN, "[%s, line %d] Error writing to %s: %s", __FILE__, __LINE__, s->path, strerror(errno));
+                }
+
+            s->pending = false;
+            s->last_sync = now;
+        }
+
+#endif
+
+    funlockfile(stream);
+
+#endif
+
+}
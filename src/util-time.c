@@ -37,6 +37,82 @@
 #include "util-time.h"
 #include "parsers/strstr-asm/strstr-hook.h"
 
+/* The coarse clocks are read from the vDSO without a system call and are
+ * good to a clock tick,  plenty for event time stamps and time outs */
+
+#ifdef CLOCK_REALTIME_COARSE
+#define SAGAN_CLOCK_REALTIME	CLOCK_REALTIME_COARSE
+#else
+#define SAGAN_CLOCK_REALTIME	CLOCK_REALTIME
+#endif
+
+/***************************************************************************
+ * Sagan_Clock_Epoch - Current time in seconds since the epoch.  Use this
+ * rather than time()/localtime()/strftime("%s")/atol().
+ ***************************************************************************/
+
+uint64_t Sagan_Clock_Epoch( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(SAGAN_CLOCK_REALTIME, &ts);
+
+    return( (uint64_t)ts.tv_sec );
+}
+
+/***************************************************************************
+ * Sagan_Clock_Mono_NS - Monotonic clock in nanoseconds,  for measuring
+ * how long things take.
+ ***************************************************************************/
+
+uint64_t Sagan_Clock_Mono_NS( void )
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec );
+}
+
+/***************************************************************************
+ * Sagan_Clock_Timeval - Current time for event and alert time stamps.
+ ***************************************************************************/
+
+void Sagan_Clock_Timeval( struct timeval *tv )
+{
+
+    struct timespec ts;
+
+    clock_gettime(SAGAN_CLOCK_REALTIME, &ts);
+
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+}
+
+/***************************************************************************
+ * Sagan_Clock_LocalTime - Current local time.  localtime_r() is only
+ * called once a second per thread.
+ ***************************************************************************/
+
+void Sagan_Clock_LocalTime( struct tm *result )
+{
+
+    static __thread time_t last = 0;
+    static __thread struct tm cached;
+
+    time_t now = (time_t)Sagan_Clock_Epoch();
+
+    if ( now != last )
+        {
+            localtime_r(&now, &cached);
+            last = now;
+        }
+
+    memcpy(result, &cached, sizeof(struct tm));
+}
+
 struct tm *Sagan_LocalTime(time_t timep, struct tm *result)
 {
     return localtime_r(&timep, result);
@@ -77,18 +153,26 @@ void CreateTimeString (const struct timeval *ts, char *str, size_t size, sbool t
 
 /***************************************************************************
  * CreateIsoTimeString - Used in EVE & alert output.  Based off Suricata
- * source.
+ * source.  Alerts come in bursts,  so the formatted second is kept per
+ * thread and only the microseconds are added per call.
  ***************************************************************************/
 
 void CreateIsoTimeString (const struct timeval *ts, char *str, size_t size)
 {
+
+    static __thread time_t last = 0;
+    static __thread char time_fmt[64] = { 0 };
+
     time_t time = ts->tv_sec;
     struct tm local_tm;
-    struct tm *t = (struct tm*)Sagan_LocalTime(time, &local_tm);
-    char time_fmt[64] = { 0 };
 
-    strftime(time_fmt, sizeof(time_fmt), "%Y-%m-%dT%H:%M:%S.%%06u%z", t);
-    snprintf(str, size, time_fmt, ts->tv_usec);
+    if ( time != last || time_fmt[0] == '\0' )
+        {
+            strftime(time_fmt, sizeof(time_fmt), "%Y-%m-%dT%H:%M:%S.%%06u%z", Sagan_LocalTime(time, &local_tm));
+            last = time;
+        }
+
+    snprintf(str, size, time_fmt, (uint32_t)ts->tv_usec);
 }
 
 
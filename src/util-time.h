@@ -18,6 +18,10 @@
 ** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 */
 
+uint64_t Sagan_Clock_Epoch( void );
+uint64_t Sagan_Clock_Mono_NS( void );
+void Sagan_Clock_Timeval( struct timeval * );
+void Sagan_Clock_LocalTime( struct tm * );
 struct tm *Sagan_LocalTime(time_t , struct tm *);
 void CreateTimeString (const struct timeval *, char *, size_t , sbool );
 void CreateIsoTimeString (const struct timeval *, char *, size_t );
@@ -33,6 +33,7 @@
 #include <grp.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <sys/time.h>
 #include <time.h>
 #include <stdarg.h>
@@ -49,11 +50,16 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "lockfile.h"
+#include "util-stream.h"
 
 #include "parsers/strstr-asm/strstr-hook.h"
 
@@ -199,21 +205,72 @@ void To_LowerC(char *const s)
 
 /******************************************************
  * Generic "sagan.log" style logging and screen output.
+ *
+ * Once Sagan_Log_Init() has started the log thread,  messages are put on
+ * a lock-free ring and written by that thread.  Callers only pay for
+ * vsnprintf().  WARN and DEBUG messages are limited to SAGAN_LOG_BURST a
+ * second per call site; the rest are counted and summarized.  ERROR is
+ * written (after anything queued) before we exit.
  *******************************************************/
 
-void Sagan_Log (int type, const char *format,... )
+typedef struct _Sagan_Log_Entry _Sagan_Log_Entry;
+struct _Sagan_Log_Entry
 {
-
-    char buf[5128] = { 0 };
-    va_list ap;
-    va_start(ap, format);
-    char *chr="*";
-    char curtime[64];
+    uint64_t seq;
+    int type;
     time_t t;
-    struct tm *now;
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  now);
+    char msg[SAGAN_LOG_MSG_SIZE];
+};
+
+static _Sagan_Log_Entry *sagan_log_ring = NULL;
+static uint64_t sagan_log_head = 0;		/* Next slot to fill */
+static uint64_t sagan_log_tail = 0;		/* Next slot to write,  under SaganLogMutex */
+static uint64_t sagan_log_drop = 0;		/* Ring was full */
+static sbool sagan_log_async = false;
+static sbool sagan_log_stop = false;		/* See Sagan_Log_Close() */
+static sbool sagan_log_thread_running = false;
+static pthread_t sagan_log_thread;
+
+static _Sagan_Log_Site *sagan_log_sites = NULL;	/* Sites that have suppressed something */
+
+/* Held by whoever is writing to the log */
+
+pthread_mutex_t SaganLogMutex=PTHREAD_MUTEX_INITIALIZER;
+
+/******************************************************
+ * Sagan_Log_Time - The time stamp for "t".  Only
+ * rebuilt when the second changes.  Called with
+ * SaganLogMutex held.
+ ******************************************************/
+
+static const char *Sagan_Log_Time( time_t t )
+{
+
+    static char curtime[64] = { 0 };
+    static time_t last = 0;
+
+    struct tm now;
+
+    if ( t != last )
+        {
+            localtime_r(&t, &now);
+            strftime(curtime, sizeof(curtime), "%m/%d/%Y %H:%M:%S",  &now);
+            last = t;
+        }
+
+    return(curtime);
+}
+
+/******************************************************
+ * Sagan_Log_Write - Writes one message.  Once
+ * Sagan_Log_Close() has closed the sagan.log it goes
+ * to stderr.  Called with SaganLogMutex held.
+ ******************************************************/
+
+static void Sagan_Log_Write( int type, time_t t, const char *msg )
+{
+
+    const char *chr = "*";
 
     if ( type == ERROR )
         {
@@ -230,22 +287,361 @@ void Sagan_Log (int type, const char *format,... )
             chr="D";
         }
 
-    vsnprintf(buf, sizeof(buf), format, ap);
-    fprintf(config->sagan_log_stream, "[%s] [%s] - %s\n", chr, curtime, buf);
-    fflush(config->sagan_log_stream);
+    fprintf(config->sagan_log_stream != NULL ? config->sagan_log_stream : stderr, "[%s] [%s] - %s\n", chr, Sagan_Log_Time(t), msg);
 
     if ( config->daemonize == 0 && config->quiet == 0 )
         {
-            printf("[%s] %s\n", chr, buf);
+            printf("[%s] %s\n", chr, msg);
         }
 
-    if ( type == ERROR )
+}
+
+/******************************************************
+ * Sagan_Log_Summary - Writes how many messages "site"
+ * has suppressed since its last summary.  Called with
+ * SaganLogMutex held.
+ ******************************************************/
+
+static void Sagan_Log_Summary( _Sagan_Log_Site *site, time_t t )
+{
+
+    char buf[256] = { 0 };
+
+    uint64_t suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+
+    if ( suppressed != 0 )
         {
-            exit(1);
+            snprintf(buf, sizeof(buf), "[%s, line %d] Suppressed %" PRIu64 " similar message(s).", site->file, site->line, suppressed);
+            Sagan_Log_Write(WARN, t, buf);
         }
 
 }
 
+/******************************************************
+ * Sagan_Log_Drain - Writes everything on the ring,
+ * summaries of quiet call sites and the count of
+ * messages lost to a full ring.  Returns the number
+ * of messages written.  Called with SaganLogMutex held.
+ ******************************************************/
+
+static int Sagan_Log_Drain( void )
+{
+
+    _Sagan_Log_Entry *entry = NULL;
+    _Sagan_Log_Site *site = NULL;
+
+    char buf[128] = { 0 };
+
+    uint64_t drop = 0;
+    time_t t = (time_t)Sagan_Clock_Epoch();
+    int count = 0;
+
+    if ( sagan_log_ring == NULL )
+        {
+            return(0);
+        }
+
+    for (;;)
+        {
+
+            entry = &sagan_log_ring[sagan_log_tail % SAGAN_LOG_QUEUE];
+
+            if ( __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != sagan_log_tail + 1 )
+                {
+                    break;
+                }
+
+            Sagan_Log_Write(entry->type, entry->t, entry->msg);
+
+            __atomic_store_n(&entry->seq, sagan_log_tail + SAGAN_LOG_QUEUE, __ATOMIC_RELEASE);
+            sagan_log_tail++;
+            count++;
+        }
+
+    /* Sites that went quiet still owe us a summary */
+
+    for ( site = __atomic_load_n(&sagan_log_sites, __ATOMIC_ACQUIRE); site != NULL; site = site->next )
+        {
+            if ( __atomic_load_n(&site->window, __ATOMIC_RELAXED) != (uint64_t)t )
+                {
+                    Sagan_Log_Summary(site, t);
+                }
+        }
+
+    drop = __atomic_exchange_n(&sagan_log_drop, 0, __ATOMIC_RELAXED);
+
+    if ( drop != 0 )
+        {
+            snprintf(buf, sizeof(buf), "Log queue full,  %" PRIu64 " message(s) lost.", drop);
+            Sagan_Log_Write(WARN, t, buf);
+            count++;
+        }
+
+    if ( count != 0 && config->sagan_log_stream != NULL )
+        {
+            fflush(config->sagan_log_stream);
+        }
+
+    return(count);
+}
+
+/******************************************************
+ * Sagan_Log_Thread - Writes queued messages until
+ * Sagan_Log_Close().
+ ******************************************************/
+
+static void *Sagan_Log_Thread( void *arg )
+{
+
+    int count = 0;
+
+    (void)SetThreadName("SaganLog");
+
+    while ( __atomic_load_n(&sagan_log_stop, __ATOMIC_ACQUIRE) == false )
+        {
+
+            pthread_mutex_lock(&SaganLogMutex);
+            count = Sagan_Log_Drain();
+            pthread_mutex_unlock(&SaganLogMutex);
+
+            if ( count == 0 )
+                {
+                    usleep(10000);
+                }
+        }
+
+    return(NULL);
+}
+
+/******************************************************
+ * Sagan_Log_Init - Starts the log thread.  Must be
+ * called after we are done fork()ing.
+ ******************************************************/
+
+void Sagan_Log_Init( void )
+{
+
+    int i = 0;
+    int rc = 0;
+
+    sagan_log_ring = malloc(sizeof(_Sagan_Log_Entry) * SAGAN_LOG_QUEUE);
+
+    if ( sagan_log_ring == NULL )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Failed to allocate memory for sagan_log_ring. Abort!", __FILE__, __LINE__);
+        }
+
+    for ( i = 0; i < SAGAN_LOG_QUEUE; i++ )
+        {
+            sagan_log_ring[i].seq = i;
+        }
+
+    /* Joined by Sagan_Log_Close() */
+
+    rc = pthread_create( &sagan_log_thread, NULL, Sagan_Log_Thread, NULL );
+
+    if ( rc != 0 )
+        {
+            Sagan_Log(ERROR, "[%s, line %d] Error creating log thread [error: %d].", __FILE__, __LINE__, rc);
+        }
+
+    sagan_log_thread_running = true;
+
+    /* Anything still queued is written on the way out */
+
+    atexit(Sagan_Log_Sync);
+
+    __atomic_store_n(&sagan_log_async, true, __ATOMIC_RELEASE);
+
+}
+
+/******************************************************
+ * Sagan_Log_Sync - Writes anything queued.  Messages
+ * after this are written by the caller.  Used before
+ * the sagan.log is closed or reopened.
+ ******************************************************/
+
+void Sagan_Log_Sync( void )
+{
+
+    __atomic_store_n(&sagan_log_async, false, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&SaganLogMutex);
+    (void)Sagan_Log_Drain();
+    pthread_mutex_unlock(&SaganLogMutex);
+
+}
+
+/******************************************************
+ * Sagan_Log_Close - Stops the log thread,  writes
+ * anything queued and closes the sagan.log.  Messages
+ * after this go to stderr.  Used at shutdown.
+ ******************************************************/
+
+void Sagan_Log_Close( void )
+{
+
+    __atomic_store_n(&sagan_log_async, false, __ATOMIC_RELEASE);
+
+    if ( sagan_log_thread_running == true )
+        {
+            __atomic_store_n(&sagan_log_stop, true, __ATOMIC_RELEASE);
+            pthread_join(sagan_log_thread, NULL);
+            sagan_log_thread_running = false;
+        }
+
+    pthread_mutex_lock(&SaganLogMutex);
+
+    (void)Sagan_Log_Drain();
+
+    if ( config->sagan_log_stream != NULL )
+        {
+            fflush(config->sagan_log_stream);
+            fclose(config->sagan_log_stream);
+            config->sagan_log_stream = NULL;
+        }
+
+    pthread_mutex_unlock(&SaganLogMutex);
+
+}
+
+/******************************************************
+ * Sagan_Log_Site - Called through the Sagan_Log()
+ * macro.
+ ******************************************************/
+
+void Sagan_Log_Site ( _Sagan_Log_Site *site, int type, const char *format,... )
+{
+
+    _Sagan_Log_Entry *entry = NULL;
+
+    char buf[SAGAN_LOG_MSG_SIZE];
+    va_list ap;
+
+    time_t t = (time_t)Sagan_Clock_Epoch();
+    uint64_t window = 0;
+    uint64_t pos = 0;
+    uint64_t seq = 0;
+
+    /* Rate limit noisy call sites.  The first message of a new second
+     * writes the summary of what the last one suppressed */
+
+    if ( type == WARN || type == DEBUG )
+        {
+
+            window = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+
+            if ( window != (uint64_t)t && __atomic_compare_exchange_n(&site->window, &window, (uint64_t)t, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+                {
+
+                    __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+
+                    if ( __atomic_load_n(&site->suppressed, __ATOMIC_RELAXED) != 0 )
+                        {
+                            pthread_mutex_lock(&SaganLogMutex);
+                            Sagan_Log_Summary(site, t);
+                            pthread_mutex_unlock(&SaganLogMutex);
+                        }
+                }
+
+            if ( __atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > SAGAN_LOG_BURST )
+                {
+
+                    __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+
+                    /* Let the log thread summarize us if we go quiet */
+
+                    if ( __atomic_exchange_n(&site->listed, true, __ATOMIC_RELAXED) == false )
+                        {
+                            site->next = __atomic_load_n(&sagan_log_sites, __ATOMIC_RELAXED);
+
+                            while ( !__atomic_compare_exchange_n(&sagan_log_sites, &site->next, site, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED) );
+                        }
+
+                    return;
+                }
+        }
+
+    /* Before the log thread is running (and for ERROR) we write it
+     * ourselves,  after anything already queued */
+
+    if ( type == ERROR || __atomic_load_n(&sagan_log_async, __ATOMIC_ACQUIRE) == false )
+        {
+
+sync_write:
+
+            va_start(ap, format);
+            vsnprintf(buf, sizeof(buf), format, ap);
+            va_end(ap);
+
+            pthread_mutex_lock(&SaganLogMutex);
+
+            (void)Sagan_Log_Drain();
+
+            Sagan_Log_Write(type, t, buf);
+
+            if ( config->sagan_log_stream != NULL )
+                {
+                    fflush(config->sagan_log_stream);
+                }
+
+            pthread_mutex_unlock(&SaganLogMutex);
+
+            if ( type == ERROR )
+                {
+                    exit(1);
+                }
+
+            return;
+        }
+
+    /* Claim a slot.  If the log thread is that far behind,  WARN and DEBUG
+     * messages are counted and dropped rather than making the caller wait.
+     * NORMAL messages (start up,  statistics) are written by the caller */
+
+    pos = __atomic_load_n(&sagan_log_head, __ATOMIC_RELAXED);
+
+    for (;;)
+        {
+
+            entry = &sagan_log_ring[pos % SAGAN_LOG_QUEUE];
+            seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+
+            if ( seq == pos )
+                {
+                    if ( __atomic_compare_exchange_n(&sagan_log_head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+                        {
+                            break;
+                        }
+                }
+            else if ( (int64_t)(seq - pos) < 0 )
+                {
+
+                    if ( type == NORMAL )
+                        {
+                            goto sync_write;
+                        }
+
+                    __atomic_add_fetch(&sagan_log_drop, 1, __ATOMIC_RELAXED);
+                    return;
+                }
+            else
+                {
+                    pos = __atomic_load_n(&sagan_log_head, __ATOMIC_RELAXED);
+                }
+        }
+
+    entry->type = type;
+    entry->t = t;
+
+    va_start(ap, format);
+    vsnprintf(entry->msg, sizeof(entry->msg), format, ap);
+    va_end(ap);
+
+    __atomic_store_n(&entry->seq, pos + 1, __ATOMIC_RELEASE);
+
+}
+
 /******************************************
  * Check if system is big || little endian
  ******************************************/
@@ -1065,6 +1461,31 @@ FILE *OpenStream( char *path, int *fd, unsigned long pw_uid, unsigned long pw_gi
     return ret;
 }
 
+/****************************************************************************
+ * Open_Output_Stream - Opens an alert/fast/eve file.  Files that are to be
+ * compressed or rotated go through Sagan_Stream_Open(),  everything else
+ * (including unix:// sockets) through OpenStream().
+ ****************************************************************************/
+
+static FILE *Open_Output_Stream( char *path, int *fd, struct passwd *pw, unsigned char compress, uint64_t rotate_size, int rotate_interval )
+{
+
+    if ( compress == STREAM_COMPRESS_NONE && rotate_size == 0 && rotate_interval == 0 )
+        {
+            return( OpenStream(path, fd, (unsigned long)pw->pw_uid, (unsigned long)pw->pw_gid) );
+        }
+
+    if ( Starts_With(path, "unix://") )
+        {
+            Sagan_Log(WARN, "[%s, line %d] Compression and rotation don't apply to %s. Ignoring.", __FILE__, __LINE__, path);
+            return( OpenStream(path, fd, (unsigned long)pw->pw_uid, (unsigned long)pw->pw_gid) );
+        }
+
+    *fd = -1;
+
+    return( Sagan_Stream_Open(path, compress, rotate_size, rotate_interval, (unsigned long)pw->pw_uid, (unsigned long)pw->pw_gid) );
+}
+
 /****************************************************************************
  * Open_Log_File - This controls the opening and/or re-opening of log
  * files.  This is useful for situation like SIGHUP,  where we want to
@@ -1087,18 +1508,25 @@ void Open_Log_File( sbool state, int type )
     if ( type == SAGAN_LOG || type == ALL_LOGS )
         {
 
-            /* For SIGHUP */
+            /* For SIGHUP.  The log thread must not write while we swap
+             * the stream */
+
+            pthread_mutex_lock(&SaganLogMutex);
 
             if ( state == REOPEN )
                 {
+                    (void)Sagan_Log_Drain();
                     CloseStream(config->sagan_log_stream, &config->sagan_log_fd);
                 }
 
             if ((config->sagan_log_stream = OpenStream(config->sagan_log_filepath, &config->sagan_log_fd,(unsigned long)pw->pw_uid,(unsigned long)pw->pw_gid)) == NULL)
                 {
+                    pthread_mutex_unlock(&SaganLogMutex);
                     fprintf(stderr, "[E] [%s, line %d] Cannot open %s - %s!\n", __FILE__, __LINE__, config->sagan_log_filepath, strerror(errno));
                     exit(-1);
                 }
+
+            pthread_mutex_unlock(&SaganLogMutex);
         }
 
 
@@ -1125,7 +1553,7 @@ void Open_Log_File( sbool state, int type )
             if ( config->eve_flag )
                 {
 
-                    if (( config->eve_stream = OpenStream(config->eve_filename, &config->eve_fd, (unsigned long)pw->pw_uid, (unsigned long)pw->pw_gid )) == NULL )
+                    if (( config->eve_stream = Open_Output_Stream(config->eve_filename, &config->eve_fd, pw, config->eve_compress, config->eve_rotate_size, config->eve_rotate_interval )) == NULL )
                         {
                             Remove_Lock_File();
                             Sagan_Log(ERROR, "[%s, line %d] Can't open \"%s\" - %s!", __FILE__, __LINE__, config->eve_filename, strerror(errno));
@@ -1136,7 +1564,7 @@ void Open_Log_File( sbool state, int type )
             if ( config->fast_flag )
                 {
 
-                    if (( config->sagan_fast_stream = OpenStream(config->fast_filename, &config->sagan_fast_fd, (unsigned long)pw->pw_uid, (unsigned long)pw->pw_gid )) == NULL )
+                    if (( config->sagan_fast_stream = Open_Output_Stream(config->fast_filename, &config->sagan_fast_fd, pw, config->fast_compress, config->fast_rotate_size, config->fast_rotate_interval )) == NULL )
                         {
                             Remove_Lock_File();
                             Sagan_Log(ERROR, "[%s, line %d] Can't open %s - %s!", __FILE__, __LINE__, config->fast_filename, strerror(errno));
@@ -1148,7 +1576,7 @@ void Open_Log_File( sbool state, int type )
             if ( config->alert_flag )
                 {
 
-                    if (( config->sagan_alert_stream = OpenStream(config->sagan_alert_filepath, &config->sagan_alert_fd, (unsigned long)pw->pw_uid, (unsigned long)pw->pw_gid )) == NULL )
+                    if (( config->sagan_alert_stream = Open_Output_Stream(config->sagan_alert_filepath, &config->sagan_alert_fd, pw, config->alert_compress, config->alert_rotate_size, config->alert_rotate_interval )) == NULL )
                         {
                             Remove_Lock_File();
                             Sagan_Log(ERROR, "[%s, line %d] Can't open %s - %s!", __FILE__, __LINE__, config->sagan_alert_filepath, strerror(errno));
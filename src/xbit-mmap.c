@@ -41,10 +41,10 @@
 #include "xbit-mmap.h"
 #include "rules.h"
 #include "sagan-config.h"
+#include "util-time.h"
 #include "parsers/parsers.h"
 
 struct _SaganCounters *counters;
-struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganConfig *config;
 
@@ -61,20 +61,12 @@ struct _Sagan_IPC_Xbit *xbit_ipc;
 sbool Xbit_Condition_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port, int dst_port, char *selector )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
-
     int i;
     int a;
 
     int xbit_total_match = 0;
     sbool xbit_match = 0;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
     Xbit_Cleanup_MMAP();
 
     for (i = 0; i < rulestruct[rule_position].xbit_count; i++)
@@ -769,16 +761,12 @@ void Xbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port,
     int i = 0;
     int a = 0;
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
     sbool xbit_match = false;
     sbool xbit_unset_match = 0;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     struct _Sagan_Xbit_Track *xbit_track;
 
@@ -1183,8 +1171,8 @@ void Xbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port,
                                     File_Lock(config->shm_xbit);
                                     pthread_mutex_lock(&Xbit_Mutex);
 
-                                    xbit_ipc[a].xbit_date = atol(timet);
-                                    xbit_ipc[a].xbit_expire = atol(timet) + rulestruct[rule_position].xbit_timeout[i];
+                                    xbit_ipc[a].xbit_date = epoch_time;
+                                    xbit_ipc[a].xbit_expire = epoch_time + rulestruct[rule_position].xbit_timeout[i];
                                     xbit_ipc[a].xbit_state = true;
                                     strlcpy(xbit_ipc[a].syslog_message, syslog_message, sizeof(xbit_ipc[a].syslog_message));
                                     strlcpy(xbit_ipc[a].signature_msg, rulestruct[rule_position].s_msg, sizeof(xbit_ipc[a].signature_msg));
@@ -1269,8 +1257,8 @@ void Xbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port,
                                     File_Lock(config->shm_xbit);
                                     pthread_mutex_lock(&Xbit_Mutex);
 
-                                    xbit_ipc[a].xbit_date = atol(timet);
-                                    xbit_ipc[a].xbit_expire = atol(timet) + rulestruct[rule_position].xbit_timeout[i];
+                                    xbit_ipc[a].xbit_date = epoch_time;
+                                    xbit_ipc[a].xbit_expire = epoch_time + rulestruct[rule_position].xbit_timeout[i];
                                     xbit_ipc[a].xbit_state = true;
                                     strlcpy(xbit_ipc[a].syslog_message, syslog_message, sizeof(xbit_ipc[a].syslog_message));
 
@@ -1349,8 +1337,8 @@ void Xbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port,
                                     File_Lock(config->shm_xbit);
                                     pthread_mutex_lock(&Xbit_Mutex);
 
-                                    xbit_ipc[a].xbit_date = atol(timet);
-                                    xbit_ipc[a].xbit_expire = atol(timet) + rulestruct[rule_position].xbit_timeout[i];
+                                    xbit_ipc[a].xbit_date = epoch_time;
+                                    xbit_ipc[a].xbit_expire = epoch_time + rulestruct[rule_position].xbit_timeout[i];
                                     xbit_ipc[a].xbit_state = true;
                                     strlcpy(xbit_ipc[a].syslog_message, syslog_message, sizeof(xbit_ipc[a].syslog_message));
 
@@ -1429,8 +1417,8 @@ void Xbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port,
                                     File_Lock(config->shm_xbit);
                                     pthread_mutex_lock(&Xbit_Mutex);
 
-                                    xbit_ipc[a].xbit_date = atol(timet);
-                                    xbit_ipc[a].xbit_expire = atol(timet) + rulestruct[rule_position].xbit_timeout[i];
+                                    xbit_ipc[a].xbit_date = epoch_time;
+                                    xbit_ipc[a].xbit_expire = epoch_time + rulestruct[rule_position].xbit_timeout[i];
                                     xbit_ipc[a].xbit_state = true;
                                     strlcpy(xbit_ipc[a].syslog_message, syslog_message, sizeof(xbit_ipc[a].syslog_message));
 
@@ -1501,8 +1489,8 @@ void Xbit_Set_MMAP(int rule_position, char *ip_src, char *ip_dst, int src_port,
 
                             xbit_ipc[counters_ipc->xbit_count].src_port = xbit_track[i].xbit_srcport;
                             xbit_ipc[counters_ipc->xbit_count].dst_port = xbit_track[i].xbit_dstport;
-                            xbit_ipc[counters_ipc->xbit_count].xbit_date = atol(timet);
-                            xbit_ipc[counters_ipc->xbit_count].xbit_expire = atol(timet) + xbit_track[i].xbit_timeout;
+                            xbit_ipc[counters_ipc->xbit_count].xbit_date = epoch_time;
+                            xbit_ipc[counters_ipc->xbit_count].xbit_expire = epoch_time + xbit_track[i].xbit_timeout;
                             xbit_ipc[counters_ipc->xbit_count].xbit_state = true;
                             xbit_ipc[counters_ipc->xbit_count].expire = xbit_track[i].xbit_timeout;
 
@@ -1544,18 +1532,14 @@ void Xbit_Cleanup_MMAP(void)
 
     int i = 0;
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
+    uint64_t epoch_time = 0;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
+    epoch_time = Sagan_Clock_Epoch();
 
     for (i=0; i<counters_ipc->xbit_count; i++)
         {
 
-            if (  xbit_ipc[i].xbit_state == true && atol(timet) >= xbit_ipc[i].xbit_expire )
+            if (  xbit_ipc[i].xbit_state == true && epoch_time >= xbit_ipc[i].xbit_expire )
                 {
                     if (debug->debugxbit)
                         {
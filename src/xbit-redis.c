@@ -32,6 +32,7 @@
 #include "sagan.h"
 #include "sagan-defs.h"
 #include "sagan-config.h"
+#include "util-time.h"
 
 #include "rules.h"
 
@@ -42,7 +43,6 @@
 #include "redis.h"
 
 struct _SaganConfig *config;
-struct _Rule_Struct *rulestruct;
 struct _SaganDebug *debug;
 struct _SaganCounters *counters;
 
@@ -84,10 +84,6 @@ sbool Xbit_Condition_Redis(int rule_position, char *ip_src_char, char *ip_dst_ch
 
     int xbit_total_match = 0;
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
-
     redisReply *reply;
 
     char redis_command[1024] = { 0 };
@@ -99,10 +95,6 @@ sbool Xbit_Condition_Redis(int rule_position, char *ip_src_char, char *ip_dst_ch
 
     uint32_t djb2_hash;
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
     int and_or = NONE;  /* | == true, & == false */
 
     char *src_or_dst = NULL;
@@ -409,9 +401,6 @@ sbool Xbit_Condition_Redis(int rule_position, char *ip_src_char, char *ip_dst_ch
 void Xbit_Set_Redis(int rule_position, char *ip_src_char, char *ip_dst_char, int src_port, int dst_port, char *selector, _Sagan_Proc_Syslog *SaganProcSyslog_LOCAL )
 {
 
-    time_t t;
-    struct tm *now;
-    char  timet[20];
     int i;
     int j;
 
@@ -427,15 +416,11 @@ void Xbit_Set_Redis(int rule_position, char *ip_src_char, char *ip_dst_char, int
     char fullsyslog_orig[400 + MAX_SYSLOGMSG] = { 0 };
 //    char altered_syslog[ (400*2) + (MAX_SYSLOGMSG*2)] = { 0 };
 
-    t = time(NULL);
-    now=localtime(&t);
-    strftime(timet, sizeof(timet), "%s",  now);
-
     uint32_t djb2_hash;
     uint32_t djb2_hash_src;
     uint32_t djb2_hash_dst;
 
-    uint32_t utime = atoi(timet);
+    uint32_t utime = Sagan_Clock_Epoch();
     uint32_t utime_plus_timeout;
 
     char notnull_selector[MAXSELECTOR] = { 0 };
@@ -0,0 +1,179 @@
+/*
+** Copyright (C) 2009-2018 Quadrant Information Security <quadrantsec.com>
+** Copyright (C) 2009-2018 Champ Clark III <cclark@quadrantsec.com>
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License Version 2 as
+** published by the Free Software Foundation.  You may not use, modify or
+** distribute this program under any other version of the GNU General
+** Public License.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+/* saganintel.c
+ *
+ * Compiles blacklist and Bro Intel files into a precompiled intel image
+ * (see src/intel-db.c).  Point the "intel-db" option of the "blacklist"
+ * and/or "bro-intel" processors at the result.  The image is replaced
+ * atomically,  so it can be rebuilt while Sagan is running.  Send Sagan a
+ * SIGHUP to pick up the new data.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"             /* From autoconf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "../src/sagan.h"
+#include "../src/sagan-defs.h"
+#include "../src/sagan-config.h"
+#include "../src/intel-db.h"
+
+#include "../src/processors/blacklist.h"
+#include "../src/processors/bro-intel.h"
+
+struct _SaganConfig *config;
+struct _SaganCounters *counters;
+struct _SaganDebug *debug;
+
+/****************************************************************************
+ * Usage - Give the user some hints about how to use this utility!
+ ****************************************************************************/
+
+void Usage( void )
+{
+
+    fprintf(stderr, "\n--[ saganintel help ]--------------------------------------------------------\n\n");
+    fprintf(stderr, "-b, --blacklist\tComma separated blacklist files (IP or CIDR).\n");
+    fprintf(stderr, "-i, --brointel\tComma separated Bro Intel files.\n");
+    fprintf(stderr, "-o, --output\tIntel database to write.\n");
+    fprintf(stderr, "-q, --quiet\tOnly report errors.\n");
+    fprintf(stderr, "-h, --help\tThis screen.\n");
+    fprintf(stderr, "\nsaganintel -b blacklist.txt -i intel.dat -o /var/sagan/intel.db\n");
+
+}
+
+int main(int argc, char **argv)
+{
+
+    const struct option long_options[] =
+    {
+        { "help",         no_argument,          NULL,   'h' },
+        { "blacklist",    required_argument,    NULL,   'b' },
+        { "brointel",     required_argument,    NULL,   'i' },
+        { "output",       required_argument,    NULL,   'o' },
+        { "quiet",        no_argument,          NULL,   'q' },
+        {0, 0, 0, 0}
+    };
+
+    static const char *short_options =
+        "b:i:o:qh";
+
+    int option_index = 0;
+
+    signed char c;
+
+    char *output = NULL;
+
+    _Sagan_Intel_DB_Writer writer;
+
+    config = calloc(1, sizeof(_SaganConfig));
+    counters = calloc(1, sizeof(_SaganCounters));
+    debug = calloc(1, sizeof(_SaganDebug));
+
+    if ( config == NULL || counters == NULL || debug == NULL )
+        {
+            fprintf(stderr, "[%s, line %d] Failed to allocate memory. Abort!\n", __FILE__, __LINE__);
+            exit(1);
+        }
+
+    /* Sagan_Log() output goes to the terminal */
+
+    config->sagan_log_stream = stderr;
+    config->quiet = true;
+
+    /* Get command line arg's */
+
+    while ((c = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1)
+        {
+
+            switch(c)
+                {
+
+                case 'h':
+                    Usage();
+                    exit(0);
+                    break;
+
+                case 'b':
+                    strlcpy(config->blacklist_files, optarg, sizeof(config->blacklist_files));
+                    config->blacklist_flag = true;
+                    break;
+
+                case 'i':
+                    strlcpy(config->brointel_files, optarg, sizeof(config->brointel_files));
+                    config->brointel_flag = true;
+                    break;
+
+                case 'o':
+                    output = optarg;
+                    break;
+
+                case 'q':
+                    config->sagan_log_stream = fopen("/dev/null", "w");
+                    break;
+
+                default:
+                    fprintf(stderr, "Invalid argument!\n");
+                    Usage();
+                    exit(1);
+                    break;
+
+                }
+
+        }
+
+    if ( output == NULL || ( config->blacklist_flag == false && config->brointel_flag == false ) )
+        {
+            Usage();
+            exit(1);
+        }
+
+    Intel_DB_Create(&writer, output);
+
+    if ( config->blacklist_flag )
+        {
+            Sagan_Blacklist_Init();
+            Sagan_Blacklist_Load();
+            Sagan_Blacklist_Save(&writer);
+        }
+
+    if ( config->brointel_flag )
+        {
+            Sagan_BroIntel_Init();
+            Sagan_BroIntel_Load_File();
+            Sagan_BroIntel_Save(&writer);
+        }
+
+    Intel_DB_Finish(&writer);
+
+    printf("Wrote %s (blacklist networks: %d, Bro Intel duplicates skipped: %d)\n", output, counters->blacklist_count, counters->brointel_dups);
+
+    return(0);
+}